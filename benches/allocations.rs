@@ -0,0 +1,107 @@
+//! Allocations per stage invocation and per completed sample.
+//!
+//! Installs the counting allocator and prints a table:
+//!
+//! ```text
+//! cargo bench --bench allocations
+//! ```
+//!
+//! The budget tests in the crate fail on regressions; this harness shows
+//! where the remaining allocations are across profile sizes.
+
+use saxsrs::alloc_count::{self, AllocCounts, CountingAllocator};
+use saxsrs::data::synthetic::{generate, generate_batch, Noise, SyntheticConfig};
+use saxsrs::data::{find_peaks, FlowMetadata};
+use saxsrs::stage::find_peak::FindPeakStage;
+use saxsrs::stage::process_peak::ProcessPeakStage;
+use saxsrs::{Runtime, RuntimeConfig, Stage};
+
+#[global_allocator]
+static ALLOC: CountingAllocator = CountingAllocator;
+
+fn config(points: usize) -> SyntheticConfig {
+    SyntheticConfig {
+        points,
+        noise: Noise::None,
+        ..Default::default()
+    }
+}
+
+fn row(name: &str, points: usize, per: &str, n: u64, counts: AllocCounts) {
+    let n = n.max(1) as f64;
+    println!(
+        "{:<14} {:>7} {:>8} {:>10.1} {:>12.0}",
+        name,
+        points,
+        per,
+        counts.total() as f64 / n,
+        counts.bytes as f64 / n
+    );
+}
+
+fn main() {
+    assert!(alloc_count::is_installed());
+    println!(
+        "{:<14} {:>7} {:>8} {:>10} {:>12}",
+        "case", "points", "per", "allocs", "bytes"
+    );
+
+    for points in [256, 1024, 4096] {
+        let cfg = config(points);
+        let sample = generate(&cfg, 7, 0);
+
+        let (_, counts) = alloc_count::count(|| find_peaks(&sample.intensity, 0.0, 0.0));
+        row("find_peaks", points, "call", 1, counts);
+
+        // Walk one sample through its pipeline, stage by stage.
+        let find = FindPeakStage::default();
+        let process = ProcessPeakStage::default();
+        let mut find_total = (0, AllocCounts::default());
+        let mut process_total = (0, AllocCounts::default());
+        let mut next = Some((
+            find.id(),
+            sample.clone(),
+            FlowMetadata::new(sample.id.clone()),
+        ));
+        while let Some((id, sample, metadata)) = next.take() {
+            let stage: &dyn Stage = if id == find.id() { &find } else { &process };
+            let (result, counts) = alloc_count::count(|| stage.process(sample, metadata));
+            let total = if id == find.id() {
+                &mut find_total
+            } else {
+                &mut process_total
+            };
+            total.0 += 1;
+            total.1.allocations += counts.allocations;
+            total.1.reallocations += counts.reallocations;
+            total.1.bytes += counts.bytes;
+
+            next = result
+                .requests
+                .into_iter()
+                .next()
+                .map(|r| (r.stage_id, result.sample, r.metadata));
+        }
+        row("FindPeak", points, "stage", find_total.0, find_total.1);
+        row(
+            "ProcessPeak",
+            points,
+            "stage",
+            process_total.0,
+            process_total.1,
+        );
+
+        // Whole runtime on one worker, so every allocation lands on this
+        // thread.
+        let samples = 16;
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        runtime.add_samples(generate_batch(&cfg, 7, 0, samples));
+        let (_, counts) = alloc_count::count(|| runtime.run_sync());
+        let stages = runtime.last_run_stats().unwrap().stages_executed;
+        row("run_sync", points, "stage", stages, counts);
+        row("run_sync", points, "sample", samples as u64, counts);
+    }
+}
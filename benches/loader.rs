@@ -0,0 +1,70 @@
+//! Compare the batched loader with sequential blocking reads.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use saxsrs::io::{parse_profile, BatchLoader, LoaderConfig};
+use std::path::PathBuf;
+
+const FILES: usize = 2000;
+const POINTS: usize = 200;
+
+fn write_profiles() -> (PathBuf, Vec<PathBuf>) {
+    let dir = std::env::temp_dir().join(format!("saxsrs_bench_loader_{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+
+    let paths = (0..FILES)
+        .map(|i| {
+            let path = dir.join(format!("profile_{:05}.dat", i));
+            let mut text = String::from("# q I err\n");
+            for k in 0..POINTS {
+                let q = 0.005 + k as f64 * 0.001;
+                let intensity = 1e3 / (1.0 + (q * 40.0).powi(2)) + (i % 7) as f64;
+                text.push_str(&format!(
+                    "{:.6e} {:.6e} {:.6e}\n",
+                    q,
+                    intensity,
+                    intensity.sqrt()
+                ));
+            }
+            std::fs::write(&path, text).unwrap();
+            path
+        })
+        .collect();
+    (dir, paths)
+}
+
+fn bench_loader(c: &mut Criterion) {
+    let (dir, paths) = write_profiles();
+    let mut group = c.benchmark_group("load_profiles");
+    group.throughput(Throughput::Elements(FILES as u64));
+
+    group.bench_function("sequential", |b| {
+        b.iter(|| {
+            let samples: Vec<_> = paths
+                .iter()
+                .map(|p| parse_profile("s", &std::fs::read(p).unwrap()).unwrap())
+                .collect();
+            black_box(samples)
+        })
+    });
+
+    let mut uring = BatchLoader::new(LoaderConfig::default());
+    let name = if uring.is_uring() {
+        "io_uring"
+    } else {
+        "batch_fallback"
+    };
+    group.bench_function(name, |b| {
+        b.iter(|| black_box(uring.load_profiles(&paths).unwrap()))
+    });
+
+    let mut threaded = BatchLoader::threaded(LoaderConfig::default());
+    group.bench_function("threaded", |b| {
+        b.iter(|| black_box(threaded.load_profiles(&paths).unwrap()))
+    });
+
+    group.finish();
+    std::fs::remove_dir_all(&dir).ok();
+}
+
+criterion_group!(benches, bench_loader);
+criterion_main!(benches);
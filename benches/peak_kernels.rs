@@ -0,0 +1,131 @@
+//! Micro-benchmarks for the `data::peak` kernels.
+//!
+//! Profiles are synthetic: a power-law background with Gaussian peaks at a
+//! given density (peaks per 1000 points) and multiplicative noise. Every
+//! group reports throughput in points so runs of different sizes compare.
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use saxsrs::data::{calc_prominence, diff, find_max, find_peaks, find_peaks_batch};
+
+const LENGTHS: [usize; 5] = [256, 1024, 4096, 16384, 65536];
+const DENSITIES: [usize; 3] = [1, 5, 20];
+const NOISE: [f64; 3] = [0.0, 0.01, 0.05];
+const BATCH_SIZES: [usize; 4] = [1, 16, 128, 1024];
+const BATCH_LENGTH: usize = 1024;
+
+/// Deterministic xorshift generator so runs are reproducible.
+struct Rng(u64);
+
+impl Rng {
+    fn next_f64(&mut self) -> f64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        (self.0 >> 11) as f64 / (1u64 << 53) as f64
+    }
+}
+
+fn profile(len: usize, density: usize, noise: f64, seed: u64) -> Vec<f64> {
+    let mut rng = Rng(seed.wrapping_mul(0x9e37_79b9_7f4a_7c15) | 1);
+    let n_peaks = (len * density / 1000).max(1);
+    let width = (len as f64 / n_peaks as f64 / 8.0).max(1.0);
+    let centers: Vec<f64> = (0..n_peaks)
+        .map(|k| (k as f64 + 0.5) * len as f64 / n_peaks as f64)
+        .collect();
+
+    (0..len)
+        .map(|i| {
+            let x = i as f64;
+            let background = 1e3 / (1.0 + (x / 50.0).powi(2));
+            let peaks: f64 = centers
+                .iter()
+                .map(|c| 50.0 * (-0.5 * ((x - c) / width).powi(2)).exp())
+                .sum();
+            let jitter = 1.0 + noise * (2.0 * rng.next_f64() - 1.0);
+            (background + peaks) * jitter
+        })
+        .collect()
+}
+
+fn bench_find_peaks(c: &mut Criterion) {
+    let mut group = c.benchmark_group("find_peaks");
+    group.sample_size(10);
+    for &len in &LENGTHS {
+        for &density in &DENSITIES {
+            for &noise in &NOISE {
+                let data = profile(len, density, noise, len as u64);
+                let id = BenchmarkId::new(format!("d{}_n{}", density, noise), len);
+                group.throughput(Throughput::Elements(len as u64));
+                group.bench_with_input(id, &data, |b, data| {
+                    b.iter(|| find_peaks(black_box(data), f64::NEG_INFINITY, 1.0))
+                });
+            }
+        }
+    }
+    group.finish();
+}
+
+fn bench_calc_prominence(c: &mut Criterion) {
+    let mut group = c.benchmark_group("calc_prominence");
+    for &len in &LENGTHS {
+        let data = profile(len, 5, 0.0, len as u64);
+        let peak = len / 2;
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &data, |b, data| {
+            b.iter(|| calc_prominence(black_box(data), black_box(peak)))
+        });
+    }
+    group.finish();
+}
+
+fn bench_find_max(c: &mut Criterion) {
+    let mut group = c.benchmark_group("find_max");
+    for &len in &LENGTHS {
+        let data = profile(len, 5, 0.01, len as u64);
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &data, |b, data| {
+            b.iter(|| find_max(black_box(data)))
+        });
+    }
+    group.finish();
+}
+
+fn bench_diff(c: &mut Criterion) {
+    let mut group = c.benchmark_group("diff");
+    for &len in &LENGTHS {
+        let data = profile(len, 5, 0.01, len as u64);
+        group.throughput(Throughput::Elements(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &data, |b, data| {
+            b.iter(|| diff(black_box(data)))
+        });
+    }
+    group.finish();
+}
+
+fn bench_find_peaks_batch(c: &mut Criterion) {
+    let mut group = c.benchmark_group("find_peaks_batch");
+    group.sample_size(20);
+    for &rows in &BATCH_SIZES {
+        for &noise in &[0.0, 0.05] {
+            let data: Vec<Vec<f64>> = (0..rows)
+                .map(|r| profile(BATCH_LENGTH, 5, noise, r as u64))
+                .collect();
+            let id = BenchmarkId::new(format!("n{}", noise), rows);
+            group.throughput(Throughput::Elements((rows * BATCH_LENGTH) as u64));
+            group.bench_with_input(id, &data, |b, data| {
+                b.iter(|| find_peaks_batch(black_box(data), f64::NEG_INFINITY, 1.0))
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_find_peaks,
+    bench_calc_prominence,
+    bench_find_max,
+    bench_diff,
+    bench_find_peaks_batch
+);
+criterion_main!(benches);
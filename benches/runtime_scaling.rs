@@ -0,0 +1,229 @@
+//! End-to-end throughput and scaling of `Runtime::run_sync` and `run_async`.
+//!
+//! Runs synthetic batches at 1..N workers across batch sizes and peaks per
+//! sample, and prints one JSON document to stdout (or `--output <path>`):
+//!
+//! ```text
+//! cargo bench --bench runtime_scaling -- --max-workers 8 --output scaling.json
+//! ```
+//!
+//! Each record carries throughput, sample latency percentiles (time from run
+//! start to completion), scheduler lock wait, worker utilization and parallel
+//! efficiency relative to the 1-worker run of the same configuration.
+
+use saxsrs::{Runtime, RuntimeConfig, Sample};
+use std::fmt::Write as _;
+use std::sync::{mpsc, Arc, Mutex};
+use std::time::{Duration, Instant};
+
+const POINTS: usize = 1024;
+
+struct Options {
+    max_workers: usize,
+    batch_sizes: Vec<usize>,
+    peak_counts: Vec<usize>,
+    repeats: usize,
+    output: Option<String>,
+}
+
+impl Options {
+    fn parse() -> Self {
+        let mut opts = Options {
+            max_workers: num_cpus::get(),
+            batch_sizes: vec![64, 512, 4096],
+            peak_counts: vec![1, 4, 16],
+            repeats: 3,
+            output: None,
+        };
+        let mut args = std::env::args().skip(1);
+        while let Some(arg) = args.next() {
+            match arg.as_str() {
+                "--max-workers" => opts.max_workers = args.next().unwrap().parse().unwrap(),
+                "--repeats" => opts.repeats = args.next().unwrap().parse().unwrap(),
+                "--output" => opts.output = args.next(),
+                "--quick" => {
+                    opts.batch_sizes = vec![64];
+                    opts.peak_counts = vec![1, 4];
+                    opts.repeats = 1;
+                }
+                // `cargo bench` passes `--bench`; ignore anything unknown.
+                _ => {}
+            }
+        }
+        opts.max_workers = opts.max_workers.max(1);
+        opts
+    }
+
+    /// 1, 2, 4, ... up to and including `max_workers`.
+    fn worker_counts(&self) -> Vec<usize> {
+        let mut counts: Vec<usize> = std::iter::successors(Some(1), |n| Some(n * 2))
+            .take_while(|&n| n < self.max_workers)
+            .collect();
+        counts.push(self.max_workers);
+        counts
+    }
+}
+
+fn make_batch(size: usize, peaks: usize) -> Vec<Sample> {
+    let q: Vec<f64> = (0..POINTS).map(|i| 0.005 + i as f64 * 0.0005).collect();
+    (0..size)
+        .map(|s| {
+            let shift = (s % 17) as f64 * 1e-4;
+            let intensity = q
+                .iter()
+                .enumerate()
+                .map(|(i, &x)| {
+                    let background = 1e3 / (1.0 + (x * 40.0).powi(2));
+                    let bumps: f64 = (0..peaks)
+                        .map(|k| {
+                            let c = 0.05 + (k as f64 + 0.5) * 0.45 / peaks as f64 + shift;
+                            200.0 * (-((x - c) / 0.004).powi(2)).exp()
+                        })
+                        .sum();
+                    background + bumps + (i % 3) as f64 * 1e-3
+                })
+                .collect();
+            Sample::new(format!("s{}", s), q.clone(), intensity, vec![1.0; POINTS]).unwrap()
+        })
+        .collect()
+}
+
+struct Measurement {
+    elapsed: Duration,
+    latencies: Vec<Duration>,
+    scheduler_wait: Option<Duration>,
+    idle: Option<Duration>,
+    utilization: Option<f64>,
+}
+
+fn run_sync(workers: usize, batch: &[Sample]) -> Measurement {
+    let mut runtime = Runtime::new(RuntimeConfig {
+        worker_count: workers,
+        max_stages: None,
+    });
+    runtime.add_samples(batch.iter().cloned());
+    runtime.run_sync();
+
+    let stats = runtime.last_run_stats().unwrap();
+    Measurement {
+        elapsed: stats.elapsed,
+        latencies: stats.sample_latencies.clone(),
+        scheduler_wait: Some(stats.scheduler_wait),
+        idle: Some(stats.idle),
+        utilization: Some(stats.utilization()),
+    }
+}
+
+fn run_async(workers: usize, batch: &[Sample]) -> Measurement {
+    let mut runtime = Runtime::new(RuntimeConfig {
+        worker_count: workers,
+        max_stages: None,
+    });
+    runtime.add_samples(batch.iter().cloned());
+
+    let latencies = Arc::new(Mutex::new(Vec::with_capacity(batch.len())));
+    let (tx, rx) = mpsc::channel();
+    let started = Instant::now();
+    let sink = latencies.clone();
+    runtime.run_async(
+        move |_| tx.send(started.elapsed()).unwrap(),
+        |_, _, _| {},
+        move |_| sink.lock().unwrap().push(started.elapsed()),
+    );
+    let elapsed = rx.recv().unwrap();
+
+    let mut latencies = std::mem::take(&mut *latencies.lock().unwrap());
+    latencies.sort_unstable();
+    Measurement {
+        elapsed,
+        latencies,
+        scheduler_wait: None,
+        idle: None,
+        utilization: None,
+    }
+}
+
+/// Run `repeats` times and keep the run with the median wall time.
+fn measure(repeats: usize, mut run: impl FnMut() -> Measurement) -> Measurement {
+    let mut runs: Vec<Measurement> = (0..repeats.max(1)).map(|_| run()).collect();
+    runs.sort_by_key(|m| m.elapsed);
+    runs.swap_remove(runs.len() / 2)
+}
+
+fn percentile_ms(sorted: &[Duration], p: f64) -> f64 {
+    if sorted.is_empty() {
+        return 0.0;
+    }
+    let rank = ((p / 100.0) * sorted.len() as f64).ceil() as usize;
+    sorted[rank.clamp(1, sorted.len()) - 1].as_secs_f64() * 1e3
+}
+
+fn json_opt(value: Option<f64>) -> String {
+    value.map_or_else(|| "null".to_string(), |v| format!("{:.6}", v))
+}
+
+fn main() {
+    let opts = Options::parse();
+    let mut records = Vec::new();
+
+    for &batch_size in &opts.batch_sizes {
+        for &peaks in &opts.peak_counts {
+            let batch = make_batch(batch_size, peaks);
+            for (mode, runner) in [
+                ("run_sync", run_sync as fn(usize, &[Sample]) -> Measurement),
+                ("run_async", run_async),
+            ] {
+                let mut baseline = None;
+                for workers in opts.worker_counts() {
+                    let m = measure(opts.repeats, || runner(workers, &batch));
+                    let throughput = batch_size as f64 / m.elapsed.as_secs_f64();
+                    let base = *baseline.get_or_insert(throughput);
+                    let efficiency = throughput / (base * workers as f64);
+                    eprintln!(
+                        "{} workers={} batch={} peaks={}: {:.0} samples/s",
+                        mode, workers, batch_size, peaks, throughput
+                    );
+
+                    let mut record = String::new();
+                    write!(
+                        record,
+                        "{{\"mode\":\"{}\",\"workers\":{},\"batch_size\":{},\
+                         \"peaks_per_sample\":{},\"points\":{},\"elapsed_s\":{:.6},\
+                         \"throughput_samples_per_s\":{:.3},\"latency_ms\":{{\"p50\":{:.3},\
+                         \"p90\":{:.3},\"p99\":{:.3},\"max\":{:.3}}},\
+                         \"scheduler_wait_s\":{},\"idle_s\":{},\"utilization\":{},\
+                         \"parallel_efficiency\":{:.4}}}",
+                        mode,
+                        workers,
+                        batch_size,
+                        peaks,
+                        POINTS,
+                        m.elapsed.as_secs_f64(),
+                        throughput,
+                        percentile_ms(&m.latencies, 50.0),
+                        percentile_ms(&m.latencies, 90.0),
+                        percentile_ms(&m.latencies, 99.0),
+                        percentile_ms(&m.latencies, 100.0),
+                        json_opt(m.scheduler_wait.map(|d| d.as_secs_f64())),
+                        json_opt(m.idle.map(|d| d.as_secs_f64())),
+                        json_opt(m.utilization),
+                        efficiency,
+                    )
+                    .unwrap();
+                    records.push(record);
+                }
+            }
+        }
+    }
+
+    let json = format!(
+        "{{\"cpus\":{},\"repeats\":{},\"results\":[\n  {}\n]}}\n",
+        num_cpus::get(),
+        opts.repeats,
+        records.join(",\n  ")
+    );
+    match &opts.output {
+        Some(path) => std::fs::write(path, json).expect("failed to write output"),
+        None => print!("{}", json),
+    }
+}
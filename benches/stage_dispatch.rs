@@ -0,0 +1,136 @@
+//! Cost of resolving and calling a stage per work item: registry lookup
+//! plus virtual call versus a static `Pipeline`.
+//!
+//! `dispatch` isolates the per-item overhead with stages that do no work;
+//! `run` compares `run_sync` and `run_pipeline` end to end on the default
+//! peak stages.
+
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use saxsrs::stage::{FindPeakStage, Pipeline, ProcessPeakStage};
+use saxsrs::{
+    FlowMetadata, Runtime, RuntimeConfig, Sample, Stage, StageId, StageRegistry, StageResult,
+};
+
+const ITEMS: usize = 100_000;
+const IDS: [StageId; 4] = [
+    StageId::Background,
+    StageId::Cut,
+    StageId::Filter,
+    StageId::Phase,
+];
+
+/// Stage that only bumps the stage counter.
+struct Touch(StageId);
+
+impl Stage for Touch {
+    fn id(&self) -> StageId {
+        self.0
+    }
+
+    fn process(&self, mut sample: Sample, metadata: FlowMetadata) -> StageResult {
+        sample.stage_num = sample.stage_num.wrapping_add(1);
+        StageResult::terminal(sample, metadata)
+    }
+}
+
+fn item() -> (Sample, FlowMetadata) {
+    let sample = Sample::new("s", vec![0.1; 8], vec![1.0; 8], vec![0.1; 8]).unwrap();
+    (sample, FlowMetadata::new("s"))
+}
+
+fn bench_dispatch(c: &mut Criterion) {
+    let mut group = c.benchmark_group("dispatch");
+    group.throughput(Throughput::Elements(ITEMS as u64));
+
+    let mut registry = StageRegistry::new();
+    for id in IDS {
+        registry.register(Touch(id));
+    }
+    group.bench_function("registry", |b| {
+        b.iter(|| {
+            let (mut sample, mut metadata) = item();
+            for i in 0..ITEMS {
+                let stage = registry.get(black_box(IDS[i % IDS.len()])).unwrap();
+                let result = stage.process(sample, metadata);
+                (sample, metadata) = (result.sample, result.metadata);
+            }
+            sample.stage_num
+        })
+    });
+
+    let pipeline = Pipeline::new((Touch(IDS[0]), Touch(IDS[1]), Touch(IDS[2]), Touch(IDS[3])));
+    group.bench_function("pipeline", |b| {
+        b.iter(|| {
+            let (mut sample, mut metadata) = item();
+            for i in 0..ITEMS {
+                let id = black_box(IDS[i % IDS.len()]);
+                let result = pipeline.process(id, sample, metadata).unwrap();
+                (sample, metadata) = (result.sample, result.metadata);
+            }
+            sample.stage_num
+        })
+    });
+    group.finish();
+}
+
+fn batch(size: usize) -> Vec<Sample> {
+    let q: Vec<f64> = (0..512).map(|i| 0.005 + i as f64 * 0.001).collect();
+    (0..size)
+        .map(|s| {
+            let intensity = q
+                .iter()
+                .map(|&x| {
+                    let shift = (s % 7) as f64 * 1e-3;
+                    1e2 / (1.0 + (x * 40.0).powi(2))
+                        + 50.0 * (-((x - 0.1 - shift) / 0.004).powi(2)).exp()
+                        + 20.0 * (-((x - 0.3 - shift) / 0.004).powi(2)).exp()
+                })
+                .collect();
+            Sample::new(format!("s{s}"), q.clone(), intensity, vec![1.0; q.len()]).unwrap()
+        })
+        .collect()
+}
+
+fn bench_run(c: &mut Criterion) {
+    let mut group = c.benchmark_group("run");
+    group.sample_size(10);
+    let samples = batch(256);
+    group.throughput(Throughput::Elements(samples.len() as u64));
+    let runtime = || {
+        Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        })
+    };
+
+    group.bench_function("run_sync", |b| {
+        b.iter_batched(
+            || samples.clone(),
+            |samples| {
+                let mut runtime = runtime();
+                runtime.add_samples(samples);
+                runtime.run_sync();
+                runtime.completed_count()
+            },
+            BatchSize::LargeInput,
+        )
+    });
+
+    let pipeline = Pipeline::new((FindPeakStage::default(), ProcessPeakStage::default()));
+    group.bench_function("run_pipeline", |b| {
+        b.iter_batched(
+            || samples.clone(),
+            |samples| {
+                let mut runtime = runtime();
+                runtime.add_samples(samples);
+                runtime.run_pipeline(&pipeline);
+                runtime.completed_count()
+            },
+            BatchSize::LargeInput,
+        )
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_dispatch, bench_run);
+criterion_main!(benches);
@@ -41,6 +41,36 @@ typedef enum SaxsStatus {
   NotFound = 7,
 } SaxsStatus;
 
+/**
+ * Form factor selector for `CSyntheticConfig`.
+ */
+typedef enum CFormFactor {
+  NoFormFactor = 0,
+  Sphere = 1,
+  Guinier = 2,
+} CFormFactor;
+
+/**
+ * Lattice selector for `CSyntheticConfig`.
+ */
+typedef enum CLattice {
+  NoLattice = 0,
+  Lamellar = 1,
+  Hexagonal = 2,
+  SimpleCubic = 3,
+  BodyCentredCubic = 4,
+  FaceCentredCubic = 5,
+} CLattice;
+
+/**
+ * Noise model selector for `CSyntheticConfig`.
+ */
+typedef enum CNoise {
+  NoNoise = 0,
+  GaussianNoise = 1,
+  PoissonNoise = 2,
+} CNoise;
+
 /**
  * Main runtime for SAXS batch processing.
  */
@@ -75,6 +105,235 @@ typedef struct Runtime *RuntimeHandle;
  */
 typedef struct Sample *SampleHandle;
 
+/**
+ * C-compatible compression counters for idle samples.
+ */
+typedef struct CCompressionStats {
+  /**
+   * Samples compressed.
+   */
+  uintptr_t compressed_samples;
+  /**
+   * Samples decompressed.
+   */
+  uintptr_t decompressed_samples;
+  /**
+   * Uncompressed array bytes of all compressed samples.
+   */
+  uint64_t raw_bytes;
+  /**
+   * Compressed array bytes of all compressed samples.
+   */
+  uint64_t compressed_bytes;
+  /**
+   * Time spent compressing (nanoseconds).
+   */
+  uint64_t compress_ns;
+  /**
+   * Time spent decompressing (nanoseconds).
+   */
+  uint64_t decompress_ns;
+} CCompressionStats;
+
+/**
+ * C-compatible result cache counters.
+ */
+typedef struct CCacheStats {
+  /**
+   * Stages served from the cache.
+   */
+  uint64_t stage_hits;
+  /**
+   * Stages that had to be executed.
+   */
+  uint64_t stage_misses;
+  /**
+   * Whole pipelines served from the cache.
+   */
+  uint64_t pipeline_hits;
+  /**
+   * Pipelines that had to be executed.
+   */
+  uint64_t pipeline_misses;
+  /**
+   * Hits read from the on-disk store.
+   */
+  uint64_t disk_hits;
+  /**
+   * Entries evicted from memory.
+   */
+  uint64_t evictions;
+  /**
+   * Approximate bytes held in memory.
+   */
+  uintptr_t bytes;
+} CCacheStats;
+
+/**
+ * C-compatible series mode counters.
+ */
+typedef struct CSeriesStats {
+  /**
+   * Detections restricted to windows from an earlier frame.
+   */
+  uint64_t warm_searches;
+  /**
+   * Detections over the full profile.
+   */
+  uint64_t full_searches;
+  /**
+   * Fits seeded from an earlier frame.
+   */
+  uint64_t warm_fits;
+  /**
+   * Fits started from a parabola estimate.
+   */
+  uint64_t cold_fits;
+  /**
+   * Warm fits redone cold because their residual grew.
+   */
+  uint64_t fallbacks;
+  /**
+   * Gaussian refinement iterations over all fits.
+   */
+  uint64_t fit_iterations;
+} CSeriesStats;
+
+/**
+ * C-compatible track points as parallel arrays of `len` elements, one row
+ * per point, ordered by track id and frame.
+ */
+typedef struct CTrackColumns {
+  uint64_t *track;
+  uint64_t *series;
+  uint64_t *frame;
+  uintptr_t *index;
+  double *q;
+  double *amplitude;
+  uintptr_t len;
+} CTrackColumns;
+
+/**
+ * C-compatible per-stage counters and latency percentiles (nanoseconds).
+ */
+typedef struct CStageStats {
+  uint64_t executions;
+  uint64_t requeues;
+  uint64_t rejections;
+  uint64_t latency_mean_ns;
+  uint64_t latency_p50_ns;
+  uint64_t latency_p90_ns;
+  uint64_t latency_p99_ns;
+  uint64_t latency_max_ns;
+  uint64_t queue_wait_p50_ns;
+  uint64_t queue_wait_p99_ns;
+  uint64_t queue_wait_max_ns;
+  /**
+   * Executions with hardware counters; see saxs_runtime_set_perf_counters.
+   */
+  uint64_t perf_samples;
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cache_misses;
+  uint64_t branch_misses;
+} CStageStats;
+
+/**
+ * C-compatible lock contention statistics.
+ */
+typedef struct CLockStats {
+  uint64_t acquisitions;
+  uint64_t contended;
+  uint64_t wait_ns;
+  uint64_t hold_ns;
+} CLockStats;
+
+/**
+ * C-compatible runtime statistics snapshot.
+ */
+typedef struct CRuntimeStats {
+  /**
+   * Indexed by stage id.
+   */
+  struct CStageStats stages[6];
+  uintptr_t completed;
+  uintptr_t pending;
+  /**
+   * Number of worker shards; see saxs_runtime_worker_stats.
+   */
+  uintptr_t worker_count;
+  uint64_t busy_ns;
+  uint64_t idle_ns;
+  uint64_t scheduler_wait_ns;
+  /**
+   * Scheduler, regroup pool and completed-list locks, in that order.
+   * Zero unless enabled with saxs_runtime_set_lock_stats.
+   */
+  struct CLockStats locks[3];
+} CRuntimeStats;
+
+/**
+ * C-compatible per-worker time accounting.
+ */
+typedef struct CWorkerStats {
+  uint64_t executions;
+  uint64_t busy_ns;
+  uint64_t idle_ns;
+  uint64_t scheduler_wait_ns;
+} CWorkerStats;
+
+/**
+ * C-compatible bytes held at one sample location.
+ */
+typedef struct CMemoryLocationStats {
+  uint64_t samples;
+  uint64_t array_bytes;
+  uint64_t metadata_bytes;
+  /**
+   * High-water mark of array plus metadata bytes in the current batch.
+   */
+  uint64_t peak_bytes;
+} CMemoryLocationStats;
+
+/**
+ * C-compatible memory accounting snapshot.
+ */
+typedef struct CMemoryStats {
+  /**
+   * Pending, queued, in flight, regroup pool, completed and FFI-owned
+   * handles, in that order. The FFI entry is process-wide.
+   */
+  struct CMemoryLocationStats locations[6];
+  /**
+   * Bytes held by the runtime (FFI handles excluded).
+   */
+  uint64_t total_bytes;
+  uint64_t peak_total_bytes;
+} CMemoryStats;
+
+/**
+ * C-compatible batch progress snapshot.
+ */
+typedef struct CProgress {
+  uint64_t total;
+  uint64_t completed;
+  uint64_t stage_results;
+  /**
+   * Stage results by the stage_num they reached; the last entry
+   * collects higher stages.
+   */
+  uint64_t at_stage[16];
+  uint64_t elapsed_ns;
+  /**
+   * Completed samples per second.
+   */
+  double throughput;
+  /**
+   * Estimated time to completion; UINT64_MAX while unknown.
+   */
+  uint64_t eta_ns;
+} CProgress;
+
 /**
  * Callback function type for completion notifications.
  *
@@ -135,6 +394,38 @@ typedef struct CPeakArray {
   uintptr_t capacity;
 } CPeakArray;
 
+/**
+ * Flat configuration for synthetic profiles (one lattice).
+ */
+typedef struct CSyntheticConfig {
+  uintptr_t points;
+  double q_min;
+  double q_max;
+  bool log_q;
+  double background_amplitude;
+  double background_exponent;
+  double background_constant;
+  enum CFormFactor form_factor;
+  /**
+   * Sphere radius or radius of gyration.
+   */
+  double form_factor_size;
+  double form_factor_scale;
+  enum CLattice lattice;
+  double d_spacing;
+  double peak_amplitude;
+  double peak_width;
+  uintptr_t peak_orders;
+  double d_jitter;
+  enum CNoise noise;
+  /**
+   * Relative sigma (Gaussian) or counts per unit intensity (Poisson).
+   */
+  double noise_level;
+  double zinger_probability;
+  double zinger_amplitude;
+} CSyntheticConfig;
+
 /**
  * Create a new runtime.
  *
@@ -143,6 +434,16 @@ typedef struct CPeakArray {
  */
 enum SaxsStatus saxs_runtime_create(const struct CRuntimeConfig *config, RuntimeHandle *out_handle);
 
+/**
+ * Resume a runtime from a snapshot directory.
+ *
+ * # Safety
+ * path must be a valid C string and out_handle a valid pointer.
+ */
+enum SaxsStatus saxs_runtime_resume(const char *path,
+                                    const struct CRuntimeConfig *config,
+                                    RuntimeHandle *out_handle);
+
 /**
  * Free a runtime handle.
  *
@@ -159,6 +460,20 @@ void saxs_runtime_free(RuntimeHandle handle);
  */
 enum SaxsStatus saxs_runtime_add_sample(RuntimeHandle runtime, SampleHandle sample);
 
+/**
+ * Load text profiles from files and add them to the runtime batch.
+ *
+ * Files that cannot be read or parsed are skipped; `out_loaded` (if not
+ * null) receives the number of samples added.
+ *
+ * # Safety
+ * paths must point to `count` valid C strings.
+ */
+enum SaxsStatus saxs_runtime_load_files(RuntimeHandle runtime,
+                                        const char *const *paths,
+                                        uintptr_t count,
+                                        uintptr_t *out_loaded);
+
 /**
  * Set checkpoint stages.
  *
@@ -169,6 +484,85 @@ enum SaxsStatus saxs_runtime_set_checkpoints(RuntimeHandle runtime,
                                              const uint32_t *stages,
                                              uintptr_t stages_len);
 
+/**
+ * Enable crash-safe snapshots into a directory.
+ *
+ * # Safety
+ * Runtime handle must be valid and path a valid C string.
+ */
+enum SaxsStatus saxs_runtime_enable_snapshots(RuntimeHandle runtime, const char *path);
+
+/**
+ * Block until all journaled state is on disk.
+ *
+ * Returns `RuntimeError` if the journal writer stopped after an I/O error;
+ * nothing recorded since then is persisted.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_sync_snapshots(RuntimeHandle runtime);
+
+/**
+ * Compress samples idle in the regroup pool for longer than `threshold_ms`.
+ *
+ * A threshold of 0 disables compression.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_cold_threshold(RuntimeHandle runtime, uint64_t threshold_ms);
+
+/**
+ * Get compression counters for idle samples.
+ *
+ * # Safety
+ * Runtime handle and out_stats must be valid.
+ */
+enum SaxsStatus saxs_runtime_compression_stats(RuntimeHandle runtime,
+                                               struct CCompressionStats *out_stats);
+
+/**
+ * Enable the content-addressed result cache.
+ *
+ * `max_bytes` of 0 keeps the default memory budget. `disk_dir` may be null
+ * for a memory-only cache.
+ *
+ * # Safety
+ * Runtime handle must be valid; disk_dir must be null or a valid C string.
+ */
+enum SaxsStatus saxs_runtime_enable_cache(RuntimeHandle runtime,
+                                          uintptr_t max_bytes,
+                                          const char *disk_dir);
+
+/**
+ * Get result cache counters.
+ *
+ * # Safety
+ * Runtime handle and out_stats must be valid.
+ */
+enum SaxsStatus saxs_runtime_cache_stats(RuntimeHandle runtime, struct CCacheStats *out_stats);
+
+/**
+ * Enable span tracing; each run writes a Chrome trace JSON to `path`.
+ *
+ * `capacity` is the number of spans kept per worker (0 = default).
+ *
+ * # Safety
+ * Runtime handle must be valid; path must be a valid C string.
+ */
+enum SaxsStatus saxs_runtime_enable_tracing(RuntimeHandle runtime,
+                                            const char *path,
+                                            uintptr_t capacity);
+
+/**
+ * Disable span tracing.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_disable_tracing(RuntimeHandle runtime);
+
 /**
  * Run the batch processing asynchronously.
  *
@@ -203,6 +597,178 @@ uintptr_t saxs_runtime_completed_count(RuntimeHandle runtime);
  */
 uintptr_t saxs_runtime_pending_count(RuntimeHandle runtime);
 
+/**
+ * Get a snapshot of cumulative runtime statistics.
+ *
+ * Can be called while a run is in progress.
+ *
+ * # Safety
+ * Runtime handle and out_stats must be valid.
+ */
+enum SaxsStatus saxs_runtime_stats(RuntimeHandle runtime, struct CRuntimeStats *out_stats);
+
+/**
+ * Get per-worker time accounting.
+ *
+ * Writes up to `capacity` entries; `out_count` receives the number of
+ * workers.
+ *
+ * # Safety
+ * Runtime handle must be valid; out_workers must have `capacity` elements.
+ */
+enum SaxsStatus saxs_runtime_worker_stats(RuntimeHandle runtime,
+                                          struct CWorkerStats *out_workers,
+                                          uintptr_t capacity,
+                                          uintptr_t *out_count);
+
+/**
+ * Enable or disable lock contention statistics.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_lock_stats(RuntimeHandle runtime, bool enabled);
+
+/**
+ * Enable or disable per-stage hardware performance counters (Linux).
+ *
+ * `out_available` (optional) receives whether counters could be opened;
+ * runs proceed without them if not.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_perf_counters(RuntimeHandle runtime,
+                                               bool enabled,
+                                               bool *out_available);
+
+/**
+ * Get bytes held per sample location with high-water marks for the
+ * current batch.
+ *
+ * # Safety
+ * Runtime handle and out_stats must be valid.
+ */
+enum SaxsStatus saxs_runtime_memory_stats(RuntimeHandle runtime, struct CMemoryStats *out_stats);
+
+/**
+ * Throttle run_async progress callbacks to at most one per `interval_ms`,
+ * delivered from a timer thread instead of the workers. 0 restores one
+ * callback per completed sample.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_progress_interval(RuntimeHandle runtime, uint64_t interval_ms);
+
+/**
+ * Make run_sync output independent of worker count and timing: results
+ * are committed in waves ordered by sample index.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_deterministic(RuntimeHandle runtime, bool deterministic);
+
+/**
+ * Run stages of run_sync in `workers` forked processes sharing sample
+ * buffers through shared memory (Linux); 0 returns to worker threads.
+ * Crashed workers are restarted and their items requeued.
+ *
+ * `out_available` (optional) receives whether the mode is supported;
+ * runs keep using threads if not.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_set_process_workers(RuntimeHandle runtime,
+                                                 uint32_t workers,
+                                                 bool *out_available);
+
+/**
+ * Enable or disable series mode: frames tagged with
+ * saxs_sample_set_series seed peak detection and fits from the previous
+ * frame of their series. Enabling again starts a fresh history.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_enable_series(RuntimeHandle runtime, bool enabled);
+
+/**
+ * Enable series mode with peak tracking: completed frames are associated
+ * into per-reflection tracks and detection also searches the tracks'
+ * predicted positions.
+ *
+ * `gate` is the largest association distance in indices (<= 0 keeps the
+ * default); a track ends after `max_missed` frames without a peak.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_enable_tracking(RuntimeHandle runtime,
+                                             double gate,
+                                             uint32_t max_missed);
+
+/**
+ * Export points of tracks with at least `min_length` points as columns.
+ *
+ * # Safety
+ * Runtime handle and out_columns must be valid.
+ * Caller must free the result with `saxs_track_columns_free`.
+ */
+enum SaxsStatus saxs_runtime_track_columns(RuntimeHandle runtime,
+                                           uintptr_t min_length,
+                                           struct CTrackColumns *out_columns);
+
+/**
+ * Free track columns.
+ *
+ * # Safety
+ * Columns must have been filled by saxs_runtime_track_columns or be zeroed.
+ */
+void saxs_track_columns_free(struct CTrackColumns *columns);
+
+/**
+ * Get series mode counters.
+ *
+ * # Safety
+ * Runtime handle and out_stats must be valid.
+ */
+enum SaxsStatus saxs_runtime_series_stats(RuntimeHandle runtime, struct CSeriesStats *out_stats);
+
+/**
+ * Enable preview mode for saxs_runtime_run_async: profiles of at least
+ * `min_points` points are first processed decimated to the minimum and
+ * maximum of every `bucket` points and delivered to the sample callback
+ * with saxs_sample_is_provisional set, then refined at full resolution
+ * around the preview's peaks. The refined sample supersedes the preview.
+ * `bucket` 0 disables preview mode; `min_points` 0 keeps the default.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_enable_preview(RuntimeHandle runtime,
+                                            uintptr_t bucket,
+                                            uintptr_t min_points);
+
+/**
+ * Get progress of the current or last batch. Safe to call while
+ * run_async is processing.
+ *
+ * # Safety
+ * Runtime handle and out_progress must be valid.
+ */
+enum SaxsStatus saxs_runtime_progress(RuntimeHandle runtime, struct CProgress *out_progress);
+
+/**
+ * Clear cumulative runtime statistics.
+ *
+ * # Safety
+ * Runtime handle must be valid.
+ */
+enum SaxsStatus saxs_runtime_reset_stats(RuntimeHandle runtime);
+
 /**
  * Collect completed samples at or above a minimum stage.
  *
@@ -277,6 +843,20 @@ uintptr_t saxs_sample_len(SampleHandle handle);
  */
 uint32_t saxs_sample_get_stage(SampleHandle handle);
 
+/**
+ * Tag a sample as frame `frame` of time series `series`.
+ *
+ * # Safety
+ * Handle must be valid.
+ */
+enum SaxsStatus saxs_sample_set_series(SampleHandle handle, uint64_t series, uint64_t frame);
+
+/**
+ * Whether the sample is a decimated preview result that a full-resolution
+ * result of the same id will supersede.
+ */
+bool saxs_sample_is_provisional(SampleHandle handle);
+
 /**
  * Get intensity array view.
  *
@@ -344,3 +924,35 @@ enum SaxsStatus saxs_find_max(const double *data,
  * Data pointer must be valid. Output buffer must have len-1 elements.
  */
 enum SaxsStatus saxs_diff(const double *data, uintptr_t len, double *out, uintptr_t out_len);
+
+/**
+ * Fill `out_config` with the default synthetic configuration.
+ *
+ * # Safety
+ * out_config must be valid.
+ */
+enum SaxsStatus saxs_synthetic_default_config(struct CSyntheticConfig *out_config);
+
+/**
+ * Generate synthetic profile `index` for `seed` as a new sample.
+ *
+ * # Safety
+ * config and out_handle must be valid. Free the sample with saxs_sample_free.
+ */
+enum SaxsStatus saxs_synthetic_generate(const struct CSyntheticConfig *config,
+                                        uint64_t seed,
+                                        uint64_t index,
+                                        SampleHandle *out_handle);
+
+/**
+ * Generate profiles `first..first + count` in parallel and add them to the
+ * runtime batch.
+ *
+ * # Safety
+ * runtime and config must be valid.
+ */
+enum SaxsStatus saxs_synthetic_add_to_runtime(RuntimeHandle runtime,
+                                              const struct CSyntheticConfig *config,
+                                              uint64_t seed,
+                                              uint64_t first,
+                                              uintptr_t count);
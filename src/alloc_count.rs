@@ -0,0 +1,180 @@
+//! Counting allocator for allocation budgets in tests and benchmarks.
+//!
+//! `CountingAllocator` forwards to the system allocator and counts calls
+//! per thread, so concurrently running tests do not see each other's
+//! allocations. The crate installs it as the global allocator for its own
+//! unit tests; benchmarks install it with
+//!
+//! ```ignore
+//! #[global_allocator]
+//! static ALLOC: saxsrs::alloc_count::CountingAllocator = saxsrs::alloc_count::CountingAllocator;
+//! ```
+//!
+//! Counts are only meaningful when `is_installed()` returns true.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::sync::atomic::{AtomicBool, Ordering};
+
+/// Allocator calls made by one thread.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct AllocCounts {
+    /// `alloc` and `alloc_zeroed` calls.
+    pub allocations: u64,
+    pub reallocations: u64,
+    pub deallocations: u64,
+    /// Bytes requested by allocations and reallocations.
+    pub bytes: u64,
+}
+
+impl AllocCounts {
+    /// Allocations plus reallocations: each one is a trip to the allocator
+    /// that an allocation-free path avoids.
+    pub fn total(&self) -> u64 {
+        self.allocations + self.reallocations
+    }
+
+    fn since(&self, start: &AllocCounts) -> AllocCounts {
+        AllocCounts {
+            allocations: self.allocations - start.allocations,
+            reallocations: self.reallocations - start.reallocations,
+            deallocations: self.deallocations - start.deallocations,
+            bytes: self.bytes - start.bytes,
+        }
+    }
+}
+
+thread_local! {
+    static COUNTS: Cell<AllocCounts> = const {
+        Cell::new(AllocCounts {
+            allocations: 0,
+            reallocations: 0,
+            deallocations: 0,
+            bytes: 0,
+        })
+    };
+}
+
+static INSTALLED: AtomicBool = AtomicBool::new(false);
+
+#[inline]
+fn bump(f: impl FnOnce(&mut AllocCounts)) {
+    // Ignore calls made while the thread-local is being torn down.
+    let _ = COUNTS.try_with(|c| {
+        let mut counts = c.get();
+        f(&mut counts);
+        c.set(counts);
+    });
+}
+
+/// System allocator that counts calls per thread.
+pub struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        INSTALLED.store(true, Ordering::Relaxed);
+        bump(|c| {
+            c.allocations += 1;
+            c.bytes += layout.size() as u64;
+        });
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        INSTALLED.store(true, Ordering::Relaxed);
+        bump(|c| {
+            c.allocations += 1;
+            c.bytes += layout.size() as u64;
+        });
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        bump(|c| {
+            c.reallocations += 1;
+            c.bytes += new_size as u64;
+        });
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        bump(|c| c.deallocations += 1);
+        System.dealloc(ptr, layout)
+    }
+}
+
+/// Whether `CountingAllocator` is the global allocator of this process.
+pub fn is_installed() -> bool {
+    // Force one allocation so the flag is set even before anything else ran.
+    drop(std::hint::black_box(Box::new(0u8)));
+    INSTALLED.load(Ordering::Relaxed)
+}
+
+/// Allocator calls made by the current thread so far.
+pub fn thread_counts() -> AllocCounts {
+    COUNTS.with(|c| c.get())
+}
+
+/// Run `f` and return its result with the allocations it made on this
+/// thread. Work `f` hands to other threads is not counted.
+pub fn count<R>(f: impl FnOnce() -> R) -> (R, AllocCounts) {
+    let start = thread_counts();
+    let result = f();
+    (result, thread_counts().since(&start))
+}
+
+/// Run `f` and panic if it allocates or reallocates more than `budget`
+/// times. Returns the result of `f`.
+#[track_caller]
+pub fn assert_max_allocations<R>(what: &str, budget: u64, f: impl FnOnce() -> R) -> R {
+    let (result, counts) = count(f);
+    assert!(
+        counts.total() <= budget,
+        "{} made {} allocations ({} bytes), budget is {}",
+        what,
+        counts.total(),
+        counts.bytes,
+        budget
+    );
+    result
+}
+
+/// Run `f` and panic if it touches the allocator at all.
+#[track_caller]
+pub fn assert_no_allocations<R>(what: &str, f: impl FnOnce() -> R) -> R {
+    assert_max_allocations(what, 0, f)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_counts_this_thread_only() {
+        assert!(is_installed());
+
+        let (v, counts) = count(|| {
+            let mut v = Vec::with_capacity(4);
+            v.extend_from_slice(&[1u64, 2, 3, 4, 5]);
+            v
+        });
+        assert_eq!(counts.allocations, 1);
+        assert_eq!(counts.reallocations, 1);
+        assert_eq!(counts.total(), 2);
+        assert!(counts.bytes >= 5 * 8);
+
+        let (_, counts) = count(|| std::thread::spawn(|| vec![0u8; 1 << 20]).join());
+        assert!(
+            counts.bytes < 1 << 20,
+            "child thread allocation was counted"
+        );
+
+        assert_no_allocations("drop", || drop(v));
+    }
+
+    #[test]
+    #[should_panic(expected = "budget is 0")]
+    fn test_budget_violation_panics() {
+        assert_no_allocations("boxing", || std::hint::black_box(Box::new(1u32)));
+    }
+}
@@ -0,0 +1,33 @@
+//! Distributed worker process.
+//!
+//! ```text
+//! saxs_worker <coordinator host:port> [threads]
+//! ```
+
+use saxsrs::distributed::{run_worker, WorkerConfig};
+
+fn main() {
+    let mut args = std::env::args().skip(1);
+    let Some(addr) = args.next() else {
+        eprintln!("usage: saxs_worker <host:port> [threads]");
+        std::process::exit(2);
+    };
+    let mut config = WorkerConfig::default();
+    if let Some(threads) = args.next() {
+        match threads.parse() {
+            Ok(n) if n > 0 => config.threads = n,
+            _ => {
+                eprintln!("invalid thread count: {}", threads);
+                std::process::exit(2);
+            }
+        }
+    }
+
+    match run_worker(addr.as_str(), config) {
+        Ok(leases) => eprintln!("completed {} leases", leases),
+        Err(e) => {
+            eprintln!("worker failed: {}", e);
+            std::process::exit(1);
+        }
+    }
+}
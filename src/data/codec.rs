@@ -0,0 +1,387 @@
+//! Compact binary encoding for samples and flow metadata.
+//!
+//! All values are little-endian. Peak maps are written sorted by index so
+//! that equal metadata always encodes to identical bytes.
+
+use super::metadata::{FlowMetadata, SampleMetadata, SearchWindows, SeriesFrame};
+use super::sample::Sample;
+use std::collections::HashMap;
+
+/// Errors that can occur while decoding binary data.
+#[derive(Debug, Clone, PartialEq)]
+pub enum CodecError {
+    /// Input ended before the value was complete.
+    UnexpectedEof,
+    /// Invalid UTF-8 in an encoded string.
+    InvalidUtf8,
+    /// Unknown tag byte.
+    InvalidTag(u8),
+    /// Decoded arrays have inconsistent lengths.
+    LengthMismatch,
+    /// Compressed data is malformed.
+    Corrupt,
+}
+
+impl std::fmt::Display for CodecError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            CodecError::UnexpectedEof => write!(f, "Unexpected end of input"),
+            CodecError::InvalidUtf8 => write!(f, "Invalid UTF-8 in string"),
+            CodecError::InvalidTag(tag) => write!(f, "Invalid tag {}", tag),
+            CodecError::LengthMismatch => write!(f, "Array length mismatch"),
+            CodecError::Corrupt => write!(f, "Corrupt compressed data"),
+        }
+    }
+}
+
+impl std::error::Error for CodecError {}
+
+#[inline]
+pub fn put_u8(buf: &mut Vec<u8>, v: u8) {
+    buf.push(v);
+}
+
+#[inline]
+pub fn put_u32(buf: &mut Vec<u8>, v: u32) {
+    buf.extend_from_slice(&v.to_le_bytes());
+}
+
+#[inline]
+pub fn put_i32(buf: &mut Vec<u8>, v: i32) {
+    buf.extend_from_slice(&v.to_le_bytes());
+}
+
+#[inline]
+pub fn put_u64(buf: &mut Vec<u8>, v: u64) {
+    buf.extend_from_slice(&v.to_le_bytes());
+}
+
+#[inline]
+pub fn put_f64(buf: &mut Vec<u8>, v: f64) {
+    buf.extend_from_slice(&v.to_le_bytes());
+}
+
+/// Write a length-prefixed byte string.
+pub fn put_bytes(buf: &mut Vec<u8>, bytes: &[u8]) {
+    put_u32(buf, bytes.len() as u32);
+    buf.extend_from_slice(bytes);
+}
+
+/// Write a length-prefixed UTF-8 string.
+pub fn put_str(buf: &mut Vec<u8>, s: &str) {
+    put_bytes(buf, s.as_bytes());
+}
+
+/// Write a length-prefixed f64 array.
+pub fn put_f64_slice(buf: &mut Vec<u8>, values: &[f64]) {
+    put_u64(buf, values.len() as u64);
+    buf.reserve(values.len() * 8);
+    for v in values {
+        buf.extend_from_slice(&v.to_le_bytes());
+    }
+}
+
+/// Write a peak map sorted by index.
+pub fn put_peak_map(buf: &mut Vec<u8>, peaks: &HashMap<usize, f64>) {
+    let mut entries: Vec<(usize, f64)> = peaks.iter().map(|(&k, &v)| (k, v)).collect();
+    entries.sort_by_key(|e| e.0);
+
+    put_u32(buf, entries.len() as u32);
+    for (idx, value) in entries {
+        put_u64(buf, idx as u64);
+        put_f64(buf, value);
+    }
+}
+
+fn put_current_peak(buf: &mut Vec<u8>, current: Option<usize>) {
+    match current {
+        Some(idx) => {
+            put_u8(buf, 1);
+            put_u64(buf, idx as u64);
+        }
+        None => put_u8(buf, 0),
+    }
+}
+
+/// Cursor over an encoded byte slice.
+pub struct Decoder<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Decoder<'a> {
+    pub fn new(data: &'a [u8]) -> Self {
+        Self { data, pos: 0 }
+    }
+
+    /// Number of bytes not yet consumed.
+    pub fn remaining(&self) -> usize {
+        self.data.len() - self.pos
+    }
+
+    /// Take the next `n` raw bytes.
+    pub fn take(&mut self, n: usize) -> Result<&'a [u8], CodecError> {
+        if self.remaining() < n {
+            return Err(CodecError::UnexpectedEof);
+        }
+        let out = &self.data[self.pos..self.pos + n];
+        self.pos += n;
+        Ok(out)
+    }
+
+    pub fn u8(&mut self) -> Result<u8, CodecError> {
+        Ok(self.take(1)?[0])
+    }
+
+    pub fn u32(&mut self) -> Result<u32, CodecError> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+
+    pub fn i32(&mut self) -> Result<i32, CodecError> {
+        Ok(i32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+
+    pub fn u64(&mut self) -> Result<u64, CodecError> {
+        Ok(u64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+
+    pub fn f64(&mut self) -> Result<f64, CodecError> {
+        Ok(f64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+
+    /// Read a length-prefixed byte string.
+    pub fn bytes(&mut self) -> Result<&'a [u8], CodecError> {
+        let len = self.u32()? as usize;
+        self.take(len)
+    }
+
+    /// Read a length-prefixed UTF-8 string.
+    pub fn string(&mut self) -> Result<String, CodecError> {
+        let bytes = self.bytes()?;
+        std::str::from_utf8(bytes)
+            .map(|s| s.to_string())
+            .map_err(|_| CodecError::InvalidUtf8)
+    }
+
+    /// Read a length-prefixed f64 array.
+    pub fn f64_vec(&mut self) -> Result<Vec<f64>, CodecError> {
+        let len = self.u64()? as usize;
+        let raw = self.take(len.checked_mul(8).ok_or(CodecError::UnexpectedEof)?)?;
+        Ok(raw
+            .chunks_exact(8)
+            .map(|c| f64::from_le_bytes(c.try_into().unwrap()))
+            .collect())
+    }
+
+    /// Read a peak map.
+    pub fn peak_map(&mut self) -> Result<HashMap<usize, f64>, CodecError> {
+        let count = self.u32()? as usize;
+        let mut map = HashMap::with_capacity(count);
+        for _ in 0..count {
+            let idx = self.u64()? as usize;
+            let value = self.f64()?;
+            map.insert(idx, value);
+        }
+        Ok(map)
+    }
+
+    fn current_peak(&mut self) -> Result<Option<usize>, CodecError> {
+        match self.u8()? {
+            0 => Ok(None),
+            1 => Ok(Some(self.u64()? as usize)),
+            tag => Err(CodecError::InvalidTag(tag)),
+        }
+    }
+
+    fn series_frame(&mut self) -> Result<Option<SeriesFrame>, CodecError> {
+        match self.u8()? {
+            0 => Ok(None),
+            1 => Ok(Some(SeriesFrame {
+                series: self.u64()?,
+                frame: self.u64()?,
+            })),
+            tag => Err(CodecError::InvalidTag(tag)),
+        }
+    }
+
+    fn sweep_point(&mut self) -> Result<Option<u32>, CodecError> {
+        match self.u8()? {
+            0 => Ok(None),
+            1 => self.u32().map(Some),
+            tag => Err(CodecError::InvalidTag(tag)),
+        }
+    }
+
+    fn search_windows(&mut self) -> Result<Option<SearchWindows>, CodecError> {
+        match self.u8()? {
+            0 => Ok(None),
+            1 => {
+                let half_width = self.u64()? as usize;
+                let count = self.u32()? as usize;
+                let mut centres = Vec::with_capacity(count.min(self.remaining() / 8));
+                for _ in 0..count {
+                    centres.push(self.u64()? as usize);
+                }
+                Ok(Some(SearchWindows {
+                    centres,
+                    half_width,
+                }))
+            }
+            tag => Err(CodecError::InvalidTag(tag)),
+        }
+    }
+}
+
+/// Encode sample metadata.
+pub fn encode_sample_metadata(buf: &mut Vec<u8>, metadata: &SampleMetadata) {
+    put_peak_map(buf, &metadata.unprocessed_peaks);
+    put_peak_map(buf, &metadata.processed_peaks);
+    put_current_peak(buf, metadata.current_peak);
+    match metadata.series {
+        None => put_u8(buf, 0),
+        Some(at) => {
+            put_u8(buf, 1);
+            put_u64(buf, at.series);
+            put_u64(buf, at.frame);
+        }
+    }
+    match metadata.sweep {
+        None => put_u8(buf, 0),
+        Some(point) => {
+            put_u8(buf, 1);
+            put_u32(buf, point);
+        }
+    }
+    match &metadata.search {
+        None => put_u8(buf, 0),
+        Some(windows) => {
+            put_u8(buf, 1);
+            put_u64(buf, windows.half_width as u64);
+            put_u32(buf, windows.centres.len() as u32);
+            for &centre in &windows.centres {
+                put_u64(buf, centre as u64);
+            }
+        }
+    }
+    put_u8(buf, metadata.provisional as u8);
+}
+
+/// Decode sample metadata.
+pub fn decode_sample_metadata(dec: &mut Decoder<'_>) -> Result<SampleMetadata, CodecError> {
+    Ok(SampleMetadata {
+        unprocessed_peaks: dec.peak_map()?,
+        processed_peaks: dec.peak_map()?,
+        current_peak: dec.current_peak()?,
+        series: dec.series_frame()?,
+        sweep: dec.sweep_point()?,
+        search: dec.search_windows()?,
+        provisional: dec.u8()? != 0,
+    })
+}
+
+/// Encode a sample including its arrays and metadata.
+pub fn encode_sample(buf: &mut Vec<u8>, sample: &Sample) {
+    put_str(buf, &sample.id);
+    put_u32(buf, sample.stage_num);
+    put_f64_slice(buf, &sample.q_values);
+    put_f64_slice(buf, &sample.intensity);
+    put_f64_slice(buf, &sample.intensity_err);
+    encode_sample_metadata(buf, &sample.metadata);
+}
+
+/// Decode a sample.
+pub fn decode_sample(dec: &mut Decoder<'_>) -> Result<Sample, CodecError> {
+    let id = dec.string()?;
+    let stage_num = dec.u32()?;
+    let q_values = dec.f64_vec()?;
+    let intensity = dec.f64_vec()?;
+    let intensity_err = dec.f64_vec()?;
+    let metadata = decode_sample_metadata(dec)?;
+
+    let mut sample = Sample::new(id, q_values, intensity, intensity_err)
+        .map_err(|_| CodecError::LengthMismatch)?;
+    sample.stage_num = stage_num;
+    sample.metadata = metadata;
+    Ok(sample)
+}
+
+/// Encode flow metadata.
+pub fn encode_flow_metadata(buf: &mut Vec<u8>, metadata: &FlowMetadata) {
+    put_str(buf, &metadata.sample_id);
+    put_peak_map(buf, &metadata.processed_peaks);
+    put_peak_map(buf, &metadata.unprocessed_peaks);
+    put_current_peak(buf, metadata.current_peak);
+}
+
+/// Decode flow metadata.
+pub fn decode_flow_metadata(dec: &mut Decoder<'_>) -> Result<FlowMetadata, CodecError> {
+    Ok(FlowMetadata {
+        sample_id: dec.string()?,
+        processed_peaks: dec.peak_map()?,
+        unprocessed_peaks: dec.peak_map()?,
+        current_peak: dec.current_peak()?,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_sample_roundtrip() {
+        let mut sample = Sample::new(
+            "roundtrip",
+            vec![0.1, 0.2, 0.3],
+            vec![10.0, 20.0, 30.0],
+            vec![1.0, 2.0, 3.0],
+        )
+        .unwrap()
+        .with_series(7, 12);
+        sample.stage_num = 4;
+        sample.metadata.processed_peaks.insert(1, 0.5);
+        sample.metadata.current_peak = Some(2);
+        sample.metadata.sweep = Some(9);
+        sample.metadata.search = Some(SearchWindows {
+            centres: vec![3, 40],
+            half_width: 6,
+        });
+
+        let mut buf = Vec::new();
+        encode_sample(&mut buf, &sample);
+        let decoded = decode_sample(&mut Decoder::new(&buf)).unwrap();
+
+        assert_eq!(decoded.id, "roundtrip");
+        assert_eq!(decoded.stage_num, 4);
+        assert_eq!(decoded.intensity, sample.intensity);
+        assert_eq!(decoded.metadata.processed_peaks.get(&1), Some(&0.5));
+        assert_eq!(decoded.metadata.current_peak, Some(2));
+        assert_eq!(decoded.series(), sample.series());
+        assert_eq!(decoded.sweep_point(), Some(9));
+        assert_eq!(decoded.metadata.search, sample.metadata.search);
+    }
+
+    #[test]
+    fn test_flow_metadata_is_canonical() {
+        let mut a = FlowMetadata::new("x");
+        let mut b = FlowMetadata::new("x");
+        for i in 0..16 {
+            a.unprocessed_peaks.insert(i, i as f64);
+            b.unprocessed_peaks.insert(15 - i, (15 - i) as f64);
+        }
+
+        let (mut buf_a, mut buf_b) = (Vec::new(), Vec::new());
+        encode_flow_metadata(&mut buf_a, &a);
+        encode_flow_metadata(&mut buf_b, &b);
+        assert_eq!(buf_a, buf_b);
+    }
+
+    #[test]
+    fn test_truncated_input() {
+        let sample = Sample::new("t", vec![1.0], vec![1.0], vec![0.1]).unwrap();
+        let mut buf = Vec::new();
+        encode_sample(&mut buf, &sample);
+
+        let result = decode_sample(&mut Decoder::new(&buf[..buf.len() - 3]));
+        assert_eq!(result.err(), Some(CodecError::UnexpectedEof));
+    }
+}
@@ -0,0 +1,333 @@
+//! Compression of sample arrays for samples that sit idle in memory.
+//!
+//! Arrays are byte-shuffled (all first bytes of every f64, then all second
+//! bytes, ...) and then compressed with an LZ4-style block codec. Smooth SAXS
+//! curves share sign and exponent bytes between neighbouring points, so the
+//! shuffled high-byte planes compress very well.
+
+use super::codec::CodecError;
+use super::metadata::SampleMetadata;
+use super::sample::Sample;
+
+const MIN_MATCH: usize = 4;
+const HASH_LOG: u32 = 12;
+/// Matches may not start within the last 12 bytes of the input.
+const MF_LIMIT: usize = 12;
+/// The last 5 bytes are always emitted as literals.
+const LAST_LITERALS: usize = 5;
+
+/// Transpose f64 values into byte planes.
+pub fn shuffle(values: &[f64], out: &mut Vec<u8>) {
+    let n = values.len();
+    out.clear();
+    out.resize(n * 8, 0);
+    for (i, v) in values.iter().enumerate() {
+        let bytes = v.to_le_bytes();
+        for (plane, &b) in bytes.iter().enumerate() {
+            out[plane * n + i] = b;
+        }
+    }
+}
+
+/// Inverse of [`shuffle`].
+pub fn unshuffle(planes: &[u8], out: &mut Vec<f64>) {
+    let n = planes.len() / 8;
+    out.clear();
+    out.reserve(n);
+    for i in 0..n {
+        let mut bytes = [0u8; 8];
+        for (plane, b) in bytes.iter_mut().enumerate() {
+            *b = planes[plane * n + i];
+        }
+        out.push(f64::from_le_bytes(bytes));
+    }
+}
+
+#[inline]
+fn read_u32(data: &[u8], pos: usize) -> u32 {
+    u32::from_le_bytes(data[pos..pos + 4].try_into().unwrap())
+}
+
+#[inline]
+fn hash(seq: u32) -> usize {
+    (seq.wrapping_mul(2654435761) >> (32 - HASH_LOG)) as usize
+}
+
+fn write_length(out: &mut Vec<u8>, mut len: usize) {
+    while len >= 255 {
+        out.push(255);
+        len -= 255;
+    }
+    out.push(len as u8);
+}
+
+fn write_sequence(out: &mut Vec<u8>, literals: &[u8], offset: u16, match_len: usize) {
+    let lit_len = literals.len();
+    let ml = match_len - MIN_MATCH;
+    out.push(((lit_len.min(15) as u8) << 4) | ml.min(15) as u8);
+    if lit_len >= 15 {
+        write_length(out, lit_len - 15);
+    }
+    out.extend_from_slice(literals);
+    out.extend_from_slice(&offset.to_le_bytes());
+    if ml >= 15 {
+        write_length(out, ml - 15);
+    }
+}
+
+/// Compress a byte buffer using the LZ4 block format.
+pub fn lz4_compress(src: &[u8], out: &mut Vec<u8>) {
+    let n = src.len();
+    let mut table = [0u32; 1 << HASH_LOG];
+    let mut anchor = 0;
+    let mut i = 0;
+
+    if n > MF_LIMIT {
+        let limit = n - MF_LIMIT;
+        while i < limit {
+            let seq = read_u32(src, i);
+            let h = hash(seq);
+            let candidate = table[h] as usize;
+            table[h] = (i + 1) as u32;
+
+            if candidate > 0 {
+                let c = candidate - 1;
+                if i - c <= u16::MAX as usize && read_u32(src, c) == seq {
+                    let max_len = n - LAST_LITERALS - i;
+                    let mut len = MIN_MATCH;
+                    while len < max_len && src[c + len] == src[i + len] {
+                        len += 1;
+                    }
+
+                    write_sequence(out, &src[anchor..i], (i - c) as u16, len);
+                    i += len;
+                    anchor = i;
+                    continue;
+                }
+            }
+            i += 1;
+        }
+    }
+
+    // Trailing literals
+    let literals = &src[anchor..];
+    out.push((literals.len().min(15) as u8) << 4);
+    if literals.len() >= 15 {
+        write_length(out, literals.len() - 15);
+    }
+    out.extend_from_slice(literals);
+}
+
+fn read_length(src: &[u8], pos: &mut usize) -> Result<usize, CodecError> {
+    let mut len = 0usize;
+    loop {
+        let b = *src.get(*pos).ok_or(CodecError::UnexpectedEof)?;
+        *pos += 1;
+        len += b as usize;
+        if b != 255 {
+            return Ok(len);
+        }
+    }
+}
+
+/// Decompress an LZ4 block, appending to `out`.
+pub fn lz4_decompress(src: &[u8], out: &mut Vec<u8>) -> Result<(), CodecError> {
+    let base = out.len();
+    let mut pos = 0;
+
+    loop {
+        let token = *src.get(pos).ok_or(CodecError::UnexpectedEof)?;
+        pos += 1;
+
+        let mut lit_len = (token >> 4) as usize;
+        if lit_len == 15 {
+            lit_len += read_length(src, &mut pos)?;
+        }
+        let literals = src
+            .get(pos..pos + lit_len)
+            .ok_or(CodecError::UnexpectedEof)?;
+        out.extend_from_slice(literals);
+        pos += lit_len;
+
+        if pos == src.len() {
+            return Ok(());
+        }
+
+        let offset = u16::from_le_bytes(
+            src.get(pos..pos + 2)
+                .ok_or(CodecError::UnexpectedEof)?
+                .try_into()
+                .unwrap(),
+        ) as usize;
+        pos += 2;
+        if offset == 0 || offset > out.len() - base {
+            return Err(CodecError::Corrupt);
+        }
+
+        let mut match_len = (token & 0x0f) as usize;
+        if match_len == 15 {
+            match_len += read_length(src, &mut pos)?;
+        }
+        match_len += MIN_MATCH;
+
+        // Matches may overlap their own output, so copy forward byte by byte.
+        let start = out.len() - offset;
+        out.reserve(match_len);
+        for k in 0..match_len {
+            let b = out[start + k];
+            out.push(b);
+        }
+    }
+}
+
+/// A compressed f64 array.
+#[derive(Clone, Debug)]
+pub struct CompressedArray {
+    len: usize,
+    data: Vec<u8>,
+}
+
+impl CompressedArray {
+    /// Shuffle and compress an array.
+    pub fn compress(values: &[f64], scratch: &mut Vec<u8>) -> Self {
+        shuffle(values, scratch);
+        let mut data = Vec::with_capacity(scratch.len() / 2);
+        lz4_compress(scratch, &mut data);
+        data.shrink_to_fit();
+        Self {
+            len: values.len(),
+            data,
+        }
+    }
+
+    /// Restore the original array.
+    pub fn decompress(&self, scratch: &mut Vec<u8>) -> Result<Vec<f64>, CodecError> {
+        scratch.clear();
+        scratch.reserve(self.len * 8);
+        lz4_decompress(&self.data, scratch)?;
+        if scratch.len() != self.len * 8 {
+            return Err(CodecError::LengthMismatch);
+        }
+        let mut values = Vec::new();
+        unshuffle(scratch, &mut values);
+        Ok(values)
+    }
+
+    /// Number of values in the original array.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Check if the original array was empty.
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Size of the compressed data in bytes.
+    pub fn compressed_bytes(&self) -> usize {
+        self.data.len()
+    }
+}
+
+/// A sample with its arrays compressed.
+#[derive(Clone, Debug)]
+pub struct CompressedSample {
+    pub id: String,
+    pub stage_num: u32,
+    pub metadata: SampleMetadata,
+    q_values: CompressedArray,
+    intensity: CompressedArray,
+    intensity_err: CompressedArray,
+}
+
+impl CompressedSample {
+    /// Compress a sample's arrays.
+    pub fn compress(sample: Sample, scratch: &mut Vec<u8>) -> Self {
+        Self {
+            q_values: CompressedArray::compress(&sample.q_values, scratch),
+            intensity: CompressedArray::compress(&sample.intensity, scratch),
+            intensity_err: CompressedArray::compress(&sample.intensity_err, scratch),
+            id: sample.id,
+            stage_num: sample.stage_num,
+            metadata: sample.metadata,
+        }
+    }
+
+    /// Restore the original sample.
+    pub fn decompress(self, scratch: &mut Vec<u8>) -> Result<Sample, CodecError> {
+        let q_values = self.q_values.decompress(scratch)?;
+        let intensity = self.intensity.decompress(scratch)?;
+        let intensity_err = self.intensity_err.decompress(scratch)?;
+
+        let mut sample = Sample::new(self.id, q_values, intensity, intensity_err)
+            .map_err(|_| CodecError::LengthMismatch)?;
+        sample.stage_num = self.stage_num;
+        sample.metadata = self.metadata;
+        Ok(sample)
+    }
+
+    /// Size of the uncompressed arrays in bytes.
+    pub fn raw_bytes(&self) -> usize {
+        (self.q_values.len() + self.intensity.len() + self.intensity_err.len()) * 8
+    }
+
+    /// Size of the compressed arrays in bytes.
+    pub fn compressed_bytes(&self) -> usize {
+        self.q_values.compressed_bytes()
+            + self.intensity.compressed_bytes()
+            + self.intensity_err.compressed_bytes()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lz4_roundtrip() {
+        let mut src = Vec::new();
+        for i in 0..5000u32 {
+            src.extend_from_slice(&(i % 97).to_le_bytes());
+        }
+        src.extend_from_slice(b"tail");
+
+        let mut compressed = Vec::new();
+        lz4_compress(&src, &mut compressed);
+        assert!(compressed.len() < src.len() / 4);
+
+        let mut restored = Vec::new();
+        lz4_decompress(&compressed, &mut restored).unwrap();
+        assert_eq!(restored, src);
+    }
+
+    #[test]
+    fn test_lz4_short_and_empty() {
+        for src in [&b""[..], &b"abc"[..], &b"abcdefghijklmnop"[..]] {
+            let mut compressed = Vec::new();
+            lz4_compress(src, &mut compressed);
+            let mut restored = Vec::new();
+            lz4_decompress(&compressed, &mut restored).unwrap();
+            assert_eq!(restored, src);
+        }
+    }
+
+    #[test]
+    fn test_sample_compression() {
+        let q: Vec<f64> = (0..4096).map(|i| 0.001 + i as f64 * 1e-4).collect();
+        let intensity: Vec<f64> = q.iter().map(|&x| 100.0 * x.powf(-2.0)).collect();
+        let err: Vec<f64> = intensity.iter().map(|i| i.sqrt()).collect();
+        let mut sample = Sample::new("s", q, intensity, err).unwrap();
+        sample.stage_num = 3;
+        let original = sample.clone();
+
+        let mut scratch = Vec::new();
+        let compressed = CompressedSample::compress(sample, &mut scratch);
+        assert!(compressed.compressed_bytes() < compressed.raw_bytes());
+
+        let restored = compressed.decompress(&mut scratch).unwrap();
+        assert_eq!(restored.q_values, original.q_values);
+        assert_eq!(restored.intensity, original.intensity);
+        assert_eq!(restored.intensity_err, original.intensity_err);
+        assert_eq!(restored.stage_num, 3);
+    }
+}
@@ -0,0 +1,115 @@
+//! Fast, stable 128-bit hashing for content-addressed keys.
+//!
+//! Unlike `DefaultHasher`, the output is fixed across Rust releases and
+//! platforms, so keys can be persisted to disk.
+
+const P1: u64 = 0x9e37_79b9_7f4a_7c15;
+const P2: u64 = 0xc2b2_ae3d_27d4_eb4f;
+
+#[inline]
+fn fmix64(mut k: u64) -> u64 {
+    k ^= k >> 33;
+    k = k.wrapping_mul(0xff51_afd7_ed55_8ccd);
+    k ^= k >> 33;
+    k = k.wrapping_mul(0xc4ce_b9fe_1a85_ec53);
+    k ^ (k >> 33)
+}
+
+/// Two-lane multiplicative hasher over 64-bit words.
+#[derive(Clone, Debug)]
+pub struct StableHasher {
+    a: u64,
+    b: u64,
+    len: u64,
+}
+
+impl StableHasher {
+    pub fn new() -> Self {
+        Self {
+            a: P1,
+            b: P2,
+            len: 0,
+        }
+    }
+
+    #[inline]
+    fn mix(&mut self, v: u64) {
+        self.a = (self.a ^ v).wrapping_mul(P1).rotate_left(29);
+        self.b = (self.b.rotate_left(17) ^ v).wrapping_mul(P2);
+        self.len += 1;
+    }
+
+    /// Hash a slice of f64 values by their bit patterns.
+    pub fn write_f64_slice(&mut self, values: &[f64]) {
+        self.mix(values.len() as u64);
+        for v in values {
+            self.mix(v.to_bits());
+        }
+    }
+
+    /// Finish with a 128-bit digest.
+    pub fn finish128(&self) -> (u64, u64) {
+        let a = fmix64(self.a ^ self.len);
+        let b = fmix64(self.b ^ a);
+        (a, b)
+    }
+}
+
+impl Default for StableHasher {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl std::hash::Hasher for StableHasher {
+    fn finish(&self) -> u64 {
+        self.finish128().0
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        self.mix(bytes.len() as u64);
+        let mut chunks = bytes.chunks_exact(8);
+        for c in &mut chunks {
+            self.mix(u64::from_le_bytes(c.try_into().unwrap()));
+        }
+        let rest = chunks.remainder();
+        if !rest.is_empty() {
+            let mut last = [0u8; 8];
+            last[..rest.len()].copy_from_slice(rest);
+            self.mix(u64::from_le_bytes(last));
+        }
+    }
+
+    fn write_u64(&mut self, v: u64) {
+        self.mix(v);
+    }
+
+    fn write_u32(&mut self, v: u32) {
+        self.mix(v as u64);
+    }
+
+    fn write_usize(&mut self, v: usize) {
+        self.mix(v as u64);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::hash::Hasher;
+
+    #[test]
+    fn test_stable_and_sensitive() {
+        let digest = |values: &[f64]| {
+            let mut h = StableHasher::new();
+            h.write_f64_slice(values);
+            h.write(b"tail");
+            h.finish128()
+        };
+
+        assert_eq!(digest(&[1.0, 2.0]), digest(&[1.0, 2.0]));
+        assert_ne!(digest(&[1.0, 2.0]), digest(&[2.0, 1.0]));
+        assert_ne!(digest(&[0.0]), digest(&[-0.0]));
+        assert_ne!(digest(&[]), digest(&[0.0]));
+    }
+}
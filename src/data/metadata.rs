@@ -2,6 +2,34 @@
 
 use std::collections::HashMap;
 
+/// Approximate heap bytes of a `HashMap<usize, f64>`: one entry and one
+/// control byte per unit of capacity.
+///
+/// The table's bucket count and trailing control group are private to std,
+/// so this is a lower bound: a table has up to 8/7 as many buckets as its
+/// capacity (more for tiny tables) plus one group of control bytes.
+fn map_heap_bytes(map: &HashMap<usize, f64>) -> usize {
+    map.capacity() * (std::mem::size_of::<(usize, f64)>() + 1)
+}
+
+/// Position of a frame within a time series.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash)]
+pub struct SeriesFrame {
+    /// Series identifier, unique within a runtime.
+    pub series: u64,
+    /// Frame index within the series.
+    pub frame: u64,
+}
+
+/// Peak search restricted to windows around known positions.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct SearchWindows {
+    /// Window centres (indices), sorted.
+    pub centres: Vec<usize>,
+    /// Half-width of every window in indices.
+    pub half_width: usize,
+}
+
 /// Sample-level metadata tracking peak processing state.
 #[derive(Clone, Debug, Default)]
 pub struct SampleMetadata {
@@ -15,6 +43,18 @@ pub struct SampleMetadata {
 
     /// The current peak being processed (if any).
     pub current_peak: Option<usize>,
+
+    /// Time series this sample is a frame of (if any).
+    pub series: Option<SeriesFrame>,
+
+    /// Parameter sweep point this sample was processed with (if any).
+    pub sweep: Option<u32>,
+
+    /// Restrict peak detection to these windows (preview refinement).
+    pub search: Option<SearchWindows>,
+
+    /// Decimated preview result, superseded by the full-resolution one.
+    pub provisional: bool,
 }
 
 impl SampleMetadata {
@@ -22,6 +62,16 @@ impl SampleMetadata {
         Self::default()
     }
 
+    /// Heap bytes held by the peak maps and search windows. The maps are
+    /// estimated from their capacity (see `map_heap_bytes`).
+    pub fn heap_bytes(&self) -> usize {
+        let search = self
+            .search
+            .as_ref()
+            .map_or(0, |w| w.centres.capacity() * std::mem::size_of::<usize>());
+        map_heap_bytes(&self.unprocessed_peaks) + map_heap_bytes(&self.processed_peaks) + search
+    }
+
     /// Add peaks to the unprocessed set.
     pub fn add_unprocessed_peaks(&mut self, peaks: impl IntoIterator<Item = (usize, f64)>) {
         self.unprocessed_peaks.extend(peaks);
@@ -88,6 +138,14 @@ impl FlowMetadata {
         }
     }
 
+    /// Heap bytes held by the id and peak maps; approximate like
+    /// `SampleMetadata::heap_bytes`.
+    pub fn heap_bytes(&self) -> usize {
+        self.sample_id.capacity()
+            + map_heap_bytes(&self.unprocessed_peaks)
+            + map_heap_bytes(&self.processed_peaks)
+    }
+
     /// Get number of processed peaks.
     pub fn processed_count(&self) -> usize {
         self.processed_peaks.len()
@@ -110,8 +168,11 @@ impl FlowMetadata {
 
     /// Apply changes back to sample metadata.
     pub fn apply_to_sample(&self, metadata: &mut SampleMetadata) {
-        metadata.processed_peaks = self.processed_peaks.clone();
-        metadata.unprocessed_peaks = self.unprocessed_peaks.clone();
+        // clone_from reuses the existing tables when they are large enough.
+        metadata.processed_peaks.clone_from(&self.processed_peaks);
+        metadata
+            .unprocessed_peaks
+            .clone_from(&self.unprocessed_peaks);
         metadata.current_peak = self.current_peak;
     }
 
@@ -182,4 +243,15 @@ mod tests {
         assert!(sample_meta.unprocessed_peaks.is_empty());
         assert_eq!(sample_meta.processed_peaks.get(&5), Some(&0.9));
     }
+
+    #[test]
+    fn test_heap_bytes_follow_capacity() {
+        let mut metadata = SampleMetadata::new();
+        assert_eq!(metadata.heap_bytes(), 0);
+
+        metadata.unprocessed_peaks.reserve(100);
+        let capacity = metadata.unprocessed_peaks.capacity();
+        assert!(capacity >= 100);
+        assert_eq!(metadata.heap_bytes(), capacity * 17);
+    }
 }
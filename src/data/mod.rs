@@ -1,9 +1,19 @@
 //! Data structures for SAXS processing.
 
+pub mod codec;
+pub mod compress;
+pub mod hash;
 pub mod metadata;
 pub mod peak;
 pub mod sample;
+pub mod synthetic;
 
-pub use metadata::{FlowMetadata, SampleMetadata};
-pub use peak::{calc_prominence, diff, find_max, find_peaks, find_peaks_batch, CPeak, Peak};
+pub use codec::CodecError;
+pub use compress::CompressedSample;
+pub use metadata::{FlowMetadata, SampleMetadata, SearchWindows, SeriesFrame};
+pub use peak::{
+    calc_prominence, diff, find_max, find_peaks, find_peaks_batch, find_peaks_near,
+    minmax_indices, CPeak, Peak,
+};
 pub use sample::{Sample, SampleError};
+pub use synthetic::{generate_batch, SyntheticConfig};
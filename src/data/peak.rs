@@ -82,6 +82,50 @@ pub fn find_peaks(data: &[f64], min_height: f64, min_prominence: f64) -> Vec<Pea
     peaks
 }
 
+/// Find peaks only within `half_width` indices of the given centres.
+///
+/// Returns exactly the peaks `find_peaks` reports inside those windows, in
+/// index order, while testing only the windowed points. Overlapping windows
+/// are merged so each point is tested once.
+pub fn find_peaks_near(
+    data: &[f64],
+    centres: &[usize],
+    half_width: usize,
+    min_height: f64,
+    min_prominence: f64,
+) -> Vec<Peak> {
+    if data.len() < 3 {
+        return Vec::new();
+    }
+
+    let mut windows: Vec<(usize, usize)> = centres
+        .iter()
+        .map(|&c| {
+            let start = c.saturating_sub(half_width).max(1);
+            let end = (c + half_width + 1).min(data.len() - 1);
+            (start, end)
+        })
+        .filter(|(start, end)| start < end)
+        .collect();
+    windows.sort_unstable();
+
+    let mut peaks = Vec::new();
+    let mut next = 0;
+    for (start, end) in windows {
+        for i in start.max(next)..end {
+            if data[i] > data[i - 1] && data[i] > data[i + 1] && data[i] >= min_height {
+                let prominence = calc_prominence(data, i);
+                if prominence >= min_prominence {
+                    peaks.push(Peak::new(i, data[i], prominence));
+                }
+            }
+        }
+        next = next.max(end);
+    }
+
+    peaks
+}
+
 /// Find peaks in batch (multiple rows) using parallel processing.
 pub fn find_peaks_batch(
     data: &[Vec<f64>],
@@ -141,6 +185,36 @@ pub fn diff(data: &[f64]) -> Vec<f64> {
     data.windows(2).map(|w| w[1] - w[0]).collect()
 }
 
+/// Indices of the minimum and maximum of every `bucket` consecutive
+/// points, in ascending order.
+///
+/// Keeping both extremes of each bucket preserves peak apexes and the
+/// valleys between them, so a peak found in the decimated data maps back
+/// to its apex in the full data. A bucket of 2 or less keeps every point.
+pub fn minmax_indices(data: &[f64], bucket: usize) -> Vec<usize> {
+    if bucket <= 2 {
+        return (0..data.len()).collect();
+    }
+    let mut indices = Vec::with_capacity(2 * data.len().div_ceil(bucket));
+    for (b, chunk) in data.chunks(bucket).enumerate() {
+        let (mut lo, mut hi) = (0, 0);
+        for (i, &v) in chunk.iter().enumerate() {
+            if v < chunk[lo] {
+                lo = i;
+            }
+            if v > chunk[hi] {
+                hi = i;
+            }
+        }
+        let start = b * bucket;
+        indices.push(start + lo.min(hi));
+        if lo != hi {
+            indices.push(start + lo.max(hi));
+        }
+    }
+    indices
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -182,6 +256,21 @@ mod tests {
         assert!(peaks.is_empty());
     }
 
+    #[test]
+    fn test_find_peaks_near_matches_full_search() {
+        let data: Vec<f64> = (0..400).map(|i| (i as f64 * 0.37).sin() + (i as f64 * 0.05).cos()).collect();
+        let centres = [30, 35, 200, 398];
+        let near = find_peaks_near(&data, &centres, 12, 0.0, 0.1);
+
+        let expected: Vec<Peak> = find_peaks(&data, 0.0, 0.1)
+            .into_iter()
+            .filter(|p| centres.iter().any(|&c| p.index.abs_diff(c) <= 12))
+            .collect();
+        assert!(!expected.is_empty());
+        assert_eq!(near, expected);
+        assert!(find_peaks_near(&data, &[], 12, 0.0, 0.1).is_empty());
+    }
+
     #[test]
     fn test_find_max() {
         let data = vec![1.0, 5.0, 3.0, 2.0];
@@ -197,6 +286,27 @@ mod tests {
         assert_eq!(result, vec![2.0, 3.0, 4.0]);
     }
 
+    #[test]
+    fn test_minmax_indices_keep_peaks() {
+        let data: Vec<f64> = (0..64)
+            .map(|i| {
+                let x = i as f64;
+                (-((x - 21.0) / 2.0).powi(2)).exp() + 0.5 * (-((x - 45.0) / 2.0).powi(2)).exp()
+            })
+            .collect();
+        let indices = minmax_indices(&data, 8);
+        assert_eq!(indices.len(), 16);
+        assert!(indices.windows(2).all(|w| w[0] < w[1]));
+
+        let decimated: Vec<f64> = indices.iter().map(|&i| data[i]).collect();
+        let peaks: Vec<usize> = find_peaks(&decimated, 0.1, 0.1)
+            .iter()
+            .map(|p| indices[p.index])
+            .collect();
+        assert_eq!(peaks, vec![21, 45]);
+        assert_eq!(minmax_indices(&data[..3], 2), vec![0, 1, 2]);
+    }
+
     #[test]
     fn test_batch_peaks() {
         let data = vec![
@@ -211,4 +321,19 @@ mod tests {
         assert_eq!(results[0][0].value, 1.0);
         assert_eq!(results[1][0].value, 2.0);
     }
+
+    #[test]
+    fn test_allocation_budget() {
+        use crate::alloc_count::{assert_max_allocations, assert_no_allocations};
+
+        let data: Vec<f64> = (0..1000).map(|i| (i as f64 * 0.1).sin()).collect();
+        assert_no_allocations("find_max", || find_max(&data));
+        assert_no_allocations("calc_prominence", || calc_prominence(&data, 16));
+        assert_no_allocations("find_peaks without peaks", || {
+            find_peaks(&data, 2.0, 0.0)
+        });
+        assert_max_allocations("diff", 1, || diff(&data));
+        // 16 peaks: one allocation and two doublings.
+        assert_max_allocations("find_peaks", 3, || find_peaks(&data, 0.0, 0.0));
+    }
 }
@@ -1,6 +1,7 @@
 //! SAXS Sample data structure.
 
-use super::metadata::SampleMetadata;
+use super::metadata::{SampleMetadata, SeriesFrame};
+use super::peak::minmax_indices;
 
 /// A SAXS sample containing measurement data.
 #[derive(Clone, Debug)]
@@ -141,6 +142,18 @@ impl Sample {
         &self.q_values
     }
 
+    /// Heap bytes of the q, intensity and error arrays (allocated capacity).
+    pub fn array_bytes(&self) -> usize {
+        (self.q_values.capacity() + self.intensity.capacity() + self.intensity_err.capacity())
+            * std::mem::size_of::<f64>()
+    }
+
+    /// Heap bytes of the id and metadata (approximate, see
+    /// `SampleMetadata::heap_bytes`).
+    pub fn metadata_bytes(&self) -> usize {
+        self.id.capacity() + self.metadata.heap_bytes()
+    }
+
     /// Get mutable reference to metadata.
     #[inline]
     pub fn metadata_mut(&mut self) -> &mut SampleMetadata {
@@ -152,6 +165,41 @@ impl Sample {
     pub fn advance_stage(&mut self) {
         self.stage_num += 1;
     }
+
+    /// Mark this sample as frame `frame` of time series `series`.
+    pub fn with_series(mut self, series: u64, frame: u64) -> Self {
+        self.metadata.series = Some(SeriesFrame { series, frame });
+        self
+    }
+
+    /// Time series position, if this sample is a frame of one.
+    #[inline]
+    pub fn series(&self) -> Option<SeriesFrame> {
+        self.metadata.series
+    }
+
+    /// Copy keeping the minimum and maximum of every `bucket` points (see
+    /// `minmax_indices`), and the full-resolution index of each kept point.
+    pub fn decimated(&self, bucket: usize) -> (Sample, Vec<usize>) {
+        let indices = minmax_indices(&self.intensity, bucket);
+        let pick = |values: &[f64]| indices.iter().map(|&i| values[i]).collect();
+        let sample = Sample {
+            id: self.id.clone(),
+            q_values: pick(&self.q_values),
+            intensity: pick(&self.intensity),
+            intensity_err: pick(&self.intensity_err),
+            stage_num: self.stage_num,
+            metadata: self.metadata.clone(),
+        };
+        (sample, indices)
+    }
+
+    /// Sweep point whose stages produced this sample, if it was processed
+    /// by `Runtime::run_sweep` past the first diverging stage.
+    #[inline]
+    pub fn sweep_point(&self) -> Option<u32> {
+        self.metadata.sweep
+    }
 }
 
 /// Errors that can occur when creating/manipulating samples.
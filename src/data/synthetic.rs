@@ -0,0 +1,527 @@
+//! Seeded synthetic SAXS profiles for tests and load generation.
+//!
+//! A profile is a power-law background plus an optional particle form
+//! factor and Bragg peaks from a lattice, with Gaussian or Poisson noise
+//! (and a matching `intensity_err`) and occasional zingers. Output depends
+//! only on `(config, seed, index)`, so any profile of a batch can be
+//! regenerated on its own and batches are identical however they are split
+//! across threads.
+
+use super::sample::Sample;
+use std::f64::consts::PI;
+
+/// xoshiro256++ generator seeded through splitmix64.
+#[derive(Clone, Debug)]
+pub struct Rng {
+    s: [u64; 4],
+}
+
+#[inline]
+fn splitmix64(state: &mut u64) -> u64 {
+    *state = state.wrapping_add(0x9e37_79b9_7f4a_7c15);
+    let mut z = *state;
+    z = (z ^ (z >> 30)).wrapping_mul(0xbf58_476d_1ce4_e5b9);
+    z = (z ^ (z >> 27)).wrapping_mul(0x94d0_49bb_1331_11eb);
+    z ^ (z >> 31)
+}
+
+impl Rng {
+    pub fn new(seed: u64) -> Self {
+        let mut state = seed;
+        Self {
+            s: [
+                splitmix64(&mut state),
+                splitmix64(&mut state),
+                splitmix64(&mut state),
+                splitmix64(&mut state),
+            ],
+        }
+    }
+
+    /// Independent stream for profile `index` of a batch seeded with `seed`.
+    pub fn for_profile(seed: u64, index: u64) -> Self {
+        let mut mixed = index;
+        Self::new(seed ^ splitmix64(&mut mixed))
+    }
+
+    #[inline]
+    pub fn next_u64(&mut self) -> u64 {
+        let s = &mut self.s;
+        let result = s[0].wrapping_add(s[3]).rotate_left(23).wrapping_add(s[0]);
+        let t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = s[3].rotate_left(45);
+        result
+    }
+
+    /// Uniform in [0, 1).
+    #[inline]
+    pub fn next_f64(&mut self) -> f64 {
+        (self.next_u64() >> 11) as f64 * (1.0 / (1u64 << 53) as f64)
+    }
+
+    /// Standard normal (Box–Muller).
+    pub fn normal(&mut self) -> f64 {
+        let u1 = 1.0 - self.next_f64();
+        let u2 = self.next_f64();
+        (-2.0 * u1.ln()).sqrt() * (2.0 * PI * u2).cos()
+    }
+
+    /// Poisson-distributed count with mean `lambda`.
+    ///
+    /// Uses inversion for small means and Hörmann's PTRS rejection sampler
+    /// otherwise.
+    pub fn poisson(&mut self, lambda: f64) -> f64 {
+        if lambda <= 0.0 {
+            return 0.0;
+        }
+        if lambda < 10.0 {
+            let limit = (-lambda).exp();
+            let mut k = 0.0;
+            let mut p = self.next_f64();
+            while p > limit {
+                k += 1.0;
+                p *= self.next_f64();
+            }
+            return k;
+        }
+
+        let slam = lambda.sqrt();
+        let loglam = lambda.ln();
+        let b = 0.931 + 2.53 * slam;
+        let a = -0.059 + 0.02483 * b;
+        let inv_alpha = 1.1239 + 1.1328 / (b - 3.4);
+        let vr = 0.9277 - 3.6224 / (b - 2.0);
+        loop {
+            let u = self.next_f64() - 0.5;
+            let v = self.next_f64();
+            let us = 0.5 - u.abs();
+            let k = ((2.0 * a / us + b) * u + lambda + 0.43).floor();
+            if us >= 0.07 && v <= vr {
+                return k;
+            }
+            if k < 0.0 || (us < 0.013 && v > us) {
+                continue;
+            }
+            if v.ln() + inv_alpha.ln() - (a / (us * us) + b).ln()
+                <= -lambda + k * loglam - ln_factorial(k)
+            {
+                return k;
+            }
+        }
+    }
+}
+
+/// ln(k!) via a table for small k and Stirling's series above.
+fn ln_factorial(k: f64) -> f64 {
+    const TABLE: [f64; 10] = [
+        0.0,
+        0.0,
+        0.693_147_180_559_945_3,
+        1.791_759_469_228_055,
+        3.178_053_830_347_146,
+        4.787_491_742_782_046,
+        6.579_251_212_010_101,
+        8.525_161_361_065_415,
+        10.604_602_902_745_25,
+        12.801_827_480_081_469,
+    ];
+    if k < 10.0 {
+        return TABLE[k as usize];
+    }
+    let inv = 1.0 / k;
+    (k + 0.5) * k.ln() - k + 0.5 * (2.0 * PI).ln() + inv / 12.0 - inv.powi(3) / 360.0
+}
+
+/// Power-law background `amplitude * q^-exponent + constant`.
+#[derive(Clone, Debug, PartialEq)]
+pub struct Background {
+    pub amplitude: f64,
+    pub exponent: f64,
+    pub constant: f64,
+}
+
+impl Default for Background {
+    fn default() -> Self {
+        Self {
+            amplitude: 1e-2,
+            exponent: 4.0,
+            constant: 0.1,
+        }
+    }
+}
+
+/// Particle form factor added on top of the background.
+#[derive(Clone, Debug, PartialEq)]
+pub enum FormFactor {
+    None,
+    /// Homogeneous sphere of the given radius.
+    Sphere {
+        radius: f64,
+        scale: f64,
+    },
+    /// Guinier approximation with radius of gyration `rg`.
+    Guinier {
+        rg: f64,
+        scale: f64,
+    },
+}
+
+impl FormFactor {
+    fn intensity(&self, q: f64) -> f64 {
+        match *self {
+            FormFactor::None => 0.0,
+            FormFactor::Sphere { radius, scale } => {
+                let x = q * radius;
+                if x < 1e-6 {
+                    return scale;
+                }
+                let amp = 3.0 * (x.sin() - x * x.cos()) / x.powi(3);
+                scale * amp * amp
+            }
+            FormFactor::Guinier { rg, scale } => scale * (-(q * rg).powi(2) / 3.0).exp(),
+        }
+    }
+}
+
+/// Lattices whose Bragg reflections can be placed in a profile.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Lattice {
+    Lamellar,
+    Hexagonal,
+    SimpleCubic,
+    BodyCentredCubic,
+    FaceCentredCubic,
+}
+
+impl Lattice {
+    /// Positions of the first `orders` reflections relative to the first.
+    pub fn ratios(self, orders: usize) -> Vec<f64> {
+        let mut sums: Vec<u32> = match self {
+            Lattice::Lamellar => return (1..=orders).map(|n| n as f64).collect(),
+            Lattice::Hexagonal => {
+                let bound = orders as u32 + 2;
+                (0..=bound)
+                    .flat_map(|h| (0..=bound).map(move |k| h * h + h * k + k * k))
+                    .collect()
+            }
+            _ => {
+                let bound = orders as u32 + 2;
+                let mut out = Vec::new();
+                for h in 0..=bound {
+                    for k in 0..=h {
+                        for l in 0..=k {
+                            let allowed = match self {
+                                Lattice::BodyCentredCubic => (h + k + l) % 2 == 0,
+                                Lattice::FaceCentredCubic => h % 2 == k % 2 && k % 2 == l % 2,
+                                _ => true,
+                            };
+                            if allowed {
+                                out.push(h * h + k * k + l * l);
+                            }
+                        }
+                    }
+                }
+                out
+            }
+        };
+        sums.retain(|&n| n > 0);
+        sums.sort_unstable();
+        sums.dedup();
+        sums.truncate(orders);
+
+        let first = sums.first().copied().unwrap_or(1) as f64;
+        sums.iter().map(|&n| (n as f64 / first).sqrt()).collect()
+    }
+}
+
+/// Bragg peaks from one lattice.
+#[derive(Clone, Debug, PartialEq)]
+pub struct BraggPeaks {
+    pub lattice: Lattice,
+    /// Real-space d-spacing of the first reflection (q1 = 2π/d).
+    pub d_spacing: f64,
+    /// Height of the first reflection; order n has height `amplitude / n`.
+    pub amplitude: f64,
+    /// Gaussian peak width (sigma) in q units.
+    pub width: f64,
+    /// Number of reflections to place.
+    pub orders: usize,
+}
+
+/// Noise model; both variants set `intensity_err` to match.
+#[derive(Clone, Debug, PartialEq)]
+pub enum Noise {
+    None,
+    /// Gaussian noise with standard deviation `relative * I`.
+    Gaussian {
+        relative: f64,
+    },
+    /// Counting statistics with `counts_per_unit` counts per unit intensity.
+    Poisson {
+        counts_per_unit: f64,
+    },
+}
+
+/// Configuration for synthetic profiles.
+#[derive(Clone, Debug, PartialEq)]
+pub struct SyntheticConfig {
+    pub points: usize,
+    pub q_min: f64,
+    pub q_max: f64,
+    /// Space q logarithmically instead of linearly.
+    pub log_q: bool,
+    pub background: Background,
+    pub form_factor: FormFactor,
+    pub peaks: Vec<BraggPeaks>,
+    /// Relative per-profile jitter of every d-spacing (uniform, ±).
+    pub d_jitter: f64,
+    pub noise: Noise,
+    /// Probability that a point is hit by a zinger.
+    pub zinger_probability: f64,
+    /// Zinger height relative to the profile maximum.
+    pub zinger_amplitude: f64,
+}
+
+impl Default for SyntheticConfig {
+    fn default() -> Self {
+        Self {
+            points: 1000,
+            q_min: 0.005,
+            q_max: 0.5,
+            log_q: false,
+            background: Background::default(),
+            form_factor: FormFactor::None,
+            peaks: vec![BraggPeaks {
+                lattice: Lattice::Lamellar,
+                d_spacing: 60.0,
+                amplitude: 50.0,
+                width: 0.002,
+                orders: 3,
+            }],
+            d_jitter: 0.0,
+            noise: Noise::Poisson {
+                counts_per_unit: 100.0,
+            },
+            zinger_probability: 0.0,
+            zinger_amplitude: 0.0,
+        }
+    }
+}
+
+impl SyntheticConfig {
+    fn q_grid(&self) -> Vec<f64> {
+        let n = self.points;
+        if n == 1 {
+            return vec![self.q_min];
+        }
+        let step = 1.0 / (n - 1) as f64;
+        if self.log_q {
+            let (lo, hi) = (self.q_min.ln(), self.q_max.ln());
+            (0..n)
+                .map(|i| (lo + (hi - lo) * i as f64 * step).exp())
+                .collect()
+        } else {
+            (0..n)
+                .map(|i| self.q_min + (self.q_max - self.q_min) * i as f64 * step)
+                .collect()
+        }
+    }
+}
+
+/// Generate profile `index` of the batch seeded with `seed`.
+///
+/// The sample id is `synthetic_<index>`.
+pub fn generate(config: &SyntheticConfig, seed: u64, index: u64) -> Sample {
+    let mut rng = Rng::for_profile(seed, index);
+    let q = config.q_grid();
+
+    // Peak centres for this profile, with per-profile d-spacing jitter.
+    let mut centres = Vec::new();
+    for peaks in &config.peaks {
+        let jitter = 1.0 + config.d_jitter * (2.0 * rng.next_f64() - 1.0);
+        let q1 = 2.0 * PI / (peaks.d_spacing * jitter);
+        for (order, ratio) in peaks.lattice.ratios(peaks.orders).into_iter().enumerate() {
+            let height = peaks.amplitude / (order + 1) as f64;
+            centres.push((q1 * ratio, height, peaks.width));
+        }
+    }
+
+    let bg = &config.background;
+    let mut intensity: Vec<f64> = q
+        .iter()
+        .map(|&q| {
+            let mut i = bg.amplitude * q.powf(-bg.exponent) + bg.constant;
+            i += config.form_factor.intensity(q);
+            for &(centre, height, width) in &centres {
+                let z = (q - centre) / width;
+                if z.abs() < 8.0 {
+                    i += height * (-0.5 * z * z).exp();
+                }
+            }
+            i
+        })
+        .collect();
+
+    let intensity_err = match config.noise {
+        Noise::None => vec![0.0; intensity.len()],
+        Noise::Gaussian { relative } => intensity
+            .iter_mut()
+            .map(|i| {
+                let err = relative * i.abs();
+                *i += err * rng.normal();
+                err
+            })
+            .collect(),
+        Noise::Poisson { counts_per_unit } => intensity
+            .iter_mut()
+            .map(|i| {
+                let counts = rng.poisson(*i * counts_per_unit);
+                *i = counts / counts_per_unit;
+                counts.max(1.0).sqrt() / counts_per_unit
+            })
+            .collect(),
+    };
+
+    if config.zinger_probability > 0.0 {
+        let max = intensity.iter().copied().fold(0.0, f64::max);
+        for i in intensity.iter_mut() {
+            if rng.next_f64() < config.zinger_probability {
+                *i += config.zinger_amplitude * max * (0.5 + rng.next_f64());
+            }
+        }
+    }
+
+    Sample::new(format!("synthetic_{}", index), q, intensity, intensity_err)
+        .expect("synthetic arrays have equal length")
+}
+
+/// Generate profiles `first..first + count` in parallel.
+pub fn generate_batch(
+    config: &SyntheticConfig,
+    seed: u64,
+    first: u64,
+    count: usize,
+) -> Vec<Sample> {
+    use rayon::prelude::*;
+
+    (first..first + count as u64)
+        .into_par_iter()
+        .map(|index| generate(config, seed, index))
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::find_peaks;
+
+    #[test]
+    fn test_lattice_ratios() {
+        let close = |a: Vec<f64>, b: &[f64]| {
+            a.len() == b.len() && a.iter().zip(b).all(|(x, y)| (x - y).abs() < 1e-12)
+        };
+        let s = f64::sqrt;
+        assert!(close(Lattice::Lamellar.ratios(3), &[1.0, 2.0, 3.0]));
+        assert!(close(
+            Lattice::Hexagonal.ratios(4),
+            &[1.0, s(3.0), 2.0, s(7.0)]
+        ));
+        assert!(close(
+            Lattice::SimpleCubic.ratios(7),
+            &[1.0, s(2.0), s(3.0), 2.0, s(5.0), s(6.0), s(8.0)]
+        ));
+        assert!(close(
+            Lattice::BodyCentredCubic.ratios(4),
+            &[1.0, s(2.0), s(3.0), 2.0]
+        ));
+        assert!(close(
+            Lattice::FaceCentredCubic.ratios(3),
+            &[1.0, s(4.0 / 3.0), s(8.0 / 3.0)]
+        ));
+    }
+
+    #[test]
+    fn test_reproducible_and_split_independent() {
+        let config = SyntheticConfig {
+            d_jitter: 0.05,
+            zinger_probability: 0.01,
+            zinger_amplitude: 1.0,
+            ..Default::default()
+        };
+        let batch = generate_batch(&config, 7, 0, 8);
+        let tail = generate_batch(&config, 7, 4, 4);
+
+        for (a, b) in batch[4..].iter().zip(&tail) {
+            assert_eq!(a.id, b.id);
+            assert_eq!(a.intensity, b.intensity);
+            assert_eq!(a.intensity_err, b.intensity_err);
+        }
+        assert_ne!(batch[0].intensity, batch[1].intensity);
+        assert_ne!(batch[0].intensity, generate(&config, 8, 0).intensity);
+    }
+
+    #[test]
+    fn test_noise_models() {
+        let config = SyntheticConfig {
+            peaks: Vec::new(),
+            background: Background {
+                amplitude: 0.0,
+                exponent: 0.0,
+                constant: 50.0,
+            },
+            points: 20_000,
+            noise: Noise::Poisson {
+                counts_per_unit: 2.0,
+            },
+            ..Default::default()
+        };
+        // Mean 100 counts: sample mean and variance should both be ~100.
+        let sample = generate(&config, 1, 0);
+        let counts: Vec<f64> = sample.intensity.iter().map(|i| i * 2.0).collect();
+        let mean = counts.iter().sum::<f64>() / counts.len() as f64;
+        let var = counts.iter().map(|c| (c - mean).powi(2)).sum::<f64>() / counts.len() as f64;
+        assert!((mean - 100.0).abs() < 0.5, "mean {}", mean);
+        assert!((var - 100.0).abs() < 5.0, "variance {}", var);
+        assert!((sample.intensity_err[0] - (counts[0].sqrt() / 2.0)).abs() < 1e-12);
+
+        let gaussian = generate(
+            &SyntheticConfig {
+                noise: Noise::Gaussian { relative: 0.01 },
+                ..config.clone()
+            },
+            1,
+            0,
+        );
+        assert!(gaussian
+            .intensity_err
+            .iter()
+            .all(|&e| (e - 0.5).abs() < 1e-12));
+    }
+
+    #[test]
+    fn test_bragg_peaks_are_found() {
+        let config = SyntheticConfig {
+            noise: Noise::None,
+            ..Default::default()
+        };
+        let sample = generate(&config, 0, 0);
+        let peaks = find_peaks(&sample.intensity, f64::NEG_INFINITY, 5.0);
+        let q1 = 2.0 * PI / 60.0;
+
+        assert_eq!(peaks.len(), 3);
+        for (n, peak) in peaks.iter().enumerate() {
+            let q = sample.q_values[peak.index];
+            assert!(
+                (q - q1 * (n + 1) as f64).abs() < 1e-3,
+                "order {} at {}",
+                n + 1,
+                q
+            );
+        }
+    }
+}
@@ -0,0 +1,468 @@
+//! Coordinator side: lease samples to workers and aggregate their output.
+
+use super::wire::{read_message, write_message, Message, PROTOCOL_VERSION};
+use crate::data::{FlowMetadata, Sample};
+use crate::runtime::{RegroupPool, WorkItem};
+use crate::stage::StageId;
+use std::collections::{HashMap, VecDeque};
+use std::io::{self, BufReader, BufWriter};
+use std::net::{SocketAddr, TcpListener, TcpStream};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// Coordinator configuration.
+#[derive(Clone, Debug)]
+pub struct CoordinatorConfig {
+    /// Listen address; port 0 picks a free port.
+    pub bind: SocketAddr,
+    /// Work items per lease.
+    pub lease_size: usize,
+    /// A worker that does not answer a lease within this time is dropped
+    /// and its lease handed to another worker.
+    pub lease_timeout: Duration,
+    /// Give up if no lease completes for this long.
+    pub stall_timeout: Duration,
+    /// Checkpoint stages of the aggregated regroup pool.
+    pub checkpoints: Vec<u32>,
+}
+
+impl Default for CoordinatorConfig {
+    fn default() -> Self {
+        Self {
+            bind: SocketAddr::from(([127, 0, 0, 1], 0)),
+            lease_size: 4,
+            lease_timeout: Duration::from_secs(60),
+            stall_timeout: Duration::from_secs(300),
+            checkpoints: Vec::new(),
+        }
+    }
+}
+
+/// Counters of a distributed run.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct DistributedStats {
+    /// Workers that connected.
+    pub workers: u64,
+    /// Workers dropped after an error or lease timeout.
+    pub failed_workers: u64,
+    /// Leases handed out, including re-leases.
+    pub leases: u64,
+    /// Work items handed out again after a worker failed.
+    pub re_leased: u64,
+}
+
+/// Aggregated output of all workers.
+pub struct DistributedRun {
+    /// Completed samples in sample order.
+    pub completed: Vec<Sample>,
+    /// Intermediate samples from every node, with the configured
+    /// checkpoints and the whole batch as expected count.
+    pub pool: RegroupPool,
+    pub stats: DistributedStats,
+}
+
+impl DistributedRun {
+    /// Collect samples at or above `min_stage`, pool first, like
+    /// `Runtime::regroup`.
+    pub fn regroup(&mut self, min_stage: u32) -> Vec<Sample> {
+        let mut result = self.pool.regroup(min_stage);
+        let (matching, kept): (Vec<_>, Vec<_>) = std::mem::take(&mut self.completed)
+            .into_iter()
+            .partition(|s| s.stage_num >= min_stage);
+        self.completed = kept;
+        result.extend(matching);
+        result
+    }
+
+    /// Samples at a checkpoint stage, once every sample of the batch
+    /// reached it on some node.
+    pub fn collect_checkpoint(&mut self, stage: u32) -> Option<Vec<Sample>> {
+        self.pool.collect_at_stage(stage)
+    }
+}
+
+struct Lease {
+    items: Vec<WorkItem>,
+}
+
+struct State {
+    queue: VecDeque<WorkItem>,
+    leases: HashMap<u64, Lease>,
+    next_lease: u64,
+    /// (order of the lease's first item, completed samples in lease order).
+    completed: Vec<(u64, Vec<Sample>)>,
+    pool: RegroupPool,
+    stats: DistributedStats,
+    last_progress: Instant,
+}
+
+impl State {
+    fn is_done(&self) -> bool {
+        self.queue.is_empty() && self.leases.is_empty()
+    }
+
+    /// Put a failed lease back at the front, keeping item order.
+    fn release(&mut self, lease: u64) {
+        if let Some(lease) = self.leases.remove(&lease) {
+            self.stats.re_leased += lease.items.len() as u64;
+            for item in lease.items.into_iter().rev() {
+                self.queue.push_front(item);
+            }
+        }
+    }
+}
+
+struct Shared {
+    state: Mutex<State>,
+    changed: Condvar,
+    finished: AtomicBool,
+}
+
+/// Shards samples to worker processes over TCP.
+pub struct Coordinator {
+    listener: TcpListener,
+    config: CoordinatorConfig,
+}
+
+impl Coordinator {
+    pub fn bind(config: CoordinatorConfig) -> io::Result<Self> {
+        let listener = TcpListener::bind(config.bind)?;
+        Ok(Self { listener, config })
+    }
+
+    /// Address workers should connect to.
+    pub fn local_addr(&self) -> io::Result<SocketAddr> {
+        self.listener.local_addr()
+    }
+
+    /// Process `samples` on whichever workers connect and return the
+    /// aggregated output. Blocks until every sample completed.
+    ///
+    /// Each lease is answered as a whole; if a worker disconnects, sends
+    /// garbage or exceeds the lease timeout, the lease goes back to the
+    /// front of the queue and partial output of that worker is discarded.
+    pub fn run(self, samples: Vec<Sample>) -> io::Result<DistributedRun> {
+        let mut pool = RegroupPool::with_expected_count(samples.len());
+        pool.set_checkpoints(self.config.checkpoints.iter().copied());
+        let queue = samples
+            .into_iter()
+            .enumerate()
+            .map(|(index, sample)| {
+                let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+                WorkItem::new(sample, metadata, StageId::FindPeak).with_order(index as u64)
+            })
+            .collect();
+        let shared = Arc::new(Shared {
+            state: Mutex::new(State {
+                queue,
+                leases: HashMap::new(),
+                next_lease: 0,
+                completed: Vec::new(),
+                pool,
+                stats: DistributedStats::default(),
+                last_progress: Instant::now(),
+            }),
+            changed: Condvar::new(),
+            finished: AtomicBool::new(false),
+        });
+
+        let acceptor = {
+            let shared = shared.clone();
+            let listener = self.listener.try_clone()?;
+            let config = self.config.clone();
+            std::thread::spawn(move || accept_loop(listener, shared, config))
+        };
+
+        let outcome = {
+            let mut state = shared.state.lock().unwrap();
+            loop {
+                if state.is_done() {
+                    break Ok(());
+                }
+                if state.last_progress.elapsed() >= self.config.stall_timeout {
+                    break Err(io::Error::new(
+                        io::ErrorKind::TimedOut,
+                        "no lease completed within the stall timeout",
+                    ));
+                }
+                state = shared
+                    .changed
+                    .wait_timeout(state, Duration::from_millis(100))
+                    .unwrap()
+                    .0;
+            }
+        };
+
+        shared.finished.store(true, Ordering::SeqCst);
+        shared.changed.notify_all();
+        let _ = acceptor.join();
+        outcome?;
+
+        let state = match Arc::try_unwrap(shared) {
+            Ok(shared) => shared.state.into_inner().unwrap(),
+            Err(_) => unreachable!("connection threads are joined"),
+        };
+        let mut completed = state.completed;
+        completed.sort_by_key(|(order, _)| *order);
+        Ok(DistributedRun {
+            completed: completed.into_iter().flat_map(|(_, s)| s).collect(),
+            pool: state.pool,
+            stats: state.stats,
+        })
+    }
+}
+
+fn accept_loop(listener: TcpListener, shared: Arc<Shared>, config: CoordinatorConfig) {
+    let mut connections: Vec<JoinHandle<()>> = Vec::new();
+    // Poll so the loop notices the end of the run.
+    let _ = listener.set_nonblocking(true);
+    while !shared.finished.load(Ordering::SeqCst) {
+        match listener.accept() {
+            Ok((stream, _)) => {
+                let shared = shared.clone();
+                let config = config.clone();
+                connections.push(std::thread::spawn(move || serve(stream, &shared, &config)));
+            }
+            Err(e) if e.kind() == io::ErrorKind::WouldBlock => {
+                std::thread::sleep(Duration::from_millis(5));
+            }
+            Err(_) => break,
+        }
+    }
+    for connection in connections {
+        let _ = connection.join();
+    }
+}
+
+/// Serve one worker connection: one outstanding lease at a time.
+fn serve(stream: TcpStream, shared: &Shared, config: &CoordinatorConfig) {
+    let mut lease = None;
+    let result = serve_leases(stream, shared, config, &mut lease);
+    let mut state = shared.state.lock().unwrap();
+    if result.is_err() {
+        state.stats.failed_workers += 1;
+        if let Some(lease) = lease {
+            state.release(lease);
+        }
+        shared.changed.notify_all();
+    }
+}
+
+fn serve_leases(
+    stream: TcpStream,
+    shared: &Shared,
+    config: &CoordinatorConfig,
+    current: &mut Option<u64>,
+) -> io::Result<()> {
+    stream.set_nonblocking(false)?;
+    stream.set_nodelay(true)?;
+    stream.set_read_timeout(Some(config.lease_timeout))?;
+    let mut reader = BufReader::new(stream.try_clone()?);
+    let mut writer = BufWriter::new(stream);
+
+    match read_message(&mut reader)? {
+        Message::Hello { version, .. } if version == PROTOCOL_VERSION => {}
+        _ => return Err(protocol_error("expected hello")),
+    }
+    shared.state.lock().unwrap().stats.workers += 1;
+
+    loop {
+        let lease = {
+            let mut state = shared.state.lock().unwrap();
+            loop {
+                if shared.finished.load(Ordering::SeqCst) || state.is_done() {
+                    break None;
+                }
+                if !state.queue.is_empty() {
+                    let take = config.lease_size.max(1).min(state.queue.len());
+                    let items: Vec<WorkItem> = state.queue.drain(..take).collect();
+                    let id = state.next_lease;
+                    state.next_lease += 1;
+                    state.stats.leases += 1;
+                    state.leases.insert(
+                        id,
+                        Lease {
+                            items: items.clone(),
+                        },
+                    );
+                    break Some((id, items));
+                }
+                // Other workers hold the remaining leases; one may fail.
+                state = shared
+                    .changed
+                    .wait_timeout(state, Duration::from_millis(100))
+                    .unwrap()
+                    .0;
+            }
+        };
+        let Some((id, items)) = lease else {
+            return write_message(&mut writer, &Message::Shutdown);
+        };
+
+        *current = Some(id);
+        write_message(&mut writer, &Message::Lease { lease: id, items })?;
+        let (completed, pooled) = match read_message(&mut reader)? {
+            Message::Result {
+                lease,
+                completed,
+                pooled,
+            } if lease == id => (completed, pooled),
+            _ => return Err(protocol_error("expected the lease result")),
+        };
+        *current = None;
+
+        let mut state = shared.state.lock().unwrap();
+        if let Some(lease) = state.leases.remove(&id) {
+            let order = lease.items.first().map_or(0, |item| item.order);
+            state.completed.push((order, completed));
+            for sample in pooled {
+                state.pool.add(sample);
+            }
+            state.last_progress = Instant::now();
+        }
+        shared.changed.notify_all();
+    }
+}
+
+fn protocol_error(what: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, what.to_string())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::worker::{run_worker, WorkerConfig};
+    use super::*;
+    use crate::data::synthetic::{generate_batch, SyntheticConfig};
+    use crate::runtime::{Runtime, RuntimeConfig};
+
+    /// Environment variable that turns `worker_process` into a worker.
+    const WORKER_ENV: &str = "SAXSRS_TEST_COORDINATOR";
+
+    fn batch() -> Vec<Sample> {
+        let config = SyntheticConfig {
+            points: 256,
+            ..Default::default()
+        };
+        generate_batch(&config, 5, 0, 12)
+    }
+
+    /// Completed and pooled samples of a single-node run.
+    fn local_reference(samples: Vec<Sample>) -> (Vec<Sample>, Vec<Sample>) {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        runtime.add_samples(samples);
+        runtime.run_sync();
+        let completed = runtime.take_completed();
+        (completed, runtime.regroup(0, usize::MAX))
+    }
+
+    /// Order-independent content of a sample set.
+    fn key(samples: &[Sample]) -> Vec<(String, u32, Vec<u64>)> {
+        let mut key: Vec<_> = samples
+            .iter()
+            .map(|s| {
+                let bits = s.intensity.iter().map(|x| x.to_bits()).collect();
+                (s.id.clone(), s.stage_num, bits)
+            })
+            .collect();
+        key.sort();
+        key
+    }
+
+    /// Entry point of the worker processes spawned by
+    /// `test_worker_processes_on_localhost`; does nothing when run directly.
+    #[test]
+    #[ignore]
+    fn worker_process() {
+        if let Ok(addr) = std::env::var(WORKER_ENV) {
+            run_worker(addr.as_str(), WorkerConfig { threads: 2 }).unwrap();
+        }
+    }
+
+    #[test]
+    fn test_worker_processes_on_localhost() {
+        let coordinator = Coordinator::bind(CoordinatorConfig {
+            lease_size: 2,
+            checkpoints: vec![1],
+            ..Default::default()
+        })
+        .unwrap();
+        let addr = coordinator.local_addr().unwrap();
+
+        let exe = std::env::current_exe().unwrap();
+        let mut workers: Vec<_> = (0..3)
+            .map(|_| {
+                std::process::Command::new(&exe)
+                    .args([
+                        "distributed::coordinator::tests::worker_process",
+                        "--exact",
+                        "--ignored",
+                        "--quiet",
+                    ])
+                    .env(WORKER_ENV, addr.to_string())
+                    .stdout(std::process::Stdio::null())
+                    .spawn()
+                    .unwrap()
+            })
+            .collect();
+
+        let mut run = coordinator.run(batch()).unwrap();
+        for worker in &mut workers {
+            assert!(worker.wait().unwrap().success());
+        }
+
+        let (completed, pooled) = local_reference(batch());
+        assert_eq!(key(&run.completed), key(&completed));
+        assert_eq!(run.stats.leases, 6);
+        assert_eq!(run.stats.failed_workers, 0);
+
+        // Every sample passed stage 1 on some node, so the checkpoint
+        // holds the whole batch.
+        let at_checkpoint = pooled.iter().filter(|s| s.stage_num == 1).count();
+        assert_eq!(at_checkpoint, 12);
+        assert_eq!(run.collect_checkpoint(1).map(|s| s.len()), Some(12));
+        assert_eq!(key(&run.pool.regroup(0)), key(&pooled[12..].to_vec()));
+    }
+
+    #[test]
+    fn test_failed_worker_lease_is_reissued() {
+        let coordinator = Coordinator::bind(CoordinatorConfig {
+            lease_size: 5,
+            ..Default::default()
+        })
+        .unwrap();
+        let addr = coordinator.local_addr().unwrap();
+
+        // Takes the first lease, then disconnects without answering.
+        let crashing = std::thread::spawn(move || {
+            let stream = TcpStream::connect(addr).unwrap();
+            let mut writer = BufWriter::new(stream.try_clone().unwrap());
+            write_message(
+                &mut writer,
+                &Message::Hello {
+                    version: PROTOCOL_VERSION,
+                    threads: 1,
+                },
+            )
+            .unwrap();
+            let lease = read_message(&mut BufReader::new(stream)).unwrap();
+            assert!(matches!(lease, Message::Lease { .. }));
+        });
+        let healthy = std::thread::spawn(move || {
+            crashing.join().unwrap();
+            run_worker(addr, WorkerConfig { threads: 1 }).unwrap()
+        });
+
+        let mut run = coordinator.run(batch()).unwrap();
+        assert!(healthy.join().unwrap() >= 1);
+        assert_eq!(run.stats.failed_workers, 1);
+        assert_eq!(run.stats.re_leased, 5);
+        let (completed, pooled) = local_reference(batch());
+        assert_eq!(key(&run.completed), key(&completed));
+        assert_eq!(run.regroup(0).len(), completed.len() + pooled.len());
+    }
+}
@@ -0,0 +1,18 @@
+//! Multi-node processing over TCP.
+//!
+//! A [`Coordinator`] listens for worker processes and leases them batches
+//! of work items. Each worker ([`run_worker`]) runs its leases on a local
+//! [`Runtime`](crate::Runtime) and answers with the completed samples and
+//! its regroup pool. The coordinator merges everything into one regroup
+//! pool whose expected count is the whole batch, so checkpoints mean "every
+//! sample reached this stage on some node". A lease that is not answered
+//! (disconnect, protocol error, timeout) is handed to another worker.
+//!
+//! The `saxs_worker` binary runs a worker: `saxs_worker <host:port> [threads]`.
+
+pub mod coordinator;
+pub mod wire;
+pub mod worker;
+
+pub use coordinator::{Coordinator, CoordinatorConfig, DistributedRun, DistributedStats};
+pub use worker::{run_worker, WorkerConfig};
@@ -0,0 +1,213 @@
+//! Binary framing between coordinator and workers.
+//!
+//! Every message is a little-endian `u32` payload length followed by the
+//! payload; the first payload byte is the message tag. Samples and flow
+//! metadata use the same encoding as snapshots (`data::codec`), so arrays
+//! travel as raw little-endian `f64` runs.
+
+use crate::data::codec::{decode_sample, encode_sample, put_u32, put_u64, put_u8, Decoder};
+use crate::data::{CodecError, Sample};
+use crate::runtime::snapshot::{decode_work_item, encode_work_item};
+use crate::runtime::WorkItem;
+use std::io::{self, Read, Write};
+
+/// Protocol version sent in `Hello`.
+pub const PROTOCOL_VERSION: u32 = 4;
+
+/// Largest accepted payload.
+const MAX_FRAME: usize = 1 << 30;
+
+const TAG_HELLO: u8 = 1;
+const TAG_LEASE: u8 = 2;
+const TAG_RESULT: u8 = 3;
+const TAG_SHUTDOWN: u8 = 4;
+
+/// One protocol message.
+pub enum Message {
+    /// Worker to coordinator, once after connecting.
+    Hello { version: u32, threads: u32 },
+    /// Coordinator to worker: work items to run to completion.
+    Lease { lease: u64, items: Vec<WorkItem> },
+    /// Worker to coordinator: everything a lease produced.
+    Result {
+        lease: u64,
+        /// Samples that finished their pipeline.
+        completed: Vec<Sample>,
+        /// Intermediate samples from the worker's regroup pool.
+        pooled: Vec<Sample>,
+    },
+    /// Coordinator to worker: no more work.
+    Shutdown,
+}
+
+fn put_samples(buf: &mut Vec<u8>, samples: &[Sample]) {
+    put_u32(buf, samples.len() as u32);
+    for sample in samples {
+        encode_sample(buf, sample);
+    }
+}
+
+fn samples(dec: &mut Decoder<'_>) -> Result<Vec<Sample>, CodecError> {
+    let count = dec.u32()? as usize;
+    let mut out = Vec::with_capacity(count.min(dec.remaining()));
+    for _ in 0..count {
+        out.push(decode_sample(dec)?);
+    }
+    Ok(out)
+}
+
+impl Message {
+    pub fn encode(&self, buf: &mut Vec<u8>) {
+        match self {
+            Message::Hello { version, threads } => {
+                put_u8(buf, TAG_HELLO);
+                put_u32(buf, *version);
+                put_u32(buf, *threads);
+            }
+            Message::Lease { lease, items } => {
+                put_u8(buf, TAG_LEASE);
+                put_u64(buf, *lease);
+                put_u32(buf, items.len() as u32);
+                for item in items {
+                    buf.extend_from_slice(&encode_work_item(item));
+                }
+            }
+            Message::Result {
+                lease,
+                completed,
+                pooled,
+            } => {
+                put_u8(buf, TAG_RESULT);
+                put_u64(buf, *lease);
+                put_samples(buf, completed);
+                put_samples(buf, pooled);
+            }
+            Message::Shutdown => put_u8(buf, TAG_SHUTDOWN),
+        }
+    }
+
+    pub fn decode(payload: &[u8]) -> Result<Self, CodecError> {
+        let mut dec = Decoder::new(payload);
+        let message = match dec.u8()? {
+            TAG_HELLO => Message::Hello {
+                version: dec.u32()?,
+                threads: dec.u32()?,
+            },
+            TAG_LEASE => {
+                let lease = dec.u64()?;
+                let count = dec.u32()? as usize;
+                let mut items = Vec::with_capacity(count.min(dec.remaining()));
+                for _ in 0..count {
+                    items.push(decode_work_item(&mut dec)?);
+                }
+                Message::Lease { lease, items }
+            }
+            TAG_RESULT => Message::Result {
+                lease: dec.u64()?,
+                completed: samples(&mut dec)?,
+                pooled: samples(&mut dec)?,
+            },
+            TAG_SHUTDOWN => Message::Shutdown,
+            tag => return Err(CodecError::InvalidTag(tag)),
+        };
+        Ok(message)
+    }
+}
+
+/// Write one framed message.
+pub fn write_message<W: Write>(w: &mut W, message: &Message) -> io::Result<()> {
+    let mut buf = vec![0; 4];
+    message.encode(&mut buf);
+    let len = (buf.len() - 4) as u32;
+    buf[..4].copy_from_slice(&len.to_le_bytes());
+    w.write_all(&buf)?;
+    w.flush()
+}
+
+/// Read one framed message.
+pub fn read_message<R: Read>(r: &mut R) -> io::Result<Message> {
+    let mut len = [0u8; 4];
+    r.read_exact(&mut len)?;
+    let len = u32::from_le_bytes(len) as usize;
+    if len > MAX_FRAME {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "frame too large",
+        ));
+    }
+    let mut payload = vec![0; len];
+    r.read_exact(&mut payload)?;
+    Message::decode(&payload).map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::FlowMetadata;
+    use crate::stage::StageId;
+
+    #[test]
+    fn test_messages_round_trip() {
+        let mut sample = Sample::new("s", vec![0.1, 0.2], vec![3.0, 4.0], vec![0.5, 0.5]).unwrap();
+        sample.stage_num = 2;
+        sample.metadata.processed_peaks.insert(1, 4.0);
+        let mut metadata = FlowMetadata::new("s");
+        metadata.current_peak = Some(1);
+
+        let mut stream = Vec::new();
+        write_message(
+            &mut stream,
+            &Message::Lease {
+                lease: 7,
+                items: vec![WorkItem::new(
+                    sample.clone(),
+                    metadata,
+                    StageId::ProcessPeak,
+                )],
+            },
+        )
+        .unwrap();
+        write_message(
+            &mut stream,
+            &Message::Result {
+                lease: 7,
+                completed: vec![sample.clone()],
+                pooled: Vec::new(),
+            },
+        )
+        .unwrap();
+
+        let mut r = stream.as_slice();
+        match read_message(&mut r).unwrap() {
+            Message::Lease { lease, items } => {
+                assert_eq!(lease, 7);
+                assert_eq!(items[0].stage_id, StageId::ProcessPeak);
+                assert_eq!(items[0].metadata.current_peak, Some(1));
+                assert_eq!(items[0].sample.intensity, sample.intensity);
+            }
+            _ => panic!("expected a lease"),
+        }
+        match read_message(&mut r).unwrap() {
+            Message::Result {
+                completed, pooled, ..
+            } => {
+                assert_eq!(completed[0].stage_num, 2);
+                assert_eq!(completed[0].metadata.processed_peaks[&1], 4.0);
+                assert!(pooled.is_empty());
+            }
+            _ => panic!("expected a result"),
+        }
+        assert!(r.is_empty());
+    }
+
+    #[test]
+    fn test_rejects_truncated_and_unknown_frames() {
+        let mut stream = Vec::new();
+        write_message(&mut stream, &Message::Shutdown).unwrap();
+        assert!(read_message(&mut &stream[..stream.len() - 1]).is_err());
+
+        let bogus = [1u8, 0, 0, 0, 99];
+        let err = read_message(&mut &bogus[..]).err().unwrap();
+        assert_eq!(err.kind(), io::ErrorKind::InvalidData);
+    }
+}
@@ -0,0 +1,76 @@
+//! Worker side: run leased work items on a local runtime.
+
+use super::wire::{read_message, write_message, Message, PROTOCOL_VERSION};
+use crate::runtime::{Runtime, RuntimeConfig};
+use std::io::{self, BufReader, BufWriter};
+use std::net::{TcpStream, ToSocketAddrs};
+
+/// Worker process configuration.
+#[derive(Clone, Debug)]
+pub struct WorkerConfig {
+    /// Threads of the local runtime.
+    pub threads: usize,
+}
+
+impl Default for WorkerConfig {
+    fn default() -> Self {
+        Self {
+            threads: num_cpus::get(),
+        }
+    }
+}
+
+/// Connect to a coordinator and process leases until it shuts the worker
+/// down. Returns the number of leases completed.
+///
+/// Each lease runs to completion in deterministic mode, so its output
+/// does not depend on the worker's thread count.
+pub fn run_worker(addr: impl ToSocketAddrs, config: WorkerConfig) -> io::Result<u64> {
+    let stream = TcpStream::connect(addr)?;
+    stream.set_nodelay(true)?;
+    let mut reader = BufReader::new(stream.try_clone()?);
+    let mut writer = BufWriter::new(stream);
+
+    write_message(
+        &mut writer,
+        &Message::Hello {
+            version: PROTOCOL_VERSION,
+            threads: config.threads as u32,
+        },
+    )?;
+
+    let mut runtime = Runtime::new(RuntimeConfig {
+        worker_count: config.threads.max(1),
+        max_stages: None,
+    });
+    runtime.set_deterministic(true);
+
+    let mut leases = 0;
+    loop {
+        match read_message(&mut reader)? {
+            Message::Lease { lease, items } => {
+                runtime.add_work_items(items);
+                runtime.run_sync();
+                let completed = runtime.take_completed();
+                let pooled = runtime.regroup(0, usize::MAX);
+                runtime.reset();
+                write_message(
+                    &mut writer,
+                    &Message::Result {
+                        lease,
+                        completed,
+                        pooled,
+                    },
+                )?;
+                leases += 1;
+            }
+            Message::Shutdown => return Ok(leases),
+            _ => {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidData,
+                    "unexpected message from coordinator",
+                ))
+            }
+        }
+    }
+}
@@ -5,8 +5,10 @@
 
 pub mod runtime;
 pub mod sample;
+pub mod synthetic;
 pub mod types;
 
 pub use runtime::*;
 pub use sample::*;
+pub use synthetic::*;
 pub use types::*;
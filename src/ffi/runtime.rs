@@ -1,10 +1,21 @@
 //! FFI functions for Runtime management.
 
 use super::sample::SampleHandle;
-use super::types::{CompletionCallback, ProgressCallback, SampleCallback, SaxsStatus};
+use super::types::{
+    CCacheStats, CCompressionStats, CLockStats, CMemoryLocationStats, CMemoryStats, CProgress,
+    CRuntimeStats, CSeriesStats, CStageStats, CTrackColumns, CWorkerStats, CompletionCallback,
+    ProgressCallback, SampleCallback, SaxsStatus,
+};
 use crate::data::Sample;
-use crate::runtime::{Runtime, RuntimeConfig};
-use std::ffi::c_void;
+use crate::io::{BatchLoader, LoaderConfig};
+use crate::runtime::memory::{ffi_handle_created, ffi_handle_released};
+use crate::runtime::{
+    CacheConfig, PreviewConfig, ProcessConfig, Runtime, RuntimeConfig, SnapshotConfig,
+    StageMetrics, TraceConfig,
+};
+use crate::series::{SeriesConfig, TrackerConfig};
+use crate::stage::StageId;
+use std::ffi::{c_char, c_void, CStr};
 
 /// Opaque handle to a Runtime.
 pub type RuntimeHandle = *mut Runtime;
@@ -70,6 +81,41 @@ pub unsafe extern "C" fn saxs_runtime_create(
     SaxsStatus::Ok
 }
 
+/// Resume a runtime from a snapshot directory.
+///
+/// # Safety
+/// path must be a valid C string and out_handle a valid pointer.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_resume(
+    path: *const c_char,
+    config: *const CRuntimeConfig,
+    out_handle: *mut RuntimeHandle,
+) -> SaxsStatus {
+    if path.is_null() || out_handle.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(s) => s,
+        Err(_) => return SaxsStatus::InvalidUtf8,
+    };
+
+    let cfg = if config.is_null() {
+        RuntimeConfig::default()
+    } else {
+        (*config).clone().into()
+    };
+
+    match Runtime::resume_with_config(cfg, path) {
+        Ok(runtime) => {
+            *out_handle = Box::into_raw(Box::new(runtime));
+            SaxsStatus::Ok
+        }
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound => SaxsStatus::NotFound,
+        Err(_) => SaxsStatus::RuntimeError,
+    }
+}
+
 /// Free a runtime handle.
 ///
 /// # Safety
@@ -96,11 +142,57 @@ pub unsafe extern "C" fn saxs_runtime_add_sample(
 
     let rt = &mut *runtime;
     let sample = Box::from_raw(sample);
+    ffi_handle_released(&sample);
     rt.add_sample(*sample);
 
     SaxsStatus::Ok
 }
 
+/// Load text profiles from files and add them to the runtime batch.
+///
+/// Files that cannot be read or parsed are skipped; `out_loaded` (if not
+/// null) receives the number of samples added.
+///
+/// # Safety
+/// paths must point to `count` valid C strings.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_load_files(
+    runtime: RuntimeHandle,
+    paths: *const *const c_char,
+    count: usize,
+    out_loaded: *mut usize,
+) -> SaxsStatus {
+    if runtime.is_null() || (paths.is_null() && count > 0) {
+        return SaxsStatus::NullPointer;
+    }
+
+    let mut path_list = Vec::with_capacity(count);
+    for i in 0..count {
+        let p = *paths.add(i);
+        if p.is_null() {
+            return SaxsStatus::NullPointer;
+        }
+        match CStr::from_ptr(p).to_str() {
+            Ok(s) => path_list.push(s),
+            Err(_) => return SaxsStatus::InvalidUtf8,
+        }
+    }
+
+    let mut loader = BatchLoader::new(LoaderConfig::default());
+    let results = match loader.load_profiles(&path_list) {
+        Ok(r) => r,
+        Err(_) => return SaxsStatus::RuntimeError,
+    };
+
+    let samples: Vec<Sample> = results.into_iter().filter_map(Result::ok).collect();
+    if !out_loaded.is_null() {
+        *out_loaded = samples.len();
+    }
+    (*runtime).add_samples(samples);
+
+    SaxsStatus::Ok
+}
+
 /// Set checkpoint stages.
 ///
 /// # Safety
@@ -127,6 +219,219 @@ pub unsafe extern "C" fn saxs_runtime_set_checkpoints(
     SaxsStatus::Ok
 }
 
+/// Enable crash-safe snapshots into a directory.
+///
+/// # Safety
+/// Runtime handle must be valid and path a valid C string.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_snapshots(
+    runtime: RuntimeHandle,
+    path: *const c_char,
+) -> SaxsStatus {
+    if runtime.is_null() || path.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(s) => s,
+        Err(_) => return SaxsStatus::InvalidUtf8,
+    };
+
+    match (*runtime).enable_snapshots(SnapshotConfig::new(path)) {
+        Ok(()) => SaxsStatus::Ok,
+        Err(_) => SaxsStatus::RuntimeError,
+    }
+}
+
+/// Block until all journaled state is on disk.
+///
+/// Returns `RuntimeError` if the journal writer stopped after an I/O error;
+/// nothing recorded since then is persisted.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_sync_snapshots(runtime: RuntimeHandle) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    match (*runtime).sync_snapshots() {
+        Ok(()) => SaxsStatus::Ok,
+        Err(_) => SaxsStatus::RuntimeError,
+    }
+}
+
+/// Compress samples idle in the regroup pool for longer than `threshold_ms`.
+///
+/// A threshold of 0 disables compression.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_cold_threshold(
+    runtime: RuntimeHandle,
+    threshold_ms: u64,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let threshold = if threshold_ms == 0 {
+        None
+    } else {
+        Some(std::time::Duration::from_millis(threshold_ms))
+    };
+    (*runtime).set_cold_sample_threshold(threshold);
+    SaxsStatus::Ok
+}
+
+/// Get compression counters for idle samples.
+///
+/// # Safety
+/// Runtime handle and out_stats must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_compression_stats(
+    runtime: RuntimeHandle,
+    out_stats: *mut CCompressionStats,
+) -> SaxsStatus {
+    if runtime.is_null() || out_stats.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let stats = (*runtime).compression_stats();
+    *out_stats = CCompressionStats {
+        compressed_samples: stats.compressed_samples,
+        decompressed_samples: stats.decompressed_samples,
+        raw_bytes: stats.raw_bytes,
+        compressed_bytes: stats.compressed_bytes,
+        compress_ns: stats.compress_time.as_nanos() as u64,
+        decompress_ns: stats.decompress_time.as_nanos() as u64,
+    };
+    SaxsStatus::Ok
+}
+
+/// Enable the content-addressed result cache.
+///
+/// `max_bytes` of 0 keeps the default memory budget. `disk_dir` may be null
+/// for a memory-only cache.
+///
+/// # Safety
+/// Runtime handle must be valid; disk_dir must be null or a valid C string.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_cache(
+    runtime: RuntimeHandle,
+    max_bytes: usize,
+    disk_dir: *const c_char,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let mut config = CacheConfig::default();
+    if max_bytes > 0 {
+        config.max_bytes = max_bytes;
+    }
+    if !disk_dir.is_null() {
+        match CStr::from_ptr(disk_dir).to_str() {
+            Ok(s) => config.disk_dir = Some(s.into()),
+            Err(_) => return SaxsStatus::InvalidUtf8,
+        }
+    }
+
+    match (*runtime).enable_cache(config) {
+        Ok(()) => SaxsStatus::Ok,
+        Err(_) => SaxsStatus::RuntimeError,
+    }
+}
+
+/// Get result cache counters.
+///
+/// # Safety
+/// Runtime handle and out_stats must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_cache_stats(
+    runtime: RuntimeHandle,
+    out_stats: *mut CCacheStats,
+) -> SaxsStatus {
+    if runtime.is_null() || out_stats.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let stats = match (*runtime).cache_stats() {
+        Some(s) => s,
+        None => return SaxsStatus::NotFound,
+    };
+    *out_stats = CCacheStats {
+        stage_hits: stats.stage_hits,
+        stage_misses: stats.stage_misses,
+        pipeline_hits: stats.pipeline_hits,
+        pipeline_misses: stats.pipeline_misses,
+        disk_hits: stats.disk_hits,
+        evictions: stats.evictions,
+        bytes: stats.bytes,
+    };
+    SaxsStatus::Ok
+}
+
+/// Enable span tracing; each run writes a Chrome trace JSON to `path`.
+///
+/// `capacity` is the number of spans kept per worker (0 = default).
+///
+/// # Safety
+/// Runtime handle must be valid; path must be a valid C string.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_tracing(
+    runtime: RuntimeHandle,
+    path: *const c_char,
+    capacity: usize,
+) -> SaxsStatus {
+    if runtime.is_null() || path.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(s) => s,
+        Err(_) => return SaxsStatus::InvalidUtf8,
+    };
+    let mut config = TraceConfig::new(path);
+    if capacity > 0 {
+        config.capacity = capacity;
+    }
+    (*runtime).enable_tracing(config);
+    SaxsStatus::Ok
+}
+
+/// Disable span tracing.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_disable_tracing(runtime: RuntimeHandle) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    (*runtime).disable_tracing();
+    SaxsStatus::Ok
+}
+
+thread_local! {
+    /// Reused NUL-terminated copy of the sample id passed to `on_sample`.
+    static ID_BUF: std::cell::RefCell<Vec<u8>> = std::cell::RefCell::new(Vec::new());
+}
+
+/// Call `f` with `id` as a C string without allocating per call. An id with
+/// an interior NUL is truncated there.
+fn with_id_c_str<R>(id: &str, f: impl FnOnce(*const c_char) -> R) -> R {
+    ID_BUF.with(|buf| {
+        let mut buf = buf.borrow_mut();
+        buf.clear();
+        buf.extend_from_slice(id.as_bytes());
+        buf.push(0);
+        f(buf.as_ptr() as *const c_char)
+    })
+}
+
 /// Run the batch processing asynchronously.
 ///
 /// This function returns immediately. The completion callback will be
@@ -164,9 +469,11 @@ pub unsafe extern "C" fn saxs_runtime_run_async(
 
     let sample_cb = move |sample: Sample| {
         let ud = user_data as *mut c_void;
-        let id_cstring = std::ffi::CString::new(sample.id.clone()).unwrap();
+        ffi_handle_created(&sample);
         let sample_handle = Box::into_raw(Box::new(sample));
-        on_sample(ud, id_cstring.as_ptr(), sample_handle as *mut c_void);
+        with_id_c_str(&(*sample_handle).id, |id| {
+            on_sample(ud, id, sample_handle as *mut c_void)
+        });
     };
 
     rt.run_async(complete_cb, progress_cb, sample_cb);
@@ -208,6 +515,431 @@ pub unsafe extern "C" fn saxs_runtime_pending_count(runtime: RuntimeHandle) -> u
     (*runtime).pending_count()
 }
 
+// CRuntimeStats::stages is sized for the current stage set.
+const _: () = assert!(StageId::COUNT == 6);
+
+// CProgress::at_stage has one entry per progress bucket.
+const _: () = assert!(crate::runtime::progress::PROGRESS_STAGES == 16);
+
+fn nanos(d: std::time::Duration) -> u64 {
+    d.as_nanos().min(u64::MAX as u128) as u64
+}
+
+impl From<&StageMetrics> for CStageStats {
+    fn from(m: &StageMetrics) -> Self {
+        let latency = m.latency.summary();
+        let queue_wait = m.queue_wait.summary();
+        CStageStats {
+            executions: m.executions,
+            requeues: m.requeues,
+            rejections: m.rejections,
+            latency_mean_ns: latency.mean_ns,
+            latency_p50_ns: latency.p50_ns,
+            latency_p90_ns: latency.p90_ns,
+            latency_p99_ns: latency.p99_ns,
+            latency_max_ns: latency.max_ns,
+            queue_wait_p50_ns: queue_wait.p50_ns,
+            queue_wait_p99_ns: queue_wait.p99_ns,
+            queue_wait_max_ns: queue_wait.max_ns,
+            perf_samples: m.perf.samples,
+            cycles: m.perf.cycles,
+            instructions: m.perf.instructions,
+            cache_misses: m.perf.cache_misses,
+            branch_misses: m.perf.branch_misses,
+        }
+    }
+}
+
+/// Get a snapshot of cumulative runtime statistics.
+///
+/// Can be called while a run is in progress.
+///
+/// # Safety
+/// Runtime handle and out_stats must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_stats(
+    runtime: RuntimeHandle,
+    out_stats: *mut CRuntimeStats,
+) -> SaxsStatus {
+    if runtime.is_null() || out_stats.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let rt = &*runtime;
+    let metrics = rt.metrics();
+    let mut stats = CRuntimeStats {
+        completed: rt.completed_count(),
+        pending: rt.pending_count(),
+        worker_count: metrics.workers.len(),
+        ..Default::default()
+    };
+    for (out, stage) in stats.stages.iter_mut().zip(metrics.stages.iter()) {
+        *out = CStageStats::from(stage);
+    }
+    for worker in &metrics.workers {
+        stats.busy_ns += nanos(worker.busy);
+        stats.idle_ns += nanos(worker.idle);
+        stats.scheduler_wait_ns += nanos(worker.scheduler_wait);
+    }
+    for (out, lock) in stats.locks.iter_mut().zip(metrics.locks.iter()) {
+        *out = CLockStats {
+            acquisitions: lock.acquisitions,
+            contended: lock.contended,
+            wait_ns: nanos(lock.wait),
+            hold_ns: nanos(lock.hold),
+        };
+    }
+    *out_stats = stats;
+    SaxsStatus::Ok
+}
+
+/// Get per-worker time accounting.
+///
+/// Writes up to `capacity` entries; `out_count` receives the number of
+/// workers.
+///
+/// # Safety
+/// Runtime handle must be valid; out_workers must have `capacity` elements.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_worker_stats(
+    runtime: RuntimeHandle,
+    out_workers: *mut CWorkerStats,
+    capacity: usize,
+    out_count: *mut usize,
+) -> SaxsStatus {
+    if runtime.is_null() || out_count.is_null() || (out_workers.is_null() && capacity > 0) {
+        return SaxsStatus::NullPointer;
+    }
+
+    let metrics = (*runtime).metrics();
+    for (i, worker) in metrics.workers.iter().take(capacity).enumerate() {
+        *out_workers.add(i) = CWorkerStats {
+            executions: worker.executions,
+            busy_ns: nanos(worker.busy),
+            idle_ns: nanos(worker.idle),
+            scheduler_wait_ns: nanos(worker.scheduler_wait),
+        };
+    }
+    *out_count = metrics.workers.len();
+    SaxsStatus::Ok
+}
+
+/// Enable or disable lock contention statistics.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_lock_stats(
+    runtime: RuntimeHandle,
+    enabled: bool,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    (*runtime).set_lock_stats(enabled);
+    SaxsStatus::Ok
+}
+
+/// Enable or disable per-stage hardware performance counters (Linux).
+///
+/// `out_available` (optional) receives whether counters could be opened;
+/// runs proceed without them if not.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_perf_counters(
+    runtime: RuntimeHandle,
+    enabled: bool,
+    out_available: *mut bool,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let available = (*runtime).set_perf_counters(enabled);
+    if !out_available.is_null() {
+        *out_available = available;
+    }
+    SaxsStatus::Ok
+}
+
+/// Get bytes held per sample location with high-water marks for the
+/// current batch.
+///
+/// # Safety
+/// Runtime handle and out_stats must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_memory_stats(
+    runtime: RuntimeHandle,
+    out_stats: *mut CMemoryStats,
+) -> SaxsStatus {
+    if runtime.is_null() || out_stats.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let stats = (*runtime).memory_stats();
+    let mut out = CMemoryStats {
+        total_bytes: stats.total_bytes,
+        peak_total_bytes: stats.peak_total_bytes,
+        ..Default::default()
+    };
+    for (dst, src) in out.locations.iter_mut().zip(stats.locations.iter()) {
+        *dst = CMemoryLocationStats {
+            samples: src.current.samples,
+            array_bytes: src.current.array_bytes,
+            metadata_bytes: src.current.metadata_bytes,
+            peak_bytes: src.peak_bytes,
+        };
+    }
+    *out_stats = out;
+    SaxsStatus::Ok
+}
+
+/// Throttle run_async progress callbacks to at most one per `interval_ms`,
+/// delivered from a timer thread instead of the workers. 0 restores one
+/// callback per completed sample.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_progress_interval(
+    runtime: RuntimeHandle,
+    interval_ms: u64,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let interval = (interval_ms > 0).then(|| std::time::Duration::from_millis(interval_ms));
+    (*runtime).set_progress_interval(interval);
+    SaxsStatus::Ok
+}
+
+/// Make run_sync output independent of worker count and timing: results
+/// are committed in waves ordered by sample index.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_deterministic(
+    runtime: RuntimeHandle,
+    deterministic: bool,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    (*runtime).set_deterministic(deterministic);
+    SaxsStatus::Ok
+}
+
+/// Run stages of run_sync in `workers` forked processes sharing sample
+/// buffers through shared memory (Linux); 0 returns to worker threads.
+/// Crashed workers are restarted and their items requeued.
+///
+/// `out_available` (optional) receives whether the mode is supported;
+/// runs keep using threads if not.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_set_process_workers(
+    runtime: RuntimeHandle,
+    workers: u32,
+    out_available: *mut bool,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let config = (workers > 0).then(|| ProcessConfig::new(workers as usize));
+    let available = (*runtime).set_process_workers(config);
+    if !out_available.is_null() {
+        *out_available = available;
+    }
+    SaxsStatus::Ok
+}
+
+/// Enable or disable series mode: frames tagged with
+/// saxs_sample_set_series seed peak detection and fits from the previous
+/// frame of their series. Enabling again starts a fresh history.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_series(
+    runtime: RuntimeHandle,
+    enabled: bool,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    if enabled {
+        (*runtime).enable_series(SeriesConfig::default());
+    } else {
+        (*runtime).disable_series();
+    }
+    SaxsStatus::Ok
+}
+
+/// Enable series mode with peak tracking: completed frames are associated
+/// into per-reflection tracks and detection also searches the tracks'
+/// predicted positions.
+///
+/// `gate` is the largest association distance in indices (<= 0 keeps the
+/// default); a track ends after `max_missed` frames without a peak.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_tracking(
+    runtime: RuntimeHandle,
+    gate: f64,
+    max_missed: u32,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let mut tracking = TrackerConfig {
+        max_missed: max_missed as u64,
+        ..Default::default()
+    };
+    if gate > 0.0 {
+        tracking.gate = gate;
+    }
+    (*runtime).enable_series(SeriesConfig {
+        tracking: Some(tracking),
+        ..Default::default()
+    });
+    SaxsStatus::Ok
+}
+
+/// Export points of tracks with at least `min_length` points as columns.
+///
+/// # Safety
+/// Runtime handle and out_columns must be valid.
+/// Caller must free the result with `saxs_track_columns_free`.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_track_columns(
+    runtime: RuntimeHandle,
+    min_length: usize,
+    out_columns: *mut CTrackColumns,
+) -> SaxsStatus {
+    if runtime.is_null() || out_columns.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let Some(store) = (*runtime).series_store() else {
+        return SaxsStatus::NotFound;
+    };
+    *out_columns = CTrackColumns::from_columns(store.track_columns(min_length));
+    SaxsStatus::Ok
+}
+
+/// Free track columns.
+///
+/// # Safety
+/// Columns must have been filled by saxs_runtime_track_columns or be zeroed.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_track_columns_free(columns: *mut CTrackColumns) {
+    if columns.is_null() {
+        return;
+    }
+    (*columns).free();
+}
+
+/// Get series mode counters.
+///
+/// # Safety
+/// Runtime handle and out_stats must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_series_stats(
+    runtime: RuntimeHandle,
+    out_stats: *mut CSeriesStats,
+) -> SaxsStatus {
+    if runtime.is_null() || out_stats.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+
+    let stats = match (*runtime).series_store() {
+        Some(store) => store.stats(),
+        None => return SaxsStatus::NotFound,
+    };
+    *out_stats = CSeriesStats {
+        warm_searches: stats.warm_searches,
+        full_searches: stats.full_searches,
+        warm_fits: stats.warm_fits,
+        cold_fits: stats.cold_fits,
+        fallbacks: stats.fallbacks,
+        fit_iterations: stats.fit_iterations,
+    };
+    SaxsStatus::Ok
+}
+
+/// Enable preview mode for saxs_runtime_run_async: profiles of at least
+/// `min_points` points are first processed decimated to the minimum and
+/// maximum of every `bucket` points and delivered to the sample callback
+/// with saxs_sample_is_provisional set, then refined at full resolution
+/// around the preview's peaks. The refined sample supersedes the preview.
+/// `bucket` 0 disables preview mode; `min_points` 0 keeps the default.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_enable_preview(
+    runtime: RuntimeHandle,
+    bucket: usize,
+    min_points: usize,
+) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    if bucket == 0 {
+        (*runtime).disable_preview();
+        return SaxsStatus::Ok;
+    }
+    let mut config = PreviewConfig::new(bucket);
+    if min_points > 0 {
+        config.min_points = min_points;
+    }
+    (*runtime).enable_preview(config);
+    SaxsStatus::Ok
+}
+
+/// Get progress of the current or last batch. Safe to call while
+/// run_async is processing.
+///
+/// # Safety
+/// Runtime handle and out_progress must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_progress(
+    runtime: RuntimeHandle,
+    out_progress: *mut CProgress,
+) -> SaxsStatus {
+    if runtime.is_null() || out_progress.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    let p = (*runtime).progress();
+    *out_progress = CProgress {
+        total: p.total,
+        completed: p.completed,
+        stage_results: p.stage_results,
+        at_stage: p.at_stage,
+        elapsed_ns: nanos(p.elapsed),
+        throughput: p.throughput,
+        eta_ns: p.eta.map_or(u64::MAX, nanos),
+    };
+    SaxsStatus::Ok
+}
+
+/// Clear cumulative runtime statistics.
+///
+/// # Safety
+/// Runtime handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_runtime_reset_stats(runtime: RuntimeHandle) -> SaxsStatus {
+    if runtime.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    (*runtime).reset_metrics();
+    SaxsStatus::Ok
+}
+
 /// Collect completed samples at or above a minimum stage.
 ///
 /// # Safety
@@ -231,6 +963,7 @@ pub unsafe extern "C" fn saxs_runtime_regroup(
 
     let count = samples.len().min(max_count);
     for (i, sample) in samples.into_iter().take(count).enumerate() {
+        ffi_handle_created(&sample);
         *out_handles.add(i) = Box::into_raw(Box::new(sample));
     }
 
@@ -1,7 +1,8 @@
 //! FFI functions for Sample manipulation.
 
 use super::types::{CArrayView, CPeakArray, SaxsStatus};
-use crate::data::{find_peaks, Sample};
+use crate::data::{find_peaks, Sample, SeriesFrame};
+use crate::runtime::memory::{ffi_handle_created, ffi_handle_released};
 use std::ffi::{c_char, CStr};
 
 /// Opaque handle to a Sample.
@@ -40,6 +41,7 @@ pub unsafe extern "C" fn saxs_sample_create(
 
     match Sample::new(id_str, q, i, e) {
         Ok(sample) => {
+            ffi_handle_created(&sample);
             let boxed = Box::new(sample);
             *out_handle = Box::into_raw(boxed);
             SaxsStatus::Ok
@@ -55,7 +57,9 @@ pub unsafe extern "C" fn saxs_sample_create(
 #[no_mangle]
 pub unsafe extern "C" fn saxs_sample_free(handle: SampleHandle) {
     if !handle.is_null() {
-        drop(Box::from_raw(handle));
+        let sample = Box::from_raw(handle);
+        ffi_handle_released(&sample);
+        drop(sample);
     }
 }
 
@@ -118,6 +122,33 @@ pub unsafe extern "C" fn saxs_sample_get_stage(handle: SampleHandle) -> u32 {
     (*handle).stage_num
 }
 
+/// Tag a sample as frame `frame` of time series `series`.
+///
+/// # Safety
+/// Handle must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_sample_set_series(
+    handle: SampleHandle,
+    series: u64,
+    frame: u64,
+) -> SaxsStatus {
+    if handle.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    (*handle).metadata.series = Some(SeriesFrame { series, frame });
+    SaxsStatus::Ok
+}
+
+/// Whether the sample is a decimated preview result that a full-resolution
+/// result of the same id will supersede.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_sample_is_provisional(handle: SampleHandle) -> bool {
+    if handle.is_null() {
+        return false;
+    }
+    (*handle).metadata.provisional
+}
+
 /// Get intensity array view.
 ///
 /// # Safety
@@ -0,0 +1,228 @@
+//! FFI functions for synthetic profile generation.
+
+use super::runtime::RuntimeHandle;
+use super::sample::SampleHandle;
+use super::types::SaxsStatus;
+use crate::data::synthetic::{
+    generate, generate_batch, Background, BraggPeaks, FormFactor, Lattice, Noise, SyntheticConfig,
+};
+use crate::runtime::memory::ffi_handle_created;
+
+/// Form factor selector for `CSyntheticConfig`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CFormFactor {
+    NoFormFactor = 0,
+    Sphere = 1,
+    Guinier = 2,
+}
+
+/// Lattice selector for `CSyntheticConfig`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CLattice {
+    NoLattice = 0,
+    Lamellar = 1,
+    Hexagonal = 2,
+    SimpleCubic = 3,
+    BodyCentredCubic = 4,
+    FaceCentredCubic = 5,
+}
+
+/// Noise model selector for `CSyntheticConfig`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CNoise {
+    NoNoise = 0,
+    GaussianNoise = 1,
+    PoissonNoise = 2,
+}
+
+/// Flat configuration for synthetic profiles (one lattice).
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct CSyntheticConfig {
+    pub points: usize,
+    pub q_min: f64,
+    pub q_max: f64,
+    pub log_q: bool,
+    pub background_amplitude: f64,
+    pub background_exponent: f64,
+    pub background_constant: f64,
+    pub form_factor: CFormFactor,
+    /// Sphere radius or radius of gyration.
+    pub form_factor_size: f64,
+    pub form_factor_scale: f64,
+    pub lattice: CLattice,
+    pub d_spacing: f64,
+    pub peak_amplitude: f64,
+    pub peak_width: f64,
+    pub peak_orders: usize,
+    pub d_jitter: f64,
+    pub noise: CNoise,
+    /// Relative sigma (Gaussian) or counts per unit intensity (Poisson).
+    pub noise_level: f64,
+    pub zinger_probability: f64,
+    pub zinger_amplitude: f64,
+}
+
+impl Default for CSyntheticConfig {
+    fn default() -> Self {
+        let d = SyntheticConfig::default();
+        let peaks = &d.peaks[0];
+        Self {
+            points: d.points,
+            q_min: d.q_min,
+            q_max: d.q_max,
+            log_q: d.log_q,
+            background_amplitude: d.background.amplitude,
+            background_exponent: d.background.exponent,
+            background_constant: d.background.constant,
+            form_factor: CFormFactor::NoFormFactor,
+            form_factor_size: 0.0,
+            form_factor_scale: 0.0,
+            lattice: CLattice::Lamellar,
+            d_spacing: peaks.d_spacing,
+            peak_amplitude: peaks.amplitude,
+            peak_width: peaks.width,
+            peak_orders: peaks.orders,
+            d_jitter: d.d_jitter,
+            noise: CNoise::PoissonNoise,
+            noise_level: 100.0,
+            zinger_probability: d.zinger_probability,
+            zinger_amplitude: d.zinger_amplitude,
+        }
+    }
+}
+
+impl From<&CSyntheticConfig> for SyntheticConfig {
+    fn from(c: &CSyntheticConfig) -> Self {
+        let lattice = match c.lattice {
+            CLattice::NoLattice => None,
+            CLattice::Lamellar => Some(Lattice::Lamellar),
+            CLattice::Hexagonal => Some(Lattice::Hexagonal),
+            CLattice::SimpleCubic => Some(Lattice::SimpleCubic),
+            CLattice::BodyCentredCubic => Some(Lattice::BodyCentredCubic),
+            CLattice::FaceCentredCubic => Some(Lattice::FaceCentredCubic),
+        };
+        SyntheticConfig {
+            points: c.points,
+            q_min: c.q_min,
+            q_max: c.q_max,
+            log_q: c.log_q,
+            background: Background {
+                amplitude: c.background_amplitude,
+                exponent: c.background_exponent,
+                constant: c.background_constant,
+            },
+            form_factor: match c.form_factor {
+                CFormFactor::NoFormFactor => FormFactor::None,
+                CFormFactor::Sphere => FormFactor::Sphere {
+                    radius: c.form_factor_size,
+                    scale: c.form_factor_scale,
+                },
+                CFormFactor::Guinier => FormFactor::Guinier {
+                    rg: c.form_factor_size,
+                    scale: c.form_factor_scale,
+                },
+            },
+            peaks: lattice
+                .map(|lattice| BraggPeaks {
+                    lattice,
+                    d_spacing: c.d_spacing,
+                    amplitude: c.peak_amplitude,
+                    width: c.peak_width,
+                    orders: c.peak_orders,
+                })
+                .into_iter()
+                .collect(),
+            d_jitter: c.d_jitter,
+            noise: match c.noise {
+                CNoise::NoNoise => Noise::None,
+                CNoise::GaussianNoise => Noise::Gaussian {
+                    relative: c.noise_level,
+                },
+                CNoise::PoissonNoise => Noise::Poisson {
+                    counts_per_unit: c.noise_level,
+                },
+            },
+            zinger_probability: c.zinger_probability,
+            zinger_amplitude: c.zinger_amplitude,
+        }
+    }
+}
+
+fn validate(config: &CSyntheticConfig) -> bool {
+    let lattice_ok = config.lattice == CLattice::NoLattice
+        || (config.d_spacing > 0.0 && config.peak_width > 0.0);
+    let noise_ok = config.noise != CNoise::PoissonNoise || config.noise_level > 0.0;
+    config.points > 0
+        && config.q_min > 0.0
+        && config.q_max >= config.q_min
+        && lattice_ok
+        && noise_ok
+}
+
+/// Fill `out_config` with the default synthetic configuration.
+///
+/// # Safety
+/// out_config must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_synthetic_default_config(
+    out_config: *mut CSyntheticConfig,
+) -> SaxsStatus {
+    if out_config.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    *out_config = CSyntheticConfig::default();
+    SaxsStatus::Ok
+}
+
+/// Generate synthetic profile `index` for `seed` as a new sample.
+///
+/// # Safety
+/// config and out_handle must be valid. Free the sample with saxs_sample_free.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_synthetic_generate(
+    config: *const CSyntheticConfig,
+    seed: u64,
+    index: u64,
+    out_handle: *mut SampleHandle,
+) -> SaxsStatus {
+    if config.is_null() || out_handle.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    if !validate(&*config) {
+        return SaxsStatus::InvalidArgument;
+    }
+
+    let sample = generate(&SyntheticConfig::from(&*config), seed, index);
+    ffi_handle_created(&sample);
+    *out_handle = Box::into_raw(Box::new(sample));
+    SaxsStatus::Ok
+}
+
+/// Generate profiles `first..first + count` in parallel and add them to the
+/// runtime batch.
+///
+/// # Safety
+/// runtime and config must be valid.
+#[no_mangle]
+pub unsafe extern "C" fn saxs_synthetic_add_to_runtime(
+    runtime: RuntimeHandle,
+    config: *const CSyntheticConfig,
+    seed: u64,
+    first: u64,
+    count: usize,
+) -> SaxsStatus {
+    if runtime.is_null() || config.is_null() {
+        return SaxsStatus::NullPointer;
+    }
+    if !validate(&*config) {
+        return SaxsStatus::InvalidArgument;
+    }
+
+    let samples = generate_batch(&SyntheticConfig::from(&*config), seed, first, count);
+    (*runtime).add_samples(samples);
+    SaxsStatus::Ok
+}
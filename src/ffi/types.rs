@@ -78,6 +78,214 @@ impl CPeakArray {
     }
 }
 
+/// C-compatible compression counters for idle samples.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CCompressionStats {
+    /// Samples compressed.
+    pub compressed_samples: usize,
+    /// Samples decompressed.
+    pub decompressed_samples: usize,
+    /// Uncompressed array bytes of all compressed samples.
+    pub raw_bytes: u64,
+    /// Compressed array bytes of all compressed samples.
+    pub compressed_bytes: u64,
+    /// Time spent compressing (nanoseconds).
+    pub compress_ns: u64,
+    /// Time spent decompressing (nanoseconds).
+    pub decompress_ns: u64,
+}
+
+/// C-compatible result cache counters.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CCacheStats {
+    /// Stages served from the cache.
+    pub stage_hits: u64,
+    /// Stages that had to be executed.
+    pub stage_misses: u64,
+    /// Whole pipelines served from the cache.
+    pub pipeline_hits: u64,
+    /// Pipelines that had to be executed.
+    pub pipeline_misses: u64,
+    /// Hits read from the on-disk store.
+    pub disk_hits: u64,
+    /// Entries evicted from memory.
+    pub evictions: u64,
+    /// Approximate bytes held in memory.
+    pub bytes: usize,
+}
+
+/// C-compatible series mode counters.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CSeriesStats {
+    /// Detections restricted to windows from an earlier frame.
+    pub warm_searches: u64,
+    /// Detections over the full profile.
+    pub full_searches: u64,
+    /// Fits seeded from an earlier frame.
+    pub warm_fits: u64,
+    /// Fits started from a parabola estimate.
+    pub cold_fits: u64,
+    /// Warm fits redone cold because their residual grew.
+    pub fallbacks: u64,
+    /// Gaussian refinement iterations over all fits.
+    pub fit_iterations: u64,
+}
+
+/// C-compatible track points as parallel arrays of `len` elements, one row
+/// per point, ordered by track id and frame.
+#[repr(C)]
+pub struct CTrackColumns {
+    pub track: *mut u64,
+    pub series: *mut u64,
+    pub frame: *mut u64,
+    pub index: *mut usize,
+    pub q: *mut f64,
+    pub amplitude: *mut f64,
+    pub len: usize,
+}
+
+impl CTrackColumns {
+    /// Take ownership of exported columns.
+    pub fn from_columns(columns: crate::series::TrackColumns) -> Self {
+        fn leak<T>(v: Vec<T>) -> *mut T {
+            Box::into_raw(v.into_boxed_slice()) as *mut T
+        }
+        Self {
+            len: columns.len(),
+            track: leak(columns.track),
+            series: leak(columns.series),
+            frame: leak(columns.frame),
+            index: leak(columns.index),
+            q: leak(columns.q),
+            amplitude: leak(columns.amplitude),
+        }
+    }
+
+    /// Free arrays created by `from_columns` and zero the struct.
+    ///
+    /// # Safety
+    /// The struct must come from `from_columns` or be zeroed.
+    pub unsafe fn free(&mut self) {
+        unsafe fn drop_array<T>(ptr: &mut *mut T, len: usize) {
+            if !ptr.is_null() {
+                drop(Box::from_raw(std::ptr::slice_from_raw_parts_mut(*ptr, len)));
+            }
+            *ptr = std::ptr::null_mut();
+        }
+        drop_array(&mut self.track, self.len);
+        drop_array(&mut self.series, self.len);
+        drop_array(&mut self.frame, self.len);
+        drop_array(&mut self.index, self.len);
+        drop_array(&mut self.q, self.len);
+        drop_array(&mut self.amplitude, self.len);
+        self.len = 0;
+    }
+}
+
+/// C-compatible per-stage counters and latency percentiles (nanoseconds).
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CStageStats {
+    pub executions: u64,
+    pub requeues: u64,
+    pub rejections: u64,
+    pub latency_mean_ns: u64,
+    pub latency_p50_ns: u64,
+    pub latency_p90_ns: u64,
+    pub latency_p99_ns: u64,
+    pub latency_max_ns: u64,
+    pub queue_wait_p50_ns: u64,
+    pub queue_wait_p99_ns: u64,
+    pub queue_wait_max_ns: u64,
+    /// Executions with hardware counters; see saxs_runtime_set_perf_counters.
+    pub perf_samples: u64,
+    pub cycles: u64,
+    pub instructions: u64,
+    pub cache_misses: u64,
+    pub branch_misses: u64,
+}
+
+/// C-compatible runtime statistics snapshot.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CRuntimeStats {
+    /// Indexed by stage id.
+    pub stages: [CStageStats; 6],
+    pub completed: usize,
+    pub pending: usize,
+    /// Number of worker shards; see saxs_runtime_worker_stats.
+    pub worker_count: usize,
+    pub busy_ns: u64,
+    pub idle_ns: u64,
+    pub scheduler_wait_ns: u64,
+    /// Scheduler, regroup pool and completed-list locks, in that order.
+    /// Zero unless enabled with saxs_runtime_set_lock_stats.
+    pub locks: [CLockStats; 3],
+}
+
+/// C-compatible lock contention statistics.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CLockStats {
+    pub acquisitions: u64,
+    pub contended: u64,
+    pub wait_ns: u64,
+    pub hold_ns: u64,
+}
+
+/// C-compatible per-worker time accounting.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CWorkerStats {
+    pub executions: u64,
+    pub busy_ns: u64,
+    pub idle_ns: u64,
+    pub scheduler_wait_ns: u64,
+}
+
+/// C-compatible bytes held at one sample location.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CMemoryLocationStats {
+    pub samples: u64,
+    pub array_bytes: u64,
+    pub metadata_bytes: u64,
+    /// High-water mark of array plus metadata bytes in the current batch.
+    pub peak_bytes: u64,
+}
+
+/// C-compatible memory accounting snapshot.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CMemoryStats {
+    /// Pending, queued, in flight, regroup pool, completed and FFI-owned
+    /// handles, in that order. The FFI entry is process-wide.
+    pub locations: [CMemoryLocationStats; 6],
+    /// Bytes held by the runtime (FFI handles excluded).
+    pub total_bytes: u64,
+    pub peak_total_bytes: u64,
+}
+
+/// C-compatible batch progress snapshot.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CProgress {
+    pub total: u64,
+    pub completed: u64,
+    pub stage_results: u64,
+    /// Stage results by the stage_num they reached; the last entry
+    /// collects higher stages.
+    pub at_stage: [u64; 16],
+    pub elapsed_ns: u64,
+    /// Completed samples per second.
+    pub throughput: f64,
+    /// Estimated time to completion; UINT64_MAX while unknown.
+    pub eta_ns: u64,
+}
+
 /// Callback function type for completion notifications.
 ///
 /// # Arguments
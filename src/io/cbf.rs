@@ -0,0 +1,237 @@
+//! Crystallographic Binary File (CBF) reader for byte-offset compressed
+//! images, as written by Pilatus and Eiger detectors.
+//!
+//! Byte-offset data stores each pixel as the difference to the previous
+//! one: a signed byte, or an escape (`0x80`) followed by a wider integer.
+//! Almost all deltas fit in one byte, so the decoder checks eight bytes at
+//! a time for escapes and, when there are none, adds all eight deltas with
+//! a branch-free prefix sum.
+
+use super::frame::{Frame, FramePool, PixelData};
+use super::{frame_len, header_usize, FrameError};
+use std::collections::HashMap;
+
+const BINARY_SECTION: &[u8] = b"--CIF-BINARY-FORMAT-SECTION--";
+const BINARY_START: [u8; 4] = [0x0c, 0x1a, 0x04, 0xd5];
+
+const LO_BITS: u64 = 0x0101_0101_0101_0101;
+const HI_BITS: u64 = 0x8080_8080_8080_8080;
+
+fn find(haystack: &[u8], needle: &[u8]) -> Option<usize> {
+    haystack.windows(needle.len()).position(|w| w == needle)
+}
+
+/// Check whether any byte of `word` is the escape byte `0x80`.
+#[inline]
+fn has_escape(word: u64) -> bool {
+    let x = word ^ HI_BITS;
+    (x.wrapping_sub(LO_BITS) & !x & HI_BITS) != 0
+}
+
+/// Decode byte-offset compressed data into `out`, reading `count` pixels.
+pub fn decode_byte_offset(src: &[u8], count: usize, out: &mut Vec<i32>) -> Result<(), FrameError> {
+    out.reserve(count);
+    let end = out.len() + count;
+    let mut value: i32 = 0;
+    let mut pos = 0;
+
+    while out.len() < end {
+        if pos + 8 <= src.len() && out.len() + 8 <= end {
+            let word = u64::from_le_bytes(src[pos..pos + 8].try_into().unwrap());
+            if !has_escape(word) {
+                let bytes = word.to_le_bytes();
+                let mut d = [0i32; 8];
+                for k in 0..8 {
+                    d[k] = bytes[k] as i8 as i32;
+                }
+                // Inclusive prefix sum in log2(8) steps.
+                for shift in [1, 2, 4] {
+                    for k in (shift..8).rev() {
+                        d[k] = d[k].wrapping_add(d[k - shift]);
+                    }
+                }
+                for x in d.iter_mut() {
+                    *x = x.wrapping_add(value);
+                }
+                value = d[7];
+                out.extend_from_slice(&d);
+                pos += 8;
+                continue;
+            }
+        }
+
+        let mut read = |n: usize| -> Result<&[u8], FrameError> {
+            let bytes = src.get(pos..pos + n).ok_or(FrameError::Truncated)?;
+            pos += n;
+            Ok(bytes)
+        };
+
+        let mut delta = read(1)?[0] as i8 as i64;
+        if delta == i8::MIN as i64 {
+            delta = i16::from_le_bytes(read(2)?.try_into().unwrap()) as i64;
+            if delta == i16::MIN as i64 {
+                delta = i32::from_le_bytes(read(4)?.try_into().unwrap()) as i64;
+                if delta == i32::MIN as i64 {
+                    delta = i64::from_le_bytes(read(8)?.try_into().unwrap());
+                }
+            }
+        }
+        value = value.wrapping_add(delta as i32);
+        out.push(value);
+    }
+
+    Ok(())
+}
+
+/// Decode a CBF frame.
+pub fn decode(data: &[u8], pool: &FramePool) -> Result<Frame, FrameError> {
+    let section = find(data, BINARY_SECTION)
+        .ok_or_else(|| FrameError::InvalidHeader("missing binary section".into()))?;
+    let start = find(&data[section..], &BINARY_START)
+        .map(|p| section + p)
+        .ok_or_else(|| FrameError::InvalidHeader("missing binary start marker".into()))?;
+
+    let text = String::from_utf8_lossy(&data[section + BINARY_SECTION.len()..start]);
+    let mut header: HashMap<String, String> = HashMap::new();
+    let mut last_key: Option<String> = None;
+    for line in text.lines() {
+        // MIME continuation lines start with whitespace.
+        if line.starts_with([' ', '\t']) {
+            if let Some(value) = last_key.as_ref().and_then(|k| header.get_mut(k)) {
+                value.push(' ');
+                value.push_str(line.trim());
+            }
+        } else if let Some((key, value)) = line.split_once(':') {
+            let key = key.trim().to_string();
+            header.insert(key.clone(), value.trim().to_string());
+            last_key = Some(key);
+        }
+    }
+
+    let content_type = header.get("Content-Type").map(String::as_str).unwrap_or("");
+    if !content_type.contains("x-CBF_BYTE_OFFSET") {
+        return Err(FrameError::Unsupported(format!(
+            "CBF conversion {}",
+            content_type
+        )));
+    }
+
+    let width = header_usize(&header, "X-Binary-Size-Fastest-Dimension")?;
+    let height = header_usize(&header, "X-Binary-Size-Second-Dimension")?;
+    let body = &data[start + BINARY_START.len()..];
+    let body = match header_usize(&header, "X-Binary-Size") {
+        Ok(size) => body.get(..size).ok_or(FrameError::Truncated)?,
+        Err(_) => body,
+    };
+
+    // Byte offset spends at least one byte per pixel, so a body shorter than
+    // the pixel count is truncated; reject it before sizing the buffer.
+    let count = frame_len(width, height, 1)?;
+    if body.len() < count {
+        return Err(FrameError::Truncated);
+    }
+
+    let mut pixels = pool.take_i32(count);
+    decode_byte_offset(body, count, &mut pixels)?;
+
+    Ok(Frame {
+        width,
+        height,
+        data: PixelData::I32(pixels),
+        header,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn encode_byte_offset(values: &[i32]) -> Vec<u8> {
+        let mut out = Vec::new();
+        let mut prev = 0i64;
+        for &v in values {
+            let delta = v as i64 - prev;
+            prev = v as i64;
+            if delta.abs() < 128 {
+                out.push(delta as i8 as u8);
+            } else if delta.abs() < 32768 {
+                out.push(0x80);
+                out.extend_from_slice(&(delta as i16).to_le_bytes());
+            } else {
+                out.push(0x80);
+                out.extend_from_slice(&i16::MIN.to_le_bytes());
+                out.extend_from_slice(&(delta as i32).to_le_bytes());
+            }
+        }
+        out
+    }
+
+    fn make_cbf(width: usize, height: usize, values: &[i32]) -> Vec<u8> {
+        let body = encode_byte_offset(values);
+        let mut out = format!(
+            "###CBF: VERSION 1.5\n\n_array_data.data\n;\n{}\n\
+             Content-Type: application/octet-stream;\n     conversions=\"x-CBF_BYTE_OFFSET\"\n\
+             X-Binary-Size: {}\nX-Binary-Element-Type: \"signed 32-bit integer\"\n\
+             X-Binary-Size-Fastest-Dimension: {}\nX-Binary-Size-Second-Dimension: {}\n\n",
+            std::str::from_utf8(BINARY_SECTION).unwrap(),
+            body.len(),
+            width,
+            height
+        )
+        .into_bytes();
+        out.extend_from_slice(&BINARY_START);
+        out.extend_from_slice(&body);
+        out.extend_from_slice(b"\n--CIF-BINARY-FORMAT-SECTION----\n;\n");
+        out
+    }
+
+    #[test]
+    fn test_escape_detection() {
+        assert!(!has_escape(0x7f7f_7f7f_0000_ffff));
+        assert!(has_escape(0x0000_0000_0080_0000));
+        assert!(has_escape(0x8000_0000_0000_0000));
+    }
+
+    #[test]
+    fn test_byte_offset_all_widths() {
+        let mut values = Vec::new();
+        for i in 0..1000 {
+            values.push((i % 50) - 20);
+        }
+        values.extend([1000, -30000, 5_000_000, -1, 0, i32::MAX, i32::MIN + 1, 3]);
+        for i in 0..37 {
+            values.push(i * 3);
+        }
+
+        let mut out = Vec::new();
+        decode_byte_offset(&encode_byte_offset(&values), values.len(), &mut out).unwrap();
+        assert_eq!(out, values);
+    }
+
+    #[test]
+    fn test_decode_cbf() {
+        let values: Vec<i32> = (0..24).map(|i| i * i * 10).collect();
+        let frame = decode(&make_cbf(6, 4, &values), &FramePool::new(1)).unwrap();
+        assert_eq!((frame.width, frame.height), (6, 4));
+        assert_eq!(frame.view().get(5, 3), (23 * 23 * 10) as f64);
+
+        let truncated = make_cbf(6, 4, &values);
+        let result = decode(&truncated[..truncated.len() - 60], &FramePool::new(1));
+        assert!(matches!(result, Err(FrameError::Truncated)));
+    }
+
+    #[test]
+    fn test_corrupt_cbf_dimensions() {
+        let values = [1, 2, 3, 4];
+        let pool = FramePool::new(1);
+
+        let overflow = make_cbf(usize::MAX / 2, 4, &values);
+        let result = decode(&overflow, &pool);
+        assert!(matches!(result, Err(FrameError::InvalidHeader(_))));
+
+        // 10^10 pixels from a four-byte body must fail before allocating.
+        let oversized = make_cbf(100_000, 100_000, &values);
+        let result = decode(&oversized, &pool);
+        assert!(matches!(result, Err(FrameError::Truncated)));
+    }
+}
@@ -0,0 +1,142 @@
+//! ESRF Data Format (EDF) reader.
+//!
+//! An EDF file is an ASCII header of `key = value ;` lines enclosed in
+//! braces, padded to a multiple of 512 bytes, followed by raw pixels.
+
+use super::frame::{Frame, FramePool, PixelType};
+use super::{frame_len, header_usize, FrameError};
+use std::collections::HashMap;
+
+fn pixel_type(name: &str) -> Result<PixelType, FrameError> {
+    match name {
+        "UnsignedByte" | "UnsignedChar" | "UnsignedInteger8" => Ok(PixelType::U8),
+        "UnsignedShort" | "UnsignedShortInteger" | "UnsignedInteger16" => Ok(PixelType::U16),
+        "UnsignedInteger" | "UnsignedLong" | "UnsignedInteger32" => Ok(PixelType::U32),
+        "SignedInteger" | "SignedLong" | "SignedInteger32" => Ok(PixelType::I32),
+        "FloatValue" | "Float" | "FloatIEEE32" | "Float32" => Ok(PixelType::F32),
+        other => Err(FrameError::Unsupported(format!("EDF DataType {}", other))),
+    }
+}
+
+/// Parse the header block, returning the key/value pairs and the offset
+/// of the first pixel byte.
+pub fn parse_header(data: &[u8]) -> Result<(HashMap<String, String>, usize), FrameError> {
+    let open = data
+        .iter()
+        .position(|&b| b == b'{')
+        .ok_or_else(|| FrameError::InvalidHeader("missing '{'".into()))?;
+    let close = data[open..]
+        .iter()
+        .position(|&b| b == b'}')
+        .map(|p| open + p)
+        .ok_or_else(|| FrameError::InvalidHeader("missing '}'".into()))?;
+
+    let text = std::str::from_utf8(&data[open + 1..close])
+        .map_err(|_| FrameError::InvalidHeader("header is not ASCII".into()))?;
+
+    let mut header = HashMap::new();
+    for entry in text.split(';') {
+        if let Some((key, value)) = entry.split_once('=') {
+            header.insert(key.trim().to_string(), value.trim().to_string());
+        }
+    }
+
+    // The closing brace is followed by a single newline.
+    let mut start = close + 1;
+    if data.get(start) == Some(&b'\n') {
+        start += 1;
+    }
+    Ok((header, start))
+}
+
+/// Decode an EDF frame.
+pub fn decode(data: &[u8], pool: &FramePool) -> Result<Frame, FrameError> {
+    let (header, start) = parse_header(data)?;
+
+    if let Some(compression) = header.get("Compression") {
+        if !compression.eq_ignore_ascii_case("None") {
+            return Err(FrameError::Unsupported(format!(
+                "EDF compression {}",
+                compression
+            )));
+        }
+    }
+
+    let width = header_usize(&header, "Dim_1")?;
+    let height = header_usize(&header, "Dim_2").unwrap_or(1);
+    let ty = pixel_type(
+        header
+            .get("DataType")
+            .ok_or_else(|| FrameError::InvalidHeader("missing DataType".into()))?,
+    )?;
+    let big_endian = header.get("ByteOrder").map(String::as_str) == Some("HighByteFirst");
+
+    let size = frame_len(width, height, ty.size())?;
+    let raw = start
+        .checked_add(size)
+        .and_then(|end| data.get(start..end))
+        .ok_or(FrameError::Truncated)?;
+    let pixels = pool.read_raw(raw, ty, big_endian);
+
+    Ok(Frame {
+        width,
+        height,
+        data: pixels,
+        header,
+    })
+}
+
+#[cfg(test)]
+pub(crate) mod tests {
+    use super::*;
+    use crate::io::PixelData;
+
+    /// Build a little-endian UnsignedShort EDF file.
+    pub(crate) fn make_edf(width: usize, height: usize, pixels: &[u16]) -> Vec<u8> {
+        let mut header = format!(
+            "{{\nHeaderID = EH:000001:000000:000000 ;\nByteOrder = LowByteFirst ;\n\
+             DataType = UnsignedShort ;\nDim_1 = {} ;\nDim_2 = {} ;\nSize = {} ;\n",
+            width,
+            height,
+            pixels.len() * 2
+        );
+        while (header.len() + 2) % 512 != 0 {
+            header.push(' ');
+        }
+        header.push_str("}\n");
+
+        let mut out = header.into_bytes();
+        for p in pixels {
+            out.extend_from_slice(&p.to_le_bytes());
+        }
+        out
+    }
+
+    #[test]
+    fn test_decode_edf() {
+        let data = make_edf(2, 2, &[1, 2, 3, 65535]);
+        assert_eq!(data.len(), 512 + 8);
+
+        let frame = decode(&data, &FramePool::new(1)).unwrap();
+        assert_eq!((frame.width, frame.height), (2, 2));
+        assert_eq!(frame.header.get("DataType").unwrap(), "UnsignedShort");
+        match frame.data {
+            PixelData::U16(v) => assert_eq!(v, vec![1, 2, 3, 65535]),
+            other => panic!("unexpected {:?}", other),
+        }
+    }
+
+    #[test]
+    fn test_truncated_edf() {
+        let data = make_edf(2, 2, &[1, 2, 3, 4]);
+        let result = decode(&data[..data.len() - 1], &FramePool::new(1));
+        assert!(matches!(result, Err(FrameError::Truncated)));
+    }
+
+    #[test]
+    fn test_corrupt_edf_dimensions() {
+        let data = make_edf(usize::MAX / 2, 4, &[1, 2, 3, 4]);
+        let result = decode(&data, &FramePool::new(1));
+        assert!(matches!(result, Err(FrameError::InvalidHeader(_))));
+    }
+}
@@ -0,0 +1,276 @@
+//! Detector frames, typed views and a reusable buffer pool.
+
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+/// Pixel storage of a decoded frame.
+#[derive(Clone, Debug)]
+pub enum PixelData {
+    U8(Vec<u8>),
+    U16(Vec<u16>),
+    U32(Vec<u32>),
+    I32(Vec<i32>),
+    F32(Vec<f32>),
+}
+
+impl PixelData {
+    /// Number of pixels.
+    pub fn len(&self) -> usize {
+        match self {
+            PixelData::U8(v) => v.len(),
+            PixelData::U16(v) => v.len(),
+            PixelData::U32(v) => v.len(),
+            PixelData::I32(v) => v.len(),
+            PixelData::F32(v) => v.len(),
+        }
+    }
+
+    /// Check if there are no pixels.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    fn capacity(&self) -> usize {
+        match self {
+            PixelData::U8(v) => v.capacity(),
+            PixelData::U16(v) => v.capacity(),
+            PixelData::U32(v) => v.capacity(),
+            PixelData::I32(v) => v.capacity(),
+            PixelData::F32(v) => v.capacity(),
+        }
+    }
+}
+
+/// Element type of raw pixel data.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum PixelType {
+    U8,
+    U16,
+    U32,
+    I32,
+    F32,
+}
+
+impl PixelType {
+    /// Size of one pixel in bytes.
+    pub fn size(self) -> usize {
+        match self {
+            PixelType::U8 => 1,
+            PixelType::U16 => 2,
+            PixelType::U32 | PixelType::I32 | PixelType::F32 => 4,
+        }
+    }
+}
+
+/// Borrowed pixels of a frame.
+#[derive(Clone, Copy, Debug)]
+pub enum PixelSlice<'a> {
+    U8(&'a [u8]),
+    U16(&'a [u16]),
+    U32(&'a [u32]),
+    I32(&'a [i32]),
+    F32(&'a [f32]),
+}
+
+/// A decoded 2D detector frame.
+#[derive(Clone, Debug)]
+pub struct Frame {
+    /// Fast (x) dimension.
+    pub width: usize,
+    /// Slow (y) dimension.
+    pub height: usize,
+    /// Pixel values in row-major order.
+    pub data: PixelData,
+    /// Header key/value pairs from the file.
+    pub header: HashMap<String, String>,
+}
+
+impl Frame {
+    /// Borrow the frame as a typed view.
+    pub fn view(&self) -> FrameView<'_> {
+        let pixels = match &self.data {
+            PixelData::U8(v) => PixelSlice::U8(v),
+            PixelData::U16(v) => PixelSlice::U16(v),
+            PixelData::U32(v) => PixelSlice::U32(v),
+            PixelData::I32(v) => PixelSlice::I32(v),
+            PixelData::F32(v) => PixelSlice::F32(v),
+        };
+        FrameView {
+            width: self.width,
+            height: self.height,
+            pixels,
+        }
+    }
+}
+
+/// A zero-copy view of a frame's pixels.
+#[derive(Clone, Copy, Debug)]
+pub struct FrameView<'a> {
+    pub width: usize,
+    pub height: usize,
+    pub pixels: PixelSlice<'a>,
+}
+
+impl<'a> FrameView<'a> {
+    /// Number of pixels.
+    pub fn len(&self) -> usize {
+        self.width * self.height
+    }
+
+    /// Check if the frame has no pixels.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Pixel value at (x, y) as f64.
+    #[inline]
+    pub fn get(&self, x: usize, y: usize) -> f64 {
+        let idx = y * self.width + x;
+        match self.pixels {
+            PixelSlice::U8(v) => v[idx] as f64,
+            PixelSlice::U16(v) => v[idx] as f64,
+            PixelSlice::U32(v) => v[idx] as f64,
+            PixelSlice::I32(v) => v[idx] as f64,
+            PixelSlice::F32(v) => v[idx] as f64,
+        }
+    }
+
+    /// Call `f(index, value)` for every pixel in row-major order.
+    pub fn for_each(&self, mut f: impl FnMut(usize, f64)) {
+        match self.pixels {
+            PixelSlice::U8(v) => v.iter().enumerate().for_each(|(i, &p)| f(i, p as f64)),
+            PixelSlice::U16(v) => v.iter().enumerate().for_each(|(i, &p)| f(i, p as f64)),
+            PixelSlice::U32(v) => v.iter().enumerate().for_each(|(i, &p)| f(i, p as f64)),
+            PixelSlice::I32(v) => v.iter().enumerate().for_each(|(i, &p)| f(i, p as f64)),
+            PixelSlice::F32(v) => v.iter().enumerate().for_each(|(i, &p)| f(i, p as f64)),
+        }
+    }
+}
+
+/// Pool of pixel buffers reused across decodes.
+///
+/// Frames of the same detector have the same size, so returning a frame's
+/// buffer after integration lets the next decode skip the allocation.
+#[derive(Debug, Default)]
+pub struct FramePool {
+    buffers: Mutex<Vec<PixelData>>,
+    max_buffers: usize,
+}
+
+macro_rules! pool_take {
+    ($name:ident, $variant:ident, $ty:ty) => {
+        /// Take a cleared buffer with capacity for at least `len` pixels.
+        pub fn $name(&self, len: usize) -> Vec<$ty> {
+            let mut buffers = self.buffers.lock().unwrap();
+            let found = buffers
+                .iter()
+                .position(|b| matches!(b, PixelData::$variant(_)) && b.capacity() >= len);
+            if let Some(pos) = found {
+                if let PixelData::$variant(mut v) = buffers.swap_remove(pos) {
+                    v.clear();
+                    return v;
+                }
+            }
+            Vec::with_capacity(len)
+        }
+    };
+}
+
+impl FramePool {
+    /// Create a pool that keeps at most `max_buffers` idle buffers.
+    pub fn new(max_buffers: usize) -> Self {
+        Self {
+            buffers: Mutex::new(Vec::new()),
+            max_buffers,
+        }
+    }
+
+    pool_take!(take_u8, U8, u8);
+    pool_take!(take_u16, U16, u16);
+    pool_take!(take_u32, U32, u32);
+    pool_take!(take_i32, I32, i32);
+    pool_take!(take_f32, F32, f32);
+
+    /// Convert raw pixel bytes into a pooled buffer.
+    pub fn read_raw(&self, raw: &[u8], pixel_type: PixelType, big_endian: bool) -> PixelData {
+        macro_rules! convert {
+            ($take:ident, $variant:ident, $ty:ty) => {{
+                const N: usize = std::mem::size_of::<$ty>();
+                let mut out = self.$take(raw.len() / N);
+                let chunks = raw.chunks_exact(N);
+                if big_endian {
+                    out.extend(chunks.map(|c| <$ty>::from_be_bytes(c.try_into().unwrap())));
+                } else {
+                    out.extend(chunks.map(|c| <$ty>::from_le_bytes(c.try_into().unwrap())));
+                }
+                PixelData::$variant(out)
+            }};
+        }
+
+        match pixel_type {
+            PixelType::U8 => {
+                let mut out = self.take_u8(raw.len());
+                out.extend_from_slice(raw);
+                PixelData::U8(out)
+            }
+            PixelType::U16 => convert!(take_u16, U16, u16),
+            PixelType::U32 => convert!(take_u32, U32, u32),
+            PixelType::I32 => convert!(take_i32, I32, i32),
+            PixelType::F32 => convert!(take_f32, F32, f32),
+        }
+    }
+
+    /// Return a frame's buffer to the pool.
+    pub fn recycle(&self, frame: Frame) {
+        let mut buffers = self.buffers.lock().unwrap();
+        if buffers.len() < self.max_buffers {
+            buffers.push(frame.data);
+        }
+    }
+
+    /// Number of idle buffers.
+    pub fn idle(&self) -> usize {
+        self.buffers.lock().unwrap().len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_pool_reuses_buffer() {
+        let pool = FramePool::new(4);
+        let mut pixels = pool.take_u16(16);
+        pixels.extend(0..16u16);
+        let ptr = pixels.as_ptr();
+
+        let frame = Frame {
+            width: 4,
+            height: 4,
+            data: PixelData::U16(pixels),
+            header: HashMap::new(),
+        };
+        assert_eq!(frame.view().get(1, 2), 9.0);
+        pool.recycle(frame);
+
+        assert!(pool.take_i32(16).capacity() >= 16);
+        assert_eq!(pool.idle(), 1);
+        let reused = pool.take_u16(16);
+        assert_eq!(reused.as_ptr(), ptr);
+        assert!(reused.is_empty());
+    }
+
+    #[test]
+    fn test_read_raw_byte_order() {
+        let pool = FramePool::new(1);
+        match pool.read_raw(&[0x01, 0x02, 0x03, 0x04], PixelType::U16, true) {
+            PixelData::U16(v) => assert_eq!(v, vec![0x0102, 0x0304]),
+            other => panic!("unexpected {:?}", other),
+        }
+        match pool.read_raw(&[0x01, 0x02, 0x03, 0x04], PixelType::I32, false) {
+            PixelData::I32(v) => assert_eq!(v, vec![0x04030201]),
+            other => panic!("unexpected {:?}", other),
+        }
+    }
+}
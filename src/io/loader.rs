@@ -0,0 +1,489 @@
+//! Batched file loader for large ingestion runs.
+//!
+//! On Linux the loader drives open, read and close for many files through
+//! one io_uring, keeping up to `depth` files in flight and reading into
+//! buffers registered with the kernel once. Where io_uring is unavailable
+//! (old kernels, seccomp-restricted containers, other platforms) it falls
+//! back to a pool of threads doing blocking reads.
+
+use super::profile::{parse_profile, ProfileError};
+use crate::data::Sample;
+use std::io;
+use std::path::Path;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc;
+
+/// Configuration for [`BatchLoader`].
+#[derive(Clone, Debug)]
+pub struct LoaderConfig {
+    /// Maximum number of files in flight.
+    pub depth: usize,
+    /// Size of each read buffer in bytes.
+    pub buffer_size: usize,
+    /// Worker threads for the fallback reader.
+    pub threads: usize,
+}
+
+impl Default for LoaderConfig {
+    fn default() -> Self {
+        Self {
+            depth: 64,
+            buffer_size: 64 * 1024,
+            threads: num_cpus::get(),
+        }
+    }
+}
+
+enum Backend {
+    #[cfg(target_os = "linux")]
+    Uring(uring_backend::UringLoader),
+    Threaded,
+}
+
+/// Loads many files with batched I/O.
+pub struct BatchLoader {
+    config: LoaderConfig,
+    backend: Backend,
+}
+
+impl BatchLoader {
+    /// Create a loader, using io_uring when the kernel supports it.
+    pub fn new(config: LoaderConfig) -> Self {
+        #[cfg(target_os = "linux")]
+        if let Ok(loader) = uring_backend::UringLoader::new(&config) {
+            return Self {
+                config,
+                backend: Backend::Uring(loader),
+            };
+        }
+        Self::threaded(config)
+    }
+
+    /// Create a loader that always uses the threaded reader.
+    pub fn threaded(config: LoaderConfig) -> Self {
+        Self {
+            config,
+            backend: Backend::Threaded,
+        }
+    }
+
+    /// Check whether the loader uses io_uring.
+    pub fn is_uring(&self) -> bool {
+        !matches!(self.backend, Backend::Threaded)
+    }
+
+    /// Read every file, calling `on_file(index, contents)` as each one
+    /// completes. Files complete in no particular order.
+    pub fn load<P, F>(&mut self, paths: &[P], mut on_file: F) -> io::Result<()>
+    where
+        P: AsRef<Path> + Sync,
+        F: FnMut(usize, io::Result<&[u8]>),
+    {
+        match &mut self.backend {
+            #[cfg(target_os = "linux")]
+            Backend::Uring(loader) => loader.load(paths, &mut on_file),
+            Backend::Threaded => {
+                load_threaded(paths, &self.config, &mut on_file);
+                Ok(())
+            }
+        }
+    }
+
+    /// Load and parse text profiles, returning results in path order.
+    ///
+    /// Sample ids are the file stems.
+    pub fn load_profiles<P: AsRef<Path> + Sync>(
+        &mut self,
+        paths: &[P],
+    ) -> io::Result<Vec<Result<Sample, ProfileError>>> {
+        let mut results: Vec<Option<Result<Sample, ProfileError>>> =
+            (0..paths.len()).map(|_| None).collect();
+
+        self.load(paths, |index, data| {
+            let path = paths[index].as_ref();
+            let id = path
+                .file_stem()
+                .map(|s| s.to_string_lossy().into_owned())
+                .unwrap_or_default();
+            results[index] = Some(match data {
+                Ok(data) => parse_profile(id, data),
+                Err(e) => Err(ProfileError::Io(e)),
+            });
+        })?;
+
+        Ok(results.into_iter().map(|r| r.unwrap()).collect())
+    }
+}
+
+fn load_threaded<P, F>(paths: &[P], config: &LoaderConfig, on_file: &mut F)
+where
+    P: AsRef<Path> + Sync,
+    F: FnMut(usize, io::Result<&[u8]>),
+{
+    let next = AtomicUsize::new(0);
+    let (tx, rx) = mpsc::sync_channel(config.depth.max(1));
+
+    std::thread::scope(|scope| {
+        for _ in 0..config.threads.max(1).min(paths.len()) {
+            let tx = tx.clone();
+            let next = &next;
+            scope.spawn(move || loop {
+                let index = next.fetch_add(1, Ordering::Relaxed);
+                if index >= paths.len() {
+                    break;
+                }
+                let result = std::fs::read(paths[index].as_ref());
+                if tx.send((index, result)).is_err() {
+                    break;
+                }
+            });
+        }
+        drop(tx);
+
+        for (index, result) in rx {
+            match result {
+                Ok(data) => on_file(index, Ok(&data)),
+                Err(e) => on_file(index, Err(e)),
+            }
+        }
+    });
+}
+
+#[cfg(target_os = "linux")]
+mod uring_backend {
+    use super::super::uring::{
+        Cqe, Ring, Sqe, IORING_OP_CLOSE, IORING_OP_OPENAT, IORING_OP_READ_FIXED,
+    };
+    use super::LoaderConfig;
+    use std::ffi::CString;
+    use std::io;
+    use std::os::unix::ffi::OsStrExt;
+    use std::path::Path;
+
+    #[derive(Clone, Copy, PartialEq)]
+    enum State {
+        Idle,
+        Opening,
+        Reading,
+        Closing,
+    }
+
+    struct Slot {
+        state: State,
+        index: usize,
+        path: CString,
+        fd: i32,
+        data: Vec<u8>,
+        error: Option<io::Error>,
+    }
+
+    pub struct UringLoader {
+        ring: Ring,
+        buffers: Vec<Box<[u8]>>,
+        slots: Vec<Slot>,
+    }
+
+    fn open_sqe(slot: usize, path: &CString) -> Sqe {
+        Sqe {
+            opcode: IORING_OP_OPENAT,
+            fd: libc::AT_FDCWD,
+            addr: path.as_ptr() as u64,
+            op_flags: (libc::O_RDONLY | libc::O_CLOEXEC) as u32,
+            user_data: slot as u64,
+            ..Default::default()
+        }
+    }
+
+    fn close_sqe(slot: usize, fd: i32) -> Sqe {
+        Sqe {
+            opcode: IORING_OP_CLOSE,
+            fd,
+            user_data: slot as u64,
+            ..Default::default()
+        }
+    }
+
+    impl UringLoader {
+        pub fn new(config: &LoaderConfig) -> io::Result<Self> {
+            let depth = config.depth.clamp(1, 4096);
+            let mut ring = Ring::new(depth as u32)?;
+            let mut buffers: Vec<Box<[u8]>> = (0..depth)
+                .map(|_| vec![0u8; config.buffer_size].into_boxed_slice())
+                .collect();
+            ring.register_buffers(&mut buffers)?;
+
+            // Kernels before 5.6 create rings but reject OPENAT.
+            let probe = CString::new(".").unwrap();
+            ring.push(open_sqe(0, &probe));
+            ring.submit_and_wait(1)?;
+            let cqe = ring
+                .pop()
+                .ok_or_else(|| io::Error::other("no completion"))?;
+            if cqe.res < 0 {
+                return Err(io::Error::from_raw_os_error(-cqe.res));
+            }
+            ring.push(close_sqe(0, cqe.res));
+            ring.submit_and_wait(1)?;
+            ring.pop();
+
+            let slots = (0..depth)
+                .map(|_| Slot {
+                    state: State::Idle,
+                    index: 0,
+                    path: CString::default(),
+                    fd: -1,
+                    data: Vec::new(),
+                    error: None,
+                })
+                .collect();
+
+            Ok(Self {
+                ring,
+                buffers,
+                slots,
+            })
+        }
+
+        fn read_sqe(&self, slot: usize) -> Sqe {
+            let buffer = &self.buffers[slot];
+            Sqe {
+                opcode: IORING_OP_READ_FIXED,
+                fd: self.slots[slot].fd,
+                off: self.slots[slot].data.len() as u64,
+                addr: buffer.as_ptr() as u64,
+                len: buffer.len() as u32,
+                user_data: slot as u64,
+                buf_index: slot as u16,
+                ..Default::default()
+            }
+        }
+
+        fn push(&mut self, sqe: Sqe) {
+            // Each slot has at most one operation in flight and the ring
+            // has one entry per slot, so this cannot overflow.
+            let queued = self.ring.push(sqe);
+            debug_assert!(queued);
+        }
+
+        /// Start loading `paths[index]` in `slot`.
+        fn start<P: AsRef<Path>>(&mut self, slot: usize, index: usize, path: &P) -> bool {
+            let s = &mut self.slots[slot];
+            s.index = index;
+            s.data.clear();
+            s.error = None;
+            match CString::new(path.as_ref().as_os_str().as_bytes()) {
+                Ok(c) => s.path = c,
+                Err(e) => {
+                    s.error = Some(io::Error::new(io::ErrorKind::InvalidInput, e));
+                    return false;
+                }
+            }
+            s.state = State::Opening;
+            let sqe = open_sqe(slot, &self.slots[slot].path);
+            self.push(sqe);
+            true
+        }
+
+        /// Settle every slot after a failed submission: wait out the
+        /// operations still in flight and close the files they opened. If
+        /// the ring cannot be waited on either, it is replaced, which
+        /// cancels whatever it still holds.
+        fn abort(&mut self) {
+            let settle = |slot: &mut Slot, cqe: Option<Cqe>| {
+                let fd = match (slot.state, cqe) {
+                    (State::Opening, Some(cqe)) => cqe.res,
+                    (State::Reading, _) => slot.fd,
+                    _ => -1,
+                };
+                if fd >= 0 {
+                    unsafe { libc::close(fd) };
+                }
+                slot.state = State::Idle;
+                slot.fd = -1;
+                slot.data.clear();
+                slot.error = None;
+            };
+
+            let mut busy = self.slots.iter().filter(|s| s.state != State::Idle).count();
+            while busy > 0 {
+                while let Some(cqe) = self.ring.pop() {
+                    let slot = &mut self.slots[cqe.user_data as usize];
+                    if slot.state != State::Idle {
+                        settle(slot, Some(cqe));
+                        busy -= 1;
+                    }
+                }
+                if busy > 0 && self.ring.submit_and_wait(1).is_err() {
+                    break;
+                }
+            }
+            if busy == 0 {
+                return;
+            }
+
+            // Reads still in flight hold their own reference to the file,
+            // so closing it here is safe.
+            for slot in &mut self.slots {
+                settle(slot, None);
+            }
+            if let Ok(ring) = Ring::new(self.slots.len() as u32) {
+                if ring.register_buffers(&mut self.buffers).is_ok() {
+                    self.ring = ring;
+                }
+            }
+        }
+
+        pub fn load<P, F>(&mut self, paths: &[P], on_file: &mut F) -> io::Result<()>
+        where
+            P: AsRef<Path>,
+            F: FnMut(usize, io::Result<&[u8]>),
+        {
+            let mut next = 0;
+            let mut active = 0;
+
+            // Fill a free slot with the next path that can be opened.
+            macro_rules! refill {
+                ($slot:expr) => {
+                    while next < paths.len() {
+                        let index = next;
+                        next += 1;
+                        if self.start($slot, index, &paths[index]) {
+                            active += 1;
+                            break;
+                        }
+                        let err = self.slots[$slot].error.take().unwrap();
+                        on_file(index, Err(err));
+                    }
+                };
+            }
+
+            for slot in 0..self.slots.len() {
+                refill!(slot);
+            }
+
+            while active > 0 {
+                if let Err(err) = self.ring.submit_and_wait(1) {
+                    self.abort();
+                    return Err(err);
+                }
+
+                while let Some(cqe) = self.ring.pop() {
+                    let slot = cqe.user_data as usize;
+                    match self.slots[slot].state {
+                        State::Opening => {
+                            if cqe.res < 0 {
+                                let err = io::Error::from_raw_os_error(-cqe.res);
+                                let index = self.slots[slot].index;
+                                self.slots[slot].state = State::Idle;
+                                active -= 1;
+                                on_file(index, Err(err));
+                                refill!(slot);
+                            } else {
+                                self.slots[slot].fd = cqe.res;
+                                self.slots[slot].state = State::Reading;
+                                let sqe = self.read_sqe(slot);
+                                self.push(sqe);
+                            }
+                        }
+                        State::Reading => {
+                            let n = cqe.res;
+                            if n < 0 {
+                                self.slots[slot].error = Some(io::Error::from_raw_os_error(-n));
+                            } else {
+                                let chunk = &self.buffers[slot][..n as usize];
+                                self.slots[slot].data.extend_from_slice(chunk);
+                            }
+
+                            // Only an empty read marks the end of the file;
+                            // a short one may be followed by more data.
+                            if n > 0 {
+                                let sqe = self.read_sqe(slot);
+                                self.push(sqe);
+                            } else {
+                                self.slots[slot].state = State::Closing;
+                                let sqe = close_sqe(slot, self.slots[slot].fd);
+                                self.push(sqe);
+                            }
+                        }
+                        State::Closing => {
+                            let s = &mut self.slots[slot];
+                            s.state = State::Idle;
+                            s.fd = -1;
+                            active -= 1;
+                            match s.error.take() {
+                                Some(err) => on_file(s.index, Err(err)),
+                                None => on_file(s.index, Ok(&s.data)),
+                            }
+                            refill!(slot);
+                        }
+                        State::Idle => {}
+                    }
+                }
+            }
+
+            Ok(())
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn write_profiles(name: &str, count: usize) -> (std::path::PathBuf, Vec<std::path::PathBuf>) {
+        let dir = std::env::temp_dir().join(format!("saxsrs_{}_{}", name, std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let paths = (0..count)
+            .map(|i| {
+                let path = dir.join(format!("p{}.dat", i));
+                let mut text = String::from("# q I err\n");
+                // Make some files larger than the read buffer.
+                for k in 0..(10 + i * 40) {
+                    text.push_str(&format!("{} {} 0.5\n", k as f64 * 0.01, i * 1000 + k));
+                }
+                std::fs::write(&path, text).unwrap();
+                path
+            })
+            .collect();
+        (dir, paths)
+    }
+
+    fn check(mut loader: BatchLoader, name: &str) {
+        let (dir, mut paths) = write_profiles(name, 20);
+        paths.push(dir.join("missing.dat"));
+
+        let results = loader.load_profiles(&paths).unwrap();
+        assert_eq!(results.len(), 21);
+        for (i, result) in results.iter().take(20).enumerate() {
+            let sample = result.as_ref().unwrap();
+            assert_eq!(sample.id, format!("p{}", i));
+            assert_eq!(sample.len(), 10 + i * 40);
+            assert_eq!(sample.intensity[3], (i * 1000 + 3) as f64);
+        }
+        assert!(matches!(results[20], Err(ProfileError::Io(_))));
+
+        std::fs::remove_dir_all(&dir).ok();
+    }
+
+    #[test]
+    fn test_batch_loader() {
+        let config = LoaderConfig {
+            depth: 4,
+            buffer_size: 512,
+            threads: 2,
+        };
+        check(BatchLoader::new(config), "uring");
+    }
+
+    #[test]
+    fn test_threaded_fallback() {
+        let config = LoaderConfig {
+            depth: 4,
+            buffer_size: 512,
+            threads: 3,
+        };
+        let loader = BatchLoader::threaded(config);
+        assert!(!loader.is_uring());
+        check(loader, "threaded");
+    }
+}
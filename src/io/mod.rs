@@ -0,0 +1,184 @@
+//! Readers for raw 2D detector frames and 1D profiles.
+//!
+//! Supported frame formats are ESRF EDF, uncompressed or LZW-compressed TIFF
+//! and CBF with byte-offset compression. Decoded pixels are written into buffers
+//! taken from a [`FramePool`] so that a stream of equally sized frames does
+//! not allocate once the pool is warm. Large sets of profile files are read
+//! with [`BatchLoader`].
+
+pub mod cbf;
+pub mod edf;
+pub mod frame;
+pub mod loader;
+pub mod profile;
+pub mod tiff;
+#[cfg(target_os = "linux")]
+mod uring;
+
+pub use frame::{Frame, FramePool, FrameView, PixelData, PixelSlice, PixelType};
+pub use loader::{BatchLoader, LoaderConfig};
+pub use profile::{parse_profile, ProfileError};
+
+use rayon::prelude::*;
+use std::path::Path;
+
+/// Errors that can occur while decoding a frame.
+#[derive(Debug)]
+pub enum FrameError {
+    /// Reading the file failed.
+    Io(std::io::Error),
+    /// The file is not in a recognised format.
+    UnknownFormat,
+    /// The header is malformed or misses a required key.
+    InvalidHeader(String),
+    /// A feature of the format is not supported.
+    Unsupported(String),
+    /// The pixel data is shorter than the header declares.
+    Truncated,
+}
+
+impl std::fmt::Display for FrameError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            FrameError::Io(e) => write!(f, "I/O error: {}", e),
+            FrameError::UnknownFormat => write!(f, "Unknown frame format"),
+            FrameError::InvalidHeader(msg) => write!(f, "Invalid header: {}", msg),
+            FrameError::Unsupported(msg) => write!(f, "Unsupported: {}", msg),
+            FrameError::Truncated => write!(f, "Pixel data is truncated"),
+        }
+    }
+}
+
+impl std::error::Error for FrameError {}
+
+impl From<std::io::Error> for FrameError {
+    fn from(e: std::io::Error) -> Self {
+        FrameError::Io(e)
+    }
+}
+
+/// Frame file formats.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum FrameFormat {
+    Edf,
+    Tiff,
+    Cbf,
+}
+
+impl FrameFormat {
+    /// Detect the format from the leading bytes of a file.
+    pub fn detect(data: &[u8]) -> Option<Self> {
+        if data.starts_with(b"II*\0") || data.starts_with(b"MM\0*") {
+            return Some(FrameFormat::Tiff);
+        }
+        if data.starts_with(b"###CBF") || data.starts_with(b"###_CIF") {
+            return Some(FrameFormat::Cbf);
+        }
+        let first = data.iter().find(|b| !b.is_ascii_whitespace())?;
+        if *first == b'{' {
+            return Some(FrameFormat::Edf);
+        }
+        None
+    }
+}
+
+/// Decode a frame from an in-memory file.
+pub fn decode_frame(data: &[u8], pool: &FramePool) -> Result<Frame, FrameError> {
+    match FrameFormat::detect(data) {
+        Some(FrameFormat::Edf) => edf::decode(data, pool),
+        Some(FrameFormat::Tiff) => tiff::decode(data, pool),
+        Some(FrameFormat::Cbf) => cbf::decode(data, pool),
+        None => Err(FrameError::UnknownFormat),
+    }
+}
+
+/// Read and decode a frame file.
+pub fn read_frame(path: impl AsRef<Path>, pool: &FramePool) -> Result<Frame, FrameError> {
+    let data = std::fs::read(path)?;
+    decode_frame(&data, pool)
+}
+
+/// Read and decode frame files in parallel.
+///
+/// Results are returned in the order of `paths`.
+pub fn read_frames<P: AsRef<Path> + Sync>(
+    paths: &[P],
+    pool: &FramePool,
+) -> Vec<Result<Frame, FrameError>> {
+    paths.par_iter().map(|p| read_frame(p, pool)).collect()
+}
+
+/// Parse a decimal header value.
+pub(crate) fn header_usize(
+    header: &std::collections::HashMap<String, String>,
+    key: &str,
+) -> Result<usize, FrameError> {
+    header
+        .get(key)
+        .ok_or_else(|| FrameError::InvalidHeader(format!("missing {}", key)))?
+        .trim()
+        .parse()
+        .map_err(|_| FrameError::InvalidHeader(format!("bad {}", key)))
+}
+
+/// Byte length of a `width` x `height` image of `pixel_size`-byte samples.
+///
+/// Dimensions come straight from file headers, so a product that does not
+/// fit in `usize` is reported as a bad header rather than wrapping.
+pub(crate) fn frame_len(
+    width: usize,
+    height: usize,
+    pixel_size: usize,
+) -> Result<usize, FrameError> {
+    width
+        .checked_mul(height)
+        .and_then(|n| n.checked_mul(pixel_size))
+        .ok_or_else(|| {
+            FrameError::InvalidHeader(format!("{}x{} frame size overflows", width, height))
+        })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_detect_format() {
+        assert_eq!(FrameFormat::detect(b"II*\0...."), Some(FrameFormat::Tiff));
+        assert_eq!(FrameFormat::detect(b"MM\0*...."), Some(FrameFormat::Tiff));
+        assert_eq!(
+            FrameFormat::detect(b"###CBF: VERSION"),
+            Some(FrameFormat::Cbf)
+        );
+        assert_eq!(
+            FrameFormat::detect(b"\n{\nHeaderID"),
+            Some(FrameFormat::Edf)
+        );
+        assert_eq!(FrameFormat::detect(b"garbage"), None);
+    }
+
+    #[test]
+    fn test_read_frames_parallel() {
+        let dir = std::env::temp_dir().join(format!("saxsrs_io_{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+
+        let paths: Vec<_> = (0..4)
+            .map(|i| {
+                let path = dir.join(format!("frame_{}.edf", i));
+                let pixels: Vec<u16> = (0..6).map(|p| p * (i + 1)).collect();
+                std::fs::write(&path, edf::tests::make_edf(3, 2, &pixels)).unwrap();
+                path
+            })
+            .collect();
+
+        let pool = FramePool::new(4);
+        let frames = read_frames(&paths, &pool);
+        for (i, frame) in frames.into_iter().enumerate() {
+            let frame = frame.unwrap();
+            assert_eq!((frame.width, frame.height), (3, 2));
+            assert_eq!(frame.view().get(2, 1), (5 * (i + 1)) as f64);
+        }
+
+        std::fs::remove_dir_all(&dir).ok();
+    }
+}
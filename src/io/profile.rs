@@ -0,0 +1,100 @@
+//! Parser for 1D text profiles (`q I [err]` columns).
+
+use crate::data::{Sample, SampleError};
+
+/// Errors that can occur while loading a profile.
+#[derive(Debug)]
+pub enum ProfileError {
+    /// Reading the file failed.
+    Io(std::io::Error),
+    /// A data line has too few columns or an invalid number.
+    Parse { line: usize },
+    /// The file contains no data lines.
+    Empty,
+    /// The parsed columns do not form a valid sample.
+    Sample(SampleError),
+}
+
+impl std::fmt::Display for ProfileError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            ProfileError::Io(e) => write!(f, "I/O error: {}", e),
+            ProfileError::Parse { line } => write!(f, "Invalid data on line {}", line),
+            ProfileError::Empty => write!(f, "Profile contains no data"),
+            ProfileError::Sample(e) => write!(f, "{}", e),
+        }
+    }
+}
+
+impl std::error::Error for ProfileError {}
+
+impl From<std::io::Error> for ProfileError {
+    fn from(e: std::io::Error) -> Self {
+        ProfileError::Io(e)
+    }
+}
+
+/// Parse a whitespace-separated profile.
+///
+/// Lines whose first field is not a number (headers, `#` comments) are
+/// skipped. Data lines need `q` and `I`; a missing error column is read
+/// as zero.
+pub fn parse_profile(id: impl Into<String>, data: &[u8]) -> Result<Sample, ProfileError> {
+    let text = String::from_utf8_lossy(data);
+    let mut q_values = Vec::new();
+    let mut intensity = Vec::new();
+    let mut intensity_err = Vec::new();
+
+    for (line_no, line) in text.lines().enumerate() {
+        let mut fields = line.split_ascii_whitespace();
+        let q = match fields.next().map(str::parse::<f64>) {
+            Some(Ok(q)) => q,
+            _ => continue,
+        };
+        let i = fields
+            .next()
+            .and_then(|f| f.parse::<f64>().ok())
+            .ok_or(ProfileError::Parse { line: line_no + 1 })?;
+        let err = match fields.next() {
+            Some(f) => f
+                .parse::<f64>()
+                .map_err(|_| ProfileError::Parse { line: line_no + 1 })?,
+            None => 0.0,
+        };
+
+        q_values.push(q);
+        intensity.push(i);
+        intensity_err.push(err);
+    }
+
+    if q_values.is_empty() {
+        return Err(ProfileError::Empty);
+    }
+    Sample::new(id, q_values, intensity, intensity_err).map_err(ProfileError::Sample)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_profile() {
+        let text = b"# sample A\nq I err\n0.01 100.0 1.0\n0.02  90.5\t0.9\n\n0.03 80 \n";
+        let sample = parse_profile("a", text).unwrap();
+        assert_eq!(sample.q_values, vec![0.01, 0.02, 0.03]);
+        assert_eq!(sample.intensity, vec![100.0, 90.5, 80.0]);
+        assert_eq!(sample.intensity_err, vec![1.0, 0.9, 0.0]);
+    }
+
+    #[test]
+    fn test_parse_errors() {
+        assert!(matches!(
+            parse_profile("a", b"0.01 100 1\n0.02 x 1\n"),
+            Err(ProfileError::Parse { line: 2 })
+        ));
+        assert!(matches!(
+            parse_profile("a", b"# nothing\n"),
+            Err(ProfileError::Empty)
+        ));
+    }
+}
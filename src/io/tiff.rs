@@ -0,0 +1,514 @@
+//! Baseline TIFF reader for single-channel detector images.
+//!
+//! Supports uncompressed and LZW-compressed strips with 8, 16 or 32-bit
+//! integer or 32-bit float samples, and horizontal differencing.
+
+use super::frame::{Frame, FramePool, PixelData, PixelType};
+use super::{frame_len, FrameError};
+use std::collections::HashMap;
+
+const TAG_IMAGE_WIDTH: u16 = 256;
+const TAG_IMAGE_LENGTH: u16 = 257;
+const TAG_BITS_PER_SAMPLE: u16 = 258;
+const TAG_COMPRESSION: u16 = 259;
+const TAG_STRIP_OFFSETS: u16 = 273;
+const TAG_SAMPLES_PER_PIXEL: u16 = 277;
+const TAG_ROWS_PER_STRIP: u16 = 278;
+const TAG_STRIP_BYTE_COUNTS: u16 = 279;
+const TAG_PREDICTOR: u16 = 317;
+const TAG_SAMPLE_FORMAT: u16 = 339;
+
+const COMPRESSION_NONE: u32 = 1;
+const COMPRESSION_LZW: u32 = 5;
+
+struct Reader<'a> {
+    data: &'a [u8],
+    big_endian: bool,
+}
+
+impl<'a> Reader<'a> {
+    fn u16(&self, pos: usize) -> Result<u16, FrameError> {
+        let b: [u8; 2] = self
+            .data
+            .get(pos..pos + 2)
+            .ok_or(FrameError::Truncated)?
+            .try_into()
+            .unwrap();
+        Ok(if self.big_endian {
+            u16::from_be_bytes(b)
+        } else {
+            u16::from_le_bytes(b)
+        })
+    }
+
+    fn u32(&self, pos: usize) -> Result<u32, FrameError> {
+        let b: [u8; 4] = self
+            .data
+            .get(pos..pos + 4)
+            .ok_or(FrameError::Truncated)?
+            .try_into()
+            .unwrap();
+        Ok(if self.big_endian {
+            u32::from_be_bytes(b)
+        } else {
+            u32::from_le_bytes(b)
+        })
+    }
+
+    /// Read the values of the IFD entry at `pos` as u32.
+    fn values(&self, pos: usize) -> Result<Vec<u32>, FrameError> {
+        let field_type = self.u16(pos + 2)?;
+        let count = self.u32(pos + 4)? as usize;
+        let size = match field_type {
+            1 => 1, // BYTE
+            3 => 2, // SHORT
+            4 => 4, // LONG
+            other => {
+                return Err(FrameError::Unsupported(format!(
+                    "TIFF field type {}",
+                    other
+                )))
+            }
+        };
+
+        let base = if count * size <= 4 {
+            pos + 8
+        } else {
+            self.u32(pos + 8)? as usize
+        };
+
+        (0..count)
+            .map(|i| {
+                let p = base + i * size;
+                match size {
+                    1 => self
+                        .data
+                        .get(p)
+                        .map(|&b| b as u32)
+                        .ok_or(FrameError::Truncated),
+                    2 => self.u16(p).map(u32::from),
+                    _ => self.u32(p),
+                }
+            })
+            .collect()
+    }
+}
+
+/// Decode a TIFF-variant LZW stream, appending at most `limit` bytes to
+/// `out`. Decoding stops once the limit is reached.
+pub fn lzw_decode(src: &[u8], out: &mut Vec<u8>, limit: usize) -> Result<(), FrameError> {
+    const CLEAR: usize = 256;
+    const EOI: usize = 257;
+    const FIRST: usize = 258;
+
+    #[derive(Clone, Copy)]
+    struct Entry {
+        prefix: u16,
+        byte: u8,
+        first: u8,
+        len: u16,
+    }
+
+    let corrupt = || FrameError::InvalidHeader("corrupt LZW data".into());
+
+    let mut table: Vec<Entry> = Vec::with_capacity(4096);
+    for b in 0..FIRST {
+        table.push(Entry {
+            prefix: 0,
+            byte: b as u8,
+            first: b as u8,
+            len: 1,
+        });
+    }
+
+    let mut width = 9;
+    let mut acc: u32 = 0;
+    let mut nbits = 0;
+    let mut bytes = src.iter();
+    let mut prev: Option<usize> = None;
+    let end = out.len().saturating_add(limit);
+
+    loop {
+        if out.len() >= end {
+            return Ok(());
+        }
+        while nbits < width {
+            match bytes.next() {
+                Some(&b) => {
+                    acc = (acc << 8) | b as u32;
+                    nbits += 8;
+                }
+                None => return Ok(()),
+            }
+        }
+        nbits -= width;
+        let code = ((acc >> nbits) & ((1 << width) - 1)) as usize;
+
+        if code == CLEAR {
+            table.truncate(FIRST);
+            width = 9;
+            prev = None;
+            continue;
+        }
+        if code == EOI {
+            return Ok(());
+        }
+
+        if let Some(p) = prev {
+            let first = if code < table.len() {
+                table[code].first
+            } else if code == table.len() {
+                table[p].first
+            } else {
+                return Err(corrupt());
+            };
+            if table.len() < 4096 {
+                table.push(Entry {
+                    prefix: p as u16,
+                    byte: first,
+                    first: table[p].first,
+                    len: table[p].len + 1,
+                });
+            }
+        } else if code >= CLEAR {
+            return Err(corrupt());
+        }
+
+        // Emit the string for `code` by walking its prefix chain backwards.
+        let len = table[code].len as usize;
+        let start = out.len();
+        out.resize(start + len, 0);
+        let mut c = code;
+        for slot in out[start..].iter_mut().rev() {
+            *slot = table[c].byte;
+            c = table[c].prefix as usize;
+        }
+        out.truncate(end);
+        prev = Some(code);
+
+        if table.len() + 1 >= (1 << width) && width < 12 {
+            width += 1;
+        }
+    }
+}
+
+/// Undo horizontal differencing row by row.
+fn undo_predictor(data: &mut PixelData, width: usize) {
+    macro_rules! accumulate {
+        ($v:expr) => {
+            for row in $v.chunks_mut(width) {
+                for x in 1..row.len() {
+                    row[x] = row[x].wrapping_add(row[x - 1]);
+                }
+            }
+        };
+    }
+
+    match data {
+        PixelData::U8(v) => accumulate!(v),
+        PixelData::U16(v) => accumulate!(v),
+        PixelData::U32(v) => accumulate!(v),
+        PixelData::I32(v) => accumulate!(v),
+        PixelData::F32(_) => {}
+    }
+}
+
+/// Decode the first image of a TIFF file.
+pub fn decode(data: &[u8], pool: &FramePool) -> Result<Frame, FrameError> {
+    let big_endian = match data.get(0..4) {
+        Some(b"II*\0") => false,
+        Some(b"MM\0*") => true,
+        _ => return Err(FrameError::UnknownFormat),
+    };
+    let reader = Reader { data, big_endian };
+
+    let ifd = reader.u32(4)? as usize;
+    let count = reader.u16(ifd)? as usize;
+    let mut tags: HashMap<u16, Vec<u32>> = HashMap::new();
+    for i in 0..count {
+        let pos = ifd + 2 + i * 12;
+        let tag = reader.u16(pos)?;
+        // Skip tags we do not need; they may use types we cannot read.
+        if matches!(
+            tag,
+            TAG_IMAGE_WIDTH
+                | TAG_IMAGE_LENGTH
+                | TAG_BITS_PER_SAMPLE
+                | TAG_COMPRESSION
+                | TAG_STRIP_OFFSETS
+                | TAG_SAMPLES_PER_PIXEL
+                | TAG_ROWS_PER_STRIP
+                | TAG_STRIP_BYTE_COUNTS
+                | TAG_PREDICTOR
+                | TAG_SAMPLE_FORMAT
+        ) {
+            tags.insert(tag, reader.values(pos)?);
+        }
+    }
+
+    let first = |tag: u16, default: Option<u32>| -> Result<u32, FrameError> {
+        tags.get(&tag)
+            .and_then(|v| v.first().copied())
+            .or(default)
+            .ok_or_else(|| FrameError::InvalidHeader(format!("missing TIFF tag {}", tag)))
+    };
+
+    let width = first(TAG_IMAGE_WIDTH, None)? as usize;
+    let height = first(TAG_IMAGE_LENGTH, None)? as usize;
+    let bits = first(TAG_BITS_PER_SAMPLE, Some(1))?;
+    let compression = first(TAG_COMPRESSION, Some(COMPRESSION_NONE))?;
+    let predictor = first(TAG_PREDICTOR, Some(1))?;
+    let sample_format = first(TAG_SAMPLE_FORMAT, Some(1))?;
+
+    if first(TAG_SAMPLES_PER_PIXEL, Some(1))? != 1 {
+        return Err(FrameError::Unsupported("multi-channel TIFF".into()));
+    }
+
+    let ty = match (bits, sample_format) {
+        (8, 1) => PixelType::U8,
+        (16, 1) => PixelType::U16,
+        (32, 1) => PixelType::U32,
+        (32, 2) => PixelType::I32,
+        (32, 3) => PixelType::F32,
+        _ => {
+            return Err(FrameError::Unsupported(format!(
+                "TIFF {}-bit samples of format {}",
+                bits, sample_format
+            )))
+        }
+    };
+
+    let offsets = tags
+        .get(&TAG_STRIP_OFFSETS)
+        .ok_or_else(|| FrameError::InvalidHeader("missing StripOffsets".into()))?;
+    let counts = tags
+        .get(&TAG_STRIP_BYTE_COUNTS)
+        .ok_or_else(|| FrameError::InvalidHeader("missing StripByteCounts".into()))?;
+    if offsets.len() != counts.len() {
+        return Err(FrameError::InvalidHeader("strip count mismatch".into()));
+    }
+
+    let size = frame_len(width, height, ty.size())?;
+    let strip = |i: usize| -> Result<&[u8], FrameError> {
+        let start = offsets[i] as usize;
+        let end = start
+            .checked_add(counts[i] as usize)
+            .ok_or_else(|| FrameError::InvalidHeader("strip offset overflows".into()))?;
+        data.get(start..end).ok_or(FrameError::Truncated)
+    };
+
+    let mut pixels = match compression {
+        // A single uncompressed strip is converted straight from the file.
+        COMPRESSION_NONE if offsets.len() == 1 => {
+            let raw = strip(0)?.get(..size).ok_or(FrameError::Truncated)?;
+            pool.read_raw(raw, ty, big_endian)
+        }
+        COMPRESSION_NONE | COMPRESSION_LZW => {
+            // Uncompressed strips can never cover more than the file, so a
+            // larger declared size is truncated before anything is reserved.
+            // LZW output grows on demand, but never past the declared size.
+            if compression == COMPRESSION_NONE && size > data.len() {
+                return Err(FrameError::Truncated);
+            }
+            let mut raw = Vec::with_capacity(size.min(data.len()));
+            for i in 0..offsets.len() {
+                if compression == COMPRESSION_LZW {
+                    let remaining = size.saturating_sub(raw.len());
+                    lzw_decode(strip(i)?, &mut raw, remaining)?;
+                } else {
+                    raw.extend_from_slice(strip(i)?);
+                }
+            }
+            if raw.len() < size {
+                return Err(FrameError::Truncated);
+            }
+            pool.read_raw(&raw[..size], ty, big_endian)
+        }
+        other => {
+            return Err(FrameError::Unsupported(format!(
+                "TIFF compression {}",
+                other
+            )));
+        }
+    };
+
+    match predictor {
+        1 => {}
+        2 => undo_predictor(&mut pixels, width),
+        other => return Err(FrameError::Unsupported(format!("TIFF predictor {}", other))),
+    }
+
+    Ok(Frame {
+        width,
+        height,
+        data: pixels,
+        header: HashMap::new(),
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// TIFF-variant LZW encoder used to build test files.
+    fn lzw_encode(src: &[u8]) -> Vec<u8> {
+        let mut out = Vec::new();
+        let (mut acc, mut nbits) = (0u32, 0u32);
+        let mut put = |code: u32, width: u32, out: &mut Vec<u8>| {
+            acc = (acc << width) | code;
+            nbits += width;
+            while nbits >= 8 {
+                nbits -= 8;
+                out.push((acc >> nbits) as u8);
+            }
+        };
+
+        let mut dict: HashMap<(u16, u8), u16> = HashMap::new();
+        let mut next = 258u32;
+        let mut width = 9;
+        put(256, width, &mut out);
+
+        let mut w = src[0] as u16;
+        for &b in &src[1..] {
+            if let Some(&code) = dict.get(&(w, b)) {
+                w = code;
+                continue;
+            }
+            put(w as u32, width, &mut out);
+            dict.insert((w, b), next as u16);
+            next += 1;
+            if next == 4094 {
+                put(256, width, &mut out);
+                dict.clear();
+                next = 258;
+                width = 9;
+            } else if next >= (1 << width) {
+                width += 1;
+            }
+            w = b as u16;
+        }
+        put(w as u32, width, &mut out);
+        next += 1;
+        if next >= (1 << width) && width < 12 {
+            width += 1;
+        }
+        put(257, width, &mut out);
+        put(0, 7, &mut out);
+        out
+    }
+
+    /// Build a little-endian 16-bit single-strip TIFF.
+    fn make_tiff(
+        width: u32,
+        height: u32,
+        strip: &[u8],
+        compression: u16,
+        predictor: u16,
+    ) -> Vec<u8> {
+        let entries: [(u16, u16, u32); 8] = [
+            (TAG_IMAGE_WIDTH, 4, width),
+            (TAG_IMAGE_LENGTH, 4, height),
+            (TAG_BITS_PER_SAMPLE, 3, 16),
+            (TAG_COMPRESSION, 3, compression as u32),
+            (TAG_STRIP_OFFSETS, 4, 8),
+            (TAG_ROWS_PER_STRIP, 4, height),
+            (TAG_STRIP_BYTE_COUNTS, 4, strip.len() as u32),
+            (TAG_PREDICTOR, 3, predictor as u32),
+        ];
+
+        let mut out = b"II*\0".to_vec();
+        out.extend_from_slice(&((8 + strip.len()) as u32).to_le_bytes());
+        out.extend_from_slice(strip);
+        out.extend_from_slice(&(entries.len() as u16).to_le_bytes());
+        for (tag, ty, value) in entries {
+            out.extend_from_slice(&tag.to_le_bytes());
+            out.extend_from_slice(&ty.to_le_bytes());
+            out.extend_from_slice(&1u32.to_le_bytes());
+            if ty == 3 {
+                out.extend_from_slice(&(value as u16).to_le_bytes());
+                out.extend_from_slice(&[0, 0]);
+            } else {
+                out.extend_from_slice(&value.to_le_bytes());
+            }
+        }
+        out.extend_from_slice(&0u32.to_le_bytes());
+        out
+    }
+
+    fn pixels_u16(frame: &Frame) -> &[u16] {
+        match &frame.data {
+            PixelData::U16(v) => v,
+            other => panic!("unexpected {:?}", other),
+        }
+    }
+
+    #[test]
+    fn test_lzw_roundtrip() {
+        let src: Vec<u8> = (0..20000u32)
+            .map(|i| ((i * 7) % 251 ^ (i / 300)) as u8)
+            .collect();
+        let mut out = Vec::new();
+        lzw_decode(&lzw_encode(&src), &mut out, usize::MAX).unwrap();
+        assert_eq!(out, src);
+    }
+
+    #[test]
+    fn test_lzw_output_is_limited() {
+        let src = vec![0u8; 1 << 20];
+        let encoded = lzw_encode(&src);
+        let mut out = vec![1, 2, 3];
+        lzw_decode(&encoded, &mut out, 1000).unwrap();
+        assert_eq!(out.len(), 1003);
+        assert!(out[3..].iter().all(|&b| b == 0));
+
+        // A small frame whose strip inflates far past its declared size.
+        let frame = decode(&make_tiff(4, 2, &encoded, 5, 1), &FramePool::new(1)).unwrap();
+        assert_eq!(pixels_u16(&frame), &[0; 8]);
+    }
+
+    #[test]
+    fn test_decode_uncompressed_and_lzw() {
+        let (width, height) = (16u32, 8u32);
+        let pixels: Vec<u16> = (0..width * height)
+            .map(|i| (i * 37 % 1000) as u16)
+            .collect();
+        let raw: Vec<u8> = pixels.iter().flat_map(|p| p.to_le_bytes()).collect();
+        let pool = FramePool::new(2);
+
+        let plain = decode(&make_tiff(width, height, &raw, 1, 1), &pool).unwrap();
+        assert_eq!(pixels_u16(&plain), &pixels[..]);
+
+        let lzw = decode(&make_tiff(width, height, &lzw_encode(&raw), 5, 1), &pool).unwrap();
+        assert_eq!((lzw.width, lzw.height), (16, 8));
+        assert_eq!(pixels_u16(&lzw), &pixels[..]);
+    }
+
+    #[test]
+    fn test_horizontal_predictor() {
+        let deltas: Vec<u16> = vec![10, 1, 1, 1, 20, 2, 2, 2];
+        let raw: Vec<u8> = deltas.iter().flat_map(|p| p.to_le_bytes()).collect();
+        let frame = decode(&make_tiff(4, 2, &raw, 1, 2), &FramePool::new(1)).unwrap();
+        assert_eq!(pixels_u16(&frame), &[10, 11, 12, 13, 20, 22, 24, 26]);
+    }
+
+    #[test]
+    fn test_corrupt_tiff_dimensions() {
+        let raw = [0u8; 8];
+        let pool = FramePool::new(1);
+
+        let overflow = make_tiff(u32::MAX, u32::MAX, &raw, 1, 1);
+        let result = decode(&overflow, &pool);
+        assert!(matches!(result, Err(FrameError::InvalidHeader(_))));
+
+        let oversized = make_tiff(65_535, 65_535, &raw, 1, 1);
+        assert!(matches!(
+            decode(&oversized, &pool),
+            Err(FrameError::Truncated)
+        ));
+        let oversized = make_tiff(65_535, 65_535, &lzw_encode(&raw), 5, 1);
+        assert!(matches!(
+            decode(&oversized, &pool),
+            Err(FrameError::Truncated)
+        ));
+    }
+}
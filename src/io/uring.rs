@@ -0,0 +1,297 @@
+//! Minimal io_uring bindings over raw syscalls.
+//!
+//! Only what the batch loader needs: one submission and completion ring,
+//! registered buffers and the OPENAT, READ_FIXED and CLOSE opcodes.
+
+use std::io;
+use std::ptr;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+pub const IORING_OP_READ_FIXED: u8 = 4;
+pub const IORING_OP_OPENAT: u8 = 18;
+pub const IORING_OP_CLOSE: u8 = 19;
+
+const IORING_ENTER_GETEVENTS: u32 = 1;
+const IORING_REGISTER_BUFFERS: u32 = 0;
+
+const IORING_OFF_SQ_RING: i64 = 0;
+const IORING_OFF_CQ_RING: i64 = 0x8000000;
+const IORING_OFF_SQES: i64 = 0x10000000;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqringOffsets,
+    cq_off: CqringOffsets,
+}
+
+/// Submission queue entry.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct Sqe {
+    pub opcode: u8,
+    pub flags: u8,
+    pub ioprio: u16,
+    pub fd: i32,
+    pub off: u64,
+    pub addr: u64,
+    pub len: u32,
+    pub op_flags: u32,
+    pub user_data: u64,
+    pub buf_index: u16,
+    pub personality: u16,
+    pub file_index: u32,
+    pub addr3: u64,
+    pub pad: u64,
+}
+
+/// Completion queue entry.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct Cqe {
+    pub user_data: u64,
+    pub res: i32,
+    pub flags: u32,
+}
+
+struct Mmap {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+impl Mmap {
+    fn new(fd: i32, len: usize, offset: i64) -> io::Result<Self> {
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                offset,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self { ptr, len })
+    }
+
+    unsafe fn at<T>(&self, offset: u32) -> *mut T {
+        (self.ptr as *mut u8).add(offset as usize) as *mut T
+    }
+}
+
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr, self.len);
+        }
+    }
+}
+
+/// An io_uring instance.
+pub struct Ring {
+    fd: i32,
+    sq_ring: Mmap,
+    cq_ring: Mmap,
+    sqes: Mmap,
+    sq_off: SqringOffsets,
+    cq_off: CqringOffsets,
+    sq_entries: u32,
+    /// Entries queued locally but not yet handed to the kernel.
+    pending: u32,
+}
+
+// The ring is only used from the thread that owns it.
+unsafe impl Send for Ring {}
+
+impl Ring {
+    /// Create a ring with room for `entries` submissions.
+    pub fn new(entries: u32) -> io::Result<Self> {
+        let mut params = Params::default();
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_setup,
+                entries,
+                &mut params as *mut Params,
+            )
+        } as i32;
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        let close_on_err = |e: io::Error| {
+            unsafe { libc::close(fd) };
+            e
+        };
+
+        let sq_len = params.sq_off.array as usize + params.sq_entries as usize * 4;
+        let cq_len =
+            params.cq_off.cqes as usize + params.cq_entries as usize * std::mem::size_of::<Cqe>();
+        let sqes_len = params.sq_entries as usize * std::mem::size_of::<Sqe>();
+
+        let sq_ring = Mmap::new(fd, sq_len, IORING_OFF_SQ_RING).map_err(close_on_err)?;
+        let cq_ring = Mmap::new(fd, cq_len, IORING_OFF_CQ_RING).map_err(close_on_err)?;
+        let sqes = Mmap::new(fd, sqes_len, IORING_OFF_SQES).map_err(close_on_err)?;
+
+        Ok(Self {
+            fd,
+            sq_ring,
+            cq_ring,
+            sqes,
+            sq_entries: params.sq_entries,
+            sq_off: params.sq_off,
+            cq_off: params.cq_off,
+            pending: 0,
+        })
+    }
+
+    /// Register fixed buffers for READ_FIXED.
+    pub fn register_buffers(&self, buffers: &mut [Box<[u8]>]) -> io::Result<()> {
+        let iovecs: Vec<libc::iovec> = buffers
+            .iter_mut()
+            .map(|b| libc::iovec {
+                iov_base: b.as_mut_ptr() as *mut libc::c_void,
+                iov_len: b.len(),
+            })
+            .collect();
+        let ret = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_register,
+                self.fd,
+                IORING_REGISTER_BUFFERS,
+                iovecs.as_ptr(),
+                iovecs.len() as u32,
+            )
+        };
+        if ret < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(())
+    }
+
+    /// Queue a submission. Returns false if the submission queue is full.
+    pub fn push(&mut self, sqe: Sqe) -> bool {
+        unsafe {
+            let head = (*self.sq_ring.at::<AtomicU32>(self.sq_off.head)).load(Ordering::Acquire);
+            let tail_ptr = self.sq_ring.at::<AtomicU32>(self.sq_off.tail);
+            let tail = (*tail_ptr).load(Ordering::Relaxed);
+            if tail.wrapping_sub(head) >= self.sq_entries {
+                return false;
+            }
+
+            let mask = *self.sq_ring.at::<u32>(self.sq_off.ring_mask);
+            let index = tail & mask;
+            *self.sqes.at::<Sqe>(0).add(index as usize) = sqe;
+            *self
+                .sq_ring
+                .at::<u32>(self.sq_off.array)
+                .add(index as usize) = index;
+            (*tail_ptr).store(tail.wrapping_add(1), Ordering::Release);
+        }
+        self.pending += 1;
+        true
+    }
+
+    /// Submit queued entries and wait for at least `wait` completions.
+    pub fn submit_and_wait(&mut self, wait: u32) -> io::Result<()> {
+        loop {
+            let ret = unsafe {
+                libc::syscall(
+                    libc::SYS_io_uring_enter,
+                    self.fd,
+                    self.pending,
+                    wait,
+                    IORING_ENTER_GETEVENTS,
+                    ptr::null::<libc::sigset_t>(),
+                    0usize,
+                )
+            };
+            if ret >= 0 {
+                self.pending -= ret as u32;
+                return Ok(());
+            }
+            let err = io::Error::last_os_error();
+            if err.kind() != io::ErrorKind::Interrupted {
+                return Err(err);
+            }
+        }
+    }
+
+    /// Pop one completion, if available.
+    pub fn pop(&mut self) -> Option<Cqe> {
+        unsafe {
+            let head_ptr = self.cq_ring.at::<AtomicU32>(self.cq_off.head);
+            let head = (*head_ptr).load(Ordering::Relaxed);
+            let tail = (*self.cq_ring.at::<AtomicU32>(self.cq_off.tail)).load(Ordering::Acquire);
+            if head == tail {
+                return None;
+            }
+
+            let mask = *self.cq_ring.at::<u32>(self.cq_off.ring_mask);
+            let cqe = *self
+                .cq_ring
+                .at::<Cqe>(self.cq_off.cqes)
+                .add((head & mask) as usize);
+            (*head_ptr).store(head.wrapping_add(1), Ordering::Release);
+            Some(cqe)
+        }
+    }
+}
+
+impl Drop for Ring {
+    fn drop(&mut self) {
+        unsafe {
+            libc::close(self.fd);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_abi_sizes() {
+        assert_eq!(std::mem::size_of::<Sqe>(), 64);
+        assert_eq!(std::mem::size_of::<Cqe>(), 16);
+        assert_eq!(std::mem::size_of::<Params>(), 120);
+    }
+}
@@ -51,17 +51,30 @@
 //! saxs_runtime_free(runtime);
 //! ```
 
+pub mod alloc_count;
 pub mod data;
+pub mod distributed;
 pub mod ffi;
+pub mod io;
 pub mod runtime;
+pub mod series;
 pub mod stage;
 
 // Re-export commonly used items
 pub use data::{FlowMetadata, Peak, Sample, SampleError, SampleMetadata};
-pub use runtime::{InsertionPolicy, PriorityScheduler, RegroupPool, Runtime, RuntimeConfig};
-pub use stage::{Stage, StageId, StageRegistry, StageRequest, StageResult};
+pub use runtime::{
+    CacheConfig, InsertionPolicy, PreviewConfig, PriorityScheduler, RegroupPool, Runtime,
+    RuntimeConfig, SnapshotConfig, Sweep,
+};
+pub use stage::{Stage, StageId, StageKey, StageRegistry, StageRequest, StageResult};
+
+// Unit tests count allocations to enforce allocation budgets.
+#[cfg(test)]
+#[global_allocator]
+static ALLOCATOR: alloc_count::CountingAllocator = alloc_count::CountingAllocator;
 
 // Re-export FFI types for cbindgen
 pub use ffi::types::*;
 pub use ffi::runtime::*;
 pub use ffi::sample::*;
+pub use ffi::synthetic::*;
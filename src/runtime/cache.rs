@@ -0,0 +1,593 @@
+//! Content-addressed cache of stage and pipeline results.
+//!
+//! Keys are 128-bit hashes of the input arrays, the sample and flow
+//! metadata, the stage id and configuration hash, and the engine version.
+//! The sample id is not part of the key, so reprocessing identical data
+//! under a new name still hits. Entries live in an LRU bounded by an
+//! approximate byte budget and can optionally be persisted to a directory,
+//! one file per key.
+
+use super::snapshot::{decode_stage_request, encode_stage_request};
+use crate::data::codec::{
+    decode_flow_metadata, decode_sample_metadata, encode_flow_metadata, encode_sample_metadata,
+    put_bytes, put_f64_slice, put_u32, put_u64, put_u8, CodecError, Decoder,
+};
+use crate::data::hash::StableHasher;
+use crate::data::{FlowMetadata, Sample, SampleMetadata};
+use crate::stage::{Stage, StageId, StageRequest, StageResult};
+use std::collections::{BTreeMap, HashMap};
+use std::hash::Hasher;
+use std::io;
+use std::path::PathBuf;
+use std::sync::{Arc, Mutex};
+
+/// Engine version mixed into every key so upgrades invalidate old entries.
+const ENGINE_VERSION: &str = env!("CARGO_PKG_VERSION");
+
+const DISK_MAGIC: &[u8; 4] = b"SXC5";
+
+const DOMAIN_STAGE: u64 = 1;
+const DOMAIN_PIPELINE: u64 = 2;
+
+/// Configuration for the result cache.
+#[derive(Clone, Debug)]
+pub struct CacheConfig {
+    /// Approximate memory budget for cached results in bytes.
+    pub max_bytes: usize,
+    /// Directory for the on-disk store (None = memory only).
+    pub disk_dir: Option<PathBuf>,
+    /// Short-circuit whole pipelines, not only single stages. Not used
+    /// while checkpoints are set: a cached sample never reaches them.
+    pub pipelines: bool,
+}
+
+impl Default for CacheConfig {
+    fn default() -> Self {
+        Self {
+            max_bytes: 256 * 1024 * 1024,
+            disk_dir: None,
+            pipelines: true,
+        }
+    }
+}
+
+/// Hit and miss counters.
+#[derive(Clone, Debug, Default)]
+pub struct CacheStats {
+    pub stage_hits: u64,
+    pub stage_misses: u64,
+    pub pipeline_hits: u64,
+    pub pipeline_misses: u64,
+    /// Hits served from the on-disk store (included in the hit counts).
+    pub disk_hits: u64,
+    pub evictions: u64,
+    /// Approximate bytes held in memory.
+    pub bytes: usize,
+    pub entries: usize,
+}
+
+impl CacheStats {
+    /// Fraction of stage lookups that hit.
+    pub fn stage_hit_rate(&self) -> f64 {
+        rate(self.stage_hits, self.stage_misses)
+    }
+
+    /// Fraction of pipeline lookups that hit.
+    pub fn pipeline_hit_rate(&self) -> f64 {
+        rate(self.pipeline_hits, self.pipeline_misses)
+    }
+}
+
+fn rate(hits: u64, misses: u64) -> f64 {
+    if hits + misses == 0 {
+        0.0
+    } else {
+        hits as f64 / (hits + misses) as f64
+    }
+}
+
+/// 128-bit cache key.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub struct CacheKey(u64, u64);
+
+impl CacheKey {
+    fn new(domain: u64, stage_hash: u64, sample: &Sample, metadata: &FlowMetadata) -> Self {
+        let mut h = StableHasher::new();
+        h.write_u64(domain);
+        h.write(ENGINE_VERSION.as_bytes());
+        h.write_u64(stage_hash);
+        h.write_u32(sample.stage_num);
+        h.write_f64_slice(&sample.q_values);
+        h.write_f64_slice(&sample.intensity);
+        h.write_f64_slice(&sample.intensity_err);
+
+        let mut buf = Vec::new();
+        encode_sample_metadata(&mut buf, &sample.metadata);
+        // Drop the length-prefixed sample id that starts the flow encoding.
+        let flow_start = buf.len();
+        encode_flow_metadata(&mut buf, metadata);
+        buf.drain(flow_start..flow_start + 4 + metadata.sample_id.len());
+        h.write(&buf);
+
+        let (a, b) = h.finish128();
+        CacheKey(a, b)
+    }
+
+    /// Key for running `stage` on a sample.
+    pub fn for_stage(
+        stage_id: StageId,
+        config_hash: u64,
+        sample: &Sample,
+        metadata: &FlowMetadata,
+    ) -> Self {
+        let mut h = StableHasher::new();
+        h.write_usize(stage_id.index());
+        h.write_u64(config_hash);
+        Self::new(DOMAIN_STAGE, h.finish(), sample, metadata)
+    }
+
+    /// Key for running a whole pipeline from its first stage.
+    pub fn for_pipeline(
+        first_stage: StageId,
+        registry_hash: u64,
+        sample: &Sample,
+        metadata: &FlowMetadata,
+    ) -> Self {
+        let mut h = StableHasher::new();
+        h.write_usize(first_stage.index());
+        h.write_u64(registry_hash);
+        Self::new(DOMAIN_PIPELINE, h.finish(), sample, metadata)
+    }
+
+    fn file_name(&self) -> String {
+        format!("{:016x}{:016x}.bin", self.0, self.1)
+    }
+}
+
+/// A cached stage or pipeline output.
+///
+/// `q_values` and `intensity_err` are only stored when the stage changed
+/// them; otherwise the input arrays are reused on a hit.
+#[derive(Clone, Debug)]
+pub struct CachedOutput {
+    intensity: Vec<f64>,
+    q_values: Option<Vec<f64>>,
+    intensity_err: Option<Vec<f64>>,
+    stage_num: u32,
+    sample_metadata: SampleMetadata,
+    metadata: FlowMetadata,
+    requests: Vec<StageRequest>,
+}
+
+impl CachedOutput {
+    /// Capture a result, storing arrays that differ from the input.
+    fn capture(input: Option<&Sample>, result: &StageResult) -> Self {
+        let out = &result.sample;
+        let changed = |a: &Vec<f64>, b: Option<&Vec<f64>>| match b {
+            Some(b) if a == b => None,
+            _ => Some(a.clone()),
+        };
+
+        Self {
+            intensity: out.intensity.clone(),
+            q_values: changed(&out.q_values, input.map(|s| &s.q_values)),
+            intensity_err: changed(&out.intensity_err, input.map(|s| &s.intensity_err)),
+            stage_num: out.stage_num,
+            sample_metadata: out.metadata.clone(),
+            metadata: result.metadata.clone(),
+            requests: result.requests.clone(),
+        }
+    }
+
+    /// Rebuild the result for an input sample.
+    fn apply(&self, mut sample: Sample) -> StageResult {
+        sample.intensity.clone_from(&self.intensity);
+        if let Some(q) = &self.q_values {
+            sample.q_values.clone_from(q);
+        }
+        if let Some(err) = &self.intensity_err {
+            sample.intensity_err.clone_from(err);
+        }
+        sample.stage_num = self.stage_num;
+        sample.metadata = self.sample_metadata.clone();
+
+        let with_id = |m: &FlowMetadata| {
+            let mut m = m.clone();
+            m.sample_id.clone_from(&sample.id);
+            m
+        };
+        let metadata = with_id(&self.metadata);
+        let requests = self
+            .requests
+            .iter()
+            .map(|r| StageRequest {
+                metadata: with_id(&r.metadata),
+                ..r.clone()
+            })
+            .collect();
+
+        StageResult::with_requests(sample, metadata, requests)
+    }
+
+    /// Approximate heap size in bytes.
+    fn size_bytes(&self) -> usize {
+        let arrays = self.intensity.len()
+            + self.q_values.as_ref().map_or(0, Vec::len)
+            + self.intensity_err.as_ref().map_or(0, Vec::len);
+        let peaks = self.sample_metadata.processed_peaks.len()
+            + self.sample_metadata.unprocessed_peaks.len()
+            + self.metadata.processed_peaks.len()
+            + self.metadata.unprocessed_peaks.len();
+        std::mem::size_of::<Self>() + arrays * 8 + peaks * 32 + self.requests.len() * 128
+    }
+
+    fn encode(&self, buf: &mut Vec<u8>) {
+        let put_opt = |buf: &mut Vec<u8>, v: &Option<Vec<f64>>| match v {
+            Some(v) => {
+                put_u8(buf, 1);
+                put_f64_slice(buf, v);
+            }
+            None => put_u8(buf, 0),
+        };
+
+        put_u32(buf, self.stage_num);
+        put_f64_slice(buf, &self.intensity);
+        put_opt(buf, &self.q_values);
+        put_opt(buf, &self.intensity_err);
+        encode_sample_metadata(buf, &self.sample_metadata);
+        encode_flow_metadata(buf, &self.metadata);
+        put_u32(buf, self.requests.len() as u32);
+        for request in &self.requests {
+            encode_stage_request(buf, request);
+        }
+    }
+
+    fn decode(dec: &mut Decoder<'_>) -> Result<Self, CodecError> {
+        let opt = |dec: &mut Decoder<'_>| match dec.u8()? {
+            0 => Ok(None),
+            1 => dec.f64_vec().map(Some),
+            tag => Err(CodecError::InvalidTag(tag)),
+        };
+
+        let stage_num = dec.u32()?;
+        let intensity = dec.f64_vec()?;
+        let q_values = opt(dec)?;
+        let intensity_err = opt(dec)?;
+        let sample_metadata = decode_sample_metadata(dec)?;
+        let metadata = decode_flow_metadata(dec)?;
+        let count = dec.u32()? as usize;
+        let mut requests = Vec::with_capacity(count.min(64));
+        for _ in 0..count {
+            requests.push(decode_stage_request(dec)?);
+        }
+
+        Ok(Self {
+            intensity,
+            q_values,
+            intensity_err,
+            stage_num,
+            sample_metadata,
+            metadata,
+            requests,
+        })
+    }
+}
+
+/// In-memory LRU bounded by bytes.
+struct Lru {
+    map: HashMap<CacheKey, (Arc<CachedOutput>, u64)>,
+    /// Last-use tick to key, oldest first.
+    order: BTreeMap<u64, CacheKey>,
+    tick: u64,
+    bytes: usize,
+    max_bytes: usize,
+}
+
+impl Lru {
+    fn get(&mut self, key: &CacheKey) -> Option<Arc<CachedOutput>> {
+        let (value, last) = self.map.get_mut(key)?;
+        self.order.remove(last);
+        self.tick += 1;
+        *last = self.tick;
+        self.order.insert(self.tick, *key);
+        Some(value.clone())
+    }
+
+    /// Insert a value, returning the number of evicted entries.
+    fn insert(&mut self, key: CacheKey, value: Arc<CachedOutput>) -> u64 {
+        let size = value.size_bytes();
+        if size > self.max_bytes {
+            return 0;
+        }
+        if let Some((old, last)) = self.map.remove(&key) {
+            self.order.remove(&last);
+            self.bytes -= old.size_bytes();
+        }
+
+        self.tick += 1;
+        self.map.insert(key, (value, self.tick));
+        self.order.insert(self.tick, key);
+        self.bytes += size;
+
+        let mut evicted = 0;
+        while self.bytes > self.max_bytes {
+            let (_, oldest) = match self.order.pop_first() {
+                Some(e) => e,
+                None => break,
+            };
+            if let Some((old, _)) = self.map.remove(&oldest) {
+                self.bytes -= old.size_bytes();
+                evicted += 1;
+            }
+        }
+        evicted
+    }
+}
+
+struct Inner {
+    lru: Lru,
+    stats: CacheStats,
+}
+
+/// Content-addressed cache shared by the executor's workers.
+pub struct ResultCache {
+    config: CacheConfig,
+    inner: Mutex<Inner>,
+}
+
+impl ResultCache {
+    /// Create a cache, creating the disk directory if configured.
+    pub fn new(config: CacheConfig) -> io::Result<Self> {
+        if let Some(dir) = &config.disk_dir {
+            std::fs::create_dir_all(dir)?;
+        }
+        Ok(Self {
+            inner: Mutex::new(Inner {
+                lru: Lru {
+                    map: HashMap::new(),
+                    order: BTreeMap::new(),
+                    tick: 0,
+                    bytes: 0,
+                    max_bytes: config.max_bytes,
+                },
+                stats: CacheStats::default(),
+            }),
+            config,
+        })
+    }
+
+    /// Check whether whole pipelines are short-circuited.
+    pub fn pipelines_enabled(&self) -> bool {
+        self.config.pipelines
+    }
+
+    /// Get a snapshot of the counters.
+    pub fn stats(&self) -> CacheStats {
+        let inner = self.inner.lock().unwrap();
+        let mut stats = inner.stats.clone();
+        stats.bytes = inner.lru.bytes;
+        stats.entries = inner.lru.map.len();
+        stats
+    }
+
+    /// Look up a key in memory, then on disk.
+    fn lookup(&self, key: &CacheKey, pipeline: bool) -> Option<Arc<CachedOutput>> {
+        let found = self.inner.lock().unwrap().lru.get(key);
+        let (found, from_disk) = match found {
+            Some(v) => (Some(v), false),
+            None => (self.read_disk(key).map(Arc::new), true),
+        };
+
+        let mut inner = self.inner.lock().unwrap();
+        match (&found, pipeline) {
+            (Some(_), true) => inner.stats.pipeline_hits += 1,
+            (Some(_), false) => inner.stats.stage_hits += 1,
+            (None, true) => inner.stats.pipeline_misses += 1,
+            (None, false) => inner.stats.stage_misses += 1,
+        }
+        if let (Some(value), true) = (&found, from_disk) {
+            inner.stats.disk_hits += 1;
+            inner.stats.evictions += inner.lru.insert(*key, value.clone());
+        }
+        found
+    }
+
+    fn store(&self, key: CacheKey, value: CachedOutput) {
+        self.write_disk(&key, &value);
+        let mut inner = self.inner.lock().unwrap();
+        inner.stats.evictions += inner.lru.insert(key, Arc::new(value));
+    }
+
+    /// Run a stage, serving the result from the cache when possible.
+    /// Stages that are not `cacheable` always run.
+    pub fn run_stage(
+        &self,
+        stage: &dyn Stage,
+        sample: Sample,
+        metadata: FlowMetadata,
+    ) -> StageResult {
+        if !stage.cacheable() {
+            return stage.process(sample, metadata);
+        }
+        let key = CacheKey::for_stage(stage.id(), stage.config_hash(), &sample, &metadata);
+        if let Some(cached) = self.lookup(&key, false) {
+            return cached.apply(sample);
+        }
+
+        let input = sample.clone();
+        let result = stage.process(sample, metadata);
+        self.store(key, CachedOutput::capture(Some(&input), &result));
+        result
+    }
+
+    /// Look up the final result of a whole pipeline.
+    pub fn lookup_pipeline(&self, key: &CacheKey, sample: Sample) -> Result<Sample, Sample> {
+        match self.lookup(key, true) {
+            Some(cached) => Ok(cached.apply(sample).sample),
+            None => Err(sample),
+        }
+    }
+
+    /// Record the final result of a pipeline.
+    pub fn store_pipeline(&self, key: CacheKey, sample: &Sample) {
+        let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+        let result = StageResult::terminal(sample.clone(), metadata);
+        self.store(key, CachedOutput::capture(None, &result));
+    }
+
+    fn read_disk(&self, key: &CacheKey) -> Option<CachedOutput> {
+        let path = self.config.disk_dir.as_ref()?.join(key.file_name());
+        let data = std::fs::read(path).ok()?;
+
+        let mut dec = Decoder::new(&data);
+        if dec.take(4).ok()? != DISK_MAGIC {
+            return None;
+        }
+        let payload = dec.bytes().ok()?;
+        let (a, b) = (dec.u64().ok()?, dec.u64().ok()?);
+        let mut h = StableHasher::new();
+        h.write(payload);
+        if h.finish128() != (a, b) {
+            return None;
+        }
+        CachedOutput::decode(&mut Decoder::new(payload)).ok()
+    }
+
+    fn write_disk(&self, key: &CacheKey, value: &CachedOutput) {
+        let dir = match &self.config.disk_dir {
+            Some(dir) => dir,
+            None => return,
+        };
+
+        let mut payload = Vec::new();
+        value.encode(&mut payload);
+        let mut h = StableHasher::new();
+        h.write(&payload);
+        let (a, b) = h.finish128();
+
+        let mut buf = DISK_MAGIC.to_vec();
+        put_bytes(&mut buf, &payload);
+        put_u64(&mut buf, a);
+        put_u64(&mut buf, b);
+
+        // Write then rename so readers never see a partial file. The disk
+        // store is best effort; failures only cost a future miss.
+        let path = dir.join(key.file_name());
+        let tmp = path.with_extension(format!("tmp{}", std::process::id()));
+        if std::fs::write(&tmp, &buf).is_ok() && std::fs::rename(&tmp, &path).is_err() {
+            let _ = std::fs::remove_file(&tmp);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::stage::FindPeakStage;
+
+    fn make_sample(id: &str, scale: f64) -> Sample {
+        let q: Vec<f64> = (0..200).map(|i| i as f64 * 0.005).collect();
+        let intensity = q
+            .iter()
+            .map(|&x| scale * (-(x - 0.4).powi(2) / 0.002).exp())
+            .collect();
+        Sample::new(id, q, intensity, vec![0.1; 200]).unwrap()
+    }
+
+    fn run(cache: &ResultCache, sample: Sample) -> StageResult {
+        let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+        cache.run_stage(&FindPeakStage::default(), sample, metadata)
+    }
+
+    #[test]
+    fn test_stage_hit_ignores_sample_id() {
+        let cache = ResultCache::new(CacheConfig::default()).unwrap();
+        let first = run(&cache, make_sample("a", 2.0));
+        let second = run(&cache, make_sample("b", 2.0));
+        run(&cache, make_sample("c", 3.0));
+
+        let stats = cache.stats();
+        assert_eq!((stats.stage_hits, stats.stage_misses), (1, 2));
+        assert_eq!(second.sample.id, "b");
+        assert_eq!(second.metadata.sample_id, "b");
+        assert_eq!(second.requests[0].metadata.sample_id, "b");
+        assert_eq!(second.sample.stage_num, first.sample.stage_num);
+        assert_eq!(second.metadata.current_peak, first.metadata.current_peak);
+    }
+
+    #[test]
+    fn test_stages_opt_in_to_caching() {
+        // Keeps the default `config_hash` and `cacheable`.
+        struct Plain;
+        impl Stage for Plain {
+            fn id(&self) -> StageId {
+                StageId::FindPeak
+            }
+            fn process(&self, sample: Sample, metadata: FlowMetadata) -> StageResult {
+                StageResult::terminal(sample, metadata)
+            }
+        }
+
+        let cache = ResultCache::new(CacheConfig::default()).unwrap();
+        for id in ["a", "b"] {
+            let sample = make_sample(id, 2.0);
+            let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+            cache.run_stage(&Plain, sample, metadata);
+        }
+        let stats = cache.stats();
+        assert_eq!(stats.stage_hits + stats.stage_misses, 0);
+    }
+
+    #[test]
+    fn test_lru_evicts_oldest() {
+        let store = |cache: &ResultCache, scale: f64| {
+            let sample = make_sample("x", scale);
+            let metadata = FlowMetadata::from_sample("x", &sample.metadata);
+            let key = CacheKey::for_pipeline(StageId::FindPeak, 0, &sample, &metadata);
+            cache.store_pipeline(key, &sample);
+        };
+
+        let probe = ResultCache::new(CacheConfig::default()).unwrap();
+        store(&probe, 1.0);
+        let size = probe.stats().bytes;
+
+        let cache = ResultCache::new(CacheConfig {
+            max_bytes: size * 2 + size / 2,
+            ..CacheConfig::default()
+        })
+        .unwrap();
+        for scale in [1.0, 2.0, 3.0] {
+            store(&cache, scale);
+        }
+
+        let stats = cache.stats();
+        assert_eq!(stats.entries, 2);
+        assert_eq!(stats.evictions, 1);
+    }
+
+    #[test]
+    fn test_disk_store_survives_restart() {
+        let dir = std::env::temp_dir().join(format!("saxsrs_cache_{}", std::process::id()));
+        let config = CacheConfig {
+            disk_dir: Some(dir.clone()),
+            ..CacheConfig::default()
+        };
+
+        let expected = run(
+            &ResultCache::new(config.clone()).unwrap(),
+            make_sample("a", 2.0),
+        );
+        let cache = ResultCache::new(config).unwrap();
+        let restored = run(&cache, make_sample("a", 2.0));
+
+        let stats = cache.stats();
+        assert_eq!((stats.stage_hits, stats.disk_hits), (1, 1));
+        assert_eq!(restored.sample.intensity, expected.sample.intensity);
+        assert_eq!(
+            restored.metadata.unprocessed_peaks,
+            expected.metadata.unprocessed_peaks
+        );
+
+        std::fs::remove_dir_all(&dir).ok();
+    }
+}
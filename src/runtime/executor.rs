@@ -1,12 +1,34 @@
 //! Async runtime executor for SAXS batch processing.
 
+use super::cache::{CacheConfig, CacheKey, CacheStats, ResultCache};
+use super::lock::{InstrumentedMutex, LockStats};
+use super::memory::{Footprint, MemoryAccount, MemoryLocation, MemoryStats};
+use super::metrics::{MetricsSnapshot, RuntimeMetrics, StepMetrics};
+use super::perf;
 use super::policy::{AlwaysInsertPolicy, InsertionPolicy};
-use super::regroup::RegroupPool;
+use super::preview::{PreviewBatch, PreviewConfig};
+use super::process::{self, ProcessConfig};
+use super::progress::{ProgressReporter, ProgressSnapshot, ProgressTracker};
+use super::regroup::{CompressionStats, RegroupPool};
 use super::scheduler::{PriorityScheduler, WorkItem};
+use super::snapshot::{
+    encode_sample_bytes, encode_work_item, Journal, JournalEntry, SnapshotConfig, SnapshotState,
+};
+use super::stats::{RunStats, WorkerStats};
+use super::sweep::Sweep;
+use super::trace::{SpanKind, TraceConfig, Tracer};
 use crate::data::{FlowMetadata, Sample};
 use crate::ffi::types::SaxsStatus;
-use crate::stage::{StageId, StageRegistry};
-use std::sync::{Arc, Mutex};
+use crate::series::{SeriesConfig, SeriesStore};
+use crate::stage::{
+    FindPeakStage, Pipeline, ProcessPeakStage, Stage, StageId, StageKey, StageRegistry,
+    StageRequest, StageResult, StageSet,
+};
+use std::collections::HashMap;
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Condvar, Mutex, PoisonError};
+use std::time::{Duration, Instant};
 use tokio::runtime::Runtime as TokioRuntime;
 
 /// Configuration for the runtime.
@@ -27,6 +49,173 @@ impl Default for RuntimeConfig {
     }
 }
 
+/// A stage result held back until its wave commits (deterministic mode).
+struct Deferred {
+    order: u64,
+    seq: u64,
+    sample: Sample,
+    requests: Vec<StageRequest>,
+}
+
+/// Finishes dequeued items if their worker unwinds before handing the
+/// results to the scheduler, so the other workers stop waiting for them.
+/// The run is stopped through `stop` and the panic continues to the caller.
+struct InFlightGuard<'a> {
+    scheduler: &'a InstrumentedMutex<PriorityScheduler>,
+    work_ready: &'a Condvar,
+    stop: &'a AtomicBool,
+    /// Items begun and not yet finished.
+    items: usize,
+}
+
+impl InFlightGuard<'_> {
+    /// The items' results reached the scheduler, which finished them.
+    fn disarm(mut self) {
+        self.items = 0;
+    }
+}
+
+impl Drop for InFlightGuard<'_> {
+    fn drop(&mut self) {
+        if self.items == 0 {
+            return;
+        }
+        self.stop.store(true, Ordering::SeqCst);
+        // The lock is poisoned if the panic left it held.
+        let mut scheduler = self
+            .scheduler
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner);
+        for _ in 0..self.items {
+            scheduler.finish();
+        }
+        self.work_ready.notify_all();
+    }
+}
+
+/// How workers resolve and run the stage of a work item. The executor's
+/// loops are generic over it, so a static `Pipeline` is dispatched without
+/// trait objects.
+trait Dispatch: Sync {
+    /// Resolved stage (registry entry or pipeline slot).
+    type Stage;
+
+    fn lookup(&self, key: StageKey) -> Option<Self::Stage>;
+
+    /// Pop the next item with its stage; `None` if the stage does not
+    /// resolve, in which case the item's sample completes as it is.
+    fn begin(&self, scheduler: &mut PriorityScheduler) -> Option<(Option<Self::Stage>, WorkItem)>;
+
+    fn run(
+        &self,
+        stage: &Self::Stage,
+        cache: Option<&ResultCache>,
+        sample: Sample,
+        metadata: FlowMetadata,
+    ) -> StageResult;
+
+    /// Configuration hash keying cached pipelines.
+    fn config_hash(&self) -> u64;
+
+    /// Whether every stage is cacheable, so whole-pipeline results can be.
+    fn cacheable(&self) -> bool;
+
+    /// Completed samples expected per input sample.
+    fn outputs_per_sample(&self) -> usize {
+        1
+    }
+}
+
+/// Stages from a registry: the runtime's, or one built for a sweep.
+struct Dynamic {
+    registry: Arc<StageRegistry>,
+    outputs_per_sample: usize,
+}
+
+impl Dynamic {
+    fn new(registry: Arc<StageRegistry>) -> Self {
+        Self {
+            registry,
+            outputs_per_sample: 1,
+        }
+    }
+}
+
+impl Dispatch for Dynamic {
+    type Stage = Arc<dyn Stage>;
+
+    fn lookup(&self, key: StageKey) -> Option<Arc<dyn Stage>> {
+        self.registry.resolve(key)
+    }
+
+    fn begin(
+        &self,
+        scheduler: &mut PriorityScheduler,
+    ) -> Option<(Option<Arc<dyn Stage>>, WorkItem)> {
+        scheduler.begin_next_by(|key| self.registry.resolve(key))
+    }
+
+    fn run(
+        &self,
+        stage: &Arc<dyn Stage>,
+        cache: Option<&ResultCache>,
+        sample: Sample,
+        metadata: FlowMetadata,
+    ) -> StageResult {
+        match cache {
+            Some(cache) => cache.run_stage(stage.as_ref(), sample, metadata),
+            None => stage.process(sample, metadata),
+        }
+    }
+
+    fn config_hash(&self) -> u64 {
+        self.registry.config_hash()
+    }
+
+    fn cacheable(&self) -> bool {
+        self.registry.cacheable()
+    }
+
+    fn outputs_per_sample(&self) -> usize {
+        self.outputs_per_sample
+    }
+}
+
+impl<S: StageSet> Dispatch for Pipeline<S> {
+    type Stage = usize;
+
+    /// Every instance of a kind runs the pipeline's stage of that kind.
+    fn lookup(&self, key: StageKey) -> Option<usize> {
+        self.slot(key.kind)
+    }
+
+    fn begin(&self, scheduler: &mut PriorityScheduler) -> Option<(Option<usize>, WorkItem)> {
+        scheduler.begin_next_by(|key| self.slot(key.kind))
+    }
+
+    #[inline]
+    fn run(
+        &self,
+        &slot: &usize,
+        cache: Option<&ResultCache>,
+        sample: Sample,
+        metadata: FlowMetadata,
+    ) -> StageResult {
+        match cache {
+            Some(cache) => cache.run_stage(self.stages().stage(slot), sample, metadata),
+            None => self.stages().process_slot(slot, sample, metadata),
+        }
+    }
+
+    fn config_hash(&self) -> u64 {
+        Pipeline::config_hash(self)
+    }
+
+    fn cacheable(&self) -> bool {
+        Pipeline::cacheable(self)
+    }
+}
+
 /// Main runtime for SAXS batch processing.
 pub struct Runtime {
     /// Configuration.
@@ -36,17 +225,54 @@ pub struct Runtime {
     /// Samples waiting to be processed.
     pending_samples: Vec<Sample>,
     /// Scheduler for work items.
-    scheduler: Mutex<PriorityScheduler>,
+    scheduler: InstrumentedMutex<PriorityScheduler>,
+    /// Signalled when work is enqueued or the last in-flight item finishes.
+    work_ready: Condvar,
     /// Pool for regrouping completed samples.
-    regroup_pool: Mutex<RegroupPool>,
+    regroup_pool: InstrumentedMutex<RegroupPool>,
     /// Insertion policy.
     insertion_policy: Arc<dyn InsertionPolicy>,
     /// Completed samples (fully processed).
-    completed: Mutex<Vec<Sample>>,
+    completed: InstrumentedMutex<Vec<Sample>>,
     /// Tokio runtime for async execution.
     tokio_runtime: TokioRuntime,
     /// Cancellation flag.
     cancelled: std::sync::atomic::AtomicBool,
+    /// Snapshot journal (if enabled).
+    journal: Option<Journal>,
+    /// Stage and pipeline result cache (if enabled).
+    cache: Option<ResultCache>,
+    /// Pipeline cache key per in-flight sample id (None for duplicate ids).
+    pipeline_keys: Mutex<HashMap<String, Option<CacheKey>>>,
+    /// Timing of the last `run_sync` call.
+    last_run: Option<RunStats>,
+    /// Cumulative per-stage and per-worker metrics.
+    metrics: Arc<RuntimeMetrics>,
+    /// Span tracing configuration (if enabled).
+    trace_config: Option<TraceConfig>,
+    /// Span recorder of the current or last `run_sync` call.
+    tracer: Option<Arc<Tracer>>,
+    /// Read hardware counters around each stage.
+    perf_counters: bool,
+    /// Sample bytes by location.
+    memory: Arc<MemoryAccount>,
+    /// Progress counters of the current or last batch.
+    progress: Arc<ProgressTracker>,
+    /// Deliver `run_async` progress from a timer at this rate.
+    progress_interval: Option<Duration>,
+    /// Commit stage results in waves ordered by sample index.
+    deterministic: bool,
+    /// Results of the current wave (deterministic mode).
+    wave: Mutex<Vec<Deferred>>,
+    /// Run stages in forked worker processes (see `set_process_workers`).
+    processes: Option<ProcessConfig>,
+    /// Warm-start state of time series (see `enable_series`).
+    series: Option<Arc<SeriesStore>>,
+    /// Decimated first pass of `run_async` (see `enable_preview`).
+    preview: Option<PreviewConfig>,
+    /// Results a sample completing before any diverging stage stands for
+    /// (the point count while `run_sweep` runs, else 1).
+    fan_out: usize,
 }
 
 impl Runtime {
@@ -60,41 +286,375 @@ impl Runtime {
             .enable_all()
             .build()
             .expect("Failed to create Tokio runtime");
+        let metrics = Arc::new(RuntimeMetrics::new(config.worker_count));
 
         Self {
             config,
             registry,
             pending_samples: Vec::new(),
-            scheduler: Mutex::new(scheduler),
-            regroup_pool: Mutex::new(RegroupPool::new()),
+            scheduler: InstrumentedMutex::new("scheduler", scheduler),
+            work_ready: Condvar::new(),
+            regroup_pool: InstrumentedMutex::new("regroup_pool", RegroupPool::new()),
             insertion_policy: Arc::new(AlwaysInsertPolicy),
-            completed: Mutex::new(Vec::new()),
+            completed: InstrumentedMutex::new("completed", Vec::new()),
             tokio_runtime,
             cancelled: std::sync::atomic::AtomicBool::new(false),
+            journal: None,
+            cache: None,
+            pipeline_keys: Mutex::new(HashMap::new()),
+            last_run: None,
+            metrics,
+            trace_config: None,
+            tracer: None,
+            perf_counters: false,
+            memory: Arc::new(MemoryAccount::new()),
+            progress: Arc::new(ProgressTracker::new()),
+            progress_interval: None,
+            deterministic: false,
+            wave: Mutex::new(Vec::new()),
+            processes: None,
+            series: None,
+            preview: None,
+            fan_out: 1,
+        }
+    }
+
+    /// Resume an interrupted run from a snapshot directory.
+    ///
+    /// Restores pending work items, the regroup pool, completed samples and
+    /// checkpoints, then keeps journaling into the same directory. Call
+    /// `run_sync` to continue; stages that already completed are not redone.
+    pub fn resume(path: impl AsRef<Path>) -> std::io::Result<Self> {
+        Self::resume_with_config(RuntimeConfig::default(), path)
+    }
+
+    /// Resume from a snapshot directory with a custom configuration.
+    pub fn resume_with_config(
+        config: RuntimeConfig,
+        path: impl AsRef<Path>,
+    ) -> std::io::Result<Self> {
+        let path = path.as_ref();
+        let (state, _) = SnapshotState::load(path)?;
+        let invalid = |e| std::io::Error::new(std::io::ErrorKind::InvalidData, e);
+
+        let mut runtime = Self::new(config);
+        {
+            let mut scheduler = runtime.scheduler.lock().unwrap();
+            for item in state.pending_items().map_err(invalid)? {
+                scheduler.enqueue_restored(item);
+            }
+
+            let mut pool = runtime.regroup_pool.lock().unwrap();
+            pool.set_expected_count(state.expected_count());
+            pool.set_checkpoints(state.checkpoints().iter().copied());
+            for sample in state.pool_samples().map_err(invalid)? {
+                pool.add(sample);
+            }
+
+            runtime
+                .completed
+                .lock()
+                .unwrap()
+                .extend(state.completed_samples().map_err(invalid)?);
+        }
+
+        runtime.recount_memory();
+        runtime.journal = Some(Journal::start(SnapshotConfig::new(path), state)?);
+        Ok(runtime)
+    }
+
+    /// Enable crash-safe snapshots into the given directory.
+    ///
+    /// The current state is written as the initial snapshot.
+    pub fn enable_snapshots(&mut self, config: SnapshotConfig) -> std::io::Result<()> {
+        // Stop any previous writer before starting a new generation.
+        self.journal = None;
+
+        let mut state = SnapshotState::default();
+        {
+            let scheduler = self.scheduler.lock().unwrap();
+            for item in scheduler.iter() {
+                state.apply(JournalEntry::Enqueue {
+                    seq: item.seq,
+                    item: encode_work_item(item),
+                });
+            }
+
+            let mut pool = self.regroup_pool.lock().unwrap();
+            pool.thaw_all();
+            state.apply(JournalEntry::ExpectedCount(pool.expected_count()));
+            state.apply(JournalEntry::Checkpoints(pool.checkpoints()));
+            for sample in pool.iter() {
+                state.apply(JournalEntry::Pooled(encode_sample_bytes(sample)));
+            }
+            self.memory.set(MemoryLocation::Pool, &pool.footprint());
+
+            for sample in self.completed.lock().unwrap().iter() {
+                state.apply(JournalEntry::Completed(encode_sample_bytes(sample)));
+            }
+        }
+
+        self.journal = Some(Journal::start(config, state)?);
+        Ok(())
+    }
+
+    /// Stop journaling. Existing snapshot files are left in place.
+    pub fn disable_snapshots(&mut self) {
+        self.journal = None;
+    }
+
+    /// Block until all journaled state is on disk.
+    ///
+    /// Fails if the journal writer stopped after an I/O error (e.g. a full
+    /// disk); nothing recorded since then is persisted.
+    pub fn sync_snapshots(&self) -> std::io::Result<()> {
+        match &self.journal {
+            Some(journal) => journal.sync(),
+            None => Ok(()),
         }
     }
 
+    /// The I/O error that stopped snapshot journaling, if any. Does not
+    /// block.
+    pub fn snapshot_error(&self) -> Option<std::io::Error> {
+        self.journal.as_ref().and_then(|j| j.error())
+    }
+
+    /// Record a journal entry if snapshots are enabled.
+    fn journal<F: FnOnce() -> JournalEntry>(&self, entry: F) {
+        if let Some(journal) = &self.journal {
+            journal.record(entry());
+        }
+    }
+
+    /// Enable the content-addressed result cache.
+    ///
+    /// Stages whose inputs, configuration and engine version match an
+    /// earlier run are served from the cache instead of being executed.
+    pub fn enable_cache(&mut self, config: CacheConfig) -> std::io::Result<()> {
+        self.cache = Some(ResultCache::new(config)?);
+        Ok(())
+    }
+
+    /// Disable and drop the result cache.
+    pub fn disable_cache(&mut self) {
+        self.cache = None;
+        self.pipeline_keys.lock().unwrap().clear();
+    }
+
+    /// Get cache hit and miss counters (None if the cache is disabled).
+    pub fn cache_stats(&self) -> Option<CacheStats> {
+        self.cache.as_ref().map(ResultCache::stats)
+    }
+
     /// Add a sample to be processed.
     pub fn add_sample(&mut self, sample: Sample) {
+        self.memory
+            .add(MemoryLocation::Pending, &Footprint::of_sample(&sample));
         self.pending_samples.push(sample);
     }
 
     /// Add multiple samples.
     pub fn add_samples(&mut self, samples: impl IntoIterator<Item = Sample>) {
+        let start = self.pending_samples.len();
         self.pending_samples.extend(samples);
+        let added = Footprint::of_samples(&self.pending_samples[start..]);
+        self.memory.add(MemoryLocation::Pending, &added);
     }
 
-    /// Set checkpoint stages.
-    pub fn set_checkpoints(&mut self, stages: &[u32]) {
-        self.regroup_pool
+    /// Enqueue work items at their own stage, e.g. work handed over by a
+    /// distributed coordinator. Items keep their `order`.
+    pub fn add_work_items(&mut self, items: impl IntoIterator<Item = WorkItem>) {
+        let mut scheduler = self.scheduler.lock().unwrap();
+        let mut count = 0;
+        for item in items {
+            self.memory.add(
+                MemoryLocation::Queued,
+                &Footprint::of_item(&item.sample, &item.metadata),
+            );
+            let encoded = self.journal.as_ref().map(|_| encode_work_item(&item));
+            let seq = scheduler.enqueue(item);
+            if let (Some(journal), Some(item)) = (&self.journal, encoded) {
+                journal.record(JournalEntry::Enqueue { seq, item });
+            }
+            count += 1;
+        }
+        let mut pool = self.regroup_pool.lock().unwrap();
+        let expected = pool.expected_count() + count;
+        pool.set_expected_count(expected);
+        self.journal(|| JournalEntry::ExpectedCount(expected));
+    }
+
+    /// Remove and return all completed samples, in completion order.
+    pub fn take_completed(&mut self) -> Vec<Sample> {
+        let completed = std::mem::take(&mut *self.completed.lock().unwrap());
+        self.memory
+            .set(MemoryLocation::Completed, &Footprint::default());
+        self.journal(|| JournalEntry::TakeCompleted);
+        completed
+    }
+
+    /// Sample bytes by location, with high-water marks since the last
+    /// batch started.
+    pub fn memory_stats(&self) -> MemoryStats {
+        self.memory.stats()
+    }
+
+    /// Progress of the current or last batch.
+    pub fn progress(&self) -> ProgressSnapshot {
+        self.progress.snapshot()
+    }
+
+    /// Shared progress counters, for querying or starting a
+    /// `ProgressReporter` from another thread while a batch runs.
+    pub fn progress_tracker(&self) -> Arc<ProgressTracker> {
+        self.progress.clone()
+    }
+
+    /// Throttle `run_async` progress callbacks.
+    ///
+    /// With an interval, `on_progress` is called from a timer thread at
+    /// most once per interval (plus a final call) instead of from the
+    /// workers after every completed sample.
+    pub fn set_progress_interval(&mut self, interval: Option<Duration>) {
+        self.progress_interval = interval;
+    }
+
+    /// Make `run_sync` output independent of worker count and timing.
+    ///
+    /// Work proceeds in waves: every item of a wave runs in parallel, and
+    /// when the last one finishes its results are committed in sample
+    /// order. Insertion decisions, the order of completed and pooled
+    /// samples, and hence `regroup` output are then defined by sample index
+    /// and stage sequence alone. Workers only wait for each other at wave
+    /// boundaries. `run_async` callbacks keep completion order.
+    pub fn set_deterministic(&mut self, deterministic: bool) {
+        self.deterministic = deterministic;
+    }
+
+    /// Run stages of `run_sync` in forked worker processes instead of
+    /// threads, for stages that are not thread-safe (Linux only).
+    ///
+    /// The calling thread schedules and applies results; items and results
+    /// pass through shared memory. A worker that crashes is restarted and
+    /// its in-flight items are requeued; an item that takes down
+    /// `max_attempts` workers panics the run, as a panicking stage does
+    /// with threads. The result cache and perf counters are not used in
+    /// this mode. While series mode is enabled runs use threads, since the
+    /// series store must see every frame. Returns whether the mode is
+    /// available; if not, runs keep using threads.
+    pub fn set_process_workers(&mut self, config: Option<ProcessConfig>) -> bool {
+        self.processes = config;
+        self.processes.is_none() || process::supported()
+    }
+
+    /// Warm-start samples tagged with a series frame from earlier frames of
+    /// the same series (see `series`). Untagged samples are processed as
+    /// before, and `run_sync` uses threads even if process workers are set.
+    /// Returns the store, which also reports warm/cold statistics.
+    pub fn enable_series(&mut self, config: SeriesConfig) -> Arc<SeriesStore> {
+        let store = Arc::new(SeriesStore::new(config));
+        let mut registry = StageRegistry::new();
+        registry.register(FindPeakStage::default().with_series(store.clone()));
+        registry.register(ProcessPeakStage::default().with_series(store.clone()));
+        self.set_registry(registry);
+        self.series = Some(store.clone());
+        store
+    }
+
+    /// Return to stateless per-sample processing.
+    pub fn disable_series(&mut self) {
+        if self.series.take().is_some() {
+            self.set_registry(StageRegistry::new_with_defaults());
+        }
+    }
+
+    /// Series store, if series mode is enabled.
+    pub fn series_store(&self) -> Option<Arc<SeriesStore>> {
+        self.series.clone()
+    }
+
+    /// Deliver a provisional result of every long profile from a
+    /// decimated copy before its full-resolution result (see `preview`).
+    /// Applies to `run_async`; `on_sample` then sees previewed samples
+    /// twice, first with `metadata.provisional` set.
+    pub fn enable_preview(&mut self, config: PreviewConfig) {
+        self.preview = Some(config);
+    }
+
+    pub fn disable_preview(&mut self) {
+        self.preview = None;
+    }
+
+    /// Stages used by `run_sync` and `run_async`.
+    pub fn registry(&self) -> &StageRegistry {
+        &self.registry
+    }
+
+    /// Replace the stages used by `run_sync` and `run_async`, e.g. with a
+    /// registry holding several instances of a stage. Enabling or disabling
+    /// series mode replaces it again.
+    pub fn set_registry(&mut self, registry: StageRegistry) {
+        self.registry = Arc::new(registry);
+        self.scheduler
             .lock()
             .unwrap()
-            .set_checkpoints(stages.iter().copied());
+            .set_registry(self.registry.clone());
+    }
+
+    /// Recompute every location from the held samples.
+    fn recount_memory(&self) {
+        let scheduler = self.scheduler.lock().unwrap();
+        let mut queued = Footprint::default();
+        for item in scheduler.iter() {
+            queued.add(&Footprint::of_item(&item.sample, &item.metadata));
+        }
+        let memory = &self.memory;
+        memory.set(MemoryLocation::Queued, &queued);
+        memory.set(
+            MemoryLocation::Pending,
+            &Footprint::of_samples(&self.pending_samples),
+        );
+        memory.set(
+            MemoryLocation::Pool,
+            &self.regroup_pool.lock().unwrap().footprint(),
+        );
+        memory.set(
+            MemoryLocation::Completed,
+            &Footprint::of_samples(self.completed.lock().unwrap().iter()),
+        );
+    }
+
+    /// Set checkpoint stages.
+    pub fn set_checkpoints(&mut self, stages: &[u32]) {
+        let mut pool = self.regroup_pool.lock().unwrap();
+        pool.set_checkpoints(stages.iter().copied());
+        self.journal(|| JournalEntry::Checkpoints(pool.checkpoints()));
     }
 
     /// Clear all checkpoints.
     pub fn clear_checkpoints(&mut self) {
         self.regroup_pool.lock().unwrap().clear_checkpoints();
+        self.journal(|| JournalEntry::Checkpoints(Vec::new()));
+    }
+
+    /// Compress samples that wait in the regroup pool longer than `threshold`.
+    ///
+    /// `None` disables compression of idle samples.
+    pub fn set_cold_sample_threshold(&mut self, threshold: Option<Duration>) {
+        self.regroup_pool
+            .lock()
+            .unwrap()
+            .set_cold_threshold(threshold);
+    }
+
+    /// Get compression counters for idle samples.
+    pub fn compression_stats(&self) -> CompressionStats {
+        self.regroup_pool
+            .lock()
+            .unwrap()
+            .compression_stats()
+            .clone()
     }
 
     /// Set the insertion policy.
@@ -113,72 +673,821 @@ impl Runtime {
     }
 
     /// Run batch processing synchronously (blocking).
+    ///
+    /// Uses `worker_count` threads; stages run outside the scheduler lock.
+    /// A panicking stage stops the run; the panic is re-raised once the
+    /// other workers have returned.
     pub fn run_sync(&mut self) {
+        let dispatch = Dynamic::new(self.registry.clone());
+        self.run_with(&dispatch);
+    }
+
+    /// Run every pending sample through every point of `sweep` (see
+    /// `sweep`). Stages before the first diverging one run once per sample;
+    /// results are tagged with their point (`Sample::sweep_point`, or group
+    /// them with `Sweep::by_point`). A sample that completes or waits in
+    /// the regroup pool before the fan-out counts once per point towards
+    /// progress and checkpoints. Whole-pipeline cache entries are not
+    /// used, since one sample yields a result per point; stage results
+    /// are.
+    pub fn run_sweep(&mut self, sweep: &Sweep) {
+        let dispatch = Dynamic {
+            registry: Arc::new(sweep.registry(&self.registry)),
+            outputs_per_sample: sweep.len().max(1),
+        };
+        self.run_with(&dispatch);
+    }
+
+    /// Run like `run_sync`, with stages taken from a pipeline fixed at
+    /// compile time instead of the registry. A sample requesting a stage
+    /// outside the pipeline completes as it is. All run_sync modes
+    /// (deterministic, process workers, cache, snapshots) apply;
+    /// `run_async` keeps using the registry.
+    pub fn run_pipeline<S: StageSet>(&mut self, pipeline: &Pipeline<S>) {
+        self.run_with(pipeline);
+    }
+
+    fn run_with<D: Dispatch>(&mut self, dispatch: &D) {
         self.cancelled
             .store(false, std::sync::atomic::Ordering::SeqCst);
 
-        // Initialize scheduler with all samples
-        let sample_count = self.pending_samples.len();
-        {
+        let started = Instant::now();
+        self.memory.begin_batch();
+        self.fan_out = dispatch.outputs_per_sample();
+        self.regroup_pool.lock().unwrap().set_fan_out(self.fan_out);
+        self.progress.begin(self.pending_count() * self.fan_out);
+        self.enqueue_pending(dispatch);
+
+        let workers = self.config.worker_count.max(1);
+        self.tracer = self
+            .trace_config
+            .as_ref()
+            .map(|c| Arc::new(Tracer::new(workers, c.capacity)));
+
+        // Series state lives in this process; forked workers would only
+        // update their own copies of it.
+        let processes = self.processes.as_ref().filter(|_| self.series.is_none());
+        let this = &*self;
+        let per_worker = if let Some(config) = processes {
+            vec![this.run_processes(dispatch, config, started)]
+        } else if workers == 1 {
+            vec![this.work_loop(dispatch, 0, started)]
+        } else {
+            std::thread::scope(|scope| {
+                let handles: Vec<_> = (0..workers)
+                    .map(|worker| scope.spawn(move || this.work_loop(dispatch, worker, started)))
+                    .collect();
+                // A panicking stage stops the run (see `InFlightGuard`);
+                // re-raise it once every worker has returned.
+                handles
+                    .into_iter()
+                    .map(|h| h.join().unwrap_or_else(|e| std::panic::resume_unwind(e)))
+                    .collect()
+            })
+        };
+
+        // A cancelled run can leave a partial wave; keep its results.
+        if !self.wave.get_mut().unwrap().is_empty() {
+            let mut stats = WorkerStats::default();
             let mut scheduler = self.scheduler.lock().unwrap();
-            let mut pool = self.regroup_pool.lock().unwrap();
+            self.commit_wave(&mut scheduler, started, &mut stats);
+        }
 
-            pool.set_expected_count(sample_count);
+        if let Some(store) = &self.series {
+            store.flush_tracks();
+        }
 
-            for sample in self.pending_samples.drain(..) {
-                let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
-                // Start with the first stage (e.g., Background or FindPeak depending on config)
-                scheduler.enqueue(WorkItem::new(sample, metadata, StageId::FindPeak));
-            }
+        let mut run = RunStats::from_workers(started.elapsed(), per_worker);
+        if let Some(config) = processes {
+            run.workers = config.workers;
         }
+        self.last_run = Some(run);
+        self.progress.finish();
 
-        // Process until done
-        loop {
-            if self.cancelled.load(std::sync::atomic::Ordering::SeqCst) {
-                break;
+        if let (Some(tracer), Some(config)) = (&self.tracer, &self.trace_config) {
+            let _ = tracer.write_to(config);
+        }
+    }
+
+    /// Record per-worker spans and write a Chrome trace to `config.path` at
+    /// the end of every run.
+    pub fn enable_tracing(&mut self, config: TraceConfig) {
+        self.trace_config = Some(config);
+    }
+
+    /// Stop tracing subsequent runs.
+    pub fn disable_tracing(&mut self) {
+        self.trace_config = None;
+        self.tracer = None;
+    }
+
+    /// Write the last `run_sync` trace to `path`.
+    pub fn write_trace(&self, path: impl Into<std::path::PathBuf>) -> std::io::Result<()> {
+        match (&self.tracer, &self.trace_config) {
+            (Some(tracer), Some(config)) => tracer.write_to(&TraceConfig {
+                path: path.into(),
+                ..config.clone()
+            }),
+            _ => Err(std::io::Error::new(
+                std::io::ErrorKind::NotFound,
+                "no trace recorded",
+            )),
+        }
+    }
+
+    /// Timing of the last `run_sync` call.
+    pub fn last_run_stats(&self) -> Option<&RunStats> {
+        self.last_run.as_ref()
+    }
+
+    /// Cumulative per-stage and per-worker metrics across runs.
+    ///
+    /// Safe to call while a run is in progress.
+    pub fn metrics(&self) -> MetricsSnapshot {
+        let mut snapshot = self.metrics.snapshot();
+        snapshot.locks = self.lock_stats();
+        snapshot
+    }
+
+    /// Clear cumulative metrics, including lock statistics.
+    pub fn reset_metrics(&self) {
+        self.metrics.reset();
+        self.scheduler.reset_stats();
+        self.regroup_pool.reset_stats();
+        self.completed.reset_stats();
+    }
+
+    /// Attribute cycles, instructions, cache misses and branch misses to
+    /// each stage (Linux `perf_event_open`, user space only).
+    ///
+    /// Returns whether counters could be opened; if not, runs proceed
+    /// without them.
+    pub fn set_perf_counters(&mut self, enabled: bool) -> bool {
+        self.perf_counters = enabled;
+        !enabled || perf::available()
+    }
+
+    /// Record acquisitions, contention, wait and hold time for the
+    /// scheduler, regroup pool and completed-list locks. The scheduler
+    /// statistics include the queues of `run_async` runs.
+    pub fn set_lock_stats(&self, enabled: bool) {
+        self.scheduler.set_enabled(enabled);
+        self.regroup_pool.set_enabled(enabled);
+        self.completed.set_enabled(enabled);
+    }
+
+    /// Cumulative statistics of the instrumented locks.
+    pub fn lock_stats(&self) -> Vec<LockStats> {
+        vec![
+            self.scheduler.stats(),
+            self.regroup_pool.stats(),
+            self.completed.stats(),
+        ]
+    }
+
+    /// Worker body: step until the queue drains or the run is cancelled.
+    fn work_loop<D: Dispatch>(&self, dispatch: &D, worker: usize, started: Instant) -> WorkerStats {
+        let mut stats = WorkerStats {
+            worker,
+            ..Default::default()
+        };
+        while self.step(dispatch, started, &mut stats) {}
+        stats
+    }
+
+    /// Process mode: the calling thread feeds forked workers and applies
+    /// their results.
+    #[cfg(target_os = "linux")]
+    fn run_processes<D: Dispatch>(
+        &self,
+        dispatch: &D,
+        config: &ProcessConfig,
+        started: Instant,
+    ) -> WorkerStats {
+        use super::process::{Event, ProcessPool};
+
+        /// What the parent remembers about a dispatched item.
+        #[derive(Clone, Copy)]
+        struct Ticket {
+            seq: u64,
+            order: u64,
+            stage_id: StageId,
+            queued: Option<Duration>,
+            input: Footprint,
+        }
+
+        let run = |item: WorkItem| {
+            let stage = dispatch
+                .lookup(item.key())
+                .expect("scheduled stage is registered");
+            let mut result = dispatch.run(&stage, None, item.sample, item.metadata);
+            result.inherit_instance(item.instance);
+            result
+        };
+        // Items too large for a slot, either way, run here instead.
+        let run_here = |tag: Ticket, item: WorkItem| {
+            let start = Instant::now();
+            let result = run(item);
+            Event::Done {
+                tag,
+                sample: result.sample,
+                requests: result.requests,
+                busy: start.elapsed(),
             }
+        };
+        let mut pool: ProcessPool<Ticket> =
+            ProcessPool::spawn(config, &run).expect("failed to start worker processes");
+        let mut oversized = Vec::new();
+        let mut attempts: HashMap<u64, u32> = HashMap::new();
+        let mut stats = WorkerStats::default();
+        // Items handed to the pool; finished if the run panics below.
+        let mut dispatched = InFlightGuard {
+            scheduler: &self.scheduler,
+            work_ready: &self.work_ready,
+            stop: &self.cancelled,
+            items: 0,
+        };
 
-            let result = {
+        loop {
+            let wait_start = Instant::now();
+            // Items no stage handles; their samples complete as they are.
+            let mut unmatched = Vec::new();
+            let drained = {
                 let mut scheduler = self.scheduler.lock().unwrap();
-                if scheduler.is_empty() {
-                    None
-                } else {
-                    scheduler.process_next()
+                let cancelled = self.cancelled.load(std::sync::atomic::Ordering::SeqCst);
+                while !cancelled && pool.has_capacity() {
+                    let Some((stage, item)) = dispatch.begin(&mut scheduler) else {
+                        break;
+                    };
+                    let input = Footprint::of_item(&item.sample, &item.metadata);
+                    self.memory
+                        .transfer(MemoryLocation::Queued, MemoryLocation::InFlight, &input);
+                    dispatched.items += 1;
+                    if stage.is_none() {
+                        unmatched.push((item, input));
+                        continue;
+                    }
+                    let ticket = Ticket {
+                        seq: item.seq,
+                        order: item.order,
+                        stage_id: item.stage_id,
+                        queued: item.enqueued_at.map(|t| t.elapsed()),
+                        input,
+                    };
+                    if pool.dispatch(&item, ticket).is_err() {
+                        oversized.push((ticket, item));
+                    }
                 }
+                scheduler.in_flight() == 0 && (cancelled || scheduler.is_empty())
             };
+            let mut wait = wait_start.elapsed();
+            if !unmatched.is_empty() {
+                for (item, input) in unmatched {
+                    let mut step = StepMetrics {
+                        stage_id: item.stage_id,
+                        queued: None,
+                        busy: Duration::ZERO,
+                        decisions: [(0, 0); StageId::COUNT],
+                        perf: None,
+                    };
+                    let (finish, lock_wait) = self.submit(
+                        item.seq,
+                        item.order,
+                        item.sample,
+                        Vec::new(),
+                        &mut step,
+                        started,
+                        &mut stats,
+                    );
+                    dispatched.items -= 1;
+                    wait += lock_wait;
+                    self.memory.sub(MemoryLocation::InFlight, &input);
+                    if let Some((sample, terminal)) = finish {
+                        self.finish_sample(sample, terminal, started, &mut stats);
+                    }
+                }
+                // Their completion may have drained the run.
+                self.record_step(&mut stats, None, wait, Duration::ZERO);
+                continue;
+            }
+            if drained {
+                self.record_step(&mut stats, None, wait, Duration::ZERO);
+                break;
+            }
 
-            match result {
-                Some(stage_result) => {
-                    let policy = self.insertion_policy.clone();
+            let idle_start = Instant::now();
+            let event = match oversized.pop() {
+                Some((tag, item)) => Some(Event::Oversized { tag, item }),
+                None => pool.poll(Duration::from_millis(100)),
+            };
+            let idle = idle_start.elapsed();
+            let event = match event {
+                Some(Event::Oversized { tag, item }) => Some(run_here(tag, item)),
+                event => event,
+            };
+            match event {
+                None => self.record_step(&mut stats, None, wait, idle),
+                Some(Event::Done {
+                    tag,
+                    sample,
+                    requests,
+                    busy,
+                }) => {
+                    attempts.remove(&tag.seq);
+                    let mut step = StepMetrics {
+                        stage_id: tag.stage_id,
+                        queued: tag.queued,
+                        busy,
+                        decisions: [(0, 0); StageId::COUNT],
+                        perf: None,
+                    };
+                    self.progress.record_stage(sample.stage_num);
+                    let (finish, lock_wait) = self.submit(
+                        tag.seq, tag.order, sample, requests, &mut step, started, &mut stats,
+                    );
+                    dispatched.items -= 1;
+                    wait += lock_wait;
+                    self.record_step(&mut stats, Some(&step), wait, idle);
+                    self.memory.sub(MemoryLocation::InFlight, &tag.input);
+                    if let Some((sample, terminal)) = finish {
+                        self.finish_sample(sample, terminal, started, &mut stats);
+                    }
+                }
+                Some(Event::Lost { tag, mut item }) => {
+                    let tries = attempts.entry(tag.seq).or_default();
+                    *tries += 1;
+                    assert!(
+                        *tries < config.max_attempts,
+                        "work item {} ({}) crashed {} worker processes",
+                        tag.seq,
+                        tag.stage_id.name(),
+                        tries
+                    );
+                    item.seq = tag.seq;
+                    item.order = tag.order;
+                    self.memory.transfer(
+                        MemoryLocation::InFlight,
+                        MemoryLocation::Queued,
+                        &tag.input,
+                    );
                     let mut scheduler = self.scheduler.lock().unwrap();
+                    scheduler.enqueue_restored(item);
+                    scheduler.finish();
+                    dispatched.items -= 1;
+                    self.record_step(&mut stats, None, wait, idle);
+                }
+                Some(Event::Oversized { .. }) => unreachable!("oversized items run above"),
+            }
+        }
+        dispatched.disarm();
+        stats.restarts = pool.restarts();
+        stats
+    }
+
+    /// Process mode needs `fork` and `memfd`; elsewhere run on one thread.
+    #[cfg(not(target_os = "linux"))]
+    fn run_processes<D: Dispatch>(
+        &self,
+        dispatch: &D,
+        _config: &ProcessConfig,
+        started: Instant,
+    ) -> WorkerStats {
+        self.work_loop(dispatch, 0, started)
+    }
+
+    /// Move pending samples into the scheduler at their first stage.
+    ///
+    /// A resumed runtime has no pending samples and continues from its
+    /// restored queue.
+    fn enqueue_pending<D: Dispatch>(&mut self, dispatch: &D) {
+        let sample_count = self.pending_samples.len();
+        if sample_count == 0 {
+            return;
+        }
+
+        let mut scheduler = self.scheduler.lock().unwrap();
+        let mut pool = self.regroup_pool.lock().unwrap();
+        let memory = &self.memory;
+        memory.set(MemoryLocation::Pending, &Footprint::default());
+
+        let outputs = sample_count * dispatch.outputs_per_sample();
+        pool.set_expected_count(outputs);
+        if let Some(journal) = &self.journal {
+            journal.record(JournalEntry::ExpectedCount(outputs));
+        }
+
+        // A cached pipeline result would skip the series store, like a
+        // cached stage result would, and never reach a checkpoint, which
+        // would then wait for it forever.
+        let pipeline_cache = self.cache.as_ref().filter(|c| {
+            c.pipelines_enabled()
+                && dispatch.outputs_per_sample() == 1
+                && dispatch.cacheable()
+                && self.series.is_none()
+                && !pool.has_checkpoints()
+        });
+        let registry_hash = pipeline_cache.map(|_| dispatch.config_hash());
 
-                    // Handle stage requests
-                    for request in &stage_result.requests {
-                        if policy.should_insert(request) {
-                            scheduler.enqueue(WorkItem::new(
-                                stage_result.sample.clone(),
-                                request.metadata.clone(),
-                                request.stage_id,
-                            ));
+        for (index, sample) in self.pending_samples.drain(..).enumerate() {
+            let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+
+            // Finished pipelines seen before go straight to completed.
+            let sample = match (pipeline_cache, registry_hash) {
+                (Some(cache), Some(hash)) => {
+                    let key = CacheKey::for_pipeline(StageId::FindPeak, hash, &sample, &metadata);
+                    match cache.lookup_pipeline(&key, sample) {
+                        Ok(done) => {
+                            if let Some(journal) = &self.journal {
+                                journal.record(JournalEntry::Completed(encode_sample_bytes(&done)));
+                            }
+                            memory.add(MemoryLocation::Completed, &Footprint::of_sample(&done));
+                            self.progress.record_completed();
+                            self.completed.lock().unwrap().push(done);
+                            continue;
+                        }
+                        Err(sample) => {
+                            let mut keys = self.pipeline_keys.lock().unwrap();
+                            keys.entry(sample.id.clone())
+                                .and_modify(|k| *k = None)
+                                .or_insert(Some(key));
+                            sample
                         }
                     }
+                }
+                _ => sample,
+            };
+
+            // Start with the first stage (e.g., Background or FindPeak depending on config)
+            let item = WorkItem::new(sample, metadata, StageId::FindPeak).with_order(index as u64);
+            memory.add(
+                MemoryLocation::Queued,
+                &Footprint::of_item(&item.sample, &item.metadata),
+            );
+            let encoded = self.journal.as_ref().map(|_| encode_work_item(&item));
+            let seq = scheduler.enqueue(item);
+            if let (Some(journal), Some(item)) = (&self.journal, encoded) {
+                journal.record(JournalEntry::Enqueue { seq, item });
+            }
+        }
+    }
+
+    /// Process one work item. Returns false once the queue is drained or
+    /// the run is cancelled.
+    ///
+    /// When the queue is empty but other workers still have items in flight,
+    /// blocks until they enqueue follow-up work or finish.
+    fn step<D: Dispatch>(&self, dispatch: &D, started: Instant, stats: &mut WorkerStats) -> bool {
+        let wait_start = Instant::now();
+        let mut wait = Duration::ZERO;
+        let mut idle = Duration::ZERO;
+        let next = {
+            let mut scheduler = self.scheduler.lock().unwrap();
+            wait += wait_start.elapsed();
+            loop {
+                if self.cancelled.load(std::sync::atomic::Ordering::SeqCst) {
+                    break None;
+                }
+                if let Some((stage, item)) = dispatch.begin(&mut scheduler) {
+                    let queued = item.enqueued_at.map(|t| t.elapsed());
+                    let input = Footprint::of_item(&item.sample, &item.metadata);
+                    self.memory
+                        .transfer(MemoryLocation::Queued, MemoryLocation::InFlight, &input);
+                    break Some((stage, item, queued, input));
+                }
+                if scheduler.in_flight() == 0 {
+                    break None;
+                }
+                let idle_start = Instant::now();
+                scheduler = self.scheduler.wait(&self.work_ready, scheduler).unwrap();
+                idle += idle_start.elapsed();
+            }
+        };
+        let (stage, item, queued, input) = match next {
+            Some(next) => next,
+            None => {
+                self.record_step(stats, None, wait, idle);
+                return false;
+            }
+        };
+        let guard = InFlightGuard {
+            scheduler: &self.scheduler,
+            work_ready: &self.work_ready,
+            stop: &self.cancelled,
+            items: 1,
+        };
+
+        let tracer = self.tracer.as_deref();
+        let worker = stats.worker;
+        let seq = item.seq;
+        let order = item.order;
+        let stage_id = item.stage_id;
+        let instance = item.instance;
+        let perf_start = self.perf_counters.then(perf::read).flatten();
+        let busy_start = Instant::now();
+        if let Some(t) = tracer {
+            t.span(worker, SpanKind::Dequeue, None, wait_start, busy_start);
+        }
+        let mut stage_result = match &stage {
+            Some(stage) => dispatch.run(stage, self.cache.as_ref(), item.sample, item.metadata),
+            // No stage handles the item: its sample is done.
+            None => StageResult::terminal(item.sample, item.metadata),
+        };
+        stage_result.inherit_instance(instance);
+        let busy = busy_start.elapsed();
+        let perf = perf_start.and_then(|start| Some(perf::read()?.since(&start)));
+        if let Some(t) = tracer {
+            t.span(
+                worker,
+                SpanKind::Execute,
+                Some(stage_id),
+                busy_start,
+                busy_start + busy,
+            );
+        }
+        let mut step = StepMetrics {
+            stage_id,
+            queued,
+            busy,
+            decisions: [(0, 0); StageId::COUNT],
+            perf,
+        };
+
+        if stage.is_some() {
+            self.progress.record_stage(stage_result.sample.stage_num);
+        }
+        let wait_start = Instant::now();
+        let (finish, lock_wait) = self.submit(
+            seq,
+            order,
+            stage_result.sample,
+            stage_result.requests,
+            &mut step,
+            started,
+            stats,
+        );
+        guard.disarm();
+        wait += lock_wait;
+        let regroup_start = Instant::now();
+        if let Some(t) = tracer {
+            t.span(worker, SpanKind::Enqueue, None, wait_start, regroup_start);
+        }
+        let step = stage.is_some().then_some(&step);
+        self.record_step(stats, step, wait, idle);
+        self.memory.sub(MemoryLocation::InFlight, &input);
+
+        if let Some((sample, terminal)) = finish {
+            self.finish_sample(sample, terminal, started, stats);
+            if let Some(t) = tracer {
+                t.span(
+                    worker,
+                    SpanKind::Regroup,
+                    None,
+                    regroup_start,
+                    Instant::now(),
+                );
+            }
+        }
+
+        true
+    }
 
-                    // If no more stages requested, sample is complete
-                    if stage_result.requests.is_empty() {
-                        let mut completed = self.completed.lock().unwrap();
-                        completed.push(stage_result.sample);
-                    } else {
-                        // Add to regroup pool at current stage
-                        let mut pool = self.regroup_pool.lock().unwrap();
-                        pool.add(stage_result.sample);
+    /// Hand a stage's output to the scheduler: enqueue the follow-ups the
+    /// policy accepts and journal the step, or hold the output for its wave
+    /// in deterministic mode.
+    ///
+    /// Returns the sample and whether it is terminal when the caller still
+    /// has to finish it, plus the time spent acquiring the scheduler lock.
+    #[allow(clippy::too_many_arguments)]
+    fn submit(
+        &self,
+        seq: u64,
+        order: u64,
+        sample: Sample,
+        requests: Vec<StageRequest>,
+        step: &mut StepMetrics,
+        started: Instant,
+        stats: &mut WorkerStats,
+    ) -> (Option<(Sample, bool)>, Duration) {
+        if self.deterministic {
+            let deferred = Deferred {
+                order,
+                seq,
+                sample,
+                requests,
+            };
+            return (None, self.defer(deferred, started, stats));
+        }
+
+        let terminal = requests.is_empty();
+        let policy = self.insertion_policy.clone();
+
+        // Build and encode follow-ups before taking the lock; only their
+        // sequence numbers are assigned under it.
+        let mut items = Vec::with_capacity(requests.len());
+        // Requests are consumed so their metadata moves into the item.
+        for request in requests {
+            let decision = &mut step.decisions[request.stage_id.index()];
+            if policy.should_insert(&request) {
+                decision.0 += 1;
+                let item = WorkItem::from_request(sample.clone(), request);
+                let encoded = self.journal.as_ref().map(|_| encode_work_item(&item));
+                items.push((item, encoded));
+            } else {
+                decision.1 += 1;
+            }
+        }
+        let encoded_sample = self.journal.as_ref().map(|_| encode_sample_bytes(&sample));
+
+        let wait_start = Instant::now();
+        let mut scheduler = self.scheduler.lock().unwrap();
+        let wait = wait_start.elapsed();
+
+        let mut enqueued = Vec::new();
+        for (item, encoded) in items {
+            self.memory.add(
+                MemoryLocation::Queued,
+                &Footprint::of_item(&item.sample, &item.metadata),
+            );
+            let new_seq = scheduler.enqueue(item);
+            if let Some(item) = encoded {
+                enqueued.push((new_seq, item));
+            }
+        }
+
+        // Journal under the lock so a follow-up step can never be
+        // recorded before the step that enqueued it.
+        if let (Some(journal), Some(sample)) = (&self.journal, encoded_sample) {
+            journal.record(JournalEntry::Step {
+                done: seq,
+                enqueued,
+                completed: terminal,
+                sample,
+            });
+        }
+
+        scheduler.finish();
+        if !scheduler.is_empty() || scheduler.in_flight() == 0 {
+            self.work_ready.notify_all();
+        }
+        (Some((sample, terminal)), wait)
+    }
+
+    /// Hold a result until its wave completes; the worker that finishes the
+    /// wave commits it. Returns the time spent acquiring the scheduler lock.
+    fn defer(&self, deferred: Deferred, started: Instant, stats: &mut WorkerStats) -> Duration {
+        // Held results count as in flight until the wave commits.
+        self.memory.add(
+            MemoryLocation::InFlight,
+            &Footprint::of_sample(&deferred.sample),
+        );
+        let wait_start = Instant::now();
+        let mut scheduler = self.scheduler.lock().unwrap();
+        let wait = wait_start.elapsed();
+        self.wave.lock().unwrap().push(deferred);
+        scheduler.finish();
+        // Committing under the same lock keeps waiting workers from seeing
+        // an empty queue between waves.
+        if scheduler.is_empty() && scheduler.in_flight() == 0 {
+            self.commit_wave(&mut scheduler, started, stats);
+        }
+        if !scheduler.is_empty() || scheduler.in_flight() == 0 {
+            self.work_ready.notify_all();
+        }
+        wait
+    }
+
+    /// Apply the held results of a wave in (order, seq) order: insertion
+    /// decisions, journal entries, then completed list or regroup pool.
+    /// Follow-up items are numbered in the same order to form the next
+    /// wave.
+    fn commit_wave(
+        &self,
+        scheduler: &mut PriorityScheduler,
+        started: Instant,
+        stats: &mut WorkerStats,
+    ) {
+        let mut wave = std::mem::take(&mut *self.wave.lock().unwrap());
+        wave.sort_unstable_by_key(|d| (d.order, d.seq));
+
+        let mut decisions = [(0, 0); StageId::COUNT];
+        let mut next_order = 0;
+        for deferred in wave {
+            self.memory.sub(
+                MemoryLocation::InFlight,
+                &Footprint::of_sample(&deferred.sample),
+            );
+            let terminal = deferred.requests.is_empty();
+            let mut enqueued = Vec::new();
+            for request in deferred.requests {
+                let decision = &mut decisions[request.stage_id.index()];
+                if self.insertion_policy.should_insert(&request) {
+                    decision.0 += 1;
+                    let item = WorkItem::from_request(deferred.sample.clone(), request)
+                        .with_order(next_order);
+                    next_order += 1;
+                    self.memory.add(
+                        MemoryLocation::Queued,
+                        &Footprint::of_item(&item.sample, &item.metadata),
+                    );
+                    let encoded = self.journal.as_ref().map(|_| encode_work_item(&item));
+                    let new_seq = scheduler.enqueue(item);
+                    if let Some(item) = encoded {
+                        enqueued.push((new_seq, item));
                     }
+                } else {
+                    decision.1 += 1;
+                }
+            }
+            self.journal(|| JournalEntry::Step {
+                done: deferred.seq,
+                enqueued,
+                completed: terminal,
+                sample: encode_sample_bytes(&deferred.sample),
+            });
+            self.finish_sample(deferred.sample, terminal, started, stats);
+        }
+        self.metrics
+            .shard(stats.worker)
+            .lock()
+            .unwrap()
+            .record_decisions(&decisions);
+    }
+
+    /// Move a stage's output sample to the completed list or regroup pool.
+    fn finish_sample(
+        &self,
+        sample: Sample,
+        terminal: bool,
+        started: Instant,
+        stats: &mut WorkerStats,
+    ) {
+        if terminal {
+            if let Some(cache) = &self.cache {
+                let key = self.pipeline_keys.lock().unwrap().remove(&sample.id);
+                if let Some(Some(key)) = key {
+                    cache.store_pipeline(key, &sample);
                 }
-                None => break,
+            }
+
+            if let Some(store) = &self.series {
+                store.complete_frame(&sample);
+            }
+            stats.sample_latencies.push(started.elapsed());
+            // A sample that ended before the sweep diverged is every
+            // point's result.
+            let results = match sample.sweep_point() {
+                Some(_) => 1,
+                None => self.fan_out,
+            };
+            self.progress.record_completed_many(results);
+            let mut completed = self.completed.lock().unwrap();
+            self.memory
+                .add(MemoryLocation::Completed, &Footprint::of_sample(&sample));
+            completed.push(sample);
+        } else {
+            // Add to regroup pool at current stage. Every worker takes the
+            // pool lock here, so idle samples are compressed outside it.
+            let idle = {
+                let mut pool = self.regroup_pool.lock().unwrap();
+                let idle = pool.add_and_take_idle(sample);
+                self.memory.set(MemoryLocation::Pool, &pool.footprint());
+                idle
+            };
+            if let Some(mut idle) = idle {
+                idle.compress();
+                let mut pool = self.regroup_pool.lock().unwrap();
+                pool.put_cold(idle);
+                self.memory.set(MemoryLocation::Pool, &pool.footprint());
             }
         }
     }
 
+    /// Fold one step's timing into the run stats and the worker's shard.
+    fn record_step(
+        &self,
+        stats: &mut WorkerStats,
+        step: Option<&StepMetrics>,
+        wait: Duration,
+        idle: Duration,
+    ) {
+        stats.scheduler_wait += wait;
+        stats.idle += idle;
+
+        let mut shard = self.metrics.shard(stats.worker).lock().unwrap();
+        shard.worker.scheduler_wait += wait;
+        shard.worker.idle += idle;
+
+        if let Some(step) = step {
+            stats.busy += step.busy;
+            stats.stages_executed += 1;
+            shard.record(step);
+        }
+    }
+
     /// Run batch processing asynchronously with callbacks.
+    ///
+    /// A panicking stage stops the run and `on_complete` receives
+    /// `SaxsStatus::RuntimeError`.
     pub fn run_async<F, P, S>(&mut self, on_complete: F, on_progress: P, on_sample: S)
     where
         F: FnOnce(SaxsStatus) + Send + 'static,
@@ -191,67 +1500,286 @@ impl Runtime {
         // Move samples to scheduler
         let samples: Vec<Sample> = self.pending_samples.drain(..).collect();
         let sample_count = samples.len();
+        let memory = self.memory.clone();
+        memory.begin_batch();
+        memory.set(MemoryLocation::Pending, &Footprint::default());
+        let progress = self.progress.clone();
+        progress.begin(sample_count);
 
         // Clone Arc references for the async task
         let registry = self.registry.clone();
         let policy = self.insertion_policy.clone();
+        let series = self.series.clone();
+        let preview = self.preview.clone().map(|c| Arc::new(PreviewBatch::new(c)));
+        let samples = match &preview {
+            Some(batch) => batch.start(samples),
+            None => samples,
+        };
 
-        self.tokio_runtime.spawn(async move {
-            let scheduler = Arc::new(Mutex::new(PriorityScheduler::new(registry)));
-            let completed = Arc::new(Mutex::new(0usize));
+        let workers = self.config.worker_count.max(1);
+        let metrics = self.metrics.clone();
+        let perf_counters = self.perf_counters;
+        let trace = self
+            .trace_config
+            .clone()
+            .map(|config| (Arc::new(Tracer::new(workers, config.capacity)), config));
+        let on_progress = Arc::new(on_progress);
+        let on_sample = Arc::new(on_sample);
+        let reporter = self.progress_interval.map(|interval| {
+            let on_progress = on_progress.clone();
+            ProgressReporter::start(progress.clone(), interval, move |s| {
+                on_progress(s.max_stage(), s.completed as usize, s.total as usize)
+            })
+        });
+        let per_sample_progress = reporter.is_none();
 
+        // Contention on this run's queue counts towards the scheduler lock.
+        let queue = Arc::new((
+            self.scheduler.sibling(PriorityScheduler::new(registry)),
+            Condvar::new(),
+        ));
+        // Set when a stage panics; the other workers then stop.
+        let failed = Arc::new(AtomicBool::new(false));
+        self.tokio_runtime.spawn(async move {
             // Initialize scheduler
             {
-                let mut sched = scheduler.lock().unwrap();
+                let mut sched = queue.0.lock().unwrap();
                 for sample in samples {
                     let metadata = FlowMetadata::from_sample(&sample.id, &sample.metadata);
+                    memory.add(
+                        MemoryLocation::Queued,
+                        &Footprint::of_item(&sample, &metadata),
+                    );
                     sched.enqueue(WorkItem::new(sample, metadata, StageId::FindPeak));
                 }
             }
 
-            // Process loop
-            loop {
-                let result = {
-                    let mut sched = scheduler.lock().unwrap();
-                    if sched.is_empty() {
-                        None
-                    } else {
-                        sched.process_next()
-                    }
-                };
-
-                match result {
-                    Some(stage_result) => {
-                        // Handle stage requests
-                        {
-                            let mut sched = scheduler.lock().unwrap();
-                            for request in &stage_result.requests {
-                                if policy.should_insert(request) {
+            // Stages are CPU-bound, so each worker gets a blocking thread.
+            let handles: Vec<_> = (0..workers)
+                .map(|worker| {
+                    let queue = queue.clone();
+                    let metrics = metrics.clone();
+                    let memory = memory.clone();
+                    let progress = progress.clone();
+                    let tracer = trace.as_ref().map(|(t, _)| t.clone());
+                    let policy = policy.clone();
+                    let on_progress = on_progress.clone();
+                    let on_sample = on_sample.clone();
+                    let series = series.clone();
+                    let preview = preview.clone();
+                    let failed = failed.clone();
+                    tokio::task::spawn_blocking(move || {
+                        let (scheduler, work_ready) = &*queue;
+                        let shard = metrics.shard(worker);
+                        let tracer = tracer.as_deref();
+                        loop {
+                            let mut idle = Duration::ZERO;
+                            let dequeue_start = Instant::now();
+                            let (stage, item) = {
+                                let mut sched = scheduler.lock().unwrap();
+                                loop {
+                                    if failed.load(Ordering::SeqCst) {
+                                        return;
+                                    }
+                                    if let Some(next) = sched.begin_next() {
+                                        break next;
+                                    }
+                                    if sched.in_flight() == 0 {
+                                        shard.lock().unwrap().worker.idle += idle;
+                                        return;
+                                    }
+                                    let idle_start = Instant::now();
+                                    sched = scheduler.wait(work_ready, sched).unwrap();
+                                    idle += idle_start.elapsed();
+                                }
+                            };
+                            let guard = InFlightGuard {
+                                scheduler,
+                                work_ready,
+                                stop: &failed,
+                                items: 1,
+                            };
+
+                            let queued = item.enqueued_at.map(|t| t.elapsed());
+                            let input = Footprint::of_item(&item.sample, &item.metadata);
+                            memory.transfer(
+                                MemoryLocation::Queued,
+                                MemoryLocation::InFlight,
+                                &input,
+                            );
+                            let perf_start = perf_counters.then(perf::read).flatten();
+                            let busy_start = Instant::now();
+                            let mut stage_result = match &stage {
+                                Some(stage) => stage.process(item.sample, item.metadata),
+                                // No stage handles the item: its sample is done.
+                                None => StageResult::terminal(item.sample, item.metadata),
+                            };
+                            stage_result.inherit_instance(item.instance);
+                            let busy = busy_start.elapsed();
+                            if stage.is_some() {
+                                progress.record_stage(stage_result.sample.stage_num);
+                            }
+                            let perf =
+                                perf_start.and_then(|start| Some(perf::read()?.since(&start)));
+                            if let Some(t) = tracer {
+                                let stage_id = Some(item.stage_id);
+                                t.span(worker, SpanKind::Dequeue, None, dequeue_start, busy_start);
+                                t.span(
+                                    worker,
+                                    SpanKind::Execute,
+                                    stage_id,
+                                    busy_start,
+                                    busy_start + busy,
+                                );
+                            }
+                            let mut step = StepMetrics {
+                                stage_id: item.stage_id,
+                                queued,
+                                busy,
+                                decisions: [(0, 0); StageId::COUNT],
+                                perf,
+                            };
+                            let StageResult {
+                                sample, requests, ..
+                            } = stage_result;
+
+                            // A finished preview is delivered before its
+                            // refinement is queued, so `on_sample` always
+                            // sees it first. The item is still in flight,
+                            // so no worker sees a drained queue meanwhile.
+                            let refined = match &preview {
+                                Some(batch) if requests.is_empty() => batch.refine(&sample),
+                                _ => None,
+                            };
+                            let sample = if refined.is_some() {
+                                let callback_start = Instant::now();
+                                on_sample(sample);
+                                if let Some(t) = tracer {
+                                    t.span(
+                                        worker,
+                                        SpanKind::Callback,
+                                        None,
+                                        callback_start,
+                                        Instant::now(),
+                                    );
+                                }
+                                None
+                            } else {
+                                Some(sample)
+                            };
+                            let enqueue_start = Instant::now();
+
+                            // Handle stage requests
+                            {
+                                let mut sched = scheduler.lock().unwrap();
+                                for request in &requests {
+                                    let decision = &mut step.decisions[request.stage_id.index()];
+                                    if policy.should_insert(request) {
+                                        decision.0 += 1;
+                                        // Only finished samples were delivered.
+                                        let item = WorkItem::from_request(
+                                            sample.clone().unwrap(),
+                                            request.clone(),
+                                        );
+                                        memory.add(
+                                            MemoryLocation::Queued,
+                                            &Footprint::of_item(&item.sample, &item.metadata),
+                                        );
+                                        sched.enqueue(item);
+                                    } else {
+                                        decision.1 += 1;
+                                    }
+                                }
+                                if let Some(sample) = refined {
+                                    let metadata =
+                                        FlowMetadata::from_sample(&sample.id, &sample.metadata);
+                                    memory.add(
+                                        MemoryLocation::Queued,
+                                        &Footprint::of_item(&sample, &metadata),
+                                    );
                                     sched.enqueue(WorkItem::new(
-                                        stage_result.sample.clone(),
-                                        request.metadata.clone(),
-                                        request.stage_id,
+                                        sample,
+                                        metadata,
+                                        StageId::FindPeak,
                                     ));
                                 }
+                                sched.finish();
+                                if !sched.is_empty() || sched.in_flight() == 0 {
+                                    work_ready.notify_all();
+                                }
+                            }
+                            guard.disarm();
+                            {
+                                let mut shard = shard.lock().unwrap();
+                                shard.worker.idle += idle;
+                                if stage.is_some() {
+                                    shard.record(&step);
+                                }
+                            }
+                            memory.sub(MemoryLocation::InFlight, &input);
+                            let callback_start = Instant::now();
+                            if let Some(t) = tracer {
+                                t.span(
+                                    worker,
+                                    SpanKind::Enqueue,
+                                    None,
+                                    enqueue_start,
+                                    callback_start,
+                                );
                             }
-                        }
-
-                        // If complete, invoke callback
-                        if stage_result.requests.is_empty() {
-                            let mut count = completed.lock().unwrap();
-                            *count += 1;
-                            let c = *count;
-                            drop(count);
 
-                            on_progress(stage_result.sample.stage_num, c, sample_count);
-                            on_sample(stage_result.sample);
+                            // If complete, invoke callback. A finished
+                            // preview is delivered but does not complete its
+                            // sample.
+                            if let Some(mut sample) = sample.filter(|_| requests.is_empty()) {
+                                if !sample.metadata.provisional {
+                                    if preview.is_some() {
+                                        sample.metadata.search = None;
+                                    }
+                                    let c = progress.record_completed() as usize;
+                                    if per_sample_progress {
+                                        on_progress(sample.stage_num, c, sample_count);
+                                    }
+                                    if let Some(store) = &series {
+                                        store.complete_frame(&sample);
+                                    }
+                                }
+                                on_sample(sample);
+                                if let Some(t) = tracer {
+                                    t.span(
+                                        worker,
+                                        SpanKind::Callback,
+                                        None,
+                                        callback_start,
+                                        Instant::now(),
+                                    );
+                                }
+                            }
                         }
-                    }
-                    None => break,
-                }
+                    })
+                })
+                .collect();
+
+            let mut panicked = false;
+            for handle in handles {
+                panicked |= handle.await.is_err();
+            }
+            if let Some(store) = &series {
+                store.flush_tracks();
+            }
+            progress.finish();
+            if let Some(reporter) = reporter {
+                reporter.stop();
+            }
+            if let Some((tracer, config)) = &trace {
+                let _ = tracer.write_to(config);
             }
 
-            on_complete(SaxsStatus::Ok);
+            on_complete(if panicked {
+                SaxsStatus::RuntimeError
+            } else {
+                SaxsStatus::Ok
+            });
         });
     }
 
@@ -260,13 +1788,12 @@ impl Runtime {
         let mut pool = self.regroup_pool.lock().unwrap();
         let mut result = pool.regroup(min_stage);
 
-        // Also include completed samples
+        // Also include completed samples; those below min_stage stay put
         {
             let mut completed = self.completed.lock().unwrap();
-            let matching: Vec<_> = completed
-                .drain(..)
-                .filter(|s| s.stage_num >= min_stage)
-                .collect();
+            let (matching, kept): (Vec<_>, Vec<_>) =
+                completed.drain(..).partition(|s| s.stage_num >= min_stage);
+            *completed = kept;
             result.extend(matching);
         }
 
@@ -275,6 +1802,13 @@ impl Runtime {
             let excess: Vec<_> = result.drain(max_count..).collect();
             self.completed.lock().unwrap().extend(excess);
         }
+        drop(pool);
+        self.recount_memory();
+
+        self.journal(|| JournalEntry::Regroup {
+            min_stage,
+            taken: result.iter().map(|s| (s.id.clone(), s.stage_num)).collect(),
+        });
 
         result
     }
@@ -283,6 +1817,8 @@ impl Runtime {
     pub fn cancel(&self) {
         self.cancelled
             .store(true, std::sync::atomic::Ordering::SeqCst);
+        let _scheduler = self.scheduler.lock().unwrap();
+        self.work_ready.notify_all();
     }
 
     /// Reset the runtime for reuse.
@@ -291,8 +1827,1049 @@ impl Runtime {
         self.scheduler.lock().unwrap().clear();
         self.regroup_pool.lock().unwrap().reset();
         self.completed.lock().unwrap().clear();
+        self.pipeline_keys.lock().unwrap().clear();
+        self.recount_memory();
         self.insertion_policy.reset();
+        self.journal(|| JournalEntry::Reset);
         self.cancelled
             .store(false, std::sync::atomic::Ordering::SeqCst);
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::runtime::preview::PreviewConfig;
+    use crate::stage::find_peak::FindPeakConfig;
+    use crate::stage::process_peak::ProcessPeakConfig;
+
+    fn make_sample(id: &str) -> Sample {
+        let q: Vec<f64> = (0..100).map(|i| i as f64 * 0.01).collect();
+        let intensity: Vec<f64> = q
+            .iter()
+            .map(|&x| 2.0 * (-(x - 0.3).powi(2) / 0.001).exp() + (-(x - 0.7).powi(2) / 0.001).exp())
+            .collect();
+        Sample::new(id, q, intensity, vec![0.1; 100]).unwrap()
+    }
+
+    #[test]
+    fn test_resume_from_snapshot() {
+        let dir = std::env::temp_dir().join(format!("saxsrs-resume-{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        let config = RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        };
+
+        let expected = {
+            let mut runtime = Runtime::new(config.clone());
+            runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+            runtime.run_sync();
+            runtime.completed_count()
+        };
+
+        {
+            let mut runtime = Runtime::new(config.clone());
+            runtime.enable_snapshots(SnapshotConfig::new(&dir)).unwrap();
+            runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+            // Process a few stages, then drop the runtime as if it crashed.
+            let dispatch = Dynamic::new(runtime.registry.clone());
+            runtime.enqueue_pending(&dispatch);
+            let mut stats = WorkerStats::default();
+            for _ in 0..3 {
+                assert!(runtime.step(&dispatch, Instant::now(), &mut stats));
+            }
+            runtime.sync_snapshots().unwrap();
+        }
+
+        let mut resumed = Runtime::resume_with_config(config, &dir).unwrap();
+        assert_eq!(resumed.pending_count(), 4);
+        assert_eq!(resumed.regroup_pool.lock().unwrap().total_count(), 3);
+        resumed.run_sync();
+        assert_eq!(resumed.completed_count(), expected);
+
+        drop(resumed);
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_parallel_run_completes_every_sample() {
+        let run = |workers| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: workers,
+                max_stages: None,
+            });
+            runtime.add_samples((0..16).map(|i| make_sample(&format!("s{}", i))));
+            runtime.run_sync();
+
+            let stats = runtime.last_run_stats().unwrap().clone();
+            let mut done: Vec<_> = runtime
+                .completed
+                .lock()
+                .unwrap()
+                .iter()
+                .map(|s| (s.id.clone(), s.stage_num))
+                .collect();
+            done.sort();
+            (done, stats)
+        };
+
+        let (serial, serial_stats) = run(1);
+        let (parallel, parallel_stats) = run(4);
+        assert_eq!(serial.len(), 16);
+        assert_eq!(serial, parallel);
+        assert_eq!(parallel_stats.workers, 4);
+        assert_eq!(parallel_stats.stages_executed, serial_stats.stages_executed);
+        assert_eq!(parallel_stats.sample_latencies.len(), 16);
+    }
+
+    #[test]
+    fn test_metrics_track_stages_and_policy() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+
+        let metrics = runtime.metrics();
+        let process = metrics.stage(StageId::ProcessPeak);
+        assert_eq!(
+            metrics.total_executions(),
+            runtime.last_run_stats().unwrap().stages_executed
+        );
+        assert!(process.executions > 0);
+        assert_eq!(process.executions, process.requeues);
+        assert_eq!(process.latency.count(), process.executions);
+        assert_eq!(process.queue_wait.count(), process.executions);
+        assert_eq!(metrics.workers.len(), 2);
+
+        runtime.reset();
+        runtime.reset_metrics();
+        runtime.set_insertion_policy(Arc::new(crate::runtime::policy::NeverInsertPolicy));
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+
+        let metrics = runtime.metrics();
+        assert_eq!(metrics.stage(StageId::FindPeak).executions, 4);
+        assert_eq!(metrics.stage(StageId::ProcessPeak).rejections, 4);
+        assert_eq!(metrics.total_executions(), 4);
+    }
+
+    #[test]
+    fn test_lock_stats_toggle() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+        assert!(runtime.lock_stats().iter().all(|l| l.acquisitions == 0));
+
+        runtime.reset();
+        runtime.set_lock_stats(true);
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+
+        let locks = runtime.metrics().locks;
+        let names: Vec<_> = locks.iter().map(|l| l.name).collect();
+        assert_eq!(names, ["scheduler", "regroup_pool", "completed"]);
+        let stages = runtime.last_run_stats().unwrap().stages_executed;
+        assert!(locks[0].acquisitions >= 2 * stages);
+        assert!(locks[2].acquisitions >= 4);
+        assert!(locks.iter().all(|l| l.contended <= l.acquisitions));
+
+        runtime.reset_metrics();
+        assert!(runtime.lock_stats().iter().all(|l| l.acquisitions == 0));
+
+        // run_async queues count towards the scheduler lock too.
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("a{}", i))));
+        let (done_tx, done_rx) = std::sync::mpsc::channel();
+        runtime.run_async(
+            move |status| done_tx.send(status).unwrap(),
+            |_, _, _| {},
+            |_| {},
+        );
+        assert_eq!(done_rx.recv().unwrap(), SaxsStatus::Ok);
+        assert!(runtime.lock_stats()[0].acquisitions >= 8);
+    }
+
+    #[test]
+    fn test_run_async_completes_unregistered_stages() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        // FindPeak requests ProcessPeak, which is not registered.
+        let mut registry = StageRegistry::new();
+        registry.register(FindPeakStage::default());
+        runtime.set_registry(registry);
+        runtime.add_samples((0..3).map(|i| make_sample(&format!("s{}", i))));
+
+        let (done_tx, done_rx) = std::sync::mpsc::channel();
+        let (sample_tx, sample_rx) = std::sync::mpsc::channel();
+        let sample_tx = Mutex::new(sample_tx);
+        runtime.run_async(
+            move |status| done_tx.send(status).unwrap(),
+            |_, _, _| {},
+            move |sample| sample_tx.lock().unwrap().send(sample.stage_num).unwrap(),
+        );
+        assert_eq!(done_rx.recv().unwrap(), SaxsStatus::Ok);
+        assert_eq!(sample_rx.try_iter().collect::<Vec<_>>(), [1, 1, 1]);
+        assert_eq!(runtime.progress().completed, 3);
+        let queued = runtime
+            .memory_stats()
+            .location(MemoryLocation::Queued)
+            .current;
+        assert_eq!(queued, Footprint::default());
+    }
+
+    /// FindPeak stand-in that panics on sample "bad".
+    struct PanicOn;
+
+    impl Stage for PanicOn {
+        fn id(&self) -> StageId {
+            StageId::FindPeak
+        }
+
+        fn process(&self, sample: Sample, metadata: FlowMetadata) -> StageResult {
+            assert!(sample.id != "bad", "stage failed");
+            std::thread::sleep(Duration::from_millis(1));
+            StageResult::terminal(sample, metadata)
+        }
+    }
+
+    #[test]
+    fn test_panicking_stage_stops_run() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 4,
+            max_stages: None,
+        });
+        let mut registry = StageRegistry::new();
+        registry.register(PanicOn);
+        runtime.set_registry(registry);
+        let batch = || (0..32).map(|i| make_sample(if i == 5 { "bad" } else { "ok" }));
+
+        runtime.add_samples(batch());
+        let result = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| runtime.run_sync()));
+        let message = result.unwrap_err();
+        assert_eq!(message.downcast_ref::<&str>(), Some(&"stage failed"));
+        assert_eq!(runtime.scheduler.lock().unwrap().in_flight(), 0);
+
+        runtime.reset();
+        runtime.add_samples(batch());
+        let (done_tx, done_rx) = std::sync::mpsc::channel();
+        runtime.run_async(
+            move |status| done_tx.send(status).unwrap(),
+            |_, _, _| {},
+            |_| {},
+        );
+        assert_eq!(done_rx.recv().unwrap(), SaxsStatus::RuntimeError);
+    }
+
+    #[test]
+    fn test_allocation_budget_per_stage() {
+        use crate::data::synthetic::{generate_batch, Noise, SyntheticConfig};
+
+        let config = SyntheticConfig {
+            noise: Noise::None,
+            ..Default::default()
+        };
+        // One worker runs on this thread, so every allocation is counted.
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        runtime.add_samples(generate_batch(&config, 1, 0, 4));
+        let (_, counts) = crate::alloc_count::count(|| runtime.run_sync());
+
+        let stages = runtime.last_run_stats().unwrap().stages_executed;
+        let per_stage = counts.total() as f64 / stages as f64;
+        assert!(per_stage <= 14.0, "{:.1} allocations per stage", per_stage);
+    }
+
+    #[test]
+    fn test_perf_counters_per_stage() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        let available = runtime.set_perf_counters(true);
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+
+        let metrics = runtime.metrics();
+        let find = metrics.stage(StageId::FindPeak);
+        if available {
+            assert_eq!(find.perf.samples, find.executions);
+            assert!(find.perf.instructions > 0);
+        } else {
+            // Not permitted here: the run still completes, without counters.
+            assert_eq!(find.perf.samples, 0);
+            assert!(find.executions > 0);
+        }
+    }
+
+    #[test]
+    fn test_memory_accounting_follows_samples() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        let samples: Vec<_> = (0..4).map(|i| make_sample(&format!("s{}", i))).collect();
+        let input = Footprint::of_samples(&samples);
+        runtime.add_samples(samples);
+        assert_eq!(
+            runtime
+                .memory_stats()
+                .location(MemoryLocation::Pending)
+                .current,
+            input
+        );
+
+        runtime.run_sync();
+        let stats = runtime.memory_stats();
+        for location in [
+            MemoryLocation::Pending,
+            MemoryLocation::Queued,
+            MemoryLocation::InFlight,
+        ] {
+            assert_eq!(stats.location(location).current, Footprint::default());
+        }
+        assert!(stats.location(MemoryLocation::Queued).peak_bytes >= input.bytes());
+        assert!(stats.location(MemoryLocation::InFlight).peak_bytes > 0);
+        let completed = stats.location(MemoryLocation::Completed).current;
+        assert_eq!(completed.samples as usize, runtime.completed_count());
+        // Intermediate results wait in the regroup pool.
+        assert!(stats.location(MemoryLocation::Pool).current.samples > 0);
+        assert!(stats.peak_total_bytes >= stats.total_bytes);
+
+        runtime.reset();
+        assert_eq!(runtime.memory_stats().total_bytes, 0);
+    }
+
+    #[test]
+    fn test_throttled_progress_runs_off_workers() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        runtime.set_progress_interval(Some(Duration::from_secs(3600)));
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+
+        let calls = Arc::new(Mutex::new(Vec::new()));
+        let (done_tx, done_rx) = std::sync::mpsc::channel();
+        let progress_calls = calls.clone();
+        runtime.run_async(
+            move |status| done_tx.send(status).unwrap(),
+            move |stage, completed, total| {
+                progress_calls
+                    .lock()
+                    .unwrap()
+                    .push((stage, completed, total))
+            },
+            |_| {},
+        );
+        assert_eq!(done_rx.recv().unwrap(), SaxsStatus::Ok);
+
+        // The interval never elapsed: only the final snapshot was delivered.
+        let calls = calls.lock().unwrap();
+        assert_eq!(calls.len(), 1);
+        assert_eq!((calls[0].1, calls[0].2), (4, 4));
+
+        let progress = runtime.progress();
+        assert!(progress.is_finished());
+        assert!(progress.stage_results >= 4);
+        assert_eq!(progress.max_stage(), calls[0].0);
+    }
+
+    #[test]
+    fn test_preview_then_refined_result() {
+        let long_sample = |id: &str| {
+            let q: Vec<f64> = (0..8192).map(|i| i as f64 * 1e-4).collect();
+            let intensity = (0..8192)
+                .map(|i| {
+                    let x = i as f64;
+                    4.0 * (-((x - 2000.0) / 12.0).powi(2)).exp()
+                        + 2.0 * (-((x - 6000.0) / 12.0).powi(2)).exp()
+                })
+                .collect();
+            Sample::new(id, q, intensity, vec![0.1; 8192]).unwrap()
+        };
+        let run = |preview: bool| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            if preview {
+                runtime.enable_preview(PreviewConfig::default());
+            }
+            runtime.add_samples((0..3).map(|i| long_sample(&format!("s{}", i))));
+            let delivered = Arc::new(Mutex::new(Vec::new()));
+            let sink = delivered.clone();
+            let (done_tx, done_rx) = std::sync::mpsc::channel();
+            runtime.run_async(
+                move |status| done_tx.send(status).unwrap(),
+                |_, _, _| {},
+                move |s| sink.lock().unwrap().push(s),
+            );
+            assert_eq!(done_rx.recv().unwrap(), SaxsStatus::Ok);
+            assert_eq!(runtime.progress().completed, 3);
+            let delivered = std::mem::take(&mut *delivered.lock().unwrap());
+            delivered
+        };
+        let peaks = |s: &Sample| {
+            let mut peaks: Vec<usize> = s.metadata.processed_peaks.keys().copied().collect();
+            peaks.sort_unstable();
+            peaks
+        };
+
+        let full = run(false);
+        let delivered = run(true);
+        assert_eq!(delivered.len(), 6);
+        for id in ["s0", "s1", "s2"] {
+            let of_id: Vec<&Sample> = delivered.iter().filter(|s| s.id == id).collect();
+            let [preview, refined] = of_id[..] else {
+                panic!("expected a preview and a refined result for {id}");
+            };
+            assert!(preview.metadata.provisional && preview.len() < 8192);
+            let coarse: Vec<f64> = peaks(preview)
+                .iter()
+                .map(|&i| preview.q_values[i])
+                .collect();
+            assert_eq!(coarse, vec![0.2, 0.6]);
+
+            assert!(!refined.metadata.provisional && refined.metadata.search.is_none());
+            let expected = full.iter().find(|s| s.id == id).unwrap();
+            assert_eq!(peaks(refined), peaks(expected));
+            assert_eq!(refined.intensity, expected.intensity);
+        }
+    }
+
+    #[test]
+    fn test_deterministic_output_independent_of_workers() {
+        use crate::data::synthetic::{generate_batch, SyntheticConfig};
+        use crate::runtime::policy::SaturationPolicy;
+
+        let config = SyntheticConfig {
+            points: 256,
+            ..Default::default()
+        };
+        let run = |workers: usize| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: workers,
+                max_stages: None,
+            });
+            runtime.set_deterministic(true);
+            // A global budget makes decisions depend on processing order.
+            runtime.set_insertion_policy(Arc::new(SaturationPolicy::new(40)));
+            runtime.add_samples(generate_batch(&config, 11, 0, 16));
+            runtime.run_sync();
+            let metrics = runtime.metrics();
+            assert!(metrics.stages.iter().map(|s| s.rejections).sum::<u64>() > 0);
+            // (id, stage, intensity bits, sorted processed peaks) in output order.
+            runtime
+                .regroup(0, usize::MAX)
+                .into_iter()
+                .map(|s| {
+                    let mut peaks: Vec<_> = s
+                        .metadata
+                        .processed_peaks
+                        .iter()
+                        .map(|(&i, a)| (i, a.to_bits()))
+                        .collect();
+                    peaks.sort_unstable();
+                    let bits: Vec<u64> = s.intensity.iter().map(|x| x.to_bits()).collect();
+                    (s.id, s.stage_num, bits, peaks)
+                })
+                .collect::<Vec<_>>()
+        };
+
+        let single = run(1);
+        assert!(single.len() > 16, "intermediate results are pooled");
+        assert_eq!(run(4), single);
+        assert_eq!(run(3), single);
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_process_workers_restart_and_match_threads() {
+        use crate::data::synthetic::{generate_batch, SyntheticConfig};
+
+        let config = SyntheticConfig {
+            points: 128,
+            ..Default::default()
+        };
+        let run = |processes: Option<ProcessConfig>| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            runtime.set_deterministic(true);
+            assert!(runtime.set_process_workers(processes));
+            runtime.add_samples(generate_batch(&config, 5, 0, 6));
+            runtime.run_sync();
+            let restarts = runtime.last_run_stats().unwrap().worker_restarts;
+            let mut out: Vec<_> = runtime
+                .regroup(0, usize::MAX)
+                .into_iter()
+                .map(|s| {
+                    let bits: Vec<u64> = s.intensity.iter().map(|x| x.to_bits()).collect();
+                    (s.id, s.stage_num, bits)
+                })
+                .collect();
+            out.extend(runtime.take_completed().into_iter().map(|s| {
+                let bits: Vec<u64> = s.intensity.iter().map(|x| x.to_bits()).collect();
+                (s.id, s.stage_num, bits)
+            }));
+            assert_eq!(
+                runtime
+                    .memory_stats()
+                    .location(MemoryLocation::InFlight)
+                    .current
+                    .samples,
+                0
+            );
+            (out, restarts)
+        };
+
+        let (threads, _) = run(None);
+        let mut processes = ProcessConfig::new(2);
+        // The first worker to reach its third item dies holding it.
+        processes.crash_after = 3;
+        let (forked, restarts) = run(Some(processes));
+        assert_eq!(restarts, 1);
+        assert_eq!(forked, threads);
+
+        // Out of attempts, the run panics like a panicking stage with
+        // threads and leaves nothing in flight.
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        let mut processes = ProcessConfig::new(2);
+        processes.crash_after = 1;
+        processes.max_attempts = 1;
+        runtime.set_process_workers(Some(processes));
+        runtime.add_samples(generate_batch(&config, 5, 0, 6));
+        let result = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| runtime.run_sync()));
+        assert!(result.is_err());
+        assert_eq!(runtime.scheduler.lock().unwrap().in_flight(), 0);
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn test_process_workers_run_oversized_items_in_parent() {
+        use crate::data::synthetic::{generate_batch, SyntheticConfig};
+
+        // Some items fit a one-page slot but their results do not; others
+        // do not fit at all.
+        let mut samples = generate_batch(
+            &SyntheticConfig {
+                points: 165,
+                ..Default::default()
+            },
+            3,
+            0,
+            6,
+        );
+        samples.extend(generate_batch(
+            &SyntheticConfig {
+                points: 2048,
+                ..Default::default()
+            },
+            3,
+            3,
+            7,
+        ));
+        let run = |processes: Option<ProcessConfig>| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            runtime.set_deterministic(true);
+            assert!(runtime.set_process_workers(processes));
+            runtime.add_samples(samples.clone());
+            runtime.run_sync();
+            let mut out: Vec<_> = runtime
+                .regroup(0, usize::MAX)
+                .into_iter()
+                .chain(runtime.take_completed())
+                .map(|s| {
+                    let bits: Vec<u64> = s.intensity.iter().map(|x| x.to_bits()).collect();
+                    (s.id, s.stage_num, bits)
+                })
+                .collect();
+            out.sort();
+            out
+        };
+
+        let threads = run(None);
+        let mut processes = ProcessConfig::new(2);
+        processes.slot_bytes = 4096;
+        assert_eq!(run(Some(processes)), threads);
+    }
+
+    #[test]
+    fn test_static_pipeline_matches_registry() {
+        let run = |pipeline: bool| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            runtime.add_samples((0..6).map(|i| make_sample(&format!("s{}", i))));
+            if pipeline {
+                runtime.run_pipeline(&Pipeline::new((
+                    FindPeakStage::default(),
+                    ProcessPeakStage::default(),
+                )));
+            } else {
+                runtime.run_sync();
+            }
+            let mut out: Vec<(String, u32, Vec<usize>)> = runtime
+                .take_completed()
+                .into_iter()
+                .map(|s| {
+                    let mut peaks: Vec<usize> =
+                        s.metadata.processed_peaks.keys().copied().collect();
+                    peaks.sort_unstable();
+                    (s.id, s.stage_num, peaks)
+                })
+                .collect();
+            out.sort();
+            out
+        };
+        let expected = run(false);
+        assert_eq!(expected.len(), 6);
+        assert_eq!(run(true), expected);
+
+        // A sample requesting a stage outside the pipeline completes after
+        // the stages it did run, in thread and process mode.
+        for processes in [false, process::supported()] {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            if processes {
+                runtime.set_process_workers(Some(ProcessConfig::new(2)));
+            }
+            runtime.add_samples((0..2).map(|i| make_sample(&format!("s{}", i))));
+            runtime.run_pipeline(&Pipeline::new((FindPeakStage::default(),)));
+            assert_eq!(runtime.pending_count(), 0);
+            assert_eq!(runtime.progress().completed, 2);
+            let queued = runtime
+                .memory_stats()
+                .location(MemoryLocation::Queued)
+                .current;
+            assert_eq!(queued, Footprint::default());
+            let completed = runtime.take_completed();
+            assert_eq!(completed.len(), 2);
+            assert!(completed.iter().all(|s| s.stage_num == 1));
+        }
+    }
+
+    #[test]
+    fn test_sweep_matches_separate_runs() {
+        let find = [
+            FindPeakConfig::default(),
+            FindPeakConfig {
+                min_height: 1.5,
+                ..Default::default()
+            },
+        ];
+        let process = [
+            ProcessPeakConfig::default(),
+            ProcessPeakConfig {
+                parabola_range: 3,
+                ..Default::default()
+            },
+        ];
+        let runtime = || {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 2,
+                max_stages: None,
+            });
+            runtime.add_samples((0..3).map(|i| make_sample(&format!("s{}", i))));
+            runtime
+        };
+        let summary = |samples: Vec<Sample>| {
+            let mut out: Vec<(String, u32, Vec<usize>, Vec<u64>)> = samples
+                .into_iter()
+                .map(|s| {
+                    let mut peaks: Vec<usize> =
+                        s.metadata.processed_peaks.keys().copied().collect();
+                    peaks.sort_unstable();
+                    let bits = s.intensity.iter().map(|v| v.to_bits()).collect();
+                    (s.id, s.stage_num, peaks, bits)
+                })
+                .collect();
+            out.sort();
+            out
+        };
+
+        let sweep = Sweep::peak_grid(&find, &process);
+        let mut swept = runtime();
+        swept.run_sweep(&sweep);
+        let progress = swept.progress();
+        assert_eq!((progress.total, progress.completed), (12, 12));
+        let groups = sweep.by_point(swept.take_completed());
+        assert_eq!(groups.len(), 4);
+
+        for (point, group) in groups.into_iter().enumerate() {
+            assert!(group.iter().all(|s| s.sweep_point() == Some(point as u32)));
+            let mut registry = StageRegistry::new();
+            registry.register(FindPeakStage::new(find[point / 2].clone()));
+            registry.register(ProcessPeakStage::new(process[point % 2].clone()));
+            let mut single = runtime();
+            single.set_registry(registry);
+            single.run_sync();
+            assert_eq!(summary(group), summary(single.take_completed()));
+        }
+    }
+
+    #[test]
+    fn test_sweep_counts_shared_results_per_point() {
+        let process = [
+            ProcessPeakConfig::default(),
+            ProcessPeakConfig {
+                parabola_range: 3,
+                ..Default::default()
+            },
+        ];
+        let mut sweep = Sweep::new();
+        for config in &process {
+            sweep.add_point(vec![Arc::new(ProcessPeakStage::new(config.clone()))]);
+        }
+        assert_eq!(sweep.diverging(), vec![StageId::ProcessPeak]);
+
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        // Peak finding runs once per sample and is a checkpoint.
+        runtime.set_checkpoints(&[1]);
+        runtime.add_samples((0..3).map(|i| make_sample(&format!("s{}", i))));
+        // No peaks: completes at the shared stage.
+        let q: Vec<f64> = (0..100).map(|i| i as f64 * 0.01).collect();
+        runtime.add_sample(Sample::new("flat", q, vec![1.0; 100], vec![0.1; 100]).unwrap());
+        runtime.run_sweep(&sweep);
+
+        let progress = runtime.progress();
+        assert_eq!((progress.total, progress.completed), (8, 8));
+        assert!(runtime.regroup_pool.lock().unwrap().checkpoint_ready(1));
+        let groups = sweep.by_point(runtime.take_completed());
+        assert!(groups.iter().all(|g| g.len() == 4));
+
+        // A plain run still counts each result once.
+        runtime.reset();
+        runtime.add_samples((0..3).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+        assert_eq!(runtime.progress().completed, 3);
+        assert!(runtime.regroup_pool.lock().unwrap().checkpoint_ready(1));
+    }
+
+    #[test]
+    fn test_coarse_then_fine_instances() {
+        let peaks = |registry: StageRegistry| {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 1,
+                max_stages: None,
+            });
+            runtime.set_registry(registry);
+            runtime.add_samples((0..3).map(|i| make_sample(&format!("s{}", i))));
+            runtime.run_sync();
+            let completed = runtime.take_completed();
+            assert_eq!(completed.len(), 3);
+            let mut peaks: Vec<usize> = completed[0]
+                .metadata
+                .processed_peaks
+                .keys()
+                .copied()
+                .collect();
+            peaks.sort_unstable();
+            peaks
+        };
+        let coarse = || {
+            FindPeakStage::new(FindPeakConfig {
+                min_height: 1.5,
+                ..Default::default()
+            })
+        };
+
+        let mut registry = StageRegistry::new();
+        registry.register(coarse());
+        registry.register(ProcessPeakStage::default());
+        assert_eq!(peaks(registry), vec![30]);
+
+        // Instance 0 finds the strong peak, then hands over to instance 1;
+        // ProcessPeak has a single instance and returns to the caller's.
+        let mut registry = StageRegistry::new();
+        registry.register(coarse().followed_by(StageKey::new(StageId::FindPeak, 1)));
+        registry.register_instance(1, FindPeakStage::default());
+        registry.register(ProcessPeakStage::default());
+        let chained = peaks(registry);
+        assert!(chained.contains(&30) && chained.contains(&70));
+    }
+
+    #[test]
+    fn test_series_frames_warm_start() {
+        use crate::data::synthetic::{generate, Noise, SyntheticConfig};
+
+        // A slowly expanding lamellar lattice: its three orders drift a
+        // little every frame.
+        let d_spacing = |t: u64| 60.0 + 0.02 * t as f64;
+        let config = |t: u64| {
+            let mut config = SyntheticConfig {
+                points: 512,
+                noise: Noise::None,
+                ..Default::default()
+            };
+            config.peaks[0].d_spacing = d_spacing(t);
+            config
+        };
+        let frames: Vec<Sample> = (0..24u64)
+            .map(|t| generate(&config(t), 3, t).with_series(1, t))
+            .collect();
+        let assert_orders_found = |runtime: &mut Runtime| {
+            let completed = runtime.take_completed();
+            assert_eq!(completed.len(), 24);
+            for sample in completed {
+                let t = sample.series().unwrap().frame;
+                let c = config(t);
+                for order in 1..=3 {
+                    let q = 2.0 * std::f64::consts::PI * order as f64 / d_spacing(t);
+                    let at = (q - c.q_min) / (c.q_max - c.q_min) * (c.points - 1) as f64;
+                    assert!(
+                        sample
+                            .metadata
+                            .processed_peaks
+                            .keys()
+                            .any(|&i| (i as f64 - at).abs() <= 2.0),
+                        "frame {t} missed order {order} near {at:.1}"
+                    );
+                }
+            }
+        };
+
+        let mut cold = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        cold.add_samples(frames.clone());
+        cold.run_sync();
+        assert_orders_found(&mut cold);
+
+        let mut warm = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        let store = warm.enable_series(SeriesConfig::default());
+        warm.add_samples(frames);
+        warm.run_sync();
+        assert_orders_found(&mut warm);
+
+        let stats = store.stats();
+        assert!(stats.warm_searches > 0 && stats.warm_fits > 0, "{stats:?}");
+        assert!(stats.iterations_per_fit() < 5.0, "{stats:?}");
+
+        // Process workers would warm-start from copies of the store.
+        let mut forked = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        let store = forked.enable_series(SeriesConfig::default());
+        forked.set_process_workers(Some(ProcessConfig::new(2)));
+        forked.add_samples((0..24u64).map(|t| generate(&config(t), 3, t).with_series(1, t)));
+        forked.run_sync();
+        assert_orders_found(&mut forked);
+        assert_eq!(forked.last_run_stats().unwrap().workers, 1);
+        assert_eq!(store.stats(), stats);
+    }
+
+    #[test]
+    fn test_series_tracks_follow_drifting_orders() {
+        use crate::data::synthetic::{generate, Noise, SyntheticConfig};
+        use crate::series::TrackerConfig;
+
+        let d_spacing = |t: u64| 60.0 + 0.1 * t as f64;
+        let config = |t: u64| {
+            let mut config = SyntheticConfig {
+                points: 512,
+                noise: Noise::None,
+                ..Default::default()
+            };
+            config.peaks[0].d_spacing = d_spacing(t);
+            config
+        };
+        let order_index = |order: u32, t: u64| {
+            let c = config(t);
+            let q = 2.0 * std::f64::consts::PI * order as f64 / d_spacing(t);
+            (q - c.q_min) / (c.q_max - c.q_min) * (c.points - 1) as f64
+        };
+
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        let store = runtime.enable_series(SeriesConfig {
+            tracking: Some(TrackerConfig::default()),
+            ..Default::default()
+        });
+        runtime.add_samples((0..40u64).map(|t| generate(&config(t), 3, t).with_series(1, t)));
+        runtime.run_sync();
+
+        // Order 3 drifts by about 18 indices, more than the window.
+        let tracks = store.tracks();
+        for order in 1..=3 {
+            let followed = tracks.iter().any(|track| {
+                let first = &track.points[0];
+                let last = track.last();
+                track.points.len() >= 36
+                    && first.frame == 0
+                    && (first.index as f64 - order_index(order, 0)).abs() <= 2.0
+                    && (last.index as f64 - order_index(order, last.frame)).abs() <= 2.0
+            });
+            assert!(followed, "order {order} not tracked");
+        }
+
+        let columns = store.track_columns(36);
+        assert!(columns.len() >= 3 * 36);
+        assert!(columns
+            .track
+            .windows(2)
+            .zip(columns.frame.windows(2))
+            .all(|(t, f)| t[0] < t[1] || (t[0] == t[1] && f[0] < f[1])));
+    }
+
+    #[test]
+    fn test_tracing_writes_chrome_trace() {
+        let path = std::env::temp_dir().join(format!("saxsrs_trace_{}.json", std::process::id()));
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 2,
+            max_stages: None,
+        });
+        runtime.enable_tracing(TraceConfig::new(&path));
+        runtime.add_samples((0..4).map(|i| make_sample(&format!("s{}", i))));
+        runtime.run_sync();
+
+        let json = std::fs::read_to_string(&path).unwrap();
+        let executed = runtime.last_run_stats().unwrap().stages_executed as usize;
+        assert_eq!(json.matches("\"cat\":\"execute\"").count(), executed);
+        assert_eq!(json.matches("\"cat\":\"regroup\"").count(), executed);
+        assert!(json.contains("\"name\":\"process_peak\""));
+        std::fs::remove_file(&path).unwrap();
+
+        runtime.disable_tracing();
+        assert!(runtime.write_trace(&path).is_err());
+    }
+
+    #[test]
+    fn test_cache_short_circuits_reruns() {
+        for pipelines in [false, true] {
+            let mut runtime = Runtime::new(RuntimeConfig {
+                worker_count: 1,
+                max_stages: None,
+            });
+            runtime
+                .enable_cache(CacheConfig {
+                    pipelines,
+                    ..CacheConfig::default()
+                })
+                .unwrap();
+
+            runtime.add_samples((0..3).map(|i| make_sample(&format!("a{}", i))));
+            runtime.run_sync();
+            let first = runtime.regroup(0, usize::MAX);
+            let misses = runtime.cache_stats().unwrap().stage_misses;
+
+            runtime.add_samples((0..3).map(|i| make_sample(&format!("b{}", i))));
+            runtime.run_sync();
+            let second: Vec<Sample> = runtime
+                .regroup(0, usize::MAX)
+                .into_iter()
+                .filter(|s| s.id.starts_with('b'))
+                .collect();
+
+            // Nothing in the second run had to be computed.
+            let stats = runtime.cache_stats().unwrap();
+            assert_eq!(stats.stage_misses, misses);
+            if pipelines {
+                assert_eq!(stats.pipeline_hits, 3);
+            } else {
+                assert_eq!(stats.pipeline_hits + stats.pipeline_misses, 0);
+            }
+
+            // The final sample of every b-run matches its a-run twin.
+            let last = |v: &[Sample], id: &str| {
+                v.iter()
+                    .filter(|s| s.id == id)
+                    .max_by_key(|s| s.stage_num)
+                    .map(|s| (s.stage_num, s.intensity.clone()))
+            };
+            for i in 0..3 {
+                let a = last(&first, &format!("a{}", i));
+                assert!(a.is_some());
+                assert_eq!(a, last(&second, &format!("b{}", i)));
+            }
+        }
+    }
+
+    #[test]
+    fn test_cache_keeps_checkpoints_reachable() {
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        runtime.enable_cache(CacheConfig::default()).unwrap();
+        runtime.set_checkpoints(&[1]);
+
+        for run in ["a", "b"] {
+            runtime.add_samples((0..3).map(|i| make_sample(&format!("{}{}", run, i))));
+            runtime.run_sync();
+            // Cached pipelines would complete without passing stage 1.
+            assert!(runtime.regroup_pool.lock().unwrap().checkpoint_ready(1));
+            runtime.regroup(0, usize::MAX);
+        }
+        let stats = runtime.cache_stats().unwrap();
+        assert_eq!(stats.pipeline_hits + stats.pipeline_misses, 0);
+        assert!(stats.stage_hits > 0);
+    }
+
+    #[test]
+    fn test_cache_skips_series_stages() {
+        use crate::data::synthetic::{generate, SyntheticConfig};
+
+        let config = SyntheticConfig {
+            points: 256,
+            ..Default::default()
+        };
+        let frames: Vec<Sample> = (0..8u64)
+            .map(|t| generate(&config, 3, t).with_series(1, t))
+            .collect();
+        let mut runtime = Runtime::new(RuntimeConfig {
+            worker_count: 1,
+            max_stages: None,
+        });
+        runtime
+            .enable_cache(CacheConfig {
+                pipelines: true,
+                ..CacheConfig::default()
+            })
+            .unwrap();
+
+        // A fresh store must see the same frames again on the rerun.
+        let mut runs = Vec::new();
+        for _ in 0..2 {
+            let store = runtime.enable_series(SeriesConfig::default());
+            runtime.add_samples(frames.clone());
+            runtime.run_sync();
+            assert_eq!(runtime.take_completed().len(), 8);
+            runs.push(store.stats());
+        }
+        assert!(runs[0].warm_searches > 0, "{:?}", runs[0]);
+        assert_eq!(runs[0], runs[1]);
+        let stats = runtime.cache_stats().unwrap();
+        assert_eq!(stats.stage_hits + stats.stage_misses, 0);
+        assert_eq!(stats.pipeline_hits + stats.pipeline_misses, 0);
+    }
+}
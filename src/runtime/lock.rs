@@ -0,0 +1,262 @@
+//! Mutex wrapper that can record contention statistics.
+//!
+//! Instrumentation is switched on at runtime. When it is off, `lock` costs
+//! one relaxed atomic load on top of the plain `Mutex`. When it is on, each
+//! acquisition first tries `try_lock` so contended acquisitions can be
+//! counted, and the guard measures how long the lock was held.
+
+use std::ops::{Deref, DerefMut};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Condvar, LockResult, Mutex, MutexGuard, PoisonError, TryLockError};
+use std::time::{Duration, Instant};
+
+/// Contention statistics for one named lock.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct LockStats {
+    pub name: &'static str,
+    /// Recorded acquisitions.
+    pub acquisitions: u64,
+    /// Acquisitions that found the lock already held.
+    pub contended: u64,
+    /// Time spent blocked waiting for the lock.
+    pub wait: Duration,
+    /// Time the lock was held (condvar waits excluded).
+    pub hold: Duration,
+}
+
+impl LockStats {
+    /// Fraction of acquisitions that were contended.
+    pub fn contention_ratio(&self) -> f64 {
+        if self.acquisitions > 0 {
+            self.contended as f64 / self.acquisitions as f64
+        } else {
+            0.0
+        }
+    }
+}
+
+/// `Mutex` that records acquisitions, contention, wait and hold time while
+/// instrumentation is enabled.
+pub struct InstrumentedMutex<T> {
+    inner: Mutex<T>,
+    counters: Arc<Counters>,
+}
+
+/// Switch and statistics, shared by a lock and its siblings.
+struct Counters {
+    name: &'static str,
+    enabled: AtomicBool,
+    acquisitions: AtomicU64,
+    contended: AtomicU64,
+    wait_ns: AtomicU64,
+    hold_ns: AtomicU64,
+}
+
+impl<T> InstrumentedMutex<T> {
+    pub fn new(name: &'static str, value: T) -> Self {
+        Self {
+            inner: Mutex::new(value),
+            counters: Arc::new(Counters {
+                name,
+                enabled: AtomicBool::new(false),
+                acquisitions: AtomicU64::new(0),
+                contended: AtomicU64::new(0),
+                wait_ns: AtomicU64::new(0),
+                hold_ns: AtomicU64::new(0),
+            }),
+        }
+    }
+
+    /// A separate lock around `value` that records into this lock's
+    /// statistics and follows its enable switch.
+    pub fn sibling<U>(&self, value: U) -> InstrumentedMutex<U> {
+        InstrumentedMutex {
+            inner: Mutex::new(value),
+            counters: self.counters.clone(),
+        }
+    }
+
+    pub fn set_enabled(&self, enabled: bool) {
+        self.counters.enabled.store(enabled, Ordering::Relaxed);
+    }
+
+    pub fn lock(&self) -> LockResult<InstrumentedGuard<'_, T>> {
+        let counters = &*self.counters;
+        if !counters.enabled.load(Ordering::Relaxed) {
+            return wrap(self.inner.lock(), |guard| self.guard(guard, None));
+        }
+
+        counters.acquisitions.fetch_add(1, Ordering::Relaxed);
+        let result = match self.inner.try_lock() {
+            Ok(guard) => Ok(guard),
+            Err(TryLockError::Poisoned(e)) => Err(e),
+            Err(TryLockError::WouldBlock) => {
+                let start = Instant::now();
+                let result = self.inner.lock();
+                counters.contended.fetch_add(1, Ordering::Relaxed);
+                add_nanos(&counters.wait_ns, start.elapsed());
+                result
+            }
+        };
+        let acquired = Instant::now();
+        wrap(result, |guard| self.guard(guard, Some(acquired)))
+    }
+
+    /// Block on `condvar`, releasing the lock while waiting.
+    ///
+    /// The wait is not counted as hold time or as a new acquisition.
+    pub fn wait<'a>(
+        &'a self,
+        condvar: &Condvar,
+        mut guard: InstrumentedGuard<'a, T>,
+    ) -> LockResult<InstrumentedGuard<'a, T>> {
+        guard.record_hold();
+        let inner = guard.inner.take().expect("guard already released");
+        let result = condvar.wait(inner);
+        let acquired = self
+            .counters
+            .enabled
+            .load(Ordering::Relaxed)
+            .then(Instant::now);
+        wrap(result, |inner| self.guard(inner, acquired))
+    }
+
+    pub fn stats(&self) -> LockStats {
+        let c = &*self.counters;
+        LockStats {
+            name: c.name,
+            acquisitions: c.acquisitions.load(Ordering::Relaxed),
+            contended: c.contended.load(Ordering::Relaxed),
+            wait: Duration::from_nanos(c.wait_ns.load(Ordering::Relaxed)),
+            hold: Duration::from_nanos(c.hold_ns.load(Ordering::Relaxed)),
+        }
+    }
+
+    pub fn reset_stats(&self) {
+        let c = &*self.counters;
+        c.acquisitions.store(0, Ordering::Relaxed);
+        c.contended.store(0, Ordering::Relaxed);
+        c.wait_ns.store(0, Ordering::Relaxed);
+        c.hold_ns.store(0, Ordering::Relaxed);
+    }
+
+    fn guard<'a>(
+        &'a self,
+        inner: MutexGuard<'a, T>,
+        acquired: Option<Instant>,
+    ) -> InstrumentedGuard<'a, T> {
+        InstrumentedGuard {
+            lock: self,
+            inner: Some(inner),
+            acquired,
+        }
+    }
+}
+
+#[inline]
+fn add_nanos(counter: &AtomicU64, d: Duration) {
+    counter.fetch_add(d.as_nanos().min(u64::MAX as u128) as u64, Ordering::Relaxed);
+}
+
+fn wrap<'a, T, U>(
+    result: LockResult<MutexGuard<'a, T>>,
+    f: impl FnOnce(MutexGuard<'a, T>) -> U,
+) -> LockResult<U> {
+    match result {
+        Ok(guard) => Ok(f(guard)),
+        Err(e) => Err(PoisonError::new(f(e.into_inner()))),
+    }
+}
+
+/// Guard returned by `InstrumentedMutex::lock`.
+pub struct InstrumentedGuard<'a, T> {
+    lock: &'a InstrumentedMutex<T>,
+    inner: Option<MutexGuard<'a, T>>,
+    acquired: Option<Instant>,
+}
+
+impl<T> InstrumentedGuard<'_, T> {
+    fn record_hold(&mut self) {
+        if let Some(acquired) = self.acquired.take() {
+            add_nanos(&self.lock.counters.hold_ns, acquired.elapsed());
+        }
+    }
+}
+
+impl<T> Deref for InstrumentedGuard<'_, T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        self.inner.as_deref().expect("guard already released")
+    }
+}
+
+impl<T> DerefMut for InstrumentedGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        self.inner.as_deref_mut().expect("guard already released")
+    }
+}
+
+impl<T> Drop for InstrumentedGuard<'_, T> {
+    fn drop(&mut self) {
+        // Stop the clock before the inner guard unlocks.
+        self.record_hold();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_disabled_records_nothing() {
+        let lock = InstrumentedMutex::new("test", 0u32);
+        *lock.lock().unwrap() += 1;
+        assert_eq!(*lock.lock().unwrap(), 1);
+        assert_eq!(lock.stats().acquisitions, 0);
+    }
+
+    #[test]
+    fn test_counts_contention_and_hold() {
+        let lock = Arc::new(InstrumentedMutex::new("test", 0u32));
+        lock.set_enabled(true);
+
+        let guard = lock.lock().unwrap();
+        let other = {
+            let lock = lock.clone();
+            std::thread::spawn(move || *lock.lock().unwrap() += 1)
+        };
+        // Give the other thread time to block on the held lock.
+        std::thread::sleep(Duration::from_millis(20));
+        drop(guard);
+        other.join().unwrap();
+
+        let stats = lock.stats();
+        assert_eq!(stats.name, "test");
+        assert_eq!(stats.acquisitions, 2);
+        assert_eq!(stats.contended, 1);
+        assert!(stats.wait > Duration::ZERO);
+        assert!(stats.hold >= Duration::from_millis(20));
+        assert!((stats.contention_ratio() - 0.5).abs() < 1e-9);
+
+        lock.reset_stats();
+        assert_eq!(
+            lock.stats(),
+            LockStats {
+                name: "test",
+                ..Default::default()
+            }
+        );
+    }
+
+    #[test]
+    fn test_sibling_shares_stats() {
+        let lock = InstrumentedMutex::new("test", 0u32);
+        let sibling = lock.sibling(String::new());
+        lock.set_enabled(true);
+        sibling.lock().unwrap().push('x');
+        *lock.lock().unwrap() += 1;
+        assert_eq!(lock.stats().acquisitions, 2);
+        assert_eq!(sibling.stats(), lock.stats());
+    }
+}
@@ -0,0 +1,322 @@
+//! Byte accounting of samples by where they are held.
+//!
+//! The runtime moves each sample between locations (pending, queued, in
+//! flight, regroup pool, completed) and updates a gauge per location. Each
+//! gauge tracks sample count, array bytes and metadata bytes, plus a
+//! high-water mark that restarts with every batch. Sample handles owned by
+//! FFI callers are tracked process-wide, since they outlive any runtime.
+
+use crate::data::{CompressedSample, FlowMetadata, Sample};
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Where a sample is held.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum MemoryLocation {
+    /// Added to the runtime, not yet scheduled.
+    Pending = 0,
+    /// Work items waiting in the scheduler.
+    Queued = 1,
+    /// Inputs of stages currently executing.
+    InFlight = 2,
+    /// Regroup pool (cold samples at their compressed size).
+    Pool = 3,
+    /// Completed samples not yet collected.
+    Completed = 4,
+    /// Sample handles owned by FFI callers (process-wide).
+    Ffi = 5,
+}
+
+impl MemoryLocation {
+    pub const COUNT: usize = 6;
+
+    pub const ALL: [MemoryLocation; Self::COUNT] = [
+        MemoryLocation::Pending,
+        MemoryLocation::Queued,
+        MemoryLocation::InFlight,
+        MemoryLocation::Pool,
+        MemoryLocation::Completed,
+        MemoryLocation::Ffi,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            MemoryLocation::Pending => "pending",
+            MemoryLocation::Queued => "queued",
+            MemoryLocation::InFlight => "in_flight",
+            MemoryLocation::Pool => "pool",
+            MemoryLocation::Completed => "completed",
+            MemoryLocation::Ffi => "ffi",
+        }
+    }
+}
+
+/// Heap bytes held by a set of samples.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct Footprint {
+    pub samples: u64,
+    /// q, intensity and error arrays (allocated capacity).
+    pub array_bytes: u64,
+    /// Id string and peak maps (maps estimated from their capacity).
+    pub metadata_bytes: u64,
+}
+
+impl Footprint {
+    pub fn of_sample(sample: &Sample) -> Self {
+        Self {
+            samples: 1,
+            array_bytes: sample.array_bytes() as u64,
+            metadata_bytes: sample.metadata_bytes() as u64,
+        }
+    }
+
+    /// A sample with the flow metadata of its work item.
+    pub fn of_item(sample: &Sample, metadata: &FlowMetadata) -> Self {
+        let mut fp = Self::of_sample(sample);
+        fp.metadata_bytes += metadata.heap_bytes() as u64;
+        fp
+    }
+
+    pub fn of_compressed(sample: &CompressedSample) -> Self {
+        Self {
+            samples: 1,
+            array_bytes: sample.compressed_bytes() as u64,
+            metadata_bytes: (sample.id.capacity() + sample.metadata.heap_bytes()) as u64,
+        }
+    }
+
+    pub fn of_samples<'a>(samples: impl IntoIterator<Item = &'a Sample>) -> Self {
+        let mut total = Self::default();
+        for sample in samples {
+            total.add(&Self::of_sample(sample));
+        }
+        total
+    }
+
+    pub fn bytes(&self) -> u64 {
+        self.array_bytes + self.metadata_bytes
+    }
+
+    pub fn add(&mut self, other: &Footprint) {
+        self.samples += other.samples;
+        self.array_bytes += other.array_bytes;
+        self.metadata_bytes += other.metadata_bytes;
+    }
+
+    pub fn sub(&mut self, other: &Footprint) {
+        self.samples = self.samples.saturating_sub(other.samples);
+        self.array_bytes = self.array_bytes.saturating_sub(other.array_bytes);
+        self.metadata_bytes = self.metadata_bytes.saturating_sub(other.metadata_bytes);
+    }
+}
+
+/// Current and high-water bytes of one location.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct LocationStats {
+    pub current: Footprint,
+    /// Highest `current.bytes()` since the batch started.
+    pub peak_bytes: u64,
+}
+
+/// Memory accounting snapshot.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct MemoryStats {
+    /// Indexed by `MemoryLocation as usize`.
+    pub locations: [LocationStats; MemoryLocation::COUNT],
+    /// Bytes held by the runtime now (all locations except `Ffi`).
+    pub total_bytes: u64,
+    /// Highest `total_bytes` since the batch started.
+    pub peak_total_bytes: u64,
+}
+
+impl MemoryStats {
+    pub fn location(&self, location: MemoryLocation) -> &LocationStats {
+        &self.locations[location as usize]
+    }
+}
+
+#[derive(Default)]
+struct Gauge {
+    samples: AtomicU64,
+    array_bytes: AtomicU64,
+    metadata_bytes: AtomicU64,
+    peak_bytes: AtomicU64,
+}
+
+impl Gauge {
+    fn add(&self, fp: &Footprint) -> u64 {
+        self.samples.fetch_add(fp.samples, Ordering::Relaxed);
+        let array = self
+            .array_bytes
+            .fetch_add(fp.array_bytes, Ordering::Relaxed);
+        let meta = self
+            .metadata_bytes
+            .fetch_add(fp.metadata_bytes, Ordering::Relaxed);
+        let now = array + meta + fp.bytes();
+        self.peak_bytes.fetch_max(now, Ordering::Relaxed);
+        now
+    }
+
+    fn sub(&self, fp: &Footprint) {
+        self.samples.fetch_sub(fp.samples, Ordering::Relaxed);
+        self.array_bytes
+            .fetch_sub(fp.array_bytes, Ordering::Relaxed);
+        self.metadata_bytes
+            .fetch_sub(fp.metadata_bytes, Ordering::Relaxed);
+    }
+
+    fn current(&self) -> Footprint {
+        Footprint {
+            samples: self.samples.load(Ordering::Relaxed),
+            array_bytes: self.array_bytes.load(Ordering::Relaxed),
+            metadata_bytes: self.metadata_bytes.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Sample handles currently owned by FFI callers.
+static FFI_HANDLES: Gauge = Gauge {
+    samples: AtomicU64::new(0),
+    array_bytes: AtomicU64::new(0),
+    metadata_bytes: AtomicU64::new(0),
+    peak_bytes: AtomicU64::new(0),
+};
+
+/// Record a sample handed out to an FFI caller.
+pub fn ffi_handle_created(sample: &Sample) {
+    FFI_HANDLES.add(&Footprint::of_sample(sample));
+}
+
+/// Record an FFI-owned sample freed or handed back to the runtime.
+pub fn ffi_handle_released(sample: &Sample) {
+    FFI_HANDLES.sub(&Footprint::of_sample(sample));
+}
+
+/// Per-location gauges of one runtime.
+#[derive(Default)]
+pub struct MemoryAccount {
+    gauges: [Gauge; MemoryLocation::COUNT - 1],
+    total: AtomicU64,
+    peak_total: AtomicU64,
+}
+
+impl MemoryAccount {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn add(&self, location: MemoryLocation, fp: &Footprint) {
+        if location == MemoryLocation::Ffi {
+            FFI_HANDLES.add(fp);
+            return;
+        }
+        self.gauges[location as usize].add(fp);
+        let total = self.total.fetch_add(fp.bytes(), Ordering::Relaxed) + fp.bytes();
+        self.peak_total.fetch_max(total, Ordering::Relaxed);
+    }
+
+    pub fn sub(&self, location: MemoryLocation, fp: &Footprint) {
+        if location == MemoryLocation::Ffi {
+            FFI_HANDLES.sub(fp);
+            return;
+        }
+        self.gauges[location as usize].sub(fp);
+        self.total.fetch_sub(fp.bytes(), Ordering::Relaxed);
+    }
+
+    /// Move `fp` between locations.
+    pub fn transfer(&self, from: MemoryLocation, to: MemoryLocation, fp: &Footprint) {
+        self.sub(from, fp);
+        self.add(to, fp);
+    }
+
+    /// Replace a location's footprint. Callers must serialise updates to
+    /// the same location (the runtime holds that location's lock).
+    pub fn set(&self, location: MemoryLocation, fp: &Footprint) {
+        let old = match location {
+            MemoryLocation::Ffi => FFI_HANDLES.current(),
+            _ => self.gauges[location as usize].current(),
+        };
+        if old != *fp {
+            self.sub(location, &old);
+            self.add(location, fp);
+        }
+    }
+
+    /// Start a new batch: high-water marks restart from current usage.
+    pub fn begin_batch(&self) {
+        for gauge in self.gauges.iter().chain(std::iter::once(&FFI_HANDLES)) {
+            let now = gauge.current().bytes();
+            gauge.peak_bytes.store(now, Ordering::Relaxed);
+        }
+        self.peak_total
+            .store(self.total.load(Ordering::Relaxed), Ordering::Relaxed);
+    }
+
+    pub fn stats(&self) -> MemoryStats {
+        let mut stats = MemoryStats {
+            total_bytes: self.total.load(Ordering::Relaxed),
+            peak_total_bytes: self.peak_total.load(Ordering::Relaxed),
+            ..Default::default()
+        };
+        for (out, gauge) in stats
+            .locations
+            .iter_mut()
+            .zip(self.gauges.iter().chain(std::iter::once(&FFI_HANDLES)))
+        {
+            out.current = gauge.current();
+            out.peak_bytes = gauge.peak_bytes.load(Ordering::Relaxed);
+        }
+        stats
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn sample(len: usize) -> Sample {
+        Sample::new("m", vec![0.0; len], vec![1.0; len], vec![0.1; len]).unwrap()
+    }
+
+    #[test]
+    fn test_footprint_counts_capacity() {
+        let mut s = sample(100);
+        let fp = Footprint::of_sample(&s);
+        assert_eq!(fp.samples, 1);
+        assert_eq!(fp.array_bytes, 3 * 100 * 8);
+        assert_eq!(fp.metadata_bytes, 1);
+
+        s.metadata.processed_peaks.insert(3, 1.0);
+        let with_map = Footprint::of_sample(&s);
+        // An entry plus a control byte per unit of capacity.
+        let capacity = s.metadata.processed_peaks.capacity() as u64;
+        assert_eq!(with_map.metadata_bytes, 1 + capacity * 17);
+    }
+
+    #[test]
+    fn test_transfers_and_high_water() {
+        let account = MemoryAccount::new();
+        let fp = Footprint::of_sample(&sample(10));
+
+        account.add(MemoryLocation::Pending, &fp);
+        account.add(MemoryLocation::Pending, &fp);
+        account.transfer(MemoryLocation::Pending, MemoryLocation::Queued, &fp);
+        account.sub(MemoryLocation::Pending, &fp);
+
+        let stats = account.stats();
+        let pending = stats.location(MemoryLocation::Pending);
+        assert_eq!(pending.current, Footprint::default());
+        assert_eq!(pending.peak_bytes, 2 * fp.bytes());
+        assert_eq!(stats.location(MemoryLocation::Queued).current, fp);
+        assert_eq!(stats.total_bytes, fp.bytes());
+        assert_eq!(stats.peak_total_bytes, 2 * fp.bytes());
+
+        account.begin_batch();
+        let stats = account.stats();
+        assert_eq!(stats.location(MemoryLocation::Pending).peak_bytes, 0);
+        assert_eq!(stats.peak_total_bytes, fp.bytes());
+
+        account.set(MemoryLocation::Queued, &Footprint::default());
+        assert_eq!(account.stats().total_bytes, 0);
+    }
+}
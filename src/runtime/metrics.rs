@@ -0,0 +1,354 @@
+//! Cumulative per-stage and per-worker runtime metrics.
+//!
+//! Each worker records into its own shard, so the hot path takes one
+//! uncontended lock per executed stage. `RuntimeMetrics::snapshot` merges
+//! the shards on demand and can be called while a run is in progress.
+
+use super::lock::LockStats;
+use super::perf::PerfCounts;
+use crate::stage::StageId;
+use std::sync::Mutex;
+use std::time::Duration;
+
+/// Sub-buckets per power of two (relative error about 1/16).
+const SUB_BITS: u32 = 4;
+const SUB_COUNT: usize = 1 << SUB_BITS;
+/// Largest recordable value is 2^MAX_EXP ns (about 18 minutes).
+const MAX_EXP: u32 = 40;
+const BUCKETS: usize = (MAX_EXP - SUB_BITS + 1) as usize * SUB_COUNT;
+
+/// Log-linear latency histogram in nanoseconds (HDR-style).
+#[derive(Clone)]
+pub struct LatencyHistogram {
+    buckets: Box<[u64]>,
+    count: u64,
+    sum: u64,
+    min: u64,
+    max: u64,
+}
+
+impl LatencyHistogram {
+    pub fn new() -> Self {
+        Self {
+            buckets: vec![0; BUCKETS].into_boxed_slice(),
+            count: 0,
+            sum: 0,
+            min: u64::MAX,
+            max: 0,
+        }
+    }
+
+    #[inline]
+    fn bucket_of(value: u64) -> usize {
+        let v = value.min((1u64 << MAX_EXP) - 1);
+        if v < SUB_COUNT as u64 {
+            return v as usize;
+        }
+        let exp = 63 - v.leading_zeros();
+        let shift = exp - SUB_BITS;
+        let sub = (v >> shift) as usize & (SUB_COUNT - 1);
+        (shift as usize + 1) * SUB_COUNT + sub
+    }
+
+    /// Smallest value that falls in `bucket`.
+    fn bucket_floor(bucket: usize) -> u64 {
+        if bucket < SUB_COUNT {
+            return bucket as u64;
+        }
+        let shift = (bucket / SUB_COUNT - 1) as u32;
+        let sub = (bucket % SUB_COUNT) as u64;
+        (SUB_COUNT as u64 + sub) << shift
+    }
+
+    #[inline]
+    pub fn record(&mut self, nanos: u64) {
+        self.buckets[Self::bucket_of(nanos)] += 1;
+        self.count += 1;
+        self.sum = self.sum.saturating_add(nanos);
+        self.min = self.min.min(nanos);
+        self.max = self.max.max(nanos);
+    }
+
+    #[inline]
+    pub fn record_duration(&mut self, d: Duration) {
+        self.record(d.as_nanos().min(u64::MAX as u128) as u64);
+    }
+
+    pub fn merge(&mut self, other: &LatencyHistogram) {
+        for (a, b) in self.buckets.iter_mut().zip(other.buckets.iter()) {
+            *a += b;
+        }
+        self.count += other.count;
+        self.sum = self.sum.saturating_add(other.sum);
+        self.min = self.min.min(other.min);
+        self.max = self.max.max(other.max);
+    }
+
+    pub fn count(&self) -> u64 {
+        self.count
+    }
+
+    /// Value at percentile `p` (0–100), accurate to the bucket width.
+    pub fn percentile(&self, p: f64) -> u64 {
+        if self.count == 0 {
+            return 0;
+        }
+        let rank = ((p / 100.0) * self.count as f64).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (bucket, &n) in self.buckets.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return Self::bucket_floor(bucket).clamp(self.min, self.max);
+            }
+        }
+        self.max
+    }
+
+    pub fn summary(&self) -> LatencySummary {
+        if self.count == 0 {
+            return LatencySummary::default();
+        }
+        LatencySummary {
+            count: self.count,
+            min_ns: self.min,
+            mean_ns: self.sum / self.count,
+            p50_ns: self.percentile(50.0),
+            p90_ns: self.percentile(90.0),
+            p99_ns: self.percentile(99.0),
+            max_ns: self.max,
+        }
+    }
+}
+
+impl Default for LatencyHistogram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl std::fmt::Debug for LatencyHistogram {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("LatencyHistogram")
+            .field("summary", &self.summary())
+            .finish()
+    }
+}
+
+/// Percentile summary of a histogram, in nanoseconds.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LatencySummary {
+    pub count: u64,
+    pub min_ns: u64,
+    pub mean_ns: u64,
+    pub p50_ns: u64,
+    pub p90_ns: u64,
+    pub p99_ns: u64,
+    pub max_ns: u64,
+}
+
+/// Counters for one stage.
+#[derive(Clone, Debug, Default)]
+pub struct StageMetrics {
+    /// Times the stage ran.
+    pub executions: u64,
+    /// Follow-up requests for this stage that were enqueued.
+    pub requeues: u64,
+    /// Follow-up requests for this stage rejected by the insertion policy.
+    pub rejections: u64,
+    /// Stage execution time.
+    pub latency: LatencyHistogram,
+    /// Time items for this stage spent queued before execution.
+    pub queue_wait: LatencyHistogram,
+    /// Hardware counters (zero unless perf counters are enabled).
+    pub perf: PerfCounts,
+}
+
+impl StageMetrics {
+    fn merge(&mut self, other: &StageMetrics) {
+        self.executions += other.executions;
+        self.requeues += other.requeues;
+        self.rejections += other.rejections;
+        self.latency.merge(&other.latency);
+        self.queue_wait.merge(&other.queue_wait);
+        self.perf.add(&other.perf);
+    }
+}
+
+/// Time accounting for one worker.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct WorkerMetrics {
+    pub executions: u64,
+    /// Time spent executing stages.
+    pub busy: Duration,
+    /// Time spent waiting for other workers to produce work.
+    pub idle: Duration,
+    /// Time spent acquiring the scheduler lock.
+    pub scheduler_wait: Duration,
+}
+
+/// What one executed stage contributes to its worker's shard.
+pub(crate) struct StepMetrics {
+    pub stage_id: StageId,
+    /// Time the item spent queued, if known.
+    pub queued: Option<Duration>,
+    /// Stage execution time.
+    pub busy: Duration,
+    /// (inserted, rejected) follow-up requests per target stage.
+    pub decisions: [(u32, u32); StageId::COUNT],
+    /// Hardware counters around the stage, if enabled and available.
+    pub perf: Option<PerfCounts>,
+}
+
+/// One worker's shard.
+#[derive(Default)]
+pub(crate) struct Shard {
+    pub stages: [StageMetrics; StageId::COUNT],
+    pub worker: WorkerMetrics,
+}
+
+impl Shard {
+    pub fn record(&mut self, step: &StepMetrics) {
+        let stage = &mut self.stages[step.stage_id.index()];
+        stage.executions += 1;
+        stage.latency.record_duration(step.busy);
+        if let Some(queued) = step.queued {
+            stage.queue_wait.record_duration(queued);
+        }
+        if let Some(perf) = &step.perf {
+            stage.perf.add(perf);
+        }
+        self.record_decisions(&step.decisions);
+        self.worker.executions += 1;
+        self.worker.busy += step.busy;
+    }
+
+    /// Count (inserted, rejected) follow-up requests per target stage.
+    pub fn record_decisions(&mut self, decisions: &[(u32, u32); StageId::COUNT]) {
+        for (stage, &(inserted, rejected)) in self.stages.iter_mut().zip(decisions) {
+            stage.requeues += inserted as u64;
+            stage.rejections += rejected as u64;
+        }
+    }
+}
+
+/// Sharded metrics owned by a runtime.
+pub struct RuntimeMetrics {
+    shards: Box<[Mutex<Shard>]>,
+}
+
+impl RuntimeMetrics {
+    pub fn new(workers: usize) -> Self {
+        Self {
+            shards: (0..workers.max(1)).map(|_| Mutex::default()).collect(),
+        }
+    }
+
+    /// Shard for worker `index`.
+    #[inline]
+    pub(crate) fn shard(&self, index: usize) -> &Mutex<Shard> {
+        &self.shards[index % self.shards.len()]
+    }
+
+    /// Merge all shards.
+    pub fn snapshot(&self) -> MetricsSnapshot {
+        let mut stages: [StageMetrics; StageId::COUNT] = Default::default();
+        let mut workers = Vec::with_capacity(self.shards.len());
+        for shard in self.shards.iter() {
+            let shard = shard.lock().unwrap();
+            for (total, s) in stages.iter_mut().zip(shard.stages.iter()) {
+                total.merge(s);
+            }
+            workers.push(shard.worker);
+        }
+        MetricsSnapshot {
+            stages,
+            workers,
+            locks: Vec::new(),
+        }
+    }
+
+    pub fn reset(&self) {
+        for shard in self.shards.iter() {
+            *shard.lock().unwrap() = Shard::default();
+        }
+    }
+}
+
+/// Point-in-time view of runtime metrics.
+#[derive(Clone, Debug)]
+pub struct MetricsSnapshot {
+    /// Indexed by `StageId::index()`.
+    pub stages: [StageMetrics; StageId::COUNT],
+    pub workers: Vec<WorkerMetrics>,
+    /// Instrumented lock statistics (empty unless filled by the runtime).
+    pub locks: Vec<LockStats>,
+}
+
+impl MetricsSnapshot {
+    pub fn stage(&self, id: StageId) -> &StageMetrics {
+        &self.stages[id.index()]
+    }
+
+    pub fn total_executions(&self) -> u64 {
+        self.stages.iter().map(|s| s.executions).sum()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_histogram_percentiles() {
+        let mut h = LatencyHistogram::new();
+        for v in 1..=10_000u64 {
+            h.record(v * 1000);
+        }
+        let s = h.summary();
+        assert_eq!(s.count, 10_000);
+        assert_eq!(s.min_ns, 1000);
+        assert_eq!(s.max_ns, 10_000_000);
+        for (p, expected) in [
+            (50.0, 5_000_000.0),
+            (90.0, 9_000_000.0),
+            (99.0, 9_900_000.0),
+        ] {
+            let got = h.percentile(p) as f64;
+            assert!(
+                (got - expected).abs() / expected < 1.0 / 16.0,
+                "p{} = {}",
+                p,
+                got
+            );
+        }
+
+        // Exact below the sub-bucket count, clamped at the top.
+        assert_eq!(
+            LatencyHistogram::bucket_floor(LatencyHistogram::bucket_of(7)),
+            7
+        );
+        assert_eq!(LatencyHistogram::bucket_of(u64::MAX), BUCKETS - 1);
+    }
+
+    #[test]
+    fn test_shards_merge() {
+        let metrics = RuntimeMetrics::new(2);
+        for (i, ns) in [(0, 100), (1, 300)] {
+            let mut shard = metrics.shard(i).lock().unwrap();
+            let stage = &mut shard.stages[StageId::FindPeak.index()];
+            stage.executions += 1;
+            stage.latency.record(ns);
+            shard.worker.executions += 1;
+        }
+
+        let snapshot = metrics.snapshot();
+        let find = snapshot.stage(StageId::FindPeak);
+        assert_eq!(find.executions, 2);
+        assert_eq!(find.latency.summary().mean_ns, 200);
+        assert_eq!(snapshot.workers.len(), 2);
+        assert_eq!(snapshot.total_executions(), 2);
+
+        metrics.reset();
+        assert_eq!(metrics.snapshot().total_executions(), 0);
+    }
+}
@@ -1,11 +1,35 @@
 //! Runtime for SAXS batch processing.
 
+pub mod cache;
 pub mod executor;
+pub mod lock;
+pub mod memory;
+pub mod metrics;
+pub mod perf;
 pub mod policy;
+pub mod preview;
+pub mod process;
+pub mod progress;
 pub mod regroup;
 pub mod scheduler;
+pub mod snapshot;
+pub mod stats;
+pub mod sweep;
+pub mod trace;
 
+pub use cache::{CacheConfig, CacheStats};
 pub use executor::{Runtime, RuntimeConfig};
+pub use lock::LockStats;
+pub use memory::{Footprint, MemoryLocation, MemoryStats};
+pub use metrics::{LatencySummary, MetricsSnapshot, StageMetrics, WorkerMetrics};
+pub use perf::PerfCounts;
 pub use policy::InsertionPolicy;
-pub use regroup::RegroupPool;
+pub use preview::PreviewConfig;
+pub use process::ProcessConfig;
+pub use progress::{ProgressReporter, ProgressSnapshot, ProgressTracker};
+pub use regroup::{CompressionStats, IdleSamples, RegroupPool};
 pub use scheduler::{PriorityScheduler, WorkItem};
+pub use snapshot::{SnapshotConfig, SnapshotState};
+pub use stats::RunStats;
+pub use sweep::Sweep;
+pub use trace::TraceConfig;
@@ -0,0 +1,286 @@
+//! Optional hardware performance counters per stage (Linux only).
+//!
+//! Each worker thread lazily opens one `perf_event_open` group of cycles,
+//! instructions, cache misses and branch misses for itself (user space
+//! only, so it works with `perf_event_paranoid` up to 2). The executor reads
+//! the group before and after `Stage::process` and attributes the delta to
+//! the stage. Where perf events are not permitted or not supported, reads
+//! return `None` and nothing is recorded.
+
+use std::cell::RefCell;
+
+/// Hardware counter totals.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct PerfCounts {
+    /// Stage executions that were counted.
+    pub samples: u64,
+    pub cycles: u64,
+    pub instructions: u64,
+    pub cache_misses: u64,
+    pub branch_misses: u64,
+}
+
+impl PerfCounts {
+    /// Instructions per cycle.
+    pub fn ipc(&self) -> f64 {
+        if self.cycles > 0 {
+            self.instructions as f64 / self.cycles as f64
+        } else {
+            0.0
+        }
+    }
+
+    pub fn add(&mut self, other: &PerfCounts) {
+        self.samples += other.samples;
+        self.cycles += other.cycles;
+        self.instructions += other.instructions;
+        self.cache_misses += other.cache_misses;
+        self.branch_misses += other.branch_misses;
+    }
+}
+
+/// One raw reading of the calling thread's counter group.
+#[derive(Clone, Copy, Debug)]
+pub(crate) struct PerfReading {
+    time_enabled: u64,
+    time_running: u64,
+    /// cycles, instructions, cache misses, branch misses.
+    values: [u64; 4],
+}
+
+impl PerfReading {
+    /// Counts between `start` and `self`, scaled up if the kernel
+    /// multiplexed the group off the PMU part of the time.
+    pub fn since(&self, start: &PerfReading) -> PerfCounts {
+        let enabled = self.time_enabled.saturating_sub(start.time_enabled);
+        let running = self.time_running.saturating_sub(start.time_running);
+        let scale = |i: usize| {
+            let delta = self.values[i].saturating_sub(start.values[i]);
+            if running > 0 && running < enabled {
+                (delta as f64 * enabled as f64 / running as f64) as u64
+            } else {
+                delta
+            }
+        };
+        PerfCounts {
+            samples: 1,
+            cycles: scale(0),
+            instructions: scale(1),
+            cache_misses: scale(2),
+            branch_misses: scale(3),
+        }
+    }
+}
+
+thread_local! {
+    /// None until first use; Some(None) if the group could not be opened.
+    static GROUP: RefCell<Option<Option<sys::Group>>> = const { RefCell::new(None) };
+}
+
+/// Read the calling thread's counters, opening them on first use.
+#[inline]
+pub(crate) fn read() -> Option<PerfReading> {
+    GROUP.with(|g| {
+        g.borrow_mut()
+            .get_or_insert_with(sys::Group::open)
+            .as_ref()
+            .and_then(|group| group.read())
+    })
+}
+
+/// Whether hardware counters can be opened on this thread.
+pub fn available() -> bool {
+    read().is_some()
+}
+
+#[cfg(target_os = "linux")]
+mod sys {
+    use super::PerfReading;
+
+    const PERF_TYPE_HARDWARE: u32 = 0;
+    const PERF_COUNT_HW_CPU_CYCLES: u64 = 0;
+    const PERF_COUNT_HW_INSTRUCTIONS: u64 = 1;
+    const PERF_COUNT_HW_CACHE_MISSES: u64 = 3;
+    const PERF_COUNT_HW_BRANCH_MISSES: u64 = 5;
+
+    const PERF_FORMAT_TOTAL_TIME_ENABLED: u64 = 1 << 0;
+    const PERF_FORMAT_TOTAL_TIME_RUNNING: u64 = 1 << 1;
+    const PERF_FORMAT_ID: u64 = 1 << 2;
+    const PERF_FORMAT_GROUP: u64 = 1 << 3;
+
+    const PERF_FLAG_FD_CLOEXEC: libc::c_ulong = 1 << 3;
+
+    const FLAG_EXCLUDE_KERNEL: u64 = 1 << 5;
+    const FLAG_EXCLUDE_HV: u64 = 1 << 6;
+
+    const EVENTS: [u64; 4] = [
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    ];
+
+    /// `struct perf_event_attr` up to PERF_ATTR_SIZE_VER0.
+    #[repr(C)]
+    #[derive(Default)]
+    struct Attr {
+        type_: u32,
+        size: u32,
+        config: u64,
+        sample_period: u64,
+        sample_type: u64,
+        read_format: u64,
+        flags: u64,
+        wakeup_events: u32,
+        bp_type: u32,
+        config1: u64,
+    }
+
+    /// Counter group of the thread that opened it.
+    pub struct Group {
+        fds: Vec<libc::c_int>,
+        /// Kernel event id per slot in `PerfReading::values` (0 = missing).
+        ids: [u64; 4],
+    }
+
+    fn open_event(config: u64, group_fd: libc::c_int) -> Option<libc::c_int> {
+        let attr = Attr {
+            type_: PERF_TYPE_HARDWARE,
+            size: std::mem::size_of::<Attr>() as u32,
+            config,
+            read_format: PERF_FORMAT_GROUP
+                | PERF_FORMAT_ID
+                | PERF_FORMAT_TOTAL_TIME_ENABLED
+                | PERF_FORMAT_TOTAL_TIME_RUNNING,
+            flags: FLAG_EXCLUDE_KERNEL | FLAG_EXCLUDE_HV,
+            ..Default::default()
+        };
+        // pid 0 / cpu -1: this thread on any CPU.
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_perf_event_open,
+                &attr as *const Attr,
+                0 as libc::pid_t,
+                -1 as libc::c_int,
+                group_fd,
+                PERF_FLAG_FD_CLOEXEC,
+            )
+        };
+        (fd >= 0).then_some(fd as libc::c_int)
+    }
+
+    fn event_id(fd: libc::c_int) -> Option<u64> {
+        const PERF_EVENT_IOC_ID: libc::c_ulong = 0x8008_2407;
+        let mut id = 0u64;
+        let rc = unsafe { libc::ioctl(fd, PERF_EVENT_IOC_ID as _, &mut id as *mut u64) };
+        (rc == 0).then_some(id)
+    }
+
+    impl Group {
+        /// Open the group; events the CPU lacks are left out. Fails if the
+        /// cycles leader cannot be opened.
+        pub fn open() -> Option<Group> {
+            let leader = open_event(EVENTS[0], -1)?;
+            let mut group = Group {
+                fds: vec![leader],
+                ids: [0; 4],
+            };
+            group.ids[0] = event_id(leader)?;
+            for (slot, &config) in EVENTS.iter().enumerate().skip(1) {
+                if let Some(fd) = open_event(config, leader) {
+                    group.fds.push(fd);
+                    group.ids[slot] = event_id(fd).unwrap_or(0);
+                }
+            }
+            Some(group)
+        }
+
+        pub fn read(&self) -> Option<PerfReading> {
+            // nr, time_enabled, time_running, then (value, id) per event.
+            let mut buf = [0u64; 3 + 2 * 4];
+            let bytes = std::mem::size_of_val(&buf);
+            let n = unsafe { libc::read(self.fds[0], buf.as_mut_ptr().cast(), bytes) };
+            if n < 24 {
+                return None;
+            }
+            let mut reading = PerfReading {
+                time_enabled: buf[1],
+                time_running: buf[2],
+                values: [0; 4],
+            };
+            let nr = (buf[0] as usize).min(4);
+            for pair in buf[3..3 + 2 * nr].chunks_exact(2) {
+                if let Some(slot) = self.ids.iter().position(|&id| id != 0 && id == pair[1]) {
+                    reading.values[slot] = pair[0];
+                }
+            }
+            Some(reading)
+        }
+    }
+
+    impl Drop for Group {
+        fn drop(&mut self) {
+            for &fd in &self.fds {
+                unsafe { libc::close(fd) };
+            }
+        }
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+mod sys {
+    use super::PerfReading;
+
+    pub struct Group;
+
+    impl Group {
+        pub fn open() -> Option<Group> {
+            None
+        }
+
+        pub fn read(&self) -> Option<PerfReading> {
+            None
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_since_scales_multiplexed_counts() {
+        let start = PerfReading {
+            time_enabled: 100,
+            time_running: 100,
+            values: [1000, 2000, 10, 5],
+        };
+        let end = PerfReading {
+            time_enabled: 300,
+            time_running: 200,
+            values: [2000, 4000, 20, 5],
+        };
+        let counts = end.since(&start);
+        assert_eq!(counts.samples, 1);
+        assert_eq!(counts.cycles, 2000);
+        assert_eq!(counts.instructions, 4000);
+        assert_eq!(counts.cache_misses, 20);
+        assert_eq!(counts.branch_misses, 0);
+        assert!((counts.ipc() - 2.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_read_degrades_gracefully() {
+        // Either counters work and advance, or every read is None.
+        let Some(start) = read() else {
+            assert!(!available());
+            return;
+        };
+        let mut x = 0u64;
+        for i in 0..100_000u64 {
+            x = std::hint::black_box(x.wrapping_mul(31).wrapping_add(i));
+        }
+        let counts = read().unwrap().since(&start);
+        assert!(counts.instructions > 0 || counts.cycles > 0);
+    }
+}
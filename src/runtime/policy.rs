@@ -155,6 +155,7 @@ mod tests {
         StageRequest {
             stage_id: StageId::FindPeak,
             metadata: FlowMetadata::new(sample_id),
+            instance: None,
         }
     }
 
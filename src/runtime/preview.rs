@@ -0,0 +1,167 @@
+//! Coarse-to-fine preview for quick-look processing.
+//!
+//! With preview enabled, `run_async` first runs the stages on a
+//! min/max-decimated copy of every long profile (see `minmax_indices`) and
+//! delivers that result through `on_sample` with
+//! `SampleMetadata::provisional` set. The full profile is then processed
+//! with peak detection restricted to windows around the preview's peaks
+//! (`SearchWindows`), and that result supersedes the preview.
+
+use crate::data::{Sample, SearchWindows};
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+/// Preview mode configuration.
+#[derive(Clone, Debug)]
+pub struct PreviewConfig {
+    /// Points per decimation bucket; each keeps its minimum and maximum.
+    pub bucket: usize,
+    /// Half-width (in full-resolution indices) of the refinement windows.
+    pub window: usize,
+    /// Profiles shorter than this are only processed at full resolution.
+    pub min_points: usize,
+}
+
+impl PreviewConfig {
+    /// Buckets of `bucket` points, refined within two buckets of each peak.
+    pub fn new(bucket: usize) -> Self {
+        Self {
+            bucket,
+            window: 2 * bucket,
+            ..Default::default()
+        }
+    }
+}
+
+impl Default for PreviewConfig {
+    fn default() -> Self {
+        Self {
+            bucket: 16,
+            window: 32,
+            min_points: 2048,
+        }
+    }
+}
+
+/// Full-resolution samples of one run, waiting for their preview.
+pub(crate) struct PreviewBatch {
+    config: PreviewConfig,
+    /// Full sample and the index map of its decimated copy, by sample id.
+    waiting: Mutex<HashMap<String, (Sample, Vec<usize>)>>,
+}
+
+impl PreviewBatch {
+    pub(crate) fn new(config: PreviewConfig) -> Self {
+        Self {
+            config,
+            waiting: Mutex::new(HashMap::new()),
+        }
+    }
+
+    /// Samples to enqueue: a provisional decimated copy of each previewed
+    /// sample, the others unchanged. Short profiles, series frames (their
+    /// store must see full-resolution indices) and samples sharing an id
+    /// are not previewed.
+    pub(crate) fn start(&self, samples: Vec<Sample>) -> Vec<Sample> {
+        let mut ids: HashMap<&str, usize> = HashMap::new();
+        for sample in &samples {
+            *ids.entry(sample.id.as_str()).or_default() += 1;
+        }
+        let previewed: Vec<bool> = samples
+            .iter()
+            .map(|s| {
+                s.len() >= self.config.min_points.max(3)
+                    && s.series().is_none()
+                    && ids[s.id.as_str()] == 1
+            })
+            .collect();
+
+        let mut waiting = self.waiting.lock().unwrap();
+        samples
+            .into_iter()
+            .zip(previewed)
+            .map(|(sample, previewed)| {
+                if !previewed {
+                    return sample;
+                }
+                let (mut preview, indices) = sample.decimated(self.config.bucket);
+                preview.metadata.provisional = true;
+                waiting.insert(sample.id.clone(), (sample, indices));
+                preview
+            })
+            .collect()
+    }
+
+    /// For a completed provisional sample, its full-resolution sample with
+    /// detection limited to windows around the preview's peaks.
+    pub(crate) fn refine(&self, preview: &Sample) -> Option<Sample> {
+        if !preview.metadata.provisional {
+            return None;
+        }
+        let (mut sample, indices) = self.waiting.lock().unwrap().remove(&preview.id)?;
+        let meta = &preview.metadata;
+        let mut centres: Vec<usize> = meta
+            .processed_peaks
+            .keys()
+            .chain(meta.unprocessed_peaks.keys())
+            .filter_map(|&i| indices.get(i).copied())
+            .collect();
+        centres.sort_unstable();
+        centres.dedup();
+        sample.metadata.search = Some(SearchWindows {
+            centres,
+            half_width: self.config.window,
+        });
+        Some(sample)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn profile(id: &str, points: usize, peak: usize) -> Sample {
+        let q: Vec<f64> = (0..points).map(|i| i as f64 * 1e-3).collect();
+        let intensity = (0..points)
+            .map(|i| 5.0 * (-((i as f64 - peak as f64) / 6.0).powi(2)).exp() + 1e-4 * i as f64)
+            .collect();
+        Sample::new(id, q, intensity, vec![0.1; points]).unwrap()
+    }
+
+    #[test]
+    fn test_start_decimates_long_unique_profiles() {
+        let batch = PreviewBatch::new(PreviewConfig {
+            min_points: 1000,
+            ..PreviewConfig::new(8)
+        });
+        let started = batch.start(vec![
+            profile("long", 4000, 1234),
+            profile("short", 500, 100),
+            profile("dup", 4000, 10),
+            profile("dup", 4000, 20),
+        ]);
+        assert_eq!(started[0].len(), 1000);
+        assert!(started[0].metadata.provisional);
+        assert!(started[1..].iter().all(|s| !s.metadata.provisional));
+        assert_eq!(started[2].len(), 4000);
+        assert_eq!(batch.waiting.lock().unwrap().len(), 1);
+    }
+
+    #[test]
+    fn test_refine_maps_peaks_to_full_resolution() {
+        let batch = PreviewBatch::new(PreviewConfig::new(8));
+        let mut preview = batch.start(vec![profile("s", 4096, 1234)]).remove(0);
+        let apex = (0..preview.len())
+            .max_by(|&a, &b| preview.intensity[a].total_cmp(&preview.intensity[b]))
+            .unwrap();
+        preview.metadata.processed_peaks.insert(apex, 5.0);
+
+        let full = batch.refine(&preview).unwrap();
+        assert_eq!(full.len(), 4096);
+        assert!(!full.metadata.provisional);
+        let windows = full.metadata.search.unwrap();
+        assert_eq!(windows.centres, vec![1234]);
+        assert_eq!(windows.half_width, 16);
+        assert!(batch.refine(&preview).is_none());
+    }
+}
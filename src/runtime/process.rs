@@ -0,0 +1,727 @@
+//! Forked worker processes for stages that are not thread-safe (Linux only).
+//!
+//! `ProcessPool` maps one `memfd` region `MAP_SHARED` before forking, so the
+//! parent and its children share the same pages. Per worker the region holds
+//! a request ring and a response ring (single-producer single-consumer,
+//! lock-free, driven by atomic head/tail counters) and a set of slots. Each
+//! slot has an input half and an output half: the parent encodes a work item
+//! into the input half and pushes the slot's descriptor; the child runs the
+//! stage from its copy-on-write image of the registry, encodes the result
+//! into the output half and pushes the descriptor back. Arrays travel as raw
+//! little-endian `f64` runs (`data::codec`), copied once each way.
+//!
+//! Both sides sleep on futexes in the shared region. A child that exits
+//! unexpectedly is reaped with `waitpid`; the items it held are decoded from
+//! their input halves, handed back to the caller to requeue, and a
+//! replacement is forked. Children are single-threaded: a stage that relies
+//! on a thread pool started before the fork will not make progress there.
+
+use super::snapshot::{decode_stage_request, encode_stage_request};
+use crate::data::codec::{decode_sample, encode_sample, put_u32, Decoder};
+use crate::data::{CodecError, Sample};
+use crate::stage::StageRequest;
+use std::cell::UnsafeCell;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+/// Largest number of slots per worker (the ring capacity).
+pub const MAX_SLOTS: usize = 64;
+
+/// Process mode configuration.
+#[derive(Clone, Debug)]
+pub struct ProcessConfig {
+    /// Worker processes.
+    pub workers: usize,
+    /// Items in flight per worker (at most `MAX_SLOTS`).
+    pub slots_per_worker: usize,
+    /// Capacity of each slot half. Pages are only touched as far as items
+    /// reach, so a generous limit costs address space, not memory. Items
+    /// or results that do not fit run in the parent instead.
+    pub slot_bytes: usize,
+    /// Times an item may take a worker down before the run panics.
+    pub max_attempts: u32,
+    /// Crash a worker on its n-th item (once per pool).
+    #[cfg(test)]
+    pub(crate) crash_after: u32,
+}
+
+impl ProcessConfig {
+    pub fn new(workers: usize) -> Self {
+        Self {
+            workers: workers.max(1),
+            slots_per_worker: 2,
+            slot_bytes: 16 << 20,
+            max_attempts: 3,
+            #[cfg(test)]
+            crash_after: 0,
+        }
+    }
+}
+
+/// Whether process mode is available on this platform.
+pub fn supported() -> bool {
+    cfg!(target_os = "linux")
+}
+
+/// Slot reference passed through the rings.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+struct Descriptor {
+    slot: u32,
+    /// Encoded bytes in the slot half.
+    len: u32,
+    /// Stage execution time measured by the child.
+    busy_ns: u64,
+}
+
+/// Descriptor slot telling a child to exit.
+const SHUTDOWN: u32 = u32::MAX;
+
+#[repr(C, align(64))]
+#[derive(Default)]
+struct Padded<T>(T);
+
+/// Lock-free single-producer single-consumer ring of descriptors.
+///
+/// All-zero bytes are a valid empty ring, so it can live in freshly
+/// truncated shared memory. The producer never has more than
+/// `MAX_SLOTS` entries outstanding (one per slot).
+#[repr(C)]
+struct Ring {
+    /// Next entry to read; written by the consumer only.
+    head: Padded<AtomicU32>,
+    /// Next entry to write; written by the producer only.
+    tail: Padded<AtomicU32>,
+    entries: [UnsafeCell<Descriptor>; MAX_SLOTS],
+}
+
+// SAFETY: an entry is written by the single producer before `tail`
+// publishes it and read by the single consumer before `head` releases it.
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    fn push(&self, descriptor: Descriptor) {
+        let tail = self.tail.0.load(Ordering::Relaxed);
+        debug_assert!(tail.wrapping_sub(self.head.0.load(Ordering::Acquire)) < MAX_SLOTS as u32);
+        unsafe { *self.entries[tail as usize % MAX_SLOTS].get() = descriptor };
+        self.tail.0.store(tail.wrapping_add(1), Ordering::Release);
+    }
+
+    fn pop(&self) -> Option<Descriptor> {
+        let head = self.head.0.load(Ordering::Relaxed);
+        if head == self.tail.0.load(Ordering::Acquire) {
+            return None;
+        }
+        let descriptor = unsafe { *self.entries[head as usize % MAX_SLOTS].get() };
+        self.head.0.store(head.wrapping_add(1), Ordering::Release);
+        Some(descriptor)
+    }
+
+    /// Empty the ring. Only valid while neither side is using it.
+    fn reset(&self) {
+        self.head.0.store(0, Ordering::Relaxed);
+        self.tail.0.store(0, Ordering::Relaxed);
+    }
+}
+
+/// Encode a stage's output sample and follow-up requests.
+fn encode_result(buf: &mut Vec<u8>, sample: &Sample, requests: &[StageRequest]) {
+    encode_sample(buf, sample);
+    put_u32(buf, requests.len() as u32);
+    for request in requests {
+        encode_stage_request(buf, request);
+    }
+}
+
+fn decode_result(dec: &mut Decoder<'_>) -> Result<(Sample, Vec<StageRequest>), CodecError> {
+    let sample = decode_sample(dec)?;
+    let count = dec.u32()? as usize;
+    let mut requests = Vec::with_capacity(count.min(dec.remaining()));
+    for _ in 0..count {
+        requests.push(decode_stage_request(dec)?);
+    }
+    Ok((sample, requests))
+}
+
+#[cfg(target_os = "linux")]
+pub(crate) use sys::{Event, ProcessPool};
+
+#[cfg(target_os = "linux")]
+mod sys {
+    use super::*;
+    use crate::runtime::scheduler::WorkItem;
+    use crate::runtime::snapshot::{decode_work_item, encode_work_item};
+    use crate::stage::StageResult;
+    use std::collections::VecDeque;
+    use std::io;
+    use std::panic::{self, AssertUnwindSafe};
+    use std::time::{Duration, Instant};
+
+    /// How often a waiting parent checks for exited children.
+    const REAP_INTERVAL: Duration = Duration::from_millis(20);
+    /// How often an idle child checks that its parent is alive.
+    const PARENT_CHECK: Duration = Duration::from_millis(200);
+
+    const EXIT_PANIC: i32 = 101;
+    const EXIT_CORRUPT: i32 = 102;
+    /// Output length reported when a result does not fit its slot.
+    const OVERFLOW: u32 = u32::MAX;
+
+    #[repr(C)]
+    struct Header {
+        /// Bumped by a child after pushing a response.
+        doorbell: Padded<AtomicU32>,
+        #[cfg(test)]
+        crash_after: AtomicU32,
+    }
+
+    #[repr(C)]
+    struct Channel {
+        requests: Ring,
+        responses: Ring,
+        /// Bumped by the parent after pushing a request.
+        wake: Padded<AtomicU32>,
+    }
+
+    fn futex_wait(word: &AtomicU32, expected: u32, timeout: Duration) {
+        let ts = libc::timespec {
+            tv_sec: timeout.as_secs() as libc::time_t,
+            tv_nsec: timeout.subsec_nanos() as libc::c_long,
+        };
+        // Shared (non-private) futex: the word is mapped in several
+        // processes.
+        unsafe {
+            libc::syscall(
+                libc::SYS_futex,
+                word as *const AtomicU32,
+                libc::FUTEX_WAIT,
+                expected,
+                &ts as *const libc::timespec,
+            )
+        };
+    }
+
+    fn futex_wake(word: &AtomicU32) {
+        unsafe {
+            libc::syscall(
+                libc::SYS_futex,
+                word as *const AtomicU32,
+                libc::FUTEX_WAKE,
+                i32::MAX,
+            )
+        };
+    }
+
+    fn round_up(n: usize, to: usize) -> usize {
+        n.div_ceil(to) * to
+    }
+
+    /// A `memfd` mapping shared with forked children.
+    struct Region {
+        ptr: *mut u8,
+        len: usize,
+        fd: libc::c_int,
+    }
+
+    impl Region {
+        fn create(len: usize) -> io::Result<Self> {
+            let fd = unsafe { libc::memfd_create(c"saxsrs-workers".as_ptr(), libc::MFD_CLOEXEC) };
+            if fd < 0 {
+                return Err(io::Error::last_os_error());
+            }
+            if unsafe { libc::ftruncate(fd, len as libc::off_t) } != 0 {
+                let err = io::Error::last_os_error();
+                unsafe { libc::close(fd) };
+                return Err(err);
+            }
+            let ptr = unsafe {
+                libc::mmap(
+                    std::ptr::null_mut(),
+                    len,
+                    libc::PROT_READ | libc::PROT_WRITE,
+                    libc::MAP_SHARED,
+                    fd,
+                    0,
+                )
+            };
+            if ptr == libc::MAP_FAILED {
+                let err = io::Error::last_os_error();
+                unsafe { libc::close(fd) };
+                return Err(err);
+            }
+            Ok(Self {
+                ptr: ptr.cast(),
+                len,
+                fd,
+            })
+        }
+    }
+
+    impl Drop for Region {
+        fn drop(&mut self) {
+            unsafe {
+                libc::munmap(self.ptr.cast(), self.len);
+                libc::close(self.fd);
+            }
+        }
+    }
+
+    /// Byte offsets within the region.
+    #[derive(Clone, Copy)]
+    struct Layout {
+        workers: usize,
+        slots: usize,
+        slot_bytes: usize,
+        channels: usize,
+        data: usize,
+        len: usize,
+    }
+
+    impl Layout {
+        fn new(workers: usize, slots: usize, slot_bytes: usize) -> Self {
+            let channels = round_up(std::mem::size_of::<Header>(), 64);
+            let data = round_up(channels + workers * std::mem::size_of::<Channel>(), 4096);
+            let slot_bytes = round_up(slot_bytes, 4096);
+            Self {
+                workers,
+                slots,
+                slot_bytes,
+                channels,
+                data,
+                len: data + workers * slots * 2 * slot_bytes,
+            }
+        }
+
+        fn channel(&self, worker: usize) -> usize {
+            self.channels + worker * std::mem::size_of::<Channel>()
+        }
+
+        /// Input half of a slot; the output half follows it.
+        fn slot(&self, worker: usize, slot: usize) -> usize {
+            self.data + (worker * self.slots + slot) * 2 * self.slot_bytes
+        }
+    }
+
+    /// What `ProcessPool::poll` delivers.
+    pub enum Event<T> {
+        /// A stage finished.
+        Done {
+            tag: T,
+            sample: Sample,
+            requests: Vec<StageRequest>,
+            busy: Duration,
+        },
+        /// The worker holding the item exited; the item should be requeued.
+        Lost { tag: T, item: WorkItem },
+        /// The result did not fit its slot; the item should run in the
+        /// caller instead.
+        Oversized { tag: T, item: WorkItem },
+    }
+
+    struct Worker<T> {
+        pid: libc::pid_t,
+        /// Caller tag of each occupied slot.
+        slots: Vec<Option<T>>,
+        busy: usize,
+    }
+
+    /// Forked workers sharing one region. Children run `run` on the items
+    /// dispatched to them; `T` tags each item for the caller.
+    pub struct ProcessPool<'a, T> {
+        region: Region,
+        layout: Layout,
+        run: &'a (dyn Fn(WorkItem) -> StageResult + 'a),
+        workers: Vec<Worker<T>>,
+        ready: VecDeque<Event<T>>,
+        scratch: Vec<u8>,
+        next_worker: usize,
+        restarts: u64,
+    }
+
+    impl<'a, T> ProcessPool<'a, T> {
+        /// Map the region and fork `config.workers` children.
+        pub fn spawn(
+            config: &ProcessConfig,
+            run: &'a (dyn Fn(WorkItem) -> StageResult + 'a),
+        ) -> io::Result<Self> {
+            let slots = config.slots_per_worker.clamp(1, MAX_SLOTS);
+            let layout = Layout::new(config.workers.max(1), slots, config.slot_bytes);
+            let region = Region::create(layout.len)?;
+            let mut pool = Self {
+                region,
+                layout,
+                run,
+                workers: Vec::with_capacity(layout.workers),
+                ready: VecDeque::new(),
+                scratch: Vec::new(),
+                next_worker: 0,
+                restarts: 0,
+            };
+            #[cfg(test)]
+            pool.header()
+                .crash_after
+                .store(config.crash_after, Ordering::Relaxed);
+            for worker in 0..layout.workers {
+                let pid = pool.fork(worker)?;
+                pool.workers.push(Worker {
+                    pid,
+                    slots: (0..slots).map(|_| None).collect(),
+                    busy: 0,
+                });
+            }
+            Ok(pool)
+        }
+
+        fn header(&self) -> &Header {
+            unsafe { &*(self.region.ptr as *const Header) }
+        }
+
+        fn channel(&self, worker: usize) -> &Channel {
+            unsafe { &*(self.region.ptr.add(self.layout.channel(worker)) as *const Channel) }
+        }
+
+        fn half(&self, worker: usize, slot: usize, output: bool) -> *mut u8 {
+            let offset = self.layout.slot(worker, slot) + output as usize * self.layout.slot_bytes;
+            unsafe { self.region.ptr.add(offset) }
+        }
+
+        /// Fork the child serving `worker`.
+        fn fork(&self, worker: usize) -> io::Result<libc::pid_t> {
+            let parent = unsafe { libc::getpid() };
+            match unsafe { libc::fork() } {
+                -1 => Err(io::Error::last_os_error()),
+                0 => {
+                    // Never unwind into the parent's frames.
+                    let code = match panic::catch_unwind(AssertUnwindSafe(|| {
+                        self.serve(worker, parent)
+                    })) {
+                        Ok(code) => code,
+                        Err(_) => EXIT_PANIC,
+                    };
+                    unsafe { libc::_exit(code) }
+                }
+                pid => Ok(pid),
+            }
+        }
+
+        /// Child main loop. Returns the exit code.
+        fn serve(&self, worker: usize, parent: libc::pid_t) -> i32 {
+            let channel = self.channel(worker);
+            let header = self.header();
+            let slot_bytes = self.layout.slot_bytes;
+            let mut out = Vec::new();
+            #[cfg(test)]
+            let mut served = 0;
+            loop {
+                let seen = channel.wake.0.load(Ordering::Acquire);
+                let Some(request) = channel.requests.pop() else {
+                    futex_wait(&channel.wake.0, seen, PARENT_CHECK);
+                    if unsafe { libc::getppid() } != parent {
+                        return 0;
+                    }
+                    continue;
+                };
+                if request.slot == SHUTDOWN {
+                    return 0;
+                }
+                let slot = request.slot as usize;
+                let input = unsafe {
+                    std::slice::from_raw_parts(self.half(worker, slot, false), request.len as usize)
+                };
+                let item = match decode_work_item(&mut Decoder::new(input)) {
+                    Ok(item) => item,
+                    Err(_) => return EXIT_CORRUPT,
+                };
+
+                #[cfg(test)]
+                {
+                    served += 1;
+                    let crash_after = &header.crash_after;
+                    if crash_after.load(Ordering::Relaxed) == served
+                        && crash_after.swap(0, Ordering::Relaxed) == served
+                    {
+                        return EXIT_PANIC;
+                    }
+                }
+
+                let start = Instant::now();
+                let result = (self.run)(item);
+                let busy_ns = start.elapsed().as_nanos() as u64;
+
+                out.clear();
+                encode_result(&mut out, &result.sample, &result.requests);
+                let len = if out.len() <= slot_bytes {
+                    let output = self.half(worker, slot, true);
+                    unsafe { std::ptr::copy_nonoverlapping(out.as_ptr(), output, out.len()) };
+                    out.len() as u32
+                } else {
+                    OVERFLOW
+                };
+                channel.responses.push(Descriptor {
+                    slot: request.slot,
+                    len,
+                    busy_ns,
+                });
+                header.doorbell.0.fetch_add(1, Ordering::Release);
+                futex_wake(&header.doorbell.0);
+            }
+        }
+
+        /// Whether some worker has a free slot.
+        pub fn has_capacity(&self) -> bool {
+            self.workers.iter().any(|w| w.busy < self.layout.slots)
+        }
+
+        /// Worker processes restarted after exiting unexpectedly.
+        pub fn restarts(&self) -> u64 {
+            self.restarts
+        }
+
+        /// Copy `item` into a free slot of the least busy worker.
+        ///
+        /// Fails if no slot is free or the encoded item exceeds
+        /// `slot_bytes`.
+        pub fn dispatch(&mut self, item: &WorkItem, tag: T) -> io::Result<()> {
+            let worker = (0..self.workers.len())
+                .min_by_key(|&w| self.workers[w].busy)
+                .filter(|&w| self.workers[w].busy < self.layout.slots)
+                .ok_or_else(|| io::Error::new(io::ErrorKind::WouldBlock, "no free slot"))?;
+            let slot = self.workers[worker]
+                .slots
+                .iter()
+                .position(Option::is_none)
+                .expect("busy count out of sync");
+
+            self.scratch = encode_work_item(item);
+            if self.scratch.len() > self.layout.slot_bytes {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidInput,
+                    format!(
+                        "work item of {} bytes exceeds slot_bytes",
+                        self.scratch.len()
+                    ),
+                ));
+            }
+            let input = self.half(worker, slot, false);
+            unsafe {
+                std::ptr::copy_nonoverlapping(self.scratch.as_ptr(), input, self.scratch.len())
+            };
+
+            self.workers[worker].slots[slot] = Some(tag);
+            self.workers[worker].busy += 1;
+            let channel = self.channel(worker);
+            channel.requests.push(Descriptor {
+                slot: slot as u32,
+                len: self.scratch.len() as u32,
+                busy_ns: 0,
+            });
+            channel.wake.0.fetch_add(1, Ordering::Release);
+            futex_wake(&channel.wake.0);
+            Ok(())
+        }
+
+        /// Wait up to `timeout` for the next finished or lost item.
+        ///
+        /// # Panics
+        /// If a child sends a result that does not decode.
+        pub fn poll(&mut self, timeout: Duration) -> Option<Event<T>> {
+            let deadline = Instant::now() + timeout;
+            loop {
+                if let Some(event) = self.ready.pop_front() {
+                    return Some(event);
+                }
+                let seen = self.header().doorbell.0.load(Ordering::Acquire);
+                let count = self.workers.len();
+                for i in 0..count {
+                    let worker = (self.next_worker + i) % count;
+                    if let Some(response) = self.channel(worker).responses.pop() {
+                        self.next_worker = (worker + 1) % count;
+                        return Some(self.complete(worker, response));
+                    }
+                }
+                self.reap();
+                if !self.ready.is_empty() {
+                    continue;
+                }
+                let now = Instant::now();
+                if now >= deadline {
+                    return None;
+                }
+                futex_wait(
+                    &self.header().doorbell.0,
+                    seen,
+                    (deadline - now).min(REAP_INTERVAL),
+                );
+            }
+        }
+
+        fn complete(&mut self, worker: usize, response: Descriptor) -> Event<T> {
+            let slot = response.slot as usize;
+            let tag = self.workers[worker].slots[slot]
+                .take()
+                .expect("response for an empty slot");
+            self.workers[worker].busy -= 1;
+            if response.len == OVERFLOW {
+                let item = self
+                    .slot_input(worker, slot)
+                    .expect("slot input was overwritten");
+                return Event::Oversized { tag, item };
+            }
+            let output = unsafe {
+                std::slice::from_raw_parts(self.half(worker, slot, true), response.len as usize)
+            };
+            let (sample, requests) = decode_result(&mut Decoder::new(output))
+                .expect("worker process sent a corrupt result");
+            Event::Done {
+                tag,
+                sample,
+                requests,
+                busy: Duration::from_nanos(response.busy_ns),
+            }
+        }
+
+        /// Decode the item last dispatched to a slot.
+        fn slot_input(&self, worker: usize, slot: usize) -> Result<WorkItem, CodecError> {
+            // Only the parent writes input halves, and the decoder stops
+            // where the item's encoding ends.
+            let input = unsafe {
+                std::slice::from_raw_parts(self.half(worker, slot, false), self.layout.slot_bytes)
+            };
+            decode_work_item(&mut Decoder::new(input))
+        }
+
+        /// Restart children that exited, queueing their finished results
+        /// and their lost items.
+        fn reap(&mut self) {
+            for worker in 0..self.workers.len() {
+                let mut status = 0;
+                let pid = self.workers[worker].pid;
+                if unsafe { libc::waitpid(pid, &mut status, libc::WNOHANG) } != pid {
+                    continue;
+                }
+                while let Some(response) = self.channel(worker).responses.pop() {
+                    let event = self.complete(worker, response);
+                    self.ready.push_back(event);
+                }
+                for slot in 0..self.layout.slots {
+                    let Some(tag) = self.workers[worker].slots[slot].take() else {
+                        continue;
+                    };
+                    let item = self
+                        .slot_input(worker, slot)
+                        .expect("slot input was overwritten");
+                    self.ready.push_back(Event::Lost { tag, item });
+                }
+                self.workers[worker].busy = 0;
+                let channel = self.channel(worker);
+                channel.requests.reset();
+                channel.responses.reset();
+                self.workers[worker].pid =
+                    self.fork(worker).expect("failed to restart worker process");
+                self.restarts += 1;
+            }
+        }
+    }
+
+    impl<T> Drop for ProcessPool<'_, T> {
+        fn drop(&mut self) {
+            for worker in 0..self.workers.len() {
+                let channel = self.channel(worker);
+                // A full request ring means the child is gone or stuck; it
+                // is killed below either way.
+                if self.workers[worker].busy < MAX_SLOTS {
+                    channel.requests.push(Descriptor {
+                        slot: SHUTDOWN,
+                        ..Default::default()
+                    });
+                }
+                channel.wake.0.fetch_add(1, Ordering::Release);
+                futex_wake(&channel.wake.0);
+            }
+            let deadline = Instant::now() + Duration::from_secs(1);
+            for worker in &self.workers {
+                let mut status = 0;
+                loop {
+                    let rc = unsafe { libc::waitpid(worker.pid, &mut status, libc::WNOHANG) };
+                    if rc != 0 {
+                        break;
+                    }
+                    if Instant::now() >= deadline {
+                        unsafe {
+                            libc::kill(worker.pid, libc::SIGKILL);
+                            libc::waitpid(worker.pid, &mut status, 0);
+                        }
+                        break;
+                    }
+                    std::thread::sleep(Duration::from_millis(1));
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::FlowMetadata;
+    use crate::stage::StageId;
+
+    fn ring() -> Box<Ring> {
+        // Same state as freshly truncated shared memory.
+        unsafe { Box::new(std::mem::zeroed()) }
+    }
+
+    #[test]
+    fn test_ring_is_fifo_across_threads() {
+        let ring = ring();
+        let total = 10_000u32;
+        std::thread::scope(|scope| {
+            scope.spawn(|| {
+                let mut sent = 0;
+                while sent < total {
+                    // Keep at most MAX_SLOTS outstanding, like the pool.
+                    let head = ring.head.0.load(Ordering::Acquire);
+                    if ring.tail.0.load(Ordering::Relaxed).wrapping_sub(head) < MAX_SLOTS as u32 {
+                        ring.push(Descriptor {
+                            slot: sent,
+                            len: sent * 2,
+                            busy_ns: sent as u64,
+                        });
+                        sent += 1;
+                    }
+                }
+            });
+            let mut expected = 0;
+            while expected < total {
+                if let Some(d) = ring.pop() {
+                    assert_eq!(
+                        (d.slot, d.len, d.busy_ns),
+                        (expected, expected * 2, expected as u64)
+                    );
+                    expected += 1;
+                }
+            }
+        });
+        assert_eq!(ring.pop(), None);
+    }
+
+    #[test]
+    fn test_result_round_trip() {
+        let sample = Sample::new("r", vec![0.1, 0.2], vec![1.0, 2.0], vec![0.1, 0.1]).unwrap();
+        let mut metadata = FlowMetadata::new("r");
+        metadata.current_peak = Some(3);
+        let requests = vec![
+            StageRequest::new(StageId::ProcessPeak, metadata.clone()),
+            StageRequest::new(StageId::FindPeak, metadata).on_instance(2),
+        ];
+
+        let mut buf = Vec::new();
+        encode_result(&mut buf, &sample, &requests);
+        let (decoded, decoded_requests) = decode_result(&mut Decoder::new(&buf)).unwrap();
+        assert_eq!(decoded.intensity, sample.intensity);
+        assert_eq!(decoded_requests.len(), 2);
+        assert_eq!(decoded_requests[0].stage_id, StageId::ProcessPeak);
+        assert_eq!(decoded_requests[0].metadata.current_peak, Some(3));
+        assert_eq!(decoded_requests[0].instance, None);
+        assert_eq!(decoded_requests[1].instance, Some(2));
+    }
+}
@@ -0,0 +1,260 @@
+//! Aggregated batch progress, delivered off the worker threads.
+//!
+//! Workers only bump atomics in a `ProgressTracker`: one counter per
+//! `stage_num` reached and one for completed samples. Snapshots are taken
+//! on demand with `ProgressTracker::snapshot`, or delivered at a fixed rate
+//! by a `ProgressReporter` timer thread, so a slow consumer never holds up
+//! processing.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{self, RecvTimeoutError, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+/// Number of `stage_num` buckets; the last one collects higher stages.
+pub const PROGRESS_STAGES: usize = 16;
+
+/// Point-in-time view of a batch.
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct ProgressSnapshot {
+    /// Samples in the batch.
+    pub total: u64,
+    /// Samples that finished their pipeline.
+    pub completed: u64,
+    /// Stage results produced so far.
+    pub stage_results: u64,
+    /// Stage results by the `stage_num` they reached.
+    pub at_stage: [u64; PROGRESS_STAGES],
+    /// Time since the batch started (frozen once it finished).
+    pub elapsed: Duration,
+    /// Completed samples per second.
+    pub throughput: f64,
+    /// Estimated time to complete the remaining samples.
+    pub eta: Option<Duration>,
+}
+
+impl ProgressSnapshot {
+    /// Highest `stage_num` reached by any stage result.
+    pub fn max_stage(&self) -> u32 {
+        self.at_stage.iter().rposition(|&n| n > 0).unwrap_or(0) as u32
+    }
+
+    pub fn is_finished(&self) -> bool {
+        self.completed >= self.total
+    }
+}
+
+#[derive(Default)]
+struct Clock {
+    started: Option<Instant>,
+    finished: Option<Duration>,
+}
+
+/// Progress counters shared by the workers of one runtime.
+#[derive(Default)]
+pub struct ProgressTracker {
+    total: AtomicU64,
+    completed: AtomicU64,
+    at_stage: [AtomicU64; PROGRESS_STAGES],
+    /// Only touched at batch boundaries and by snapshots.
+    clock: Mutex<Clock>,
+}
+
+impl ProgressTracker {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Start a batch of `total` samples, clearing previous counts.
+    pub fn begin(&self, total: usize) {
+        self.total.store(total as u64, Ordering::Relaxed);
+        self.completed.store(0, Ordering::Relaxed);
+        for n in &self.at_stage {
+            n.store(0, Ordering::Relaxed);
+        }
+        *self.clock.lock().unwrap() = Clock {
+            started: Some(Instant::now()),
+            finished: None,
+        };
+    }
+
+    /// A stage produced a result at `stage_num`.
+    #[inline]
+    pub fn record_stage(&self, stage_num: u32) {
+        let bucket = (stage_num as usize).min(PROGRESS_STAGES - 1);
+        self.at_stage[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// A sample finished its pipeline; returns the completed count.
+    #[inline]
+    pub fn record_completed(&self) -> u64 {
+        self.completed.fetch_add(1, Ordering::Relaxed) + 1
+    }
+
+    /// `count` results finished at once; returns the completed count.
+    #[inline]
+    pub fn record_completed_many(&self, count: usize) -> u64 {
+        self.completed.fetch_add(count as u64, Ordering::Relaxed) + count as u64
+    }
+
+    /// Stop the batch clock.
+    pub fn finish(&self) {
+        let mut clock = self.clock.lock().unwrap();
+        if let (Some(started), None) = (clock.started, clock.finished) {
+            clock.finished = Some(started.elapsed());
+        }
+    }
+
+    pub fn snapshot(&self) -> ProgressSnapshot {
+        let elapsed = {
+            let clock = self.clock.lock().unwrap();
+            clock
+                .finished
+                .or_else(|| clock.started.map(|s| s.elapsed()))
+                .unwrap_or_default()
+        };
+        let mut snapshot = ProgressSnapshot {
+            total: self.total.load(Ordering::Relaxed),
+            completed: self.completed.load(Ordering::Relaxed),
+            elapsed,
+            ..Default::default()
+        };
+        for (out, n) in snapshot.at_stage.iter_mut().zip(&self.at_stage) {
+            *out = n.load(Ordering::Relaxed);
+        }
+        snapshot.stage_results = snapshot.at_stage.iter().sum();
+
+        let secs = elapsed.as_secs_f64();
+        if secs > 0.0 {
+            snapshot.throughput = snapshot.completed as f64 / secs;
+        }
+        let remaining = snapshot.total.saturating_sub(snapshot.completed);
+        snapshot.eta = if remaining == 0 {
+            Some(Duration::ZERO)
+        } else if snapshot.throughput > 0.0 {
+            Some(Duration::from_secs_f64(
+                remaining as f64 / snapshot.throughput,
+            ))
+        } else {
+            None
+        };
+        snapshot
+    }
+}
+
+/// Timer thread that delivers snapshots at a fixed interval.
+///
+/// A snapshot is only delivered when something changed since the previous
+/// one. `stop` (or drop) delivers a final snapshot and joins the thread.
+pub struct ProgressReporter {
+    stop: Option<Sender<()>>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl ProgressReporter {
+    pub fn start<F>(tracker: Arc<ProgressTracker>, interval: Duration, on_progress: F) -> Self
+    where
+        F: Fn(&ProgressSnapshot) + Send + 'static,
+    {
+        let (stop, stopped) = mpsc::channel::<()>();
+        let thread = std::thread::Builder::new()
+            .name("saxs-progress".into())
+            .spawn(move || {
+                let mut last = (u64::MAX, u64::MAX);
+                loop {
+                    let done = match stopped.recv_timeout(interval) {
+                        Err(RecvTimeoutError::Timeout) => false,
+                        _ => true,
+                    };
+                    let snapshot = tracker.snapshot();
+                    let key = (snapshot.completed, snapshot.stage_results);
+                    if done || key != last {
+                        on_progress(&snapshot);
+                        last = key;
+                    }
+                    if done {
+                        return;
+                    }
+                }
+            })
+            .expect("failed to spawn progress thread");
+        Self {
+            stop: Some(stop),
+            thread: Some(thread),
+        }
+    }
+
+    /// Deliver a final snapshot and wait for the timer thread to exit.
+    pub fn stop(mut self) {
+        self.shutdown();
+    }
+
+    fn shutdown(&mut self) {
+        drop(self.stop.take());
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+impl Drop for ProgressReporter {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_snapshot_aggregates_stages() {
+        let tracker = ProgressTracker::new();
+        tracker.begin(4);
+        tracker.record_stage(1);
+        tracker.record_stage(1);
+        tracker.record_stage(2);
+        tracker.record_stage(40);
+        tracker.record_completed();
+
+        let snapshot = tracker.snapshot();
+        assert_eq!(snapshot.total, 4);
+        assert_eq!(snapshot.completed, 1);
+        assert_eq!(snapshot.stage_results, 4);
+        assert_eq!(snapshot.at_stage[1], 2);
+        assert_eq!(snapshot.at_stage[PROGRESS_STAGES - 1], 1);
+        assert_eq!(snapshot.max_stage(), PROGRESS_STAGES as u32 - 1);
+        assert!(!snapshot.is_finished());
+
+        for _ in 0..3 {
+            tracker.record_completed();
+        }
+        tracker.finish();
+        let done = tracker.snapshot();
+        assert!(done.is_finished());
+        assert_eq!(done.eta, Some(Duration::ZERO));
+        assert_eq!(tracker.snapshot().elapsed, done.elapsed);
+
+        tracker.begin(2);
+        assert_eq!(tracker.snapshot().stage_results, 0);
+    }
+
+    #[test]
+    fn test_reporter_delivers_final_snapshot() {
+        let tracker = Arc::new(ProgressTracker::new());
+        tracker.begin(1);
+        let seen = Arc::new(Mutex::new(Vec::new()));
+        let reporter = {
+            let seen = seen.clone();
+            ProgressReporter::start(tracker.clone(), Duration::from_secs(60), move |s| {
+                seen.lock().unwrap().push(s.completed)
+            })
+        };
+        tracker.record_stage(1);
+        tracker.record_completed();
+        reporter.stop();
+        // The interval never elapsed: only the final snapshot arrives.
+        assert_eq!(*seen.lock().unwrap(), vec![1]);
+    }
+}
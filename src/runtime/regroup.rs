@@ -1,26 +1,125 @@
 //! Regrouping pool for collecting processed samples.
+//!
+//! Samples that wait in the pool longer than the cold threshold are
+//! compressed in place and decompressed again when they are collected.
 
-use crate::data::Sample;
+use super::memory::Footprint;
+use crate::data::{CompressedSample, Sample};
 use std::collections::{HashMap, HashSet};
+use std::time::{Duration, Instant};
+
+/// Compression counters for cold samples.
+#[derive(Clone, Debug, Default)]
+pub struct CompressionStats {
+    /// Samples compressed.
+    pub compressed_samples: usize,
+    /// Samples decompressed.
+    pub decompressed_samples: usize,
+    /// Uncompressed array bytes of all compressed samples.
+    pub raw_bytes: u64,
+    /// Compressed array bytes of all compressed samples.
+    pub compressed_bytes: u64,
+    /// Time spent compressing.
+    pub compress_time: Duration,
+    /// Time spent decompressing.
+    pub decompress_time: Duration,
+}
+
+impl CompressionStats {
+    /// Overall compression ratio (raw / compressed).
+    pub fn ratio(&self) -> f64 {
+        if self.compressed_bytes == 0 {
+            1.0
+        } else {
+            self.raw_bytes as f64 / self.compressed_bytes as f64
+        }
+    }
+}
+
+/// Samples held at one stage.
+#[derive(Default)]
+struct StagePool {
+    /// Uncompressed samples in arrival order.
+    hot: Vec<Sample>,
+    /// Arrival time of each hot sample.
+    arrived: Vec<Instant>,
+    /// Compressed samples, oldest first.
+    cold: Vec<CompressedSample>,
+    /// Samples taken out for compression (see `RegroupPool::take_idle`).
+    in_transit: usize,
+    /// Samples (hot, cold or in transit) not tagged with a sweep point.
+    shared: usize,
+}
+
+impl StagePool {
+    /// Samples held (hot or cold), not counting those in transit.
+    fn len(&self) -> usize {
+        self.hot.len() + self.cold.len()
+    }
+}
+
+/// Idle samples taken out of a `RegroupPool` by `take_idle`.
+pub struct IdleSamples {
+    stages: Vec<IdleStage>,
+    /// `RegroupPool::generation` when taken.
+    generation: u64,
+    /// The pool's codec buffer, handed back by `put_cold`.
+    scratch: Vec<u8>,
+    compress_time: Duration,
+}
+
+/// Idle samples of one stage.
+struct IdleStage {
+    stage: u32,
+    /// Heap bytes of the samples before compression.
+    footprint: Footprint,
+    hot: Vec<Sample>,
+    cold: Vec<CompressedSample>,
+}
+
+impl IdleSamples {
+    /// Compress the samples; needs no access to the pool.
+    pub fn compress(&mut self) {
+        let start = Instant::now();
+        for batch in &mut self.stages {
+            for sample in batch.hot.drain(..) {
+                batch
+                    .cold
+                    .push(CompressedSample::compress(sample, &mut self.scratch));
+            }
+        }
+        self.compress_time += start.elapsed();
+    }
+}
 
 /// Pool for collecting samples at various processing stages.
 pub struct RegroupPool {
     /// Samples grouped by their current stage number.
-    pools: HashMap<u32, Vec<Sample>>,
+    pools: HashMap<u32, StagePool>,
     /// Stages designated as checkpoints (require all samples to sync).
     checkpoints: HashSet<u32>,
     /// Expected total number of samples in the batch.
     expected_count: usize,
+    /// Results each untagged sample stands for (the point count of a sweep).
+    fan_out: usize,
+    /// Idle time after which samples are compressed (None = never).
+    cold_threshold: Option<Duration>,
+    /// Time of the last idle sweep.
+    last_sweep: Instant,
+    /// Compression counters.
+    compression: CompressionStats,
+    /// Scratch buffer reused by the codec.
+    scratch: Vec<u8>,
+    /// Heap bytes of all held samples (cold ones at compressed size).
+    footprint: Footprint,
+    /// Bumped by `clear` and `reset`, which drop samples in transit too.
+    generation: u64,
 }
 
 impl RegroupPool {
     /// Create a new empty regroup pool.
     pub fn new() -> Self {
-        Self {
-            pools: HashMap::new(),
-            checkpoints: HashSet::new(),
-            expected_count: 0,
-        }
+        Self::with_expected_count(0)
     }
 
     /// Create with expected sample count.
@@ -29,14 +128,63 @@ impl RegroupPool {
             pools: HashMap::new(),
             checkpoints: HashSet::new(),
             expected_count: expected,
+            fan_out: 1,
+            cold_threshold: None,
+            last_sweep: Instant::now(),
+            compression: CompressionStats::default(),
+            scratch: Vec::new(),
+            footprint: Footprint::default(),
+            generation: 0,
         }
     }
 
+    /// Compress samples that stay in the pool longer than `threshold`.
+    ///
+    /// `None` disables compression; already compressed samples stay cold
+    /// until they are collected.
+    pub fn set_cold_threshold(&mut self, threshold: Option<Duration>) {
+        self.cold_threshold = threshold;
+    }
+
+    /// Heap bytes of the samples held, cold samples at compressed size.
+    pub fn footprint(&self) -> Footprint {
+        self.footprint
+    }
+
+    /// Get compression counters.
+    pub fn compression_stats(&self) -> &CompressionStats {
+        &self.compression
+    }
+
     /// Set the expected number of samples.
     pub fn set_expected_count(&mut self, count: usize) {
         self.expected_count = count;
     }
 
+    /// Count each sample not yet tagged with a sweep point as `fan_out`
+    /// samples towards checkpoints. A sweep expects one result per sample
+    /// and point, but stages before the fan-out run once per sample.
+    pub fn set_fan_out(&mut self, fan_out: usize) {
+        self.fan_out = fan_out.max(1);
+    }
+
+    /// Get the expected number of samples.
+    pub fn expected_count(&self) -> usize {
+        self.expected_count
+    }
+
+    /// Get the checkpoint stages in ascending order.
+    pub fn checkpoints(&self) -> Vec<u32> {
+        let mut stages: Vec<u32> = self.checkpoints.iter().copied().collect();
+        stages.sort();
+        stages
+    }
+
+    /// Whether any stage is a checkpoint.
+    pub fn has_checkpoints(&self) -> bool {
+        !self.checkpoints.is_empty()
+    }
+
     /// Set checkpoint stages.
     pub fn set_checkpoints(&mut self, stages: impl IntoIterator<Item = u32>) {
         self.checkpoints = stages.into_iter().collect();
@@ -57,10 +205,183 @@ impl RegroupPool {
         self.checkpoints.contains(&stage)
     }
 
-    /// Add a completed sample to the pool.
+    /// Add a completed sample to the pool, compressing idle samples when a
+    /// sweep is due.
     pub fn add(&mut self, sample: Sample) {
+        if let Some(idle) = self.add_and_take_idle(sample) {
+            self.put_cold(idle);
+        }
+    }
+
+    /// Add a sample like `add`, but hand idle samples back instead of
+    /// compressing them here, so a shared pool's lock is not held while
+    /// compressing. Compress them with `IdleSamples::compress` and return
+    /// them with `put_cold`.
+    pub fn add_and_take_idle(&mut self, sample: Sample) -> Option<IdleSamples> {
         let stage = sample.stage_num;
-        self.pools.entry(stage).or_insert_with(Vec::new).push(sample);
+        let now = Instant::now();
+        let pool = self.pools.entry(stage).or_default();
+        self.footprint.add(&Footprint::of_sample(&sample));
+        if sample.sweep_point().is_none() {
+            pool.shared += 1;
+        }
+        pool.hot.push(sample);
+        pool.arrived.push(now);
+
+        // Sweep a few times per threshold period rather than on every add.
+        let threshold = self.cold_threshold?;
+        if now.duration_since(self.last_sweep) >= threshold / 4 {
+            self.take_idle(now)
+        } else {
+            None
+        }
+    }
+
+    /// Compress all hot samples that have been idle longer than the threshold.
+    ///
+    /// Returns the number of samples compressed.
+    pub fn compress_idle(&mut self, now: Instant) -> usize {
+        match self.take_idle(now) {
+            Some(idle) => self.put_cold(idle),
+            None => 0,
+        }
+    }
+
+    /// Take out the hot samples idle longer than the threshold.
+    ///
+    /// They stay in the footprint, and their stage is neither ready nor
+    /// collected until `put_cold` returns them.
+    pub fn take_idle(&mut self, now: Instant) -> Option<IdleSamples> {
+        let threshold = self.cold_threshold?;
+        self.last_sweep = now;
+
+        let mut stages = Vec::new();
+        for (&stage, pool) in self.pools.iter_mut() {
+            // Hot samples are in arrival order, so the idle ones form a prefix.
+            let idle = pool
+                .arrived
+                .iter()
+                .take_while(|&&t| now.duration_since(t) >= threshold)
+                .count();
+            if idle == 0 {
+                continue;
+            }
+
+            pool.arrived.drain(..idle);
+            let hot: Vec<Sample> = pool.hot.drain(..idle).collect();
+            pool.in_transit += idle;
+            stages.push(IdleStage {
+                stage,
+                footprint: Footprint::of_samples(&hot),
+                hot,
+                cold: Vec::new(),
+            });
+        }
+
+        if stages.is_empty() {
+            return None;
+        }
+        Some(IdleSamples {
+            stages,
+            generation: self.generation,
+            scratch: std::mem::take(&mut self.scratch),
+            compress_time: Duration::ZERO,
+        })
+    }
+
+    /// Return samples taken by `take_idle` as cold samples, compressing
+    /// any that are not yet. Returns the number of samples.
+    pub fn put_cold(&mut self, mut idle: IdleSamples) -> usize {
+        // The pool was cleared meanwhile, and these samples with it.
+        if idle.generation != self.generation {
+            return 0;
+        }
+        idle.compress();
+
+        let mut count = 0;
+        for batch in idle.stages {
+            let n = batch.cold.len();
+            // A stage with samples in transit is never taken.
+            let pool = self
+                .pools
+                .get_mut(&batch.stage)
+                .expect("stage taken while samples were in transit");
+            pool.in_transit -= n;
+            self.footprint.sub(&batch.footprint);
+            for compressed in &batch.cold {
+                self.footprint.add(&Footprint::of_compressed(compressed));
+                self.compression.raw_bytes += compressed.raw_bytes() as u64;
+                self.compression.compressed_bytes += compressed.compressed_bytes() as u64;
+            }
+            pool.cold.extend(batch.cold);
+            count += n;
+        }
+
+        self.compression.compressed_samples += count;
+        self.compression.compress_time += idle.compress_time;
+        if self.scratch.capacity() < idle.scratch.capacity() {
+            self.scratch = idle.scratch;
+        }
+        count
+    }
+
+    /// Decompress cold samples, oldest first.
+    fn thaw(&mut self, cold: Vec<CompressedSample>) -> Vec<Sample> {
+        if cold.is_empty() {
+            return Vec::new();
+        }
+
+        let start = Instant::now();
+        let count = cold.len();
+        let mut samples = Vec::with_capacity(count);
+        for compressed in cold {
+            self.footprint.sub(&Footprint::of_compressed(&compressed));
+            // Compression is lossless and produced locally, so this cannot fail.
+            samples.push(
+                compressed
+                    .decompress(&mut self.scratch)
+                    .expect("corrupt cold sample"),
+            );
+        }
+
+        self.compression.decompressed_samples += count;
+        self.compression.decompress_time += start.elapsed();
+        samples
+    }
+
+    /// Remove a stage pool and return its samples decompressed (cold
+    /// samples first). A stage with samples in transit is left in place.
+    fn take_stage(&mut self, stage: u32) -> Option<Vec<Sample>> {
+        if self.pools.get(&stage)?.in_transit > 0 {
+            return None;
+        }
+        let pool = self.pools.remove(&stage)?;
+        self.footprint.sub(&Footprint::of_samples(&pool.hot));
+        let mut samples = self.thaw(pool.cold);
+        samples.extend(pool.hot);
+        Some(samples)
+    }
+
+    /// Decompress the cold samples of one stage in place.
+    fn thaw_stage(&mut self, stage: u32) {
+        let cold = match self.pools.get_mut(&stage) {
+            Some(p) if !p.cold.is_empty() => std::mem::take(&mut p.cold),
+            _ => return,
+        };
+        let mut samples = self.thaw(cold);
+        self.footprint.add(&Footprint::of_samples(&samples));
+        let pool = self.pools.get_mut(&stage).unwrap();
+        samples.append(&mut pool.hot);
+        pool.arrived = vec![Instant::now(); samples.len()];
+        pool.hot = samples;
+    }
+
+    /// Decompress all cold samples in place.
+    pub fn thaw_all(&mut self) {
+        let stages: Vec<u32> = self.pools.keys().copied().collect();
+        for stage in stages {
+            self.thaw_stage(stage);
+        }
     }
 
     /// Check if a checkpoint is ready (all samples have reached it).
@@ -69,35 +390,48 @@ impl RegroupPool {
             return false;
         }
 
-        let count = self.pools.get(&stage).map(|v| v.len()).unwrap_or(0);
+        let pool = match self.pools.get(&stage) {
+            Some(pool) => pool,
+            None => return false,
+        };
+        // Samples still being compressed cannot be collected yet.
+        if pool.in_transit > 0 {
+            return false;
+        }
+        // Untagged samples stand for every point of a sweep.
+        let count = pool.len() + pool.shared * (self.fan_out - 1);
         count >= self.expected_count && self.expected_count > 0
     }
 
-    /// Get the number of samples at a specific stage.
+    /// Get the number of samples held at a specific stage (not counting
+    /// samples in transit).
     pub fn count_at_stage(&self, stage: u32) -> usize {
-        self.pools.get(&stage).map(|v| v.len()).unwrap_or(0)
+        self.pools.get(&stage).map(|p| p.len()).unwrap_or(0)
     }
 
     /// Get total number of samples in the pool.
     pub fn total_count(&self) -> usize {
-        self.pools.values().map(|v| v.len()).sum()
+        self.pools.values().map(|p| p.len()).sum()
     }
 
     /// On-demand regroup: collect all samples at or above min_stage.
     ///
-    /// Samples are removed from the pool.
+    /// Samples are removed from the pool. A stage with samples in transit
+    /// (see `take_idle`) is left for a later call.
     pub fn regroup(&mut self, min_stage: u32) -> Vec<Sample> {
         let mut result = Vec::new();
 
-        let stages_to_drain: Vec<u32> = self
+        let mut stages_to_drain: Vec<u32> = self
             .pools
             .keys()
             .filter(|&&s| s >= min_stage)
             .copied()
             .collect();
+        // Lowest stage first, independent of hash order.
+        stages_to_drain.sort_unstable();
 
         for stage in stages_to_drain {
-            if let Some(samples) = self.pools.remove(&stage) {
+            if let Some(samples) = self.take_stage(stage) {
                 result.extend(samples);
             }
         }
@@ -113,7 +447,7 @@ impl RegroupPool {
             return None;
         }
 
-        self.pools.remove(&stage)
+        self.take_stage(stage)
     }
 
     /// Collect all samples from a checkpoint stage (blocking semantics).
@@ -124,12 +458,22 @@ impl RegroupPool {
             return None;
         }
 
-        self.pools.remove(&stage)
+        self.take_stage(stage)
     }
 
     /// Peek at samples at a stage without removing them.
-    pub fn peek_at_stage(&self, stage: u32) -> Option<&[Sample]> {
-        self.pools.get(&stage).map(|v| v.as_slice())
+    ///
+    /// Cold samples at this stage are decompressed first.
+    pub fn peek_at_stage(&mut self, stage: u32) -> Option<&[Sample]> {
+        self.thaw_stage(stage);
+        self.pools.get(&stage).map(|p| p.hot.as_slice())
+    }
+
+    /// Iterate over all uncompressed samples in the pool.
+    ///
+    /// Call `thaw_all` first to include compressed samples.
+    pub fn iter(&self) -> impl Iterator<Item = &Sample> {
+        self.pools.values().flat_map(|p| p.hot.iter())
     }
 
     /// Get all stage numbers that have samples.
@@ -142,12 +486,17 @@ impl RegroupPool {
     /// Clear all samples from the pool.
     pub fn clear(&mut self) {
         self.pools.clear();
+        self.footprint = Footprint::default();
+        self.generation += 1;
     }
 
     /// Reset the pool completely.
     pub fn reset(&mut self) {
         self.pools.clear();
+        self.footprint = Footprint::default();
         self.expected_count = 0;
+        self.fan_out = 1;
+        self.generation += 1;
         // Keep checkpoints as they're configuration
     }
 }
@@ -216,4 +565,83 @@ mod tests {
         let samples = pool.collect_checkpoint(5).unwrap();
         assert_eq!(samples.len(), 3);
     }
+
+    #[test]
+    fn test_cold_samples_compressed_and_restored() {
+        let mut pool = RegroupPool::with_expected_count(2);
+        pool.add_checkpoint(4);
+        pool.set_cold_threshold(Some(Duration::from_secs(60)));
+
+        let q: Vec<f64> = (0..512).map(|i| 0.01 + i as f64 * 1e-3).collect();
+        let intensity: Vec<f64> = q.iter().map(|&x| x.powf(-3.0)).collect();
+        let sample = Sample::new("a", q.clone(), intensity.clone(), vec![0.0; 512]).unwrap();
+        let mut sample_b = sample.clone();
+        sample_b.id = "b".to_string();
+        let mut sample = sample;
+        sample.stage_num = 4;
+        sample_b.stage_num = 4;
+
+        pool.add(sample);
+        assert_eq!(
+            pool.compress_idle(Instant::now() + Duration::from_secs(120)),
+            1
+        );
+        assert_eq!(pool.count_at_stage(4), 1);
+        assert!(pool.compression_stats().ratio() > 1.0);
+
+        // Checkpoint arrivals count compressed samples too.
+        pool.add(sample_b);
+        assert!(pool.checkpoint_ready(4));
+
+        let samples = pool.collect_checkpoint(4).unwrap();
+        assert_eq!(samples.len(), 2);
+        assert_eq!(samples[0].id, "a");
+        assert_eq!(samples[0].intensity, intensity);
+        assert_eq!(pool.compression_stats().decompressed_samples, 1);
+    }
+
+    #[test]
+    fn test_idle_samples_compressed_outside_pool() {
+        let mut pool = RegroupPool::with_expected_count(2);
+        pool.add_checkpoint(4);
+        pool.set_cold_threshold(Some(Duration::from_secs(60)));
+        pool.add(make_sample("a", 4));
+        let footprint = pool.footprint();
+
+        let later = Instant::now() + Duration::from_secs(120);
+        let mut idle = pool.take_idle(later).unwrap();
+        // The pool is free for others, but the stage waits for the
+        // samples in transit.
+        assert_eq!(pool.count_at_stage(4), 0);
+        assert_eq!(pool.footprint(), footprint);
+        pool.add(make_sample("b", 4));
+        assert!(!pool.checkpoint_ready(4));
+        assert!(pool.collect_at_stage(4).is_none());
+        assert!(pool.regroup(0).is_empty());
+
+        idle.compress();
+        assert_eq!(pool.put_cold(idle), 1);
+        assert_eq!(pool.count_at_stage(4), 2);
+        assert_eq!(pool.compression_stats().compressed_samples, 1);
+        assert!(pool.checkpoint_ready(4));
+
+        let ids: Vec<String> = pool
+            .collect_checkpoint(4)
+            .unwrap()
+            .into_iter()
+            .map(|s| s.id)
+            .collect();
+        assert_eq!(ids, ["a", "b"]);
+        assert_eq!(pool.footprint(), Footprint::default());
+
+        // Samples taken before a clear are not returned.
+        pool.add(make_sample("c", 4));
+        let idle = pool
+            .take_idle(Instant::now() + Duration::from_secs(120))
+            .unwrap();
+        pool.clear();
+        assert_eq!(pool.put_cold(idle), 0);
+        assert_eq!(pool.total_count(), 0);
+        assert_eq!(pool.footprint(), Footprint::default());
+    }
 }
@@ -1,10 +1,11 @@
 //! Priority-based scheduler for SAXS processing.
 
 use crate::data::{FlowMetadata, Sample};
-use crate::stage::{Stage, StageId, StageRegistry, StageRequest, StageResult};
+use crate::stage::{Stage, StageId, StageKey, StageRegistry, StageRequest, StageResult};
 use std::cmp::Ordering;
 use std::collections::BinaryHeap;
 use std::sync::Arc;
+use std::time::Instant;
 
 /// A unit of work in the scheduler queue.
 #[derive(Clone)]
@@ -15,8 +16,17 @@ pub struct WorkItem {
     pub metadata: FlowMetadata,
     /// The stage to execute.
     pub stage_id: StageId,
+    /// Instance of the stage to execute (0 = default).
+    pub instance: u16,
     /// Priority modifier (higher = more priority).
     pub priority_boost: i32,
+    /// Sequence number assigned by the scheduler on enqueue.
+    pub seq: u64,
+    /// When the item entered the queue.
+    pub enqueued_at: Option<Instant>,
+    /// Position within its wave in deterministic mode (the sample index
+    /// for the first wave).
+    pub order: u64,
 }
 
 impl WorkItem {
@@ -25,14 +35,41 @@ impl WorkItem {
             sample,
             metadata,
             stage_id,
+            instance: 0,
             priority_boost: 0,
+            seq: 0,
+            enqueued_at: None,
+            order: 0,
         }
     }
 
+    /// Item for a request issued by a stage. Requests without an instance
+    /// run on the default one; results inherit the issuing item's instance
+    /// before they get here (see `StageResult::inherit_instance`).
+    pub fn from_request(sample: Sample, request: StageRequest) -> Self {
+        Self::new(sample, request.metadata, request.stage_id)
+            .with_instance(request.instance.unwrap_or(0))
+    }
+
+    pub fn with_instance(mut self, instance: u16) -> Self {
+        self.instance = instance;
+        self
+    }
+
+    /// Stage kind and instance this item runs on.
+    pub fn key(&self) -> StageKey {
+        StageKey::new(self.stage_id, self.instance)
+    }
+
     pub fn with_priority(mut self, boost: i32) -> Self {
         self.priority_boost = boost;
         self
     }
+
+    pub fn with_order(mut self, order: u64) -> Self {
+        self.order = order;
+        self
+    }
 }
 
 // Implement ordering for priority queue.
@@ -73,6 +110,10 @@ pub struct PriorityScheduler {
     total_enqueued: usize,
     /// Total items processed.
     total_processed: usize,
+    /// Items handed out by `begin_next` and not yet finished.
+    in_flight: usize,
+    /// Next sequence number to assign.
+    next_seq: u64,
 }
 
 impl PriorityScheduler {
@@ -83,11 +124,35 @@ impl PriorityScheduler {
             registry,
             total_enqueued: 0,
             total_processed: 0,
+            in_flight: 0,
+            next_seq: 0,
         }
     }
 
+    /// Replace the registry used to look up stages of queued items.
+    pub fn set_registry(&mut self, registry: Arc<StageRegistry>) {
+        self.registry = registry;
+    }
+
     /// Enqueue a work item.
-    pub fn enqueue(&mut self, item: WorkItem) {
+    ///
+    /// Returns the sequence number assigned to the item.
+    pub fn enqueue(&mut self, mut item: WorkItem) -> u64 {
+        let seq = self.next_seq;
+        self.next_seq += 1;
+        item.seq = seq;
+        item.enqueued_at = Some(Instant::now());
+        self.queue.push(item);
+        self.total_enqueued += 1;
+        seq
+    }
+
+    /// Enqueue a work item that keeps its existing sequence number.
+    ///
+    /// Used when restoring a queue from a snapshot.
+    pub fn enqueue_restored(&mut self, mut item: WorkItem) {
+        self.next_seq = self.next_seq.max(item.seq + 1);
+        item.enqueued_at = Some(Instant::now());
         self.queue.push(item);
         self.total_enqueued += 1;
     }
@@ -115,13 +180,58 @@ impl PriorityScheduler {
     pub fn process_next(&mut self) -> Option<StageResult> {
         let item = self.queue.pop()?;
 
-        let stage = self.registry.get(item.stage_id)?;
-        let result = stage.process(item.sample, item.metadata);
+        let stage = self.registry.resolve(item.key())?;
+        let mut result = stage.process(item.sample, item.metadata);
+        result.inherit_instance(item.instance);
 
         self.total_processed += 1;
         Some(result)
     }
 
+    /// Pop the next work item together with its stage so the caller can run
+    /// it without holding the scheduler. An item whose stage is not
+    /// registered is handed out without one; the caller completes its
+    /// sample as it is.
+    ///
+    /// Every returned item must be paired with a call to `finish`.
+    pub fn begin_next(&mut self) -> Option<(Option<Arc<dyn Stage>>, WorkItem)> {
+        let item = self.queue.pop()?;
+        let stage = self.registry.resolve(item.key());
+        self.in_flight += 1;
+        if stage.is_some() {
+            self.total_processed += 1;
+        }
+        Some((stage, item))
+    }
+
+    /// Like `begin_next`, but stages are resolved by `lookup` instead of the
+    /// registry (e.g. a slot of a static pipeline). An item `lookup` rejects
+    /// is still handed out, without a stage: the caller completes its
+    /// sample as it is, so the item is journaled, accounted and counted
+    /// like any other.
+    pub fn begin_next_by<T>(
+        &mut self,
+        lookup: impl FnOnce(StageKey) -> Option<T>,
+    ) -> Option<(Option<T>, WorkItem)> {
+        let item = self.queue.pop()?;
+        let stage = lookup(item.key());
+        self.in_flight += 1;
+        if stage.is_some() {
+            self.total_processed += 1;
+        }
+        Some((stage, item))
+    }
+
+    /// Mark an item returned by `begin_next` as done.
+    pub fn finish(&mut self) {
+        self.in_flight -= 1;
+    }
+
+    /// Number of items currently being executed outside the scheduler.
+    pub fn in_flight(&self) -> usize {
+        self.in_flight
+    }
+
     /// Process next and automatically enqueue stage requests.
     ///
     /// Returns the processed sample and metadata, or None if queue is empty.
@@ -137,17 +247,18 @@ impl PriorityScheduler {
         // Enqueue approved stage requests
         for request in result.requests {
             if should_insert(&request) {
-                self.enqueue(WorkItem::new(
-                    result.sample.clone(),
-                    request.metadata,
-                    request.stage_id,
-                ));
+                self.enqueue(WorkItem::from_request(result.sample.clone(), request));
             }
         }
 
         Some((result.sample, result.metadata))
     }
 
+    /// Iterate over queued work items in arbitrary order.
+    pub fn iter(&self) -> impl Iterator<Item = &WorkItem> {
+        self.queue.iter()
+    }
+
     /// Check if the queue is empty.
     pub fn is_empty(&self) -> bool {
         self.queue.is_empty()
@@ -0,0 +1,831 @@
+//! Crash-safe snapshots of runtime state.
+//!
+//! State changes made by `Runtime::run_sync` are appended to a journal by a
+//! background writer thread. Every `compact_every` entries the writer folds
+//! the journal into a full snapshot and starts a new journal generation, so
+//! replay on resume stays short. The writer keeps no copy of the state; it
+//! replays the files on disk to compact them.
+//!
+//! ```text
+//! <dir>/state.snap          full snapshot, header holds generation N
+//! <dir>/journal.<N>.log     entries appended since that snapshot
+//! ```
+//!
+//! Every frame is `[len: u32][checksum: u32][payload]`. Replay stops at the
+//! first truncated or corrupt frame, which is what a crash mid-write leaves.
+
+use super::scheduler::WorkItem;
+use crate::data::codec::{
+    decode_flow_metadata, decode_sample, encode_flow_metadata, encode_sample, put_bytes, put_i32,
+    put_str, put_u32, put_u64, put_u8, CodecError, Decoder,
+};
+use crate::stage::{StageId, StageRequest};
+use std::collections::BTreeMap;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, BufWriter, Write};
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{self, RecvTimeoutError};
+use std::sync::Mutex;
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+const SNAPSHOT_FILE: &str = "state.snap";
+
+const TAG_HEADER: u8 = 0;
+const TAG_EXPECTED_COUNT: u8 = 1;
+const TAG_CHECKPOINTS: u8 = 2;
+const TAG_ENQUEUE: u8 = 3;
+const TAG_STEP: u8 = 4;
+const TAG_REGROUP: u8 = 5;
+const TAG_RESET: u8 = 6;
+const TAG_POOLED: u8 = 7;
+const TAG_COMPLETED: u8 = 8;
+const TAG_TAKE_COMPLETED: u8 = 9;
+
+/// Configuration for runtime snapshots.
+#[derive(Clone, Debug)]
+pub struct SnapshotConfig {
+    /// Directory holding the snapshot and journal files.
+    pub dir: PathBuf,
+    /// How often buffered journal entries are flushed and synced to disk.
+    pub flush_interval: Duration,
+    /// Number of journal entries between compactions.
+    pub compact_every: usize,
+}
+
+impl SnapshotConfig {
+    /// Create a configuration with default intervals.
+    pub fn new(dir: impl Into<PathBuf>) -> Self {
+        Self {
+            dir: dir.into(),
+            flush_interval: Duration::from_millis(500),
+            compact_every: 65536,
+        }
+    }
+}
+
+/// A single state change recorded in the journal.
+pub(crate) enum JournalEntry {
+    /// Expected batch size was set.
+    ExpectedCount(usize),
+    /// Checkpoint stages were replaced.
+    Checkpoints(Vec<u32>),
+    /// A work item was enqueued outside of a stage step.
+    Enqueue { seq: u64, item: Vec<u8> },
+    /// Work item `done` was processed, producing new items and one sample.
+    Step {
+        done: u64,
+        enqueued: Vec<(u64, Vec<u8>)>,
+        completed: bool,
+        sample: Vec<u8>,
+    },
+    /// Samples were handed out by an on-demand regroup.
+    Regroup {
+        min_stage: u32,
+        taken: Vec<(String, u32)>,
+    },
+    /// All state was cleared.
+    Reset,
+    /// A sample held in the regroup pool (snapshot only).
+    Pooled(Vec<u8>),
+    /// A completed sample (snapshot only).
+    Completed(Vec<u8>),
+    /// All completed samples were handed out.
+    TakeCompleted,
+}
+
+/// An encoded sample with the fields needed to match it on regroup.
+#[derive(Clone)]
+struct StoredSample {
+    id: String,
+    stage: u32,
+    bytes: Vec<u8>,
+}
+
+impl StoredSample {
+    fn from_bytes(bytes: Vec<u8>) -> Self {
+        // Encoded samples start with the id followed by the stage number.
+        let mut dec = Decoder::new(&bytes);
+        let id = dec.string().unwrap_or_default();
+        let stage = dec.u32().unwrap_or(0);
+        Self { id, stage, bytes }
+    }
+}
+
+/// Runtime state reconstructed from a snapshot and its journal.
+#[derive(Default)]
+pub struct SnapshotState {
+    expected_count: usize,
+    checkpoints: Vec<u32>,
+    pending: BTreeMap<u64, Vec<u8>>,
+    pool: Vec<StoredSample>,
+    completed: Vec<StoredSample>,
+}
+
+impl SnapshotState {
+    /// Load the latest snapshot and replay its journal.
+    pub fn load(dir: &Path) -> io::Result<(Self, u64)> {
+        let mut state = SnapshotState::default();
+        let mut generation = 0;
+
+        let snapshot = fs::read(dir.join(SNAPSHOT_FILE))?;
+        for entry in read_frames(&snapshot) {
+            match entry {
+                Frame::Header(gen) => generation = gen,
+                Frame::Entry(entry) => state.apply(entry),
+            }
+        }
+
+        match fs::read(journal_path(dir, generation)) {
+            Ok(journal) => {
+                for frame in read_frames(&journal) {
+                    if let Frame::Entry(entry) = frame {
+                        state.apply(entry);
+                    }
+                }
+            }
+            Err(e) if e.kind() == io::ErrorKind::NotFound => {}
+            Err(e) => return Err(e),
+        }
+
+        Ok((state, generation))
+    }
+
+    /// Expected sample count of the interrupted batch.
+    pub fn expected_count(&self) -> usize {
+        self.expected_count
+    }
+
+    /// Checkpoint stages at the time of the snapshot.
+    pub fn checkpoints(&self) -> &[u32] {
+        &self.checkpoints
+    }
+
+    /// Decode the pending work items.
+    pub fn pending_items(&self) -> Result<Vec<WorkItem>, CodecError> {
+        self.pending
+            .iter()
+            .map(|(&seq, bytes)| {
+                let mut item = decode_work_item(&mut Decoder::new(bytes))?;
+                item.seq = seq;
+                Ok(item)
+            })
+            .collect()
+    }
+
+    /// Decode the samples held in the regroup pool.
+    pub fn pool_samples(&self) -> Result<Vec<crate::data::Sample>, CodecError> {
+        self.pool
+            .iter()
+            .map(|s| decode_sample(&mut Decoder::new(&s.bytes)))
+            .collect()
+    }
+
+    /// Decode the completed samples.
+    pub fn completed_samples(&self) -> Result<Vec<crate::data::Sample>, CodecError> {
+        self.completed
+            .iter()
+            .map(|s| decode_sample(&mut Decoder::new(&s.bytes)))
+            .collect()
+    }
+
+    /// Number of pending work items.
+    pub fn pending_count(&self) -> usize {
+        self.pending.len()
+    }
+
+    pub(crate) fn apply(&mut self, entry: JournalEntry) {
+        match entry {
+            JournalEntry::ExpectedCount(count) => self.expected_count = count,
+            JournalEntry::Checkpoints(stages) => self.checkpoints = stages,
+            JournalEntry::Enqueue { seq, item } => {
+                self.pending.insert(seq, item);
+            }
+            JournalEntry::Step {
+                done,
+                enqueued,
+                completed,
+                sample,
+            } => {
+                self.pending.remove(&done);
+                self.pending.extend(enqueued);
+                let sample = StoredSample::from_bytes(sample);
+                if completed {
+                    self.completed.push(sample);
+                } else {
+                    self.pool.push(sample);
+                }
+            }
+            JournalEntry::Regroup {
+                min_stage,
+                mut taken,
+            } => {
+                // Mirror Runtime::regroup: pool first, then completed, with
+                // anything not handed out returned to the completed list.
+                let (candidates, kept): (Vec<_>, Vec<_>) =
+                    self.pool.drain(..).partition(|s| s.stage >= min_stage);
+                self.pool = kept;
+                let (done, kept): (Vec<_>, Vec<_>) =
+                    self.completed.drain(..).partition(|s| s.stage >= min_stage);
+                self.completed = kept;
+
+                for sample in candidates.into_iter().chain(done) {
+                    match taken
+                        .iter()
+                        .position(|(id, stage)| *id == sample.id && *stage == sample.stage)
+                    {
+                        Some(pos) => {
+                            taken.swap_remove(pos);
+                        }
+                        None => self.completed.push(sample),
+                    }
+                }
+            }
+            JournalEntry::Reset => {
+                self.expected_count = 0;
+                self.pending.clear();
+                self.pool.clear();
+                self.completed.clear();
+            }
+            JournalEntry::Pooled(bytes) => self.pool.push(StoredSample::from_bytes(bytes)),
+            JournalEntry::Completed(bytes) => self.completed.push(StoredSample::from_bytes(bytes)),
+            JournalEntry::TakeCompleted => self.completed.clear(),
+        }
+    }
+}
+
+/// Encode a work item (without its sequence number).
+pub(crate) fn encode_work_item(item: &WorkItem) -> Vec<u8> {
+    let mut buf = Vec::with_capacity(64 + item.sample.len() * 24);
+    put_u8(&mut buf, item.stage_id.index() as u8);
+    put_u32(&mut buf, item.instance as u32);
+    put_i32(&mut buf, item.priority_boost);
+    encode_sample(&mut buf, &item.sample);
+    encode_flow_metadata(&mut buf, &item.metadata);
+    buf
+}
+
+/// Decode a work item written by `encode_work_item`.
+pub(crate) fn decode_work_item(dec: &mut Decoder<'_>) -> Result<WorkItem, CodecError> {
+    let stage_id = decode_stage_id(dec)?;
+    let instance = decode_instance(dec)?;
+    let priority_boost = dec.i32()?;
+    let sample = decode_sample(dec)?;
+    let metadata = decode_flow_metadata(dec)?;
+    Ok(WorkItem::new(sample, metadata, stage_id)
+        .with_instance(instance)
+        .with_priority(priority_boost))
+}
+
+/// Instance written for a request that names none.
+const NO_INSTANCE: u32 = u32::MAX;
+
+/// Encode a stage request.
+pub(crate) fn encode_stage_request(buf: &mut Vec<u8>, request: &StageRequest) {
+    put_u8(buf, request.stage_id.index() as u8);
+    put_u32(buf, request.instance.map_or(NO_INSTANCE, u32::from));
+    encode_flow_metadata(buf, &request.metadata);
+}
+
+/// Decode a request written by `encode_stage_request`.
+pub(crate) fn decode_stage_request(dec: &mut Decoder<'_>) -> Result<StageRequest, CodecError> {
+    let stage_id = decode_stage_id(dec)?;
+    let instance = match dec.u32()? {
+        NO_INSTANCE => None,
+        v => Some(u16::try_from(v).map_err(|_| CodecError::Corrupt)?),
+    };
+    let mut request = StageRequest::new(stage_id, decode_flow_metadata(dec)?);
+    request.instance = instance;
+    Ok(request)
+}
+
+fn decode_stage_id(dec: &mut Decoder<'_>) -> Result<StageId, CodecError> {
+    let tag = dec.u8()?;
+    StageId::from_index(tag as usize).ok_or(CodecError::InvalidTag(tag))
+}
+
+fn decode_instance(dec: &mut Decoder<'_>) -> Result<u16, CodecError> {
+    let v = dec.u32()?;
+    u16::try_from(v).map_err(|_| CodecError::Corrupt)
+}
+
+/// Encode a sample for a journal entry.
+pub(crate) fn encode_sample_bytes(sample: &crate::data::Sample) -> Vec<u8> {
+    let mut buf = Vec::with_capacity(64 + sample.len() * 24);
+    encode_sample(&mut buf, sample);
+    buf
+}
+
+// ============================================================================
+// Framing
+// ============================================================================
+
+enum Frame {
+    Header(u64),
+    Entry(JournalEntry),
+}
+
+/// FNV-1a over the frame payload.
+fn checksum(data: &[u8]) -> u32 {
+    data.iter().fold(0x811c_9dc5u32, |h, &b| {
+        (h ^ b as u32).wrapping_mul(0x0100_0193)
+    })
+}
+
+fn write_frame<W: Write>(w: &mut W, payload: &[u8]) -> io::Result<()> {
+    w.write_all(&(payload.len() as u32).to_le_bytes())?;
+    w.write_all(&checksum(payload).to_le_bytes())?;
+    w.write_all(payload)
+}
+
+fn encode_entry(buf: &mut Vec<u8>, entry: &JournalEntry) {
+    match entry {
+        JournalEntry::ExpectedCount(count) => {
+            put_u8(buf, TAG_EXPECTED_COUNT);
+            put_u64(buf, *count as u64);
+        }
+        JournalEntry::Checkpoints(stages) => {
+            put_u8(buf, TAG_CHECKPOINTS);
+            put_u32(buf, stages.len() as u32);
+            for &stage in stages {
+                put_u32(buf, stage);
+            }
+        }
+        JournalEntry::Enqueue { seq, item } => {
+            put_u8(buf, TAG_ENQUEUE);
+            put_u64(buf, *seq);
+            put_bytes(buf, item);
+        }
+        JournalEntry::Step {
+            done,
+            enqueued,
+            completed,
+            sample,
+        } => {
+            put_u8(buf, TAG_STEP);
+            put_u64(buf, *done);
+            put_u32(buf, enqueued.len() as u32);
+            for (seq, item) in enqueued {
+                put_u64(buf, *seq);
+                put_bytes(buf, item);
+            }
+            put_u8(buf, *completed as u8);
+            put_bytes(buf, sample);
+        }
+        JournalEntry::Regroup { min_stage, taken } => {
+            put_u8(buf, TAG_REGROUP);
+            put_u32(buf, *min_stage);
+            put_u32(buf, taken.len() as u32);
+            for (id, stage) in taken {
+                put_str(buf, id);
+                put_u32(buf, *stage);
+            }
+        }
+        JournalEntry::Reset => put_u8(buf, TAG_RESET),
+        JournalEntry::Pooled(bytes) => {
+            put_u8(buf, TAG_POOLED);
+            put_bytes(buf, bytes);
+        }
+        JournalEntry::Completed(bytes) => {
+            put_u8(buf, TAG_COMPLETED);
+            put_bytes(buf, bytes);
+        }
+        JournalEntry::TakeCompleted => put_u8(buf, TAG_TAKE_COMPLETED),
+    }
+}
+
+fn decode_frame(payload: &[u8]) -> Result<Frame, CodecError> {
+    let mut dec = Decoder::new(payload);
+    let entry = match dec.u8()? {
+        TAG_HEADER => return Ok(Frame::Header(dec.u64()?)),
+        TAG_EXPECTED_COUNT => JournalEntry::ExpectedCount(dec.u64()? as usize),
+        TAG_CHECKPOINTS => {
+            let count = dec.u32()? as usize;
+            let mut stages = Vec::with_capacity(count);
+            for _ in 0..count {
+                stages.push(dec.u32()?);
+            }
+            JournalEntry::Checkpoints(stages)
+        }
+        TAG_ENQUEUE => JournalEntry::Enqueue {
+            seq: dec.u64()?,
+            item: dec.bytes()?.to_vec(),
+        },
+        TAG_STEP => {
+            let done = dec.u64()?;
+            let count = dec.u32()? as usize;
+            let mut enqueued = Vec::with_capacity(count);
+            for _ in 0..count {
+                let seq = dec.u64()?;
+                enqueued.push((seq, dec.bytes()?.to_vec()));
+            }
+            JournalEntry::Step {
+                done,
+                enqueued,
+                completed: dec.u8()? != 0,
+                sample: dec.bytes()?.to_vec(),
+            }
+        }
+        TAG_REGROUP => {
+            let min_stage = dec.u32()?;
+            let count = dec.u32()? as usize;
+            let mut taken = Vec::with_capacity(count);
+            for _ in 0..count {
+                let id = dec.string()?;
+                taken.push((id, dec.u32()?));
+            }
+            JournalEntry::Regroup { min_stage, taken }
+        }
+        TAG_RESET => JournalEntry::Reset,
+        TAG_POOLED => JournalEntry::Pooled(dec.bytes()?.to_vec()),
+        TAG_COMPLETED => JournalEntry::Completed(dec.bytes()?.to_vec()),
+        TAG_TAKE_COMPLETED => JournalEntry::TakeCompleted,
+        tag => return Err(CodecError::InvalidTag(tag)),
+    };
+    Ok(Frame::Entry(entry))
+}
+
+/// Decode frames until the data ends or a damaged frame is found.
+fn read_frames(data: &[u8]) -> Vec<Frame> {
+    let mut frames = Vec::new();
+    let mut pos = 0;
+
+    while data.len() - pos >= 8 {
+        let len = u32::from_le_bytes(data[pos..pos + 4].try_into().unwrap()) as usize;
+        let sum = u32::from_le_bytes(data[pos + 4..pos + 8].try_into().unwrap());
+        let start = pos + 8;
+        if data.len() - start < len {
+            break;
+        }
+        let payload = &data[start..start + len];
+        if checksum(payload) != sum {
+            break;
+        }
+        match decode_frame(payload) {
+            Ok(frame) => frames.push(frame),
+            Err(_) => break,
+        }
+        pos = start + len;
+    }
+
+    frames
+}
+
+fn journal_path(dir: &Path, generation: u64) -> PathBuf {
+    dir.join(format!("journal.{}.log", generation))
+}
+
+// ============================================================================
+// Background writer
+// ============================================================================
+
+enum Message {
+    Entry(JournalEntry),
+    Sync(mpsc::Sender<()>),
+}
+
+/// Handle to the background journal writer.
+pub(crate) struct Journal {
+    tx: Option<mpsc::Sender<Message>>,
+    /// Writer thread; joined once it has stopped.
+    handle: Mutex<Option<JoinHandle<io::Result<()>>>>,
+    /// Error that stopped the writer.
+    error: Mutex<Option<io::Error>>,
+}
+
+impl Journal {
+    /// Start a new snapshot generation from `state` and spawn the writer.
+    pub fn start(config: SnapshotConfig, state: SnapshotState) -> io::Result<Self> {
+        fs::create_dir_all(&config.dir)?;
+
+        let generation = match fs::read(config.dir.join(SNAPSHOT_FILE)) {
+            Ok(data) => match read_frames(&data).first() {
+                Some(Frame::Header(gen)) => *gen,
+                _ => 0,
+            },
+            Err(_) => 0,
+        };
+
+        let mut writer = JournalWriter {
+            config,
+            generation,
+            file: None,
+            entries_since_compact: 0,
+            buf: Vec::new(),
+        };
+        writer.compact(&state)?;
+        drop(state);
+
+        let (tx, rx) = mpsc::channel();
+        let handle = std::thread::Builder::new()
+            .name("saxs-journal".into())
+            .spawn(move || writer.run(rx))?;
+
+        Ok(Self {
+            tx: Some(tx),
+            handle: Mutex::new(Some(handle)),
+            error: Mutex::new(None),
+        })
+    }
+
+    /// Queue an entry for the writer thread.
+    ///
+    /// Entries are dropped if the writer has stopped after an I/O error;
+    /// `sync` and `error` then report it.
+    pub fn record(&self, entry: JournalEntry) {
+        if let Some(tx) = &self.tx {
+            let _ = tx.send(Message::Entry(entry));
+        }
+    }
+
+    /// Block until all queued entries are on disk. Fails with the writer's
+    /// error once it has stopped.
+    pub fn sync(&self) -> io::Result<()> {
+        let (ack_tx, ack_rx) = mpsc::channel();
+        let sent = self
+            .tx
+            .as_ref()
+            .is_some_and(|tx| tx.send(Message::Sync(ack_tx)).is_ok());
+        if sent && ack_rx.recv().is_ok() {
+            Ok(())
+        } else {
+            Err(self.stopped())
+        }
+    }
+
+    /// The error that stopped the writer, if it has stopped. The writer
+    /// only stops early on an I/O error.
+    pub fn error(&self) -> Option<io::Error> {
+        let finished = self
+            .handle
+            .lock()
+            .unwrap()
+            .as_ref()
+            .map_or(true, |h| h.is_finished());
+        finished.then(|| self.stopped())
+    }
+
+    /// Join the stopped writer and return a copy of its error.
+    fn stopped(&self) -> io::Error {
+        let mut error = self.error.lock().unwrap();
+        let e = error.get_or_insert_with(|| match self.handle.lock().unwrap().take() {
+            Some(handle) => match handle.join() {
+                Ok(Err(e)) => e,
+                Ok(Ok(())) => io::Error::new(io::ErrorKind::Other, "journal writer stopped"),
+                Err(_) => io::Error::new(io::ErrorKind::Other, "journal writer panicked"),
+            },
+            None => io::Error::new(io::ErrorKind::Other, "journal writer stopped"),
+        });
+        io::Error::new(e.kind(), e.to_string())
+    }
+}
+
+impl Drop for Journal {
+    fn drop(&mut self) {
+        self.tx.take();
+        if let Some(handle) = self.handle.get_mut().unwrap().take() {
+            let _ = handle.join();
+        }
+    }
+}
+
+struct JournalWriter {
+    config: SnapshotConfig,
+    generation: u64,
+    file: Option<BufWriter<File>>,
+    entries_since_compact: usize,
+    buf: Vec<u8>,
+}
+
+impl JournalWriter {
+    fn run(mut self, rx: mpsc::Receiver<Message>) -> io::Result<()> {
+        let mut last_sync = Instant::now();
+
+        loop {
+            match rx.recv_timeout(self.config.flush_interval) {
+                Ok(Message::Entry(entry)) => {
+                    self.append(&entry)?;
+                    if self.entries_since_compact >= self.config.compact_every {
+                        // Sample payloads are only held while compacting.
+                        self.sync()?;
+                        let (state, _) = SnapshotState::load(&self.config.dir)?;
+                        self.compact(&state)?;
+                    }
+                }
+                Ok(Message::Sync(ack)) => {
+                    self.sync()?;
+                    last_sync = Instant::now();
+                    let _ = ack.send(());
+                }
+                Err(RecvTimeoutError::Timeout) => {}
+                Err(RecvTimeoutError::Disconnected) => return self.sync(),
+            }
+
+            if last_sync.elapsed() >= self.config.flush_interval {
+                self.sync()?;
+                last_sync = Instant::now();
+            }
+        }
+    }
+
+    fn append(&mut self, entry: &JournalEntry) -> io::Result<()> {
+        self.buf.clear();
+        encode_entry(&mut self.buf, entry);
+        if let Some(file) = self.file.as_mut() {
+            write_frame(file, &self.buf)?;
+        }
+        self.entries_since_compact += 1;
+        Ok(())
+    }
+
+    fn sync(&mut self) -> io::Result<()> {
+        if let Some(file) = self.file.as_mut() {
+            file.flush()?;
+            file.get_ref().sync_data()?;
+        }
+        Ok(())
+    }
+
+    /// Write `state` as a new snapshot generation.
+    fn compact(&mut self, state: &SnapshotState) -> io::Result<()> {
+        let dir = self.config.dir.clone();
+        let generation = self.generation + 1;
+        let tmp = dir.join("state.snap.tmp");
+
+        {
+            let mut w = BufWriter::new(File::create(&tmp)?);
+            let mut buf = Vec::new();
+
+            put_u8(&mut buf, TAG_HEADER);
+            put_u64(&mut buf, generation);
+            write_frame(&mut w, &buf)?;
+
+            let mut frame = |entry: &JournalEntry, w: &mut BufWriter<File>| {
+                buf.clear();
+                encode_entry(&mut buf, entry);
+                write_frame(w, &buf)
+            };
+            frame(&JournalEntry::ExpectedCount(state.expected_count), &mut w)?;
+            frame(
+                &JournalEntry::Checkpoints(state.checkpoints.clone()),
+                &mut w,
+            )?;
+            // Borrowed payloads are framed directly to avoid cloning arrays.
+            for (&seq, item) in &state.pending {
+                let mut payload = Vec::with_capacity(item.len() + 16);
+                put_u8(&mut payload, TAG_ENQUEUE);
+                put_u64(&mut payload, seq);
+                put_bytes(&mut payload, item);
+                write_frame(&mut w, &payload)?;
+            }
+            for (tag, samples) in [(TAG_POOLED, &state.pool), (TAG_COMPLETED, &state.completed)] {
+                for sample in samples {
+                    let mut payload = Vec::with_capacity(sample.bytes.len() + 8);
+                    put_u8(&mut payload, tag);
+                    put_bytes(&mut payload, &sample.bytes);
+                    write_frame(&mut w, &payload)?;
+                }
+            }
+
+            w.flush()?;
+            w.get_ref().sync_all()?;
+        }
+
+        fs::rename(&tmp, dir.join(SNAPSHOT_FILE))?;
+        if let Ok(d) = File::open(&dir) {
+            let _ = d.sync_all();
+        }
+
+        let file = OpenOptions::new()
+            .create(true)
+            .write(true)
+            .truncate(true)
+            .open(journal_path(&dir, generation))?;
+        let _ = fs::remove_file(journal_path(&dir, self.generation));
+
+        self.file = Some(BufWriter::new(file));
+        self.generation = generation;
+        self.entries_since_compact = 0;
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::{FlowMetadata, Sample};
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("saxsrs-{}-{}", name, std::process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        dir
+    }
+
+    fn make_item(id: &str, stage: u32) -> WorkItem {
+        let mut s = Sample::new(id, vec![1.0, 2.0], vec![3.0, 4.0], vec![0.1, 0.2]).unwrap();
+        s.stage_num = stage;
+        WorkItem::new(s, FlowMetadata::new(id), StageId::FindPeak)
+    }
+
+    #[test]
+    fn test_journal_replay() {
+        let dir = temp_dir("replay");
+        {
+            let journal =
+                Journal::start(SnapshotConfig::new(&dir), SnapshotState::default()).unwrap();
+            journal.record(JournalEntry::ExpectedCount(2));
+            journal.record(JournalEntry::Enqueue {
+                seq: 0,
+                item: encode_work_item(&make_item("a", 0)),
+            });
+            journal.record(JournalEntry::Enqueue {
+                seq: 1,
+                item: encode_work_item(&make_item("b", 0)),
+            });
+            journal.record(JournalEntry::Step {
+                done: 0,
+                enqueued: vec![(2, encode_work_item(&make_item("a", 1).with_instance(3)))],
+                completed: false,
+                sample: encode_sample_bytes(&make_item("a", 1).sample),
+            });
+            journal.sync().unwrap();
+        }
+
+        let (state, _) = SnapshotState::load(&dir).unwrap();
+        assert_eq!(state.expected_count(), 2);
+        let pending = state.pending_items().unwrap();
+        let seqs: Vec<u64> = pending.iter().map(|i| i.seq).collect();
+        assert_eq!(seqs, vec![1, 2]);
+        assert_eq!(pending[1].instance, 3);
+        assert_eq!(state.pool_samples().unwrap().len(), 1);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_compaction_preserves_state() {
+        let dir = temp_dir("compact");
+        {
+            let mut config = SnapshotConfig::new(&dir);
+            config.compact_every = 2;
+            let journal = Journal::start(config, SnapshotState::default()).unwrap();
+            for seq in 0..5 {
+                journal.record(JournalEntry::Enqueue {
+                    seq,
+                    item: encode_work_item(&make_item("x", 0)),
+                });
+            }
+            journal.sync().unwrap();
+        }
+
+        let (state, generation) = SnapshotState::load(&dir).unwrap();
+        assert!(generation > 1);
+        assert_eq!(state.pending_count(), 5);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_writer_error_is_reported() {
+        let dir = temp_dir("error");
+        let mut config = SnapshotConfig::new(&dir);
+        config.compact_every = 1;
+        let journal = Journal::start(config, SnapshotState::default()).unwrap();
+        assert!(journal.error().is_none());
+
+        // The next compaction cannot create its file.
+        fs::remove_dir_all(&dir).unwrap();
+        journal.record(JournalEntry::ExpectedCount(1));
+        let error = journal.sync().unwrap_err();
+        assert_eq!(error.kind(), io::ErrorKind::NotFound);
+        journal.record(JournalEntry::ExpectedCount(2));
+        assert!(journal.sync().is_err());
+        assert_eq!(journal.error().unwrap().kind(), io::ErrorKind::NotFound);
+    }
+
+    #[test]
+    fn test_truncated_journal_tail() {
+        let dir = temp_dir("truncated");
+        {
+            let journal =
+                Journal::start(SnapshotConfig::new(&dir), SnapshotState::default()).unwrap();
+            journal.record(JournalEntry::ExpectedCount(7));
+            journal.record(JournalEntry::Enqueue {
+                seq: 0,
+                item: encode_work_item(&make_item("a", 0)),
+            });
+            journal.sync().unwrap();
+        }
+
+        // Simulate a crash in the middle of the last frame.
+        let path = journal_path(&dir, 1);
+        let data = fs::read(&path).unwrap();
+        fs::write(&path, &data[..data.len() - 5]).unwrap();
+
+        let (state, _) = SnapshotState::load(&dir).unwrap();
+        assert_eq!(state.expected_count(), 7);
+        assert_eq!(state.pending_count(), 0);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
@@ -0,0 +1,121 @@
+//! Timing summary for a `run_sync` call.
+
+use std::time::Duration;
+
+/// Timing collected by one worker thread.
+#[derive(Debug, Default)]
+pub(crate) struct WorkerStats {
+    /// Worker index, which also selects its metrics shard.
+    pub worker: usize,
+    pub stages_executed: u64,
+    pub busy: Duration,
+    pub scheduler_wait: Duration,
+    pub idle: Duration,
+    pub sample_latencies: Vec<Duration>,
+    /// Worker processes restarted (process mode).
+    pub restarts: u64,
+}
+
+/// Summary of the last `run_sync` call.
+#[derive(Debug, Clone, Default)]
+pub struct RunStats {
+    /// Worker threads used.
+    pub workers: usize,
+    /// Wall-clock duration of the run.
+    pub elapsed: Duration,
+    /// Stage executions across all workers.
+    pub stages_executed: u64,
+    /// Time spent inside stages, summed over workers.
+    pub busy: Duration,
+    /// Time spent acquiring the scheduler lock, summed over workers.
+    pub scheduler_wait: Duration,
+    /// Time spent waiting for other workers to produce work.
+    pub idle: Duration,
+    /// Time from the start of the run until each sample completed.
+    pub sample_latencies: Vec<Duration>,
+    /// Worker processes restarted after exiting unexpectedly (process
+    /// mode).
+    pub worker_restarts: u64,
+}
+
+impl RunStats {
+    pub(crate) fn from_workers(elapsed: Duration, workers: Vec<WorkerStats>) -> Self {
+        let mut stats = RunStats {
+            workers: workers.len(),
+            elapsed,
+            ..Default::default()
+        };
+        for w in workers {
+            stats.stages_executed += w.stages_executed;
+            stats.busy += w.busy;
+            stats.scheduler_wait += w.scheduler_wait;
+            stats.idle += w.idle;
+            stats.sample_latencies.extend(w.sample_latencies);
+            stats.worker_restarts += w.restarts;
+        }
+        stats.sample_latencies.sort_unstable();
+        stats
+    }
+
+    /// Completed samples per second.
+    pub fn throughput(&self) -> f64 {
+        let secs = self.elapsed.as_secs_f64();
+        if secs > 0.0 {
+            self.sample_latencies.len() as f64 / secs
+        } else {
+            0.0
+        }
+    }
+
+    /// Fraction of worker time spent executing stages.
+    pub fn utilization(&self) -> f64 {
+        let total = self.elapsed.as_secs_f64() * self.workers as f64;
+        if total > 0.0 {
+            self.busy.as_secs_f64() / total
+        } else {
+            0.0
+        }
+    }
+
+    /// Sample latency at percentile `p` (0–100), nearest rank.
+    pub fn latency_percentile(&self, p: f64) -> Option<Duration> {
+        let n = self.sample_latencies.len();
+        if n == 0 {
+            return None;
+        }
+        let rank = ((p / 100.0) * n as f64).ceil() as usize;
+        Some(self.sample_latencies[rank.clamp(1, n) - 1])
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_merge_and_percentiles() {
+        let ms = Duration::from_millis;
+        let workers = vec![
+            WorkerStats {
+                stages_executed: 3,
+                busy: ms(30),
+                sample_latencies: vec![ms(40), ms(10)],
+                ..Default::default()
+            },
+            WorkerStats {
+                stages_executed: 2,
+                busy: ms(20),
+                sample_latencies: vec![ms(20), ms(30)],
+                ..Default::default()
+            },
+        ];
+        let stats = RunStats::from_workers(ms(50), workers);
+
+        assert_eq!(stats.stages_executed, 5);
+        assert_eq!(stats.latency_percentile(50.0), Some(ms(20)));
+        assert_eq!(stats.latency_percentile(100.0), Some(ms(40)));
+        assert_eq!(stats.latency_percentile(0.0), Some(ms(10)));
+        assert!((stats.utilization() - 0.5).abs() < 1e-9);
+        assert!((stats.throughput() - 80.0).abs() < 1e-9);
+    }
+}
@@ -0,0 +1,257 @@
+//! Parameter sweeps over stage configurations.
+//!
+//! A `Sweep` is a list of points, each replacing some of the runtime's
+//! stages. `Runtime::run_sweep` runs the stages no point replaces once per
+//! sample. At the first replaced ("diverging") stage a sample reaches, a
+//! fan-out stage hands one copy to every point, so only the diverging part
+//! of the pipeline runs once per point. Point `p` runs at stage instance
+//! `p + 1` (see `StageKey`) and tags the samples it produces
+//! (`Sample::sweep_point`).
+
+use crate::data::hash::StableHasher;
+use crate::data::{FlowMetadata, Sample};
+use crate::stage::find_peak::FindPeakConfig;
+use crate::stage::process_peak::ProcessPeakConfig;
+use crate::stage::{
+    FindPeakStage, ProcessPeakStage, Stage, StageId, StageRegistry, StageRequest, StageResult,
+};
+use std::hash::Hasher;
+use std::sync::Arc;
+
+/// Largest number of points (instance 0 is the shared pipeline).
+pub const MAX_POINTS: usize = u16::MAX as usize;
+
+/// Grid of stage configurations to run every sample through.
+#[derive(Clone, Default)]
+pub struct Sweep {
+    points: Vec<Vec<Arc<dyn Stage>>>,
+}
+
+impl Sweep {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Every combination of peak finding and peak processing settings.
+    /// Point `f * process.len() + p` uses `find[f]` and `process[p]`.
+    pub fn peak_grid(find: &[FindPeakConfig], process: &[ProcessPeakConfig]) -> Self {
+        let mut sweep = Self::new();
+        for f in find {
+            for p in process {
+                sweep.add_point(vec![
+                    Arc::new(FindPeakStage::new(f.clone())),
+                    Arc::new(ProcessPeakStage::new(p.clone())),
+                ]);
+            }
+        }
+        sweep
+    }
+
+    /// Add a point whose `stages` replace the runtime's stages of the same
+    /// kind; returns its index.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the sweep already has `MAX_POINTS` points.
+    pub fn add_point(&mut self, stages: Vec<Arc<dyn Stage>>) -> u32 {
+        assert!(self.points.len() < MAX_POINTS, "too many sweep points");
+        self.points.push(stages);
+        (self.points.len() - 1) as u32
+    }
+
+    pub fn len(&self) -> usize {
+        self.points.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.points.is_empty()
+    }
+
+    /// Stage kinds replaced by at least one point.
+    pub fn diverging(&self) -> Vec<StageId> {
+        StageId::ALL
+            .into_iter()
+            .filter(|&id| self.points.iter().flatten().any(|s| s.id() == id))
+            .collect()
+    }
+
+    /// Registry running `base` up to the first diverging stage and each
+    /// point's stages after it.
+    pub(crate) fn registry(&self, base: &StageRegistry) -> StageRegistry {
+        let diverging = self.diverging();
+        let mut registry = StageRegistry::new();
+        for id in base.stage_ids() {
+            if !diverging.contains(&id) {
+                registry.register_arc(base.get(id).unwrap());
+            }
+        }
+        for &kind in &diverging {
+            registry.register(FanOut {
+                kind,
+                points: self.points.len() as u16,
+            });
+        }
+        for (point, stages) in self.points.iter().enumerate() {
+            for &kind in &diverging {
+                // A later stage of the same kind wins, as in the registry.
+                let own = stages.iter().rev().find(|s| s.id() == kind).cloned();
+                if let Some(stage) = own.or_else(|| base.get(kind)) {
+                    let branch = Branch {
+                        point: point as u32,
+                        stage,
+                    };
+                    registry.register_instance(point as u16 + 1, branch);
+                }
+            }
+        }
+        registry
+    }
+
+    /// Completed samples grouped by point. Samples that finished before
+    /// any diverging stage are the same for every point and are copied
+    /// into each group.
+    pub fn by_point(&self, samples: Vec<Sample>) -> Vec<Vec<Sample>> {
+        let mut groups: Vec<Vec<Sample>> = vec![Vec::new(); self.points.len()];
+        for sample in samples {
+            match sample.sweep_point() {
+                Some(point) => {
+                    if let Some(group) = groups.get_mut(point as usize) {
+                        group.push(sample);
+                    }
+                }
+                None => {
+                    for group in &mut groups {
+                        group.push(sample.clone());
+                    }
+                }
+            }
+        }
+        groups
+    }
+}
+
+/// First diverging stage of the shared pipeline: requests the same kind
+/// at every point's instance. The executor copies the sample per request.
+struct FanOut {
+    kind: StageId,
+    points: u16,
+}
+
+impl Stage for FanOut {
+    fn id(&self) -> StageId {
+        self.kind
+    }
+
+    fn config_hash(&self) -> u64 {
+        let mut h = StableHasher::new();
+        h.write_u16(self.points);
+        h.finish()
+    }
+
+    fn cacheable(&self) -> bool {
+        true
+    }
+
+    fn process(&self, sample: Sample, metadata: FlowMetadata) -> StageResult {
+        // A point without a stage of this kind falls back to instance 0;
+        // its samples end here instead of fanning out again.
+        if sample.sweep_point().is_some() {
+            return StageResult::terminal(sample, metadata);
+        }
+        let requests = (1..=self.points)
+            .map(|instance| StageRequest::new(self.kind, metadata.clone()).on_instance(instance))
+            .collect();
+        StageResult::with_requests(sample, metadata, requests)
+    }
+}
+
+/// A point's stage; tags the sample with the point before running it.
+struct Branch {
+    point: u32,
+    stage: Arc<dyn Stage>,
+}
+
+impl Stage for Branch {
+    fn id(&self) -> StageId {
+        self.stage.id()
+    }
+
+    fn name(&self) -> &'static str {
+        self.stage.name()
+    }
+
+    fn config_hash(&self) -> u64 {
+        // The point is part of the output, so it is part of the key.
+        let mut h = StableHasher::new();
+        h.write_u64(self.stage.config_hash());
+        h.write_u32(self.point);
+        h.finish()
+    }
+
+    fn cacheable(&self) -> bool {
+        self.stage.cacheable()
+    }
+
+    fn process(&self, mut sample: Sample, metadata: FlowMetadata) -> StageResult {
+        sample.metadata.sweep = Some(self.point);
+        self.stage.process(sample, metadata)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::stage::StageKey;
+
+    #[test]
+    fn test_registry_shares_upstream_stages() {
+        let find = [
+            FindPeakConfig::default(),
+            FindPeakConfig {
+                min_height: 2.0,
+                ..Default::default()
+            },
+        ];
+        let sweep = Sweep::peak_grid(&find, &[ProcessPeakConfig::default()]);
+        assert_eq!(sweep.len(), 2);
+        assert_eq!(
+            sweep.diverging(),
+            vec![StageId::FindPeak, StageId::ProcessPeak]
+        );
+
+        let registry = sweep.registry(&StageRegistry::new_with_defaults());
+        let keys = registry.keys();
+        assert_eq!(keys.len(), 6);
+        assert!(keys.contains(&StageKey::new(StageId::ProcessPeak, 2)));
+        assert!(!keys.contains(&StageKey::new(StageId::FindPeak, 3)));
+
+        // The fan-out copies the sample to both points.
+        let sample = Sample::new("s", vec![0.1; 4], vec![1.0; 4], vec![0.1; 4]).unwrap();
+        let fan_out = registry.get(StageId::FindPeak).unwrap();
+        let result = fan_out.process(sample, FlowMetadata::new("s"));
+        let instances: Vec<_> = result.requests.iter().map(|r| r.instance).collect();
+        assert_eq!(instances, vec![Some(1), Some(2)]);
+    }
+
+    #[test]
+    fn test_by_point_copies_shared_results() {
+        let mut sweep = Sweep::new();
+        sweep.add_point(vec![Arc::new(FindPeakStage::default())]);
+        sweep.add_point(vec![Arc::new(FindPeakStage::default())]);
+        let sample = |id: &str, point: Option<u32>| {
+            let mut s = Sample::new(id, vec![0.1], vec![1.0], vec![0.1]).unwrap();
+            s.metadata.sweep = point;
+            s
+        };
+        let groups = sweep.by_point(vec![
+            sample("a", Some(1)),
+            sample("b", None),
+            sample("a", Some(0)),
+        ]);
+        let ids: Vec<Vec<&str>> = groups
+            .iter()
+            .map(|g| g.iter().map(|s| s.id.as_str()).collect())
+            .collect();
+        assert_eq!(ids, vec![vec!["b", "a"], vec!["a", "b"]]);
+    }
+}
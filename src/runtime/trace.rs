@@ -0,0 +1,239 @@
+//! Optional per-worker span tracing with Chrome trace export.
+//!
+//! Each worker appends spans to its own fixed-size ring, so recording is a
+//! plain store plus one atomic publish with no locking. Rings keep the most
+//! recent spans when they overflow. After the run, `Tracer::write_chrome`
+//! emits a `chrome://tracing` / Perfetto-compatible JSON file.
+
+use crate::stage::StageId;
+use std::cell::UnsafeCell;
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Instant;
+
+/// Tracing configuration.
+#[derive(Clone, Debug)]
+pub struct TraceConfig {
+    /// Chrome trace JSON written at the end of each run.
+    pub path: PathBuf,
+    /// Spans kept per worker.
+    pub capacity: usize,
+}
+
+impl TraceConfig {
+    pub fn new(path: impl Into<PathBuf>) -> Self {
+        Self {
+            path: path.into(),
+            capacity: 1 << 16,
+        }
+    }
+}
+
+/// What a span covers.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum SpanKind {
+    /// Waiting for and popping the next work item.
+    Dequeue,
+    /// Running a stage.
+    Execute,
+    /// Enqueueing follow-up requests.
+    Enqueue,
+    /// Adding a sample to the regroup pool or the completed list.
+    Regroup,
+    /// User callbacks (`run_async`).
+    Callback,
+}
+
+impl SpanKind {
+    fn name(self) -> &'static str {
+        match self {
+            SpanKind::Dequeue => "dequeue",
+            SpanKind::Execute => "execute",
+            SpanKind::Enqueue => "enqueue",
+            SpanKind::Regroup => "regroup",
+            SpanKind::Callback => "callback",
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+struct Span {
+    kind: SpanKind,
+    stage: Option<StageId>,
+    start_ns: u64,
+    dur_ns: u64,
+}
+
+/// Single-writer ring of spans.
+struct Ring {
+    spans: Box<[UnsafeCell<Span>]>,
+    written: AtomicU64,
+}
+
+// Each ring is written only by the worker that owns its index and read only
+// after all workers of the run have finished. `Tracer` is crate-private so
+// that only the executor, which upholds this, can record spans.
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    fn new(capacity: usize) -> Self {
+        let empty = Span {
+            kind: SpanKind::Dequeue,
+            stage: None,
+            start_ns: 0,
+            dur_ns: 0,
+        };
+        Self {
+            spans: (0..capacity.max(1))
+                .map(|_| UnsafeCell::new(empty))
+                .collect(),
+            written: AtomicU64::new(0),
+        }
+    }
+
+    #[inline]
+    fn push(&self, span: Span) {
+        let n = self.written.load(Ordering::Relaxed);
+        let slot = (n % self.spans.len() as u64) as usize;
+        unsafe { *self.spans[slot].get() = span };
+        self.written.store(n + 1, Ordering::Release);
+    }
+
+    /// Spans in recording order, and how many were overwritten.
+    fn drain(&self) -> (Vec<Span>, u64) {
+        let n = self.written.load(Ordering::Acquire);
+        let cap = self.spans.len() as u64;
+        let kept = n.min(cap);
+        let spans = (n - kept..n)
+            .map(|i| unsafe { *self.spans[(i % cap) as usize].get() })
+            .collect();
+        (spans, n - kept)
+    }
+}
+
+/// Span recorder for one run.
+///
+/// Crate-private: `span` relies on each worker index being written by a
+/// single thread, which only the executor guarantees.
+pub(crate) struct Tracer {
+    epoch: Instant,
+    rings: Box<[Ring]>,
+}
+
+impl Tracer {
+    pub(crate) fn new(workers: usize, capacity: usize) -> Self {
+        Self {
+            epoch: Instant::now(),
+            rings: (0..workers.max(1)).map(|_| Ring::new(capacity)).collect(),
+        }
+    }
+
+    /// Record a span for `worker`. Only that worker may call this.
+    #[inline]
+    pub(crate) fn span(
+        &self,
+        worker: usize,
+        kind: SpanKind,
+        stage: Option<StageId>,
+        start: Instant,
+        end: Instant,
+    ) {
+        let start_ns = start.saturating_duration_since(self.epoch).as_nanos() as u64;
+        let dur_ns = end.saturating_duration_since(start).as_nanos() as u64;
+        self.rings[worker % self.rings.len()].push(Span {
+            kind,
+            stage,
+            start_ns,
+            dur_ns,
+        });
+    }
+
+    /// Write all spans as Chrome trace JSON. Call once workers have stopped.
+    pub(crate) fn write_chrome(&self, out: &mut impl Write) -> io::Result<()> {
+        writeln!(out, "{{\"displayTimeUnit\":\"ns\",\"traceEvents\":[")?;
+        let mut first = true;
+        let mut sep = |out: &mut dyn Write| -> io::Result<()> {
+            if !first {
+                writeln!(out, ",")?;
+            }
+            first = false;
+            Ok(())
+        };
+
+        for (tid, ring) in self.rings.iter().enumerate() {
+            let (spans, dropped) = ring.drain();
+            sep(out)?;
+            write!(
+                out,
+                "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\
+                 \"args\":{{\"name\":\"worker {}\",\"dropped_spans\":{}}}}}",
+                tid, tid, dropped
+            )?;
+            for span in spans {
+                sep(out)?;
+                let name = match (span.kind, span.stage) {
+                    (SpanKind::Execute, Some(stage)) => stage.name(),
+                    (kind, _) => kind.name(),
+                };
+                write!(
+                    out,
+                    "{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\
+                     \"ts\":{:.3},\"dur\":{:.3}}}",
+                    name,
+                    span.kind.name(),
+                    tid,
+                    span.start_ns as f64 / 1e3,
+                    span.dur_ns as f64 / 1e3
+                )?;
+            }
+        }
+        writeln!(out, "\n]}}")
+    }
+
+    /// Write the trace to `config.path`.
+    pub(crate) fn write_to(&self, config: &TraceConfig) -> io::Result<()> {
+        let mut out = BufWriter::new(File::create(&config.path)?);
+        self.write_chrome(&mut out)?;
+        out.flush()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_ring_keeps_latest_spans() {
+        let tracer = Tracer::new(1, 4);
+        let t0 = tracer.epoch;
+        for i in 0..6u64 {
+            let start = t0 + std::time::Duration::from_micros(i);
+            tracer.span(0, SpanKind::Dequeue, None, start, start);
+        }
+
+        let (spans, dropped) = tracer.rings[0].drain();
+        assert_eq!(dropped, 2);
+        let starts: Vec<u64> = spans.iter().map(|s| s.start_ns / 1000).collect();
+        assert_eq!(starts, vec![2, 3, 4, 5]);
+    }
+
+    #[test]
+    fn test_chrome_json() {
+        let tracer = Tracer::new(2, 8);
+        let start = Instant::now();
+        let end = start + std::time::Duration::from_micros(5);
+        tracer.span(1, SpanKind::Execute, Some(StageId::FindPeak), start, end);
+
+        let mut out = Vec::new();
+        tracer.write_chrome(&mut out).unwrap();
+        let json = String::from_utf8(out).unwrap();
+
+        assert!(json.starts_with("{\"displayTimeUnit\""));
+        assert!(json.contains("\"name\":\"find_peak\",\"cat\":\"execute\",\"ph\":\"X\""));
+        assert!(json.contains("\"dur\":5.000"));
+        assert_eq!(json.matches("\"ph\":\"M\"").count(), 2);
+        assert!(json.trim_end().ends_with("]}"));
+    }
+}
@@ -0,0 +1,634 @@
+//! Global fits of one peak model to many samples.
+//!
+//! Concentration series and temperature scans share peak positions (and
+//! often widths) across samples while the amplitudes vary. `GlobalFit`
+//! fits Gaussians of the form used by `ProcessPeakStage` to a set of
+//! samples at once, for example those collected at a regroup checkpoint
+//! (`RegroupPool::collect_checkpoint`): shared parameters are fitted to all
+//! samples, amplitudes and an optional constant background to each one.
+//!
+//! Every Levenberg-Marquardt step solves normal equations of the form
+//!
+//! ```text
+//! [ U_1           W_1 ] [ dl_1 ]   [ b_1 ]
+//! [      ...      ... ] [  ..  ] = [  .. ]
+//! [           U_n W_n ] [ dl_n ]   [ b_n ]
+//! [ W_1' ... W_n'  V  ] [  dg  ]   [  b  ]
+//! ```
+//!
+//! where sample `i`'s own parameters `dl_i` only couple to the shared ones
+//! `dg`. Eliminating the local blocks leaves the Schur complement
+//! `S = V - sum(W_i' U_i^-1 W_i)` over the shared parameters alone; the
+//! local steps are then back-substituted sample by sample. A step costs
+//! one small solve per sample, linear in the number of samples, instead of
+//! a dense solve over all parameters.
+
+use crate::data::Sample;
+use nalgebra::{DMatrix, DVector};
+
+/// Damping of the first step.
+const INITIAL_LAMBDA: f64 = 1e-3;
+
+/// Damping at which a step that still does not lower chi-square ends the
+/// fit.
+const MAX_LAMBDA: f64 = 1e12;
+
+/// Global fit configuration.
+#[derive(Clone, Debug)]
+pub struct GlobalFitConfig {
+    /// Fit one position per peak to all samples.
+    pub share_position: bool,
+    /// Fit one width per peak to all samples.
+    pub share_width: bool,
+    /// Fit a constant background per sample.
+    pub background: bool,
+    /// Points within this many seed sigmas of a peak are fitted.
+    pub range_multiplier: f64,
+    pub max_iterations: u32,
+    /// Stop once a step lowers chi-square by less than this fraction.
+    pub tolerance: f64,
+}
+
+impl Default for GlobalFitConfig {
+    fn default() -> Self {
+        Self {
+            share_position: true,
+            share_width: true,
+            background: true,
+            range_multiplier: 3.0,
+            max_iterations: 50,
+            tolerance: 1e-9,
+        }
+    }
+}
+
+/// Initial position and width of one peak, in q units.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct PeakSeed {
+    pub mu: f64,
+    pub sigma: f64,
+}
+
+/// Fitted parameters of one sample, one entry per peak; shared values are
+/// the same in every sample.
+#[derive(Clone, Debug, PartialEq)]
+pub struct SampleFit {
+    pub id: String,
+    pub mu: Vec<f64>,
+    pub sigma: Vec<f64>,
+    pub amplitude: Vec<f64>,
+    /// Constant background (0 unless fitted).
+    pub background: f64,
+    /// Weighted sum of squared residuals over the fitted points.
+    pub chi_square: f64,
+}
+
+/// Result of a global fit, samples in input order.
+#[derive(Clone, Debug, PartialEq)]
+pub struct GlobalFitResult {
+    pub samples: Vec<SampleFit>,
+    pub chi_square: f64,
+    pub iterations: u32,
+    /// The last step lowered chi-square by less than the tolerance, or no
+    /// damping could lower it further.
+    pub converged: bool,
+}
+
+/// Errors that can occur when starting a global fit.
+#[derive(Debug, Clone, PartialEq)]
+pub enum GlobalFitError {
+    /// No samples or no peaks to fit.
+    Empty,
+    /// The seed of this peak has a non-positive or non-finite width.
+    InvalidSeed(usize),
+}
+
+impl std::fmt::Display for GlobalFitError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            GlobalFitError::Empty => write!(f, "No samples or peaks to fit"),
+            GlobalFitError::InvalidSeed(peak) => write!(f, "Invalid seed for peak {}", peak),
+        }
+    }
+}
+
+impl std::error::Error for GlobalFitError {}
+
+/// Position of a parameter in the shared or a sample's local vector.
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum Slot {
+    Shared(usize),
+    Local(usize),
+}
+
+/// Parameter layout. Local vectors start with the amplitudes, one per peak.
+struct Layout {
+    mu: Vec<Slot>,
+    sigma: Vec<Slot>,
+    background: Option<usize>,
+    shared: usize,
+    local: usize,
+}
+
+impl Layout {
+    fn new(config: &GlobalFitConfig, peaks: usize) -> Self {
+        let (mut shared, mut local) = (0, peaks);
+        let mut slot = |share: bool| {
+            if share {
+                shared += 1;
+                Slot::Shared(shared - 1)
+            } else {
+                local += 1;
+                Slot::Local(local - 1)
+            }
+        };
+        let mu = (0..peaks).map(|_| slot(config.share_position)).collect();
+        let sigma = (0..peaks).map(|_| slot(config.share_width)).collect();
+        let background = config.background.then(|| {
+            local += 1;
+            local - 1
+        });
+        Self {
+            mu,
+            sigma,
+            background,
+            shared,
+            local,
+        }
+    }
+
+    fn peaks(&self) -> usize {
+        self.mu.len()
+    }
+
+    /// Widths must stay positive.
+    fn valid(&self, shared: &DVector<f64>, local: &DVector<f64>) -> bool {
+        self.sigma.iter().all(|&s| value(s, shared, local) > 0.0)
+    }
+}
+
+fn value(slot: Slot, shared: &DVector<f64>, local: &DVector<f64>) -> f64 {
+    match slot {
+        Slot::Shared(i) => shared[i],
+        Slot::Local(i) => local[i],
+    }
+}
+
+/// One sample's normal equation blocks: `u` (local x local), `w` (local x
+/// shared), `v` (shared x shared) and the right-hand sides `bl`, `bg`.
+struct Normal {
+    u: DMatrix<f64>,
+    w: DMatrix<f64>,
+    v: DMatrix<f64>,
+    bl: DVector<f64>,
+    bg: DVector<f64>,
+}
+
+impl Normal {
+    fn zeros(layout: &Layout) -> Self {
+        Self {
+            u: DMatrix::zeros(layout.local, layout.local),
+            w: DMatrix::zeros(layout.local, layout.shared),
+            v: DMatrix::zeros(layout.shared, layout.shared),
+            bl: DVector::zeros(layout.local),
+            bg: DVector::zeros(layout.shared),
+        }
+    }
+}
+
+/// A sample's fitted points, their weights and its local parameters.
+struct Block<'a> {
+    sample: &'a Sample,
+    points: Vec<usize>,
+    weights: Vec<f64>,
+    local: DVector<f64>,
+}
+
+impl<'a> Block<'a> {
+    fn new(
+        sample: &'a Sample,
+        config: &GlobalFitConfig,
+        layout: &Layout,
+        peaks: &[PeakSeed],
+    ) -> Self {
+        let q = &sample.q_values;
+        let points: Vec<usize> = (0..sample.len())
+            .filter(|&j| {
+                sample.intensity[j].is_finite()
+                    && peaks
+                        .iter()
+                        .any(|p| (q[j] - p.mu).abs() <= config.range_multiplier * p.sigma)
+            })
+            .collect();
+        let weights = points
+            .iter()
+            .map(|&j| {
+                let err = sample.intensity_err[j];
+                if err.is_finite() && err > 0.0 {
+                    1.0 / (err * err)
+                } else {
+                    1.0
+                }
+            })
+            .collect();
+
+        let mut local = DVector::zeros(layout.local);
+        let background = points
+            .iter()
+            .map(|&j| sample.intensity[j])
+            .fold(f64::INFINITY, f64::min);
+        let background = if background.is_finite() {
+            background
+        } else {
+            0.0
+        };
+        if let Some(b) = layout.background {
+            local[b] = background;
+        }
+        for (k, peak) in peaks.iter().enumerate() {
+            let nearest = points
+                .iter()
+                .min_by(|&&a, &&b| (q[a] - peak.mu).abs().total_cmp(&(q[b] - peak.mu).abs()));
+            local[k] = nearest.map_or(0.0, |&j| sample.intensity[j])
+                - layout.background.map_or(0.0, |_| background);
+            if let Slot::Local(i) = layout.mu[k] {
+                local[i] = peak.mu;
+            }
+            if let Slot::Local(i) = layout.sigma[k] {
+                local[i] = peak.sigma;
+            }
+        }
+        Self {
+            sample,
+            points,
+            weights,
+            local,
+        }
+    }
+
+    /// Weighted chi-square at the given parameters; with `normal`, also
+    /// accumulate the Gauss-Newton normal equations into it.
+    fn evaluate(
+        &self,
+        layout: &Layout,
+        shared: &DVector<f64>,
+        local: &DVector<f64>,
+        mut normal: Option<&mut Normal>,
+    ) -> f64 {
+        let q = &self.sample.q_values;
+        let mut jacobian: Vec<(Slot, f64)> = Vec::with_capacity(3 * layout.peaks() + 1);
+        let mut chi_square = 0.0;
+        for (&j, &weight) in self.points.iter().zip(&self.weights) {
+            jacobian.clear();
+            let mut model = layout.background.map_or(0.0, |b| local[b]);
+            if let Some(b) = layout.background {
+                jacobian.push((Slot::Local(b), 1.0));
+            }
+            for k in 0..layout.peaks() {
+                let mu = value(layout.mu[k], shared, local);
+                let sigma = value(layout.sigma[k], shared, local);
+                let amplitude = local[k];
+                let d = q[j] - mu;
+                let e = (-(d * d) / (sigma * sigma)).exp();
+                model += amplitude * e;
+                jacobian.push((Slot::Local(k), e));
+                jacobian.push((layout.mu[k], amplitude * e * 2.0 * d / (sigma * sigma)));
+                jacobian.push((
+                    layout.sigma[k],
+                    amplitude * e * 2.0 * d * d / (sigma * sigma * sigma),
+                ));
+            }
+            let residual = self.sample.intensity[j] - model;
+            chi_square += weight * residual * residual;
+
+            let Some(normal) = normal.as_deref_mut() else {
+                continue;
+            };
+            for &(a, ja) in &jacobian {
+                match a {
+                    Slot::Local(a) => normal.bl[a] += weight * ja * residual,
+                    Slot::Shared(a) => normal.bg[a] += weight * ja * residual,
+                }
+                for &(b, jb) in &jacobian {
+                    let h = weight * ja * jb;
+                    match (a, b) {
+                        (Slot::Local(a), Slot::Local(b)) => normal.u[(a, b)] += h,
+                        (Slot::Local(a), Slot::Shared(b)) => normal.w[(a, b)] += h,
+                        (Slot::Shared(a), Slot::Shared(b)) => normal.v[(a, b)] += h,
+                        // The transpose of `w`.
+                        (Slot::Shared(_), Slot::Local(_)) => {}
+                    }
+                }
+            }
+        }
+        chi_square
+    }
+}
+
+/// `m` with its diagonal scaled by `1 + lambda` (Marquardt damping).
+fn damped(m: &DMatrix<f64>, lambda: f64) -> DMatrix<f64> {
+    let mut m = m.clone();
+    for i in 0..m.nrows() {
+        m[(i, i)] += lambda * m[(i, i)].max(f64::EPSILON);
+    }
+    m
+}
+
+/// Solve the damped block system by eliminating the local blocks; returns
+/// the shared step and each sample's local step, or `None` if a block is
+/// not positive definite.
+fn solve_step(
+    normals: &[Normal],
+    v: &DMatrix<f64>,
+    bg: &DVector<f64>,
+    lambda: f64,
+) -> Option<(DVector<f64>, Vec<DVector<f64>>)> {
+    let mut schur = damped(v, lambda);
+    let mut rhs = bg.clone();
+    let mut eliminated = Vec::with_capacity(normals.len());
+    for normal in normals {
+        let u = damped(&normal.u, lambda).cholesky()?;
+        // U^-1 W and U^-1 b_l.
+        let x = u.solve(&normal.w);
+        let y = u.solve(&normal.bl);
+        schur -= normal.w.tr_mul(&x);
+        rhs -= normal.w.tr_mul(&y);
+        eliminated.push((x, y));
+    }
+    let dg = if rhs.is_empty() {
+        rhs
+    } else {
+        schur.cholesky()?.solve(&rhs)
+    };
+    let dl = eliminated.into_iter().map(|(x, y)| y - x * &dg).collect();
+    Some((dg, dl))
+}
+
+/// Levenberg-Marquardt fit of Gaussian peaks across samples.
+pub struct GlobalFit {
+    config: GlobalFitConfig,
+}
+
+impl GlobalFit {
+    pub fn new(config: GlobalFitConfig) -> Self {
+        Self { config }
+    }
+
+    pub fn config(&self) -> &GlobalFitConfig {
+        &self.config
+    }
+
+    /// Fit `peaks` to all `samples`, starting from the seeds' positions
+    /// and widths and amplitudes read off each profile.
+    pub fn fit(
+        &self,
+        samples: &[Sample],
+        peaks: &[PeakSeed],
+    ) -> Result<GlobalFitResult, GlobalFitError> {
+        if samples.is_empty() || peaks.is_empty() {
+            return Err(GlobalFitError::Empty);
+        }
+        if let Some(k) = peaks
+            .iter()
+            .position(|p| !(p.sigma > 0.0 && p.sigma.is_finite() && p.mu.is_finite()))
+        {
+            return Err(GlobalFitError::InvalidSeed(k));
+        }
+
+        let layout = Layout::new(&self.config, peaks.len());
+        let mut shared = DVector::zeros(layout.shared);
+        for (k, peak) in peaks.iter().enumerate() {
+            if let Slot::Shared(i) = layout.mu[k] {
+                shared[i] = peak.mu;
+            }
+            if let Slot::Shared(i) = layout.sigma[k] {
+                shared[i] = peak.sigma;
+            }
+        }
+        let mut blocks: Vec<Block> = samples
+            .iter()
+            .map(|s| Block::new(s, &self.config, &layout, peaks))
+            .collect();
+
+        let mut chi_square: f64 = blocks
+            .iter()
+            .map(|b| b.evaluate(&layout, &shared, &b.local, None))
+            .sum();
+        let mut lambda = INITIAL_LAMBDA;
+        let mut iterations = 0;
+        let mut converged = false;
+        while iterations < self.config.max_iterations && !converged {
+            iterations += 1;
+            let mut normals = Vec::with_capacity(blocks.len());
+            let mut v = DMatrix::zeros(layout.shared, layout.shared);
+            let mut bg = DVector::zeros(layout.shared);
+            for block in &blocks {
+                let mut normal = Normal::zeros(&layout);
+                block.evaluate(&layout, &shared, &block.local, Some(&mut normal));
+                v += &normal.v;
+                bg += &normal.bg;
+                normals.push(normal);
+            }
+
+            let mut accepted = None;
+            while accepted.is_none() && lambda <= MAX_LAMBDA {
+                if let Some((dg, dl)) = solve_step(&normals, &v, &bg, lambda) {
+                    let trial_shared = &shared + &dg;
+                    let trial_local: Vec<DVector<f64>> =
+                        blocks.iter().zip(&dl).map(|(b, d)| &b.local + d).collect();
+                    if trial_local.iter().all(|l| layout.valid(&trial_shared, l)) {
+                        let trial_chi: f64 = blocks
+                            .iter()
+                            .zip(&trial_local)
+                            .map(|(b, l)| b.evaluate(&layout, &trial_shared, l, None))
+                            .sum();
+                        if trial_chi < chi_square {
+                            accepted = Some((trial_shared, trial_local, trial_chi));
+                            lambda = (lambda / 10.0).max(f64::EPSILON);
+                            continue;
+                        }
+                    }
+                }
+                lambda *= 10.0;
+            }
+
+            match accepted {
+                Some((trial_shared, trial_local, trial_chi)) => {
+                    converged = chi_square - trial_chi <= self.config.tolerance * chi_square;
+                    shared = trial_shared;
+                    for (block, local) in blocks.iter_mut().zip(trial_local) {
+                        block.local = local;
+                    }
+                    chi_square = trial_chi;
+                }
+                // No damping lowers chi-square: at a minimum.
+                None => converged = true,
+            }
+        }
+
+        let samples = blocks
+            .iter()
+            .map(|b| SampleFit {
+                id: b.sample.id.clone(),
+                mu: layout
+                    .mu
+                    .iter()
+                    .map(|&s| value(s, &shared, &b.local))
+                    .collect(),
+                sigma: layout
+                    .sigma
+                    .iter()
+                    .map(|&s| value(s, &shared, &b.local))
+                    .collect(),
+                amplitude: (0..layout.peaks()).map(|k| b.local[k]).collect(),
+                background: layout.background.map_or(0.0, |i| b.local[i]),
+                chi_square: b.evaluate(&layout, &shared, &b.local, None),
+            })
+            .collect();
+        Ok(GlobalFitResult {
+            samples,
+            chi_square,
+            iterations,
+            converged,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Two Gaussians on a constant background; amplitudes and background
+    /// vary with `s`, widths only when `width_step` is non-zero.
+    fn sample(s: usize, width_step: f64) -> Sample {
+        let q: Vec<f64> = (0..400).map(|i| 0.05 + i as f64 * 5e-4).collect();
+        let intensity = q
+            .iter()
+            .enumerate()
+            .map(|(i, &x)| {
+                let a = 10.0 + s as f64;
+                let b = 4.0 + 0.5 * s as f64;
+                let w = 0.008 + width_step * s as f64;
+                1.0 + 0.1 * s as f64
+                    + a * (-((x - 0.1) / 0.005).powi(2)).exp()
+                    + b * (-((x - 0.2) / w).powi(2)).exp()
+                    + 0.01 * (i as f64 * 12.9898 + s as f64).sin()
+            })
+            .collect();
+        Sample::new(format!("s{s}"), q.clone(), intensity, vec![0.01; q.len()]).unwrap()
+    }
+
+    fn seeds() -> Vec<PeakSeed> {
+        vec![
+            PeakSeed {
+                mu: 0.1015,
+                sigma: 0.006,
+            },
+            PeakSeed {
+                mu: 0.199,
+                sigma: 0.007,
+            },
+        ]
+    }
+
+    #[test]
+    fn test_recovers_shared_peaks_and_amplitudes() {
+        let samples: Vec<Sample> = (0..24).map(|s| sample(s, 0.0)).collect();
+        let result = GlobalFit::new(GlobalFitConfig::default())
+            .fit(&samples, &seeds())
+            .unwrap();
+        assert!(result.converged);
+        assert_eq!(result.samples.len(), 24);
+        for (s, fit) in result.samples.iter().enumerate() {
+            assert_eq!(fit.mu, result.samples[0].mu);
+            assert!((fit.mu[0] - 0.1).abs() < 1e-5 && (fit.mu[1] - 0.2).abs() < 1e-5);
+            assert!((fit.sigma[0] - 0.005).abs() < 1e-5 && (fit.sigma[1] - 0.008).abs() < 1e-5);
+            assert!((fit.amplitude[0] - (10.0 + s as f64)).abs() < 0.02);
+            assert!((fit.amplitude[1] - (4.0 + 0.5 * s as f64)).abs() < 0.02);
+            assert!((fit.background - (1.0 + 0.1 * s as f64)).abs() < 0.01);
+        }
+        assert!(matches!(
+            GlobalFit::new(GlobalFitConfig::default()).fit(&samples, &[]),
+            Err(GlobalFitError::Empty)
+        ));
+    }
+
+    #[test]
+    fn test_local_widths() {
+        let samples: Vec<Sample> = (0..6).map(|s| sample(s, 5e-4)).collect();
+        let config = GlobalFitConfig {
+            share_width: false,
+            ..Default::default()
+        };
+        let result = GlobalFit::new(config).fit(&samples, &seeds()).unwrap();
+        for (s, fit) in result.samples.iter().enumerate() {
+            assert!((fit.mu[1] - 0.2).abs() < 1e-5);
+            assert!((fit.sigma[1] - (0.008 + 5e-4 * s as f64)).abs() < 1e-5);
+        }
+    }
+
+    #[test]
+    fn test_schur_step_matches_dense_solve() {
+        let samples: Vec<Sample> = (0..3).map(|s| sample(s, 0.0)).collect();
+        let config = GlobalFitConfig {
+            share_width: false,
+            ..Default::default()
+        };
+        let layout = Layout::new(&config, 2);
+        let shared = DVector::from_vec(vec![0.1015, 0.199]);
+        let blocks: Vec<Block> = samples
+            .iter()
+            .map(|s| Block::new(s, &config, &layout, &seeds()))
+            .collect();
+        let normals: Vec<Normal> = blocks
+            .iter()
+            .map(|b| {
+                let mut normal = Normal::zeros(&layout);
+                b.evaluate(&layout, &shared, &b.local, Some(&mut normal));
+                normal
+            })
+            .collect();
+        let mut v = DMatrix::zeros(layout.shared, layout.shared);
+        let mut bg = DVector::zeros(layout.shared);
+        for normal in &normals {
+            v += &normal.v;
+            bg += &normal.bg;
+        }
+        let (dg, dl) = solve_step(&normals, &v, &bg, 0.1).unwrap();
+
+        // The same system assembled densely: locals first, shared last.
+        let (nl, ng) = (layout.local, layout.shared);
+        let n = nl * normals.len() + ng;
+        let mut dense = DMatrix::zeros(n, n);
+        let mut rhs = DVector::zeros(n);
+        for (i, normal) in normals.iter().enumerate() {
+            for a in 0..nl {
+                rhs[i * nl + a] = normal.bl[a];
+                for b in 0..nl {
+                    dense[(i * nl + a, i * nl + b)] = normal.u[(a, b)];
+                }
+                for b in 0..ng {
+                    dense[(i * nl + a, n - ng + b)] = normal.w[(a, b)];
+                    dense[(n - ng + b, i * nl + a)] = normal.w[(a, b)];
+                }
+            }
+        }
+        for a in 0..ng {
+            rhs[n - ng + a] = bg[a];
+            for b in 0..ng {
+                dense[(n - ng + a, n - ng + b)] = v[(a, b)];
+            }
+        }
+        let step = damped(&dense, 0.1).cholesky().unwrap().solve(&rhs);
+
+        let scale = step.iter().fold(0.0f64, |m, x| m.max(x.abs()));
+        for a in 0..ng {
+            assert!((dg[a] - step[n - ng + a]).abs() <= 1e-9 * scale);
+        }
+        for (i, d) in dl.iter().enumerate() {
+            for a in 0..nl {
+                assert!((d[a] - step[i * nl + a]).abs() <= 1e-9 * scale);
+            }
+        }
+    }
+}
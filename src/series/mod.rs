@@ -0,0 +1,26 @@
+//! Time-series processing across consecutive frames.
+//!
+//! Samples tagged with a `SeriesFrame` (see `Sample::with_series`) share
+//! state with the other frames of their series through a `SeriesStore`.
+//! Peak candidates and fit parameters of the nearest earlier frame seed
+//! detection windows and initial fit values, so a frame that barely moved
+//! skips the full-profile search and most fit iterations. A warm fit whose
+//! residual grows is redone cold and the next frame searches the full
+//! profile again.
+//!
+//! With tracking configured, completed frames are also associated into
+//! per-reflection tracks (see `tracking`) whose predicted positions join
+//! the detection windows, so a peak drifting steadily stays inside them.
+//!
+//! `global_fit` fits one peak model to a whole set of samples, sharing
+//! positions and widths across them.
+
+pub mod global_fit;
+pub mod store;
+pub mod tracking;
+
+pub use global_fit::{
+    GlobalFit, GlobalFitConfig, GlobalFitError, GlobalFitResult, PeakSeed, SampleFit,
+};
+pub use store::{PeakFit, SeriesConfig, SeriesStats, SeriesStore};
+pub use tracking::{Track, TrackColumns, TrackPoint, Tracker, TrackerConfig};
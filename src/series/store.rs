@@ -0,0 +1,361 @@
+//! Per-series frame history shared by the peak stages.
+
+use super::tracking::{Detection, Track, TrackColumns, Tracker, TrackerConfig};
+use crate::data::{Sample, SeriesFrame};
+use std::collections::{BTreeMap, HashMap};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+
+/// Series mode configuration.
+#[derive(Clone, Debug)]
+pub struct SeriesConfig {
+    /// Half-width (in indices) of the detection window around each peak of
+    /// the previous frame.
+    pub window: usize,
+    /// A warm fit whose residual exceeds its seed's residual by this factor
+    /// is redone cold and the next frame searches the full profile.
+    pub residual_growth: f64,
+    /// Search the full profile every n-th frame so new peaks are picked up
+    /// (0 = only on fallback).
+    pub full_search_every: u64,
+    /// Frames kept per series.
+    pub history: usize,
+    /// Warm fits stop once mu and sigma move less than this fraction of
+    /// sigma between iterations.
+    pub tolerance: f64,
+    /// Follow peaks across frames; track predictions are added to the
+    /// detection windows.
+    pub tracking: Option<TrackerConfig>,
+}
+
+impl Default for SeriesConfig {
+    fn default() -> Self {
+        Self {
+            window: 8,
+            residual_growth: 1.5,
+            full_search_every: 32,
+            history: 8,
+            tolerance: 1e-6,
+            tracking: None,
+        }
+    }
+}
+
+/// Fitted Gaussian of one peak.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct PeakFit {
+    /// Index the fit was centred on.
+    pub index: usize,
+    pub mu: f64,
+    pub sigma: f64,
+    pub amplitude: f64,
+    /// RMS of data minus model over the fit window, relative to the
+    /// amplitude.
+    pub residual: f64,
+}
+
+#[derive(Default)]
+struct FrameState {
+    /// Detected peak indices, sorted.
+    candidates: Vec<usize>,
+    fits: Vec<PeakFit>,
+    /// A warm fit fell back; the next frame must not trust this one.
+    diverged: bool,
+}
+
+/// Counters across all series of a store.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct SeriesStats {
+    /// Detections restricted to windows from an earlier frame.
+    pub warm_searches: u64,
+    /// Detections over the full profile.
+    pub full_searches: u64,
+    /// Fits seeded from an earlier frame.
+    pub warm_fits: u64,
+    /// Fits started from a parabola estimate.
+    pub cold_fits: u64,
+    /// Warm fits redone cold because their residual grew.
+    pub fallbacks: u64,
+    /// Gaussian refinement iterations over all fits.
+    pub fit_iterations: u64,
+}
+
+impl SeriesStats {
+    pub fn iterations_per_fit(&self) -> f64 {
+        let fits = self.warm_fits + self.cold_fits;
+        if fits > 0 {
+            self.fit_iterations as f64 / fits as f64
+        } else {
+            0.0
+        }
+    }
+}
+
+#[derive(Default)]
+struct Counters {
+    warm_searches: AtomicU64,
+    full_searches: AtomicU64,
+    warm_fits: AtomicU64,
+    cold_fits: AtomicU64,
+    fallbacks: AtomicU64,
+    fit_iterations: AtomicU64,
+}
+
+/// Recent frames of every series, keyed by series id and frame index.
+///
+/// Frames may be processed out of order and concurrently; lookups use the
+/// nearest earlier frame that has been recorded.
+pub struct SeriesStore {
+    config: SeriesConfig,
+    frames: Mutex<HashMap<u64, BTreeMap<u64, FrameState>>>,
+    tracker: Option<Mutex<Tracker>>,
+    counters: Counters,
+}
+
+impl SeriesStore {
+    pub fn new(config: SeriesConfig) -> Self {
+        let tracker = config.tracking.clone().map(|c| Mutex::new(Tracker::new(c)));
+        Self {
+            config,
+            frames: Mutex::new(HashMap::new()),
+            tracker,
+            counters: Counters::default(),
+        }
+    }
+
+    pub fn config(&self) -> &SeriesConfig {
+        &self.config
+    }
+
+    /// Window centres for detecting peaks in frame `at`: the candidates and
+    /// fitted peaks of the nearest earlier frame, plus the predicted
+    /// positions of live tracks. `None` means search the full profile
+    /// (first frame, periodic full search, or the earlier frame diverged).
+    pub fn detection_seeds(&self, at: SeriesFrame) -> Option<Vec<usize>> {
+        let every = self.config.full_search_every;
+        if every > 0 && at.frame % every == 0 {
+            return None;
+        }
+        let mut centres = Vec::new();
+        {
+            let frames = self.frames.lock().unwrap();
+            let prev = frames
+                .get(&at.series)
+                .and_then(|s| s.range(..at.frame).next_back());
+            if let Some((_, prev)) = prev {
+                if prev.diverged {
+                    return None;
+                }
+                centres.extend_from_slice(&prev.candidates);
+                centres.extend(prev.fits.iter().map(|f| f.index));
+            }
+        }
+        if let Some(tracker) = &self.tracker {
+            centres.extend(tracker.lock().unwrap().predictions(at));
+        }
+        centres.sort_unstable();
+        centres.dedup();
+        (!centres.is_empty()).then_some(centres)
+    }
+
+    /// Count one detection pass.
+    pub fn record_search(&self, warm: bool) {
+        let counter = if warm {
+            &self.counters.warm_searches
+        } else {
+            &self.counters.full_searches
+        };
+        counter.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Add detected peak indices to frame `at`.
+    pub fn record_candidates(&self, at: SeriesFrame, indices: impl IntoIterator<Item = usize>) {
+        let mut frames = self.frames.lock().unwrap();
+        let frame = self.frame_mut(&mut frames, at);
+        frame.candidates.extend(indices);
+        frame.candidates.sort_unstable();
+        frame.candidates.dedup();
+    }
+
+    /// Fit of the nearest earlier frame closest to `index`, within the
+    /// detection window.
+    pub fn fit_seed(&self, at: SeriesFrame, index: usize) -> Option<PeakFit> {
+        let frames = self.frames.lock().unwrap();
+        let (_, prev) = frames.get(&at.series)?.range(..at.frame).next_back()?;
+        prev.fits
+            .iter()
+            .filter(|f| f.index.abs_diff(index) <= self.config.window)
+            .min_by_key(|f| f.index.abs_diff(index))
+            .copied()
+    }
+
+    /// Store a fit of frame `at` and count its iterations.
+    pub fn record_fit(&self, at: SeriesFrame, fit: PeakFit, warm: bool, iterations: u32) {
+        let counter = if warm {
+            &self.counters.warm_fits
+        } else {
+            &self.counters.cold_fits
+        };
+        counter.fetch_add(1, Ordering::Relaxed);
+        self.counters
+            .fit_iterations
+            .fetch_add(iterations as u64, Ordering::Relaxed);
+        let mut frames = self.frames.lock().unwrap();
+        self.frame_mut(&mut frames, at).fits.push(fit);
+    }
+
+    /// A warm fit of frame `at` fell back to a cold fit.
+    pub fn mark_diverged(&self, at: SeriesFrame) {
+        self.counters.fallbacks.fetch_add(1, Ordering::Relaxed);
+        let mut frames = self.frames.lock().unwrap();
+        self.frame_mut(&mut frames, at).diverged = true;
+    }
+
+    /// Fits recorded for frame `at` (empty once it left the history).
+    pub fn fits(&self, at: SeriesFrame) -> Vec<PeakFit> {
+        let frames = self.frames.lock().unwrap();
+        frames
+            .get(&at.series)
+            .and_then(|s| s.get(&at.frame))
+            .map(|f| f.fits.clone())
+            .unwrap_or_default()
+    }
+
+    pub fn stats(&self) -> SeriesStats {
+        let c = &self.counters;
+        SeriesStats {
+            warm_searches: c.warm_searches.load(Ordering::Relaxed),
+            full_searches: c.full_searches.load(Ordering::Relaxed),
+            warm_fits: c.warm_fits.load(Ordering::Relaxed),
+            cold_fits: c.cold_fits.load(Ordering::Relaxed),
+            fallbacks: c.fallbacks.load(Ordering::Relaxed),
+            fit_iterations: c.fit_iterations.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Hand the fitted peaks of a completed sample to the tracker.
+    pub fn complete_frame(&self, sample: &Sample) {
+        let (Some(tracker), Some(at)) = (&self.tracker, sample.series()) else {
+            return;
+        };
+        let mut detections: Vec<Detection> = sample
+            .metadata
+            .processed_peaks
+            .iter()
+            .map(|(&index, &amplitude)| Detection {
+                index,
+                q: sample.get_q(index).unwrap_or(f64::NAN),
+                amplitude,
+            })
+            .collect();
+        detections.sort_by_key(|d| d.index);
+        tracker.lock().unwrap().push(at, detections);
+    }
+
+    /// Associate frames still waiting for a missing earlier frame.
+    pub fn flush_tracks(&self) {
+        if let Some(tracker) = &self.tracker {
+            tracker.lock().unwrap().flush();
+        }
+    }
+
+    /// All tracks so far (empty unless tracking is configured).
+    pub fn tracks(&self) -> Vec<Track> {
+        self.tracker
+            .as_ref()
+            .map(|t| t.lock().unwrap().tracks())
+            .unwrap_or_default()
+    }
+
+    /// Points of tracks with at least `min_length` points, as columns.
+    pub fn track_columns(&self, min_length: usize) -> TrackColumns {
+        self.tracker
+            .as_ref()
+            .map(|t| t.lock().unwrap().columns(min_length))
+            .unwrap_or_default()
+    }
+
+    /// Forget all frames and tracks (counters are kept).
+    pub fn clear(&self) {
+        self.frames.lock().unwrap().clear();
+        if let Some(tracker) = &self.tracker {
+            let mut tracker = tracker.lock().unwrap();
+            *tracker = Tracker::new(tracker.config().clone());
+        }
+    }
+
+    /// State of frame `at`, dropping older frames beyond the history.
+    fn frame_mut<'a>(
+        &self,
+        frames: &'a mut HashMap<u64, BTreeMap<u64, FrameState>>,
+        at: SeriesFrame,
+    ) -> &'a mut FrameState {
+        let series = frames.entry(at.series).or_default();
+        series.entry(at.frame).or_default();
+        while series.len() > self.config.history.max(1) {
+            match series.first_key_value() {
+                Some((&oldest, _)) if oldest < at.frame => {
+                    series.pop_first();
+                }
+                _ => break,
+            }
+        }
+        series.get_mut(&at.frame).unwrap()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn at(frame: u64) -> SeriesFrame {
+        SeriesFrame { series: 1, frame }
+    }
+
+    fn fit(index: usize) -> PeakFit {
+        PeakFit {
+            index,
+            mu: index as f64 * 0.01,
+            sigma: 0.02,
+            amplitude: 1.0,
+            residual: 0.01,
+        }
+    }
+
+    #[test]
+    fn test_seeds_come_from_nearest_earlier_frame() {
+        let store = SeriesStore::new(SeriesConfig {
+            full_search_every: 4,
+            history: 2,
+            ..Default::default()
+        });
+        assert_eq!(store.detection_seeds(at(1)), None);
+
+        store.record_candidates(at(1), [40, 10]);
+        store.record_fit(at(1), fit(41), false, 5);
+        store.record_candidates(at(2), [12]);
+        assert_eq!(store.detection_seeds(at(2)), Some(vec![10, 40, 41]));
+        assert_eq!(store.detection_seeds(at(3)), Some(vec![12]));
+        // Every fourth frame searches the full profile.
+        assert_eq!(store.detection_seeds(at(4)), None);
+
+        assert_eq!(store.fit_seed(at(2), 45), Some(fit(41)));
+        assert_eq!(store.fit_seed(at(2), 60), None);
+        assert_eq!(store.fit_seed(at(3), 41), None);
+
+        // Frame 1 falls out of a two-frame history.
+        store.record_candidates(at(3), [13]);
+        assert!(store.fits(at(1)).is_empty());
+        assert_eq!(store.stats().cold_fits, 1);
+    }
+
+    #[test]
+    fn test_diverged_frame_forces_full_search() {
+        let store = SeriesStore::new(SeriesConfig::default());
+        store.record_candidates(at(5), [20]);
+        assert!(store.detection_seeds(at(6)).is_some());
+        store.mark_diverged(at(5));
+        assert_eq!(store.detection_seeds(at(6)), None);
+        assert_eq!(store.stats().fallbacks, 1);
+    }
+}
@@ -0,0 +1,367 @@
+//! Association of peaks across the frames of a series into tracks.
+
+use crate::data::SeriesFrame;
+use std::collections::{BTreeMap, HashMap};
+
+/// Peak tracking configuration.
+#[derive(Clone, Debug)]
+pub struct TrackerConfig {
+    /// Largest distance (in indices) between a track's predicted position
+    /// and a peak it is associated with.
+    pub gate: f64,
+    /// Frames a track may go without a peak before it ends.
+    pub max_missed: u64,
+    /// Peaks below this amplitude neither start nor extend tracks.
+    pub min_amplitude: f64,
+    /// Peaks of one frame closer than this (in indices) are one reflection;
+    /// only the strongest is associated.
+    pub merge_distance: usize,
+}
+
+impl Default for TrackerConfig {
+    fn default() -> Self {
+        Self {
+            gate: 4.0,
+            max_missed: 2,
+            min_amplitude: 0.0,
+            merge_distance: 3,
+        }
+    }
+}
+
+/// A peak reported by a completed frame.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct Detection {
+    pub index: usize,
+    pub q: f64,
+    pub amplitude: f64,
+}
+
+/// One frame of a track.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct TrackPoint {
+    pub frame: u64,
+    pub index: usize,
+    pub q: f64,
+    pub amplitude: f64,
+}
+
+/// A reflection followed over consecutive frames of one series.
+#[derive(Clone, Debug, PartialEq)]
+pub struct Track {
+    pub id: u64,
+    pub series: u64,
+    /// Points in frame order; never empty.
+    pub points: Vec<TrackPoint>,
+}
+
+impl Track {
+    pub fn last(&self) -> &TrackPoint {
+        self.points.last().unwrap()
+    }
+
+    /// Index expected at `frame`, extrapolating the drift of the last two
+    /// points.
+    pub fn predict(&self, frame: u64) -> f64 {
+        let last = self.last();
+        let ahead = frame.saturating_sub(last.frame) as f64;
+        match self.points.len().checked_sub(2).map(|i| &self.points[i]) {
+            Some(prev) => {
+                let rate =
+                    (last.index as f64 - prev.index as f64) / (last.frame - prev.frame) as f64;
+                last.index as f64 + rate * ahead
+            }
+            None => last.index as f64,
+        }
+    }
+}
+
+/// Track points as parallel columns, one row per point, ordered by track
+/// id and frame.
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct TrackColumns {
+    pub track: Vec<u64>,
+    pub series: Vec<u64>,
+    pub frame: Vec<u64>,
+    pub index: Vec<usize>,
+    pub q: Vec<f64>,
+    pub amplitude: Vec<f64>,
+}
+
+impl TrackColumns {
+    pub fn len(&self) -> usize {
+        self.track.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.track.is_empty()
+    }
+}
+
+#[derive(Default)]
+struct SeriesTracks {
+    /// Completed frames waiting for an earlier frame.
+    pending: BTreeMap<u64, Vec<Detection>>,
+    /// Next frame to associate.
+    next: u64,
+    active: Vec<Track>,
+    ended: Vec<Track>,
+}
+
+/// Incremental gated nearest-neighbour tracker.
+///
+/// Frames are associated in frame order as they complete; a frame that
+/// completes early waits until the frames before it have arrived (series
+/// are expected to start at frame 0) or `flush` is called.
+pub struct Tracker {
+    config: TrackerConfig,
+    series: HashMap<u64, SeriesTracks>,
+    next_id: u64,
+}
+
+impl Tracker {
+    pub fn new(config: TrackerConfig) -> Self {
+        Self {
+            config,
+            series: HashMap::new(),
+            next_id: 0,
+        }
+    }
+
+    pub fn config(&self) -> &TrackerConfig {
+        &self.config
+    }
+
+    /// Add the peaks of completed frame `at` and associate every frame
+    /// that is now in order.
+    pub fn push(&mut self, at: SeriesFrame, detections: Vec<Detection>) {
+        let detections = merge(&self.config, detections);
+        let tracks = self.series.entry(at.series).or_default();
+        if at.frame < tracks.next {
+            // Late duplicate of an associated frame.
+            return;
+        }
+        tracks.pending.insert(at.frame, detections);
+        while let Some(detections) = tracks.pending.remove(&tracks.next) {
+            let frame = tracks.next;
+            associate(
+                &self.config,
+                &mut self.next_id,
+                tracks,
+                at.series,
+                frame,
+                detections,
+            );
+            tracks.next = frame + 1;
+        }
+    }
+
+    /// Associate all waiting frames, skipping the missing ones.
+    pub fn flush(&mut self) {
+        for (&series, tracks) in &mut self.series {
+            while let Some((frame, detections)) = tracks.pending.pop_first() {
+                associate(
+                    &self.config,
+                    &mut self.next_id,
+                    tracks,
+                    series,
+                    frame,
+                    detections,
+                );
+                tracks.next = frame + 1;
+            }
+        }
+    }
+
+    /// Frames completed but not yet associated.
+    pub fn pending_frames(&self) -> usize {
+        self.series.values().map(|s| s.pending.len()).sum()
+    }
+
+    /// Predicted indices of the tracks still alive at frame `at`.
+    pub fn predictions(&self, at: SeriesFrame) -> Vec<usize> {
+        let Some(tracks) = self.series.get(&at.series) else {
+            return Vec::new();
+        };
+        tracks
+            .active
+            .iter()
+            .filter(|t| at.frame > t.last().frame && alive(&self.config, t, at.frame))
+            .map(|t| t.predict(at.frame).round().max(0.0) as usize)
+            .collect()
+    }
+
+    /// All tracks, ordered by id.
+    pub fn tracks(&self) -> Vec<Track> {
+        let mut out: Vec<Track> = self
+            .series
+            .values()
+            .flat_map(|s| s.ended.iter().chain(&s.active))
+            .cloned()
+            .collect();
+        out.sort_by_key(|t| t.id);
+        out
+    }
+
+    /// Points of tracks with at least `min_length` points, as columns.
+    pub fn columns(&self, min_length: usize) -> TrackColumns {
+        let mut out = TrackColumns::default();
+        for track in self.tracks() {
+            if track.points.len() < min_length {
+                continue;
+            }
+            for p in &track.points {
+                out.track.push(track.id);
+                out.series.push(track.series);
+                out.frame.push(p.frame);
+                out.index.push(p.index);
+                out.q.push(p.q);
+                out.amplitude.push(p.amplitude);
+            }
+        }
+        out
+    }
+}
+
+/// Drop weak peaks and the weaker of peaks within the merge distance.
+fn merge(config: &TrackerConfig, mut detections: Vec<Detection>) -> Vec<Detection> {
+    detections.retain(|d| d.amplitude >= config.min_amplitude);
+    detections.sort_by(|a, b| b.amplitude.total_cmp(&a.amplitude));
+    let mut kept: Vec<Detection> = Vec::with_capacity(detections.len());
+    for det in detections {
+        if kept
+            .iter()
+            .all(|k| k.index.abs_diff(det.index) >= config.merge_distance)
+        {
+            kept.push(det);
+        }
+    }
+    kept.sort_by_key(|d| d.index);
+    kept
+}
+
+fn alive(config: &TrackerConfig, track: &Track, frame: u64) -> bool {
+    frame - track.last().frame <= config.max_missed + 1
+}
+
+/// Extend the active tracks of one series with the peaks of `frame`,
+/// closest pairs within the gate first; unmatched peaks start new tracks.
+fn associate(
+    config: &TrackerConfig,
+    next_id: &mut u64,
+    tracks: &mut SeriesTracks,
+    series: u64,
+    frame: u64,
+    detections: Vec<Detection>,
+) {
+    let (active, ended): (Vec<Track>, Vec<Track>) = std::mem::take(&mut tracks.active)
+        .into_iter()
+        .partition(|t| alive(config, t, frame));
+    tracks.ended.extend(ended);
+    tracks.active = active;
+
+    let mut pairs = Vec::new();
+    for (t, track) in tracks.active.iter().enumerate() {
+        let predicted = track.predict(frame);
+        for (d, det) in detections.iter().enumerate() {
+            let distance = (det.index as f64 - predicted).abs();
+            if distance <= config.gate {
+                pairs.push((distance, t, d));
+            }
+        }
+    }
+    pairs.sort_by(|a, b| a.0.total_cmp(&b.0));
+
+    let mut track_taken = vec![false; tracks.active.len()];
+    let mut det_taken = vec![false; detections.len()];
+    for (_, t, d) in pairs {
+        if track_taken[t] || det_taken[d] {
+            continue;
+        }
+        track_taken[t] = true;
+        det_taken[d] = true;
+        tracks.active[t].points.push(point(frame, &detections[d]));
+    }
+
+    for (det, _) in detections
+        .iter()
+        .zip(&det_taken)
+        .filter(|(_, &taken)| !taken)
+    {
+        tracks.active.push(Track {
+            id: *next_id,
+            series,
+            points: vec![point(frame, det)],
+        });
+        *next_id += 1;
+    }
+}
+
+fn point(frame: u64, det: &Detection) -> TrackPoint {
+    TrackPoint {
+        frame,
+        index: det.index,
+        q: det.q,
+        amplitude: det.amplitude,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn at(frame: u64) -> SeriesFrame {
+        SeriesFrame { series: 3, frame }
+    }
+
+    fn det(index: usize, amplitude: f64) -> Detection {
+        Detection {
+            index,
+            q: index as f64 * 0.001,
+            amplitude,
+        }
+    }
+
+    #[test]
+    fn test_crossing_drift_follows_prediction() {
+        let mut tracker = Tracker::new(TrackerConfig::default());
+        // Two reflections drifting towards each other by 3 indices a
+        // frame; the weak shoulder next to the first is merged into it.
+        for f in 0..5u64 {
+            let a = 100 + 3 * f as usize;
+            let b = 130 - 3 * f as usize;
+            tracker.push(at(f), vec![det(a, 10.0), det(a + 1, 1.0), det(b, 5.0)]);
+        }
+        let tracks = tracker.tracks();
+        assert_eq!(tracks.len(), 2);
+        assert!(tracks.iter().all(|t| t.points.len() == 5));
+        assert_eq!(tracks[0].last().index, 112);
+        assert_eq!(tracks[1].last().index, 118);
+        assert_eq!(tracker.predictions(at(5)), vec![115, 115]);
+    }
+
+    #[test]
+    fn test_out_of_order_frames_and_gaps() {
+        let mut tracker = Tracker::new(TrackerConfig {
+            max_missed: 1,
+            min_amplitude: 1.0,
+            ..Default::default()
+        });
+        tracker.push(at(1), vec![det(51, 2.0)]);
+        assert_eq!(tracker.pending_frames(), 1);
+        tracker.push(at(0), vec![det(50, 2.0), det(80, 0.5)]);
+        assert_eq!(tracker.pending_frames(), 0);
+
+        // Frame 2 is missing; frame 4 is too far for the track to survive.
+        tracker.push(at(3), vec![det(53, 2.0)]);
+        tracker.push(at(6), vec![det(56, 2.0)]);
+        assert_eq!(tracker.pending_frames(), 2);
+        tracker.flush();
+
+        let columns = tracker.columns(2);
+        assert_eq!(columns.frame, vec![0, 1, 3]);
+        assert_eq!(columns.index, vec![50, 51, 53]);
+        assert!(columns.track.iter().all(|&t| t == columns.track[0]));
+        assert_eq!(tracker.tracks().len(), 2);
+    }
+}
@@ -1,7 +1,11 @@
 //! FindPeak stage implementation.
 
-use super::traits::{Stage, StageId, StageRequest, StageResult};
-use crate::data::{find_peaks, FlowMetadata, Sample};
+use super::traits::{Stage, StageId, StageKey, StageRequest, StageResult};
+use crate::data::hash::StableHasher;
+use crate::data::{find_peaks, find_peaks_near, FlowMetadata, Sample};
+use crate::series::SeriesStore;
+use std::hash::Hasher;
+use std::sync::Arc;
 
 /// Configuration for peak finding.
 #[derive(Debug, Clone)]
@@ -27,12 +31,34 @@ impl Default for FindPeakConfig {
 /// Stage for finding peaks in SAXS intensity data.
 pub struct FindPeakStage {
     config: FindPeakConfig,
+    /// Warm-start state for samples that are frames of a series.
+    series: Option<Arc<SeriesStore>>,
+    /// Stage to run once no peaks are left, instead of finishing.
+    then: Option<StageKey>,
 }
 
 impl FindPeakStage {
     /// Create with custom configuration.
     pub fn new(config: FindPeakConfig) -> Self {
-        Self { config }
+        Self {
+            config,
+            series: None,
+            then: None,
+        }
+    }
+
+    /// Hand the sample to `key` once every peak found here is processed,
+    /// e.g. a coarse instance followed by a more sensitive one. `key` must
+    /// not lead back to this instance.
+    pub fn followed_by(mut self, key: StageKey) -> Self {
+        self.then = Some(key);
+        self
+    }
+
+    /// Search series frames only around the peaks of the previous frame.
+    pub fn with_series(mut self, series: Arc<SeriesStore>) -> Self {
+        self.series = Some(series);
+        self
     }
 
     /// Create with default configuration.
@@ -43,9 +69,7 @@ impl FindPeakStage {
 
 impl Default for FindPeakStage {
     fn default() -> Self {
-        Self {
-            config: FindPeakConfig::default(),
-        }
+        Self::new(FindPeakConfig::default())
     }
 }
 
@@ -54,13 +78,47 @@ impl Stage for FindPeakStage {
         StageId::FindPeak
     }
 
+    fn config_hash(&self) -> u64 {
+        let mut h = StableHasher::new();
+        h.write_u64(self.config.min_height.to_bits());
+        h.write_u64(self.config.min_prominence.to_bits());
+        h.write_usize(self.config.min_distance);
+        // Warm-started output depends on other frames.
+        if self.series.is_some() {
+            h.write_u8(1);
+        }
+        if let Some(then) = self.then {
+            h.write_u8(2);
+            h.write_usize(then.index());
+        }
+        h.finish()
+    }
+
+    fn cacheable(&self) -> bool {
+        // Series frames record their candidates in the store.
+        self.series.is_none()
+    }
+
     fn process(&self, mut sample: Sample, mut metadata: FlowMetadata) -> StageResult {
-        // Find peaks in intensity data
-        let peaks = find_peaks(
-            sample.intensity_ref(),
-            self.config.min_height,
-            self.config.min_prominence,
-        );
+        // Find peaks in intensity data, around the previous frame's peaks
+        // for series frames
+        let frame = self.series.as_deref().zip(sample.series());
+        let peaks = match (&sample.metadata.search, frame) {
+            // Refinement of a preview: only the windows around its peaks
+            (Some(windows), _) => find_peaks_near(
+                sample.intensity_ref(),
+                &windows.centres,
+                windows.half_width,
+                self.config.min_height,
+                self.config.min_prominence,
+            ),
+            (None, Some((store, at))) => self.find_series_peaks(store, at, &sample, &metadata),
+            (None, None) => find_peaks(
+                sample.intensity_ref(),
+                self.config.min_height,
+                self.config.min_prominence,
+            ),
+        };
 
         // Filter by minimum distance if configured
         let filtered_peaks: Vec<_> = if self.config.min_distance > 1 {
@@ -69,6 +127,10 @@ impl Stage for FindPeakStage {
             peaks
         };
 
+        if let Some((store, at)) = frame {
+            store.record_candidates(at, filtered_peaks.iter().map(|p| p.index));
+        }
+
         // Add new peaks to unprocessed set
         for peak in &filtered_peaks {
             // Only add if not already processed
@@ -82,8 +144,15 @@ impl Stage for FindPeakStage {
 
         // Determine next stage
         let requests = if metadata.unprocessed_peaks.is_empty() {
-            // No peaks to process - terminal
-            Vec::new()
+            // No peaks to process - terminal unless another pass follows
+            match self.then {
+                Some(then) => {
+                    metadata.current_peak = None;
+                    let request = StageRequest::new(then.kind, metadata.clone());
+                    vec![request.on_instance(then.instance)]
+                }
+                None => Vec::new(),
+            }
         } else {
             // Select highest peak and request ProcessPeak
             let max_entry = metadata
@@ -106,6 +175,37 @@ impl Stage for FindPeakStage {
     }
 }
 
+impl FindPeakStage {
+    /// Windowed search seeded by the series store, falling back to the full
+    /// profile when there is no usable earlier frame or a frame's first
+    /// search finds nothing in the windows (its peaks moved away).
+    fn find_series_peaks(
+        &self,
+        store: &SeriesStore,
+        at: crate::data::SeriesFrame,
+        sample: &Sample,
+        metadata: &FlowMetadata,
+    ) -> Vec<crate::data::Peak> {
+        let data = sample.intensity_ref();
+        if let Some(centres) = store.detection_seeds(at) {
+            let peaks = find_peaks_near(
+                data,
+                &centres,
+                store.config().window,
+                self.config.min_height,
+                self.config.min_prominence,
+            );
+            // Later passes run on subtracted data and may find nothing.
+            if !peaks.is_empty() || !metadata.processed_peaks.is_empty() {
+                store.record_search(true);
+                return peaks;
+            }
+        }
+        store.record_search(false);
+        find_peaks(data, self.config.min_height, self.config.min_prominence)
+    }
+}
+
 /// Filter peaks to ensure minimum distance between them.
 /// Keeps higher peaks when there's a conflict.
 fn filter_by_distance(mut peaks: Vec<crate::data::Peak>, min_distance: usize) -> Vec<crate::data::Peak> {
@@ -201,4 +301,16 @@ mod tests {
         assert!(filtered.iter().any(|p| p.index == 10));
         assert!(filtered.iter().any(|p| p.index == 25));
     }
+
+    #[test]
+    fn test_allocation_budget() {
+        let stage = FindPeakStage::default();
+        let sample = make_sample_with_peaks();
+        let metadata = FlowMetadata::new("test");
+        // Peak list, distance filter, metadata maps and the request.
+        let result = crate::alloc_count::assert_max_allocations("FindPeak", 7, || {
+            stage.process(sample, metadata)
+        });
+        assert_eq!(result.requests.len(), 1);
+    }
 }
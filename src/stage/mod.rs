@@ -1,11 +1,13 @@
 //! Stage system for SAXS processing pipeline.
 
 pub mod find_peak;
+pub mod pipeline;
 pub mod process_peak;
 pub mod registry;
 pub mod traits;
 
 pub use find_peak::FindPeakStage;
+pub use pipeline::{Pipeline, StageSet};
 pub use process_peak::ProcessPeakStage;
 pub use registry::StageRegistry;
-pub use traits::{Stage, StageId, StageRequest, StageResult};
+pub use traits::{Stage, StageId, StageKey, StageRequest, StageResult};
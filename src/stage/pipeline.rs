@@ -0,0 +1,168 @@
+//! Pipelines of stages fixed at compile time.
+//!
+//! A `Pipeline` wraps a tuple of concrete stage types. Work items are
+//! dispatched by a `match` on the stage's slot in the tuple, so the
+//! compiler sees every `process` call and can inline it, instead of a
+//! registry lookup, an `Arc` clone and a virtual call per item. Use
+//! `StageRegistry` for pipelines assembled at run time.
+
+use super::traits::{Stage, StageId, StageResult};
+use crate::data::hash::StableHasher;
+use crate::data::{FlowMetadata, Sample};
+use std::hash::Hasher;
+
+/// A tuple of concrete stages; implemented for tuples of up to
+/// `StageId::COUNT` stages.
+pub trait StageSet: Send + Sync {
+    /// Number of stages.
+    const LEN: usize;
+
+    /// Identifier of every stage, in slot order.
+    fn ids(&self) -> Vec<StageId>;
+
+    /// Run the stage in `slot`.
+    fn process_slot(&self, slot: usize, sample: Sample, metadata: FlowMetadata) -> StageResult;
+
+    /// The stage in `slot` as a trait object.
+    fn stage(&self, slot: usize) -> &dyn Stage;
+}
+
+macro_rules! impl_stage_set {
+    ($len:expr; $($slot:tt $S:ident),+) => {
+        impl<$($S: Stage),+> StageSet for ($($S,)+) {
+            const LEN: usize = $len;
+
+            fn ids(&self) -> Vec<StageId> {
+                vec![$(self.$slot.id()),+]
+            }
+
+            #[inline]
+            fn process_slot(
+                &self,
+                slot: usize,
+                sample: Sample,
+                metadata: FlowMetadata,
+            ) -> StageResult {
+                match slot {
+                    $($slot => self.$slot.process(sample, metadata),)+
+                    _ => unreachable!("stage slot {slot} out of range"),
+                }
+            }
+
+            fn stage(&self, slot: usize) -> &dyn Stage {
+                match slot {
+                    $($slot => &self.$slot,)+
+                    _ => unreachable!("stage slot {slot} out of range"),
+                }
+            }
+        }
+    };
+}
+
+impl_stage_set!(1; 0 A);
+impl_stage_set!(2; 0 A, 1 B);
+impl_stage_set!(3; 0 A, 1 B, 2 C);
+impl_stage_set!(4; 0 A, 1 B, 2 C, 3 D);
+impl_stage_set!(5; 0 A, 1 B, 2 C, 3 D, 4 E);
+impl_stage_set!(6; 0 A, 1 B, 2 C, 3 D, 4 E, 5 F);
+
+/// Statically typed pipeline over a tuple of stages.
+///
+/// ```ignore
+/// let pipeline = Pipeline::new((FindPeakStage::default(), ProcessPeakStage::default()));
+/// runtime.run_pipeline(&pipeline);
+/// ```
+pub struct Pipeline<S: StageSet> {
+    stages: S,
+    /// Slot of each stage id (`u8::MAX` = not in the pipeline).
+    slots: [u8; StageId::COUNT],
+}
+
+impl<S: StageSet> Pipeline<S> {
+    /// Build a pipeline. Like `StageRegistry::register`, a later stage with
+    /// the same id replaces an earlier one.
+    pub fn new(stages: S) -> Self {
+        let mut slots = [u8::MAX; StageId::COUNT];
+        for (slot, id) in stages.ids().into_iter().enumerate() {
+            slots[id.index()] = slot as u8;
+        }
+        Self { stages, slots }
+    }
+
+    pub fn stages(&self) -> &S {
+        &self.stages
+    }
+
+    /// Slot of the stage with `id`, if it is part of the pipeline.
+    #[inline]
+    pub fn slot(&self, id: StageId) -> Option<usize> {
+        let slot = self.slots[id.index()];
+        (slot != u8::MAX).then_some(slot as usize)
+    }
+
+    pub fn contains(&self, id: StageId) -> bool {
+        self.slot(id).is_some()
+    }
+
+    /// Run the stage with `id`; `None` if it is not part of the pipeline.
+    #[inline]
+    pub fn process(
+        &self,
+        id: StageId,
+        sample: Sample,
+        metadata: FlowMetadata,
+    ) -> Option<StageResult> {
+        let slot = self.slot(id)?;
+        Some(self.stages.process_slot(slot, sample, metadata))
+    }
+
+    /// Whether every stage is cacheable.
+    pub fn cacheable(&self) -> bool {
+        (0..S::LEN).all(|slot| self.stages.stage(slot).cacheable())
+    }
+
+    /// Combined configuration hash; equal to the hash of a `StageRegistry`
+    /// holding the same stages, so both share result cache entries.
+    pub fn config_hash(&self) -> u64 {
+        let mut h = StableHasher::new();
+        for id in StageId::ALL {
+            if let Some(slot) = self.slot(id) {
+                h.write_usize(id.index());
+                h.write_u64(self.stages.stage(slot).config_hash());
+            }
+        }
+        h.finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::stage::{FindPeakStage, ProcessPeakStage, StageRegistry};
+
+    #[test]
+    fn test_pipeline_dispatches_by_slot() {
+        let pipeline = Pipeline::new((ProcessPeakStage::default(), FindPeakStage::default()));
+        assert_eq!(pipeline.slot(StageId::FindPeak), Some(1));
+        assert_eq!(pipeline.slot(StageId::ProcessPeak), Some(0));
+        assert!(!pipeline.contains(StageId::Background));
+
+        let mut intensity = vec![0.0; 64];
+        intensity[30] = 5.0;
+        let sample = Sample::new("s", vec![0.1; 64], intensity, vec![0.1; 64]).unwrap();
+        let metadata = FlowMetadata::new("s");
+        let result = pipeline
+            .process(StageId::FindPeak, sample.clone(), metadata.clone())
+            .unwrap();
+        let expected = FindPeakStage::default().process(sample.clone(), metadata.clone());
+        assert_eq!(result.requests.len(), expected.requests.len());
+        assert!(pipeline.process(StageId::Phase, sample, metadata).is_none());
+    }
+
+    #[test]
+    fn test_config_hash_matches_registry() {
+        let pipeline = Pipeline::new((FindPeakStage::default(), ProcessPeakStage::default()));
+        let registry = StageRegistry::new_with_defaults();
+        assert_eq!(pipeline.config_hash(), registry.config_hash());
+    }
+}
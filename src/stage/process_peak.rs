@@ -1,7 +1,11 @@
 //! ProcessPeak stage implementation.
 
 use super::traits::{Stage, StageId, StageRequest, StageResult};
+use crate::data::hash::StableHasher;
 use crate::data::{FlowMetadata, Sample};
+use crate::series::{PeakFit, SeriesStore};
+use std::hash::Hasher;
+use std::sync::Arc;
 
 /// Configuration for peak processing.
 #[derive(Debug, Clone)]
@@ -21,15 +25,33 @@ impl Default for ProcessPeakConfig {
     }
 }
 
+/// Gaussian refinement iterations of a cold fit.
+const FIT_ITERATIONS: u32 = 5;
+
+/// Relative residual a warm fit may always reach, so near-perfect seeds do
+/// not turn noise into fallbacks.
+const RESIDUAL_FLOOR: f64 = 0.01;
+
 /// Stage for processing (fitting and subtracting) a single peak.
 pub struct ProcessPeakStage {
     config: ProcessPeakConfig,
+    /// Warm-start state for samples that are frames of a series.
+    series: Option<Arc<SeriesStore>>,
 }
 
 impl ProcessPeakStage {
     /// Create with custom configuration.
     pub fn new(config: ProcessPeakConfig) -> Self {
-        Self { config }
+        Self {
+            config,
+            series: None,
+        }
+    }
+
+    /// Seed fits of series frames from the previous frame's fit.
+    pub fn with_series(mut self, series: Arc<SeriesStore>) -> Self {
+        self.series = Some(series);
+        self
     }
 
     /// Create with default configuration.
@@ -40,9 +62,7 @@ impl ProcessPeakStage {
 
 impl Default for ProcessPeakStage {
     fn default() -> Self {
-        Self {
-            config: ProcessPeakConfig::default(),
-        }
+        Self::new(ProcessPeakConfig::default())
     }
 }
 
@@ -51,6 +71,22 @@ impl Stage for ProcessPeakStage {
         StageId::ProcessPeak
     }
 
+    fn config_hash(&self) -> u64 {
+        let mut h = StableHasher::new();
+        h.write_usize(self.config.parabola_range);
+        h.write_u64(self.config.gaussian_range_multiplier.to_bits());
+        // Warm-started output depends on other frames.
+        if self.series.is_some() {
+            h.write_u8(1);
+        }
+        h.finish()
+    }
+
+    fn cacheable(&self) -> bool {
+        // Series frames record their fits in the store.
+        self.series.is_none()
+    }
+
     fn process(&self, mut sample: Sample, mut metadata: FlowMetadata) -> StageResult {
         // Get current peak to process
         let peak_idx = match metadata.current_peak {
@@ -67,29 +103,15 @@ impl Stage for ProcessPeakStage {
             return StageResult::terminal(sample, metadata);
         }
 
-        // Step 1: Fit parabola around peak
-        let (mu, sigma, amplitude) = fit_parabola(
-            &sample.q_values,
-            &sample.intensity,
-            peak_idx,
-            self.config.parabola_range,
-        );
-
-        // Step 2: Fit Gaussian using parabola parameters as initial guess
-        let (mu, sigma, amplitude) = fit_gaussian(
-            &sample.q_values,
-            &sample.intensity,
-            peak_idx,
-            mu,
-            sigma,
-            amplitude,
-            self.config.gaussian_range_multiplier,
-        );
+        // Steps 1-2: Fit parabola, then refine a Gaussian from it (or from
+        // the previous frame's fit for series frames)
+        let (mu, sigma, amplitude) = match self.series.as_deref().zip(sample.series()) {
+            Some((store, at)) => self.fit_series_peak(store, at, &sample, peak_idx),
+            None => self.fit_cold(&sample, peak_idx).0,
+        };
 
         // Step 3: Subtract Gaussian from intensity
-        // Clone q_values to avoid borrow conflict
-        let q_values = sample.q_values.clone();
-        subtract_gaussian(&mut sample.intensity, &q_values, mu, sigma, amplitude);
+        subtract_gaussian(&mut sample.intensity, &sample.q_values, mu, sigma, amplitude);
 
         // Mark peak as processed
         metadata.processed_peaks.insert(peak_idx, amplitude);
@@ -106,6 +128,87 @@ impl Stage for ProcessPeakStage {
     }
 }
 
+impl ProcessPeakStage {
+    /// Parabola estimate refined by a fixed number of Gaussian iterations.
+    /// Returns ((mu, sigma, amplitude), iterations).
+    fn fit_cold(&self, sample: &Sample, peak_idx: usize) -> ((f64, f64, f64), u32) {
+        let (mu, sigma, amplitude) = fit_parabola(
+            &sample.q_values,
+            &sample.intensity,
+            peak_idx,
+            self.config.parabola_range,
+        );
+        let (mu, sigma, amplitude, iterations) = refine_gaussian(
+            &sample.q_values,
+            &sample.intensity,
+            peak_idx,
+            (mu, sigma, amplitude),
+            self.config.gaussian_range_multiplier,
+            FIT_ITERATIONS,
+            0.0,
+        );
+        ((mu, sigma, amplitude), iterations)
+    }
+
+    /// Start from the previous frame's width and stop once converged. A
+    /// warm fit whose residual grew past the store's limit is redone cold
+    /// and the frame is marked diverged.
+    fn fit_series_peak(
+        &self,
+        store: &SeriesStore,
+        at: crate::data::SeriesFrame,
+        sample: &Sample,
+        peak_idx: usize,
+    ) -> (f64, f64, f64) {
+        let (q, intensity) = (&sample.q_values, &sample.intensity);
+        let multiplier = self.config.gaussian_range_multiplier;
+        let residual = |(mu, sigma, amplitude)| {
+            fit_residual(q, intensity, peak_idx, mu, sigma, amplitude, multiplier)
+        };
+
+        let mut iterations = 0;
+        if let Some(seed) = store.fit_seed(at, peak_idx) {
+            let (mu, sigma, amplitude, n) = refine_gaussian(
+                q,
+                intensity,
+                peak_idx,
+                (q[peak_idx], seed.sigma, intensity[peak_idx]),
+                multiplier,
+                FIT_ITERATIONS,
+                store.config().tolerance,
+            );
+            iterations += n;
+            let params = (mu, sigma, amplitude);
+            let fit_residual = residual(params);
+            let limit = seed.residual * store.config().residual_growth + RESIDUAL_FLOOR;
+            if fit_residual <= limit {
+                let fit = PeakFit {
+                    index: peak_idx,
+                    mu,
+                    sigma,
+                    amplitude,
+                    residual: fit_residual,
+                };
+                store.record_fit(at, fit, true, iterations);
+                return params;
+            }
+            store.mark_diverged(at);
+        }
+
+        let (params, n) = self.fit_cold(sample, peak_idx);
+        let (mu, sigma, amplitude) = params;
+        let fit = PeakFit {
+            index: peak_idx,
+            mu,
+            sigma,
+            amplitude,
+            residual: residual(params),
+        };
+        store.record_fit(at, fit, false, iterations + n);
+        params
+    }
+}
+
 /// Fit a parabola around a peak to estimate Gaussian parameters.
 ///
 /// Returns (mu, sigma, amplitude).
@@ -125,9 +228,9 @@ fn fit_parabola(
         return (mu, 0.1, amplitude);
     }
 
-    // Extract local data
-    let local_q: Vec<f64> = q[start..end].to_vec();
-    let local_i: Vec<f64> = intensity[start..end].to_vec();
+    // Local window (borrowed, no copies)
+    let local_q = &q[start..end];
+    let local_i = &intensity[start..end];
 
     // Simple parabola fit: y = a(x - mu)^2 + c
     // Use least squares for a, mu, c
@@ -163,31 +266,40 @@ fn fit_parabola(
     (mu, sigma.max(0.01), amplitude)
 }
 
-/// Refine Gaussian fit using initial estimates.
-///
-/// Returns (mu, sigma, amplitude).
-fn fit_gaussian(
-    q: &[f64],
-    intensity: &[f64],
-    peak_idx: usize,
-    initial_mu: f64,
-    initial_sigma: f64,
-    initial_amplitude: f64,
-    range_multiplier: f64,
-) -> (f64, f64, f64) {
-    // Determine fitting range based on sigma
+/// Indices `[start, end)` of the fit window for a given sigma.
+fn fit_window(q: &[f64], len: usize, peak_idx: usize, sigma: f64, range_multiplier: f64) -> (usize, usize) {
     let delta_q = if q.len() > 1 {
         (q.last().unwrap_or(&1.0) - q.first().unwrap_or(&0.0)) / (q.len() - 1) as f64
     } else {
         0.01
     };
 
-    let range_indices = ((initial_sigma * range_multiplier) / delta_q).ceil() as usize;
+    let range_indices = ((sigma * range_multiplier) / delta_q).ceil() as usize;
     let start = peak_idx.saturating_sub(range_indices);
-    let end = (peak_idx + range_indices + 1).min(intensity.len());
+    let end = (peak_idx + range_indices + 1).min(len);
+    (start, end)
+}
+
+/// Refine a Gaussian from `initial` (mu, sigma, amplitude) for at most
+/// `max_iterations`, stopping early once mu and sigma move less than
+/// `tolerance * sigma` (0 runs every iteration).
+///
+/// Returns (mu, sigma, amplitude, iterations).
+fn refine_gaussian(
+    q: &[f64],
+    intensity: &[f64],
+    peak_idx: usize,
+    initial: (f64, f64, f64),
+    range_multiplier: f64,
+    max_iterations: u32,
+    tolerance: f64,
+) -> (f64, f64, f64, u32) {
+    let (initial_mu, initial_sigma, initial_amplitude) = initial;
+    // Determine fitting range based on sigma
+    let (start, end) = fit_window(q, intensity.len(), peak_idx, initial_sigma, range_multiplier);
 
     if end - start < 3 {
-        return (initial_mu, initial_sigma, initial_amplitude);
+        return (initial_mu, initial_sigma, initial_amplitude, 0);
     }
 
     // Simple iterative refinement (Gauss-Newton style, simplified)
@@ -195,7 +307,11 @@ fn fit_gaussian(
     let mut sigma = initial_sigma;
     let mut amplitude = initial_amplitude;
 
-    for _ in 0..5 {
+    let mut iterations = 0;
+    while iterations < max_iterations {
+        iterations += 1;
+        let (prev_mu, prev_sigma) = (mu, sigma);
+
         // Calculate weighted centroid for mu
         let mut sum_wi = 0.0;
         let mut sum_wiq = 0.0;
@@ -229,9 +345,35 @@ fn fit_gaussian(
 
         // Update amplitude
         amplitude = intensity.get(peak_idx).copied().unwrap_or(initial_amplitude);
+
+        let step = (mu - prev_mu).abs().max((sigma - prev_sigma).abs());
+        if tolerance > 0.0 && step <= tolerance * sigma {
+            break;
+        }
     }
 
-    (mu, sigma, amplitude)
+    (mu, sigma, amplitude, iterations)
+}
+
+/// RMS of data minus the fitted Gaussian over the fit window, relative to
+/// the amplitude.
+fn fit_residual(
+    q: &[f64],
+    intensity: &[f64],
+    peak_idx: usize,
+    mu: f64,
+    sigma: f64,
+    amplitude: f64,
+    range_multiplier: f64,
+) -> f64 {
+    let (start, end) = fit_window(q, intensity.len(), peak_idx, sigma, range_multiplier);
+    if end <= start || amplitude.abs() < 1e-12 {
+        return f64::INFINITY;
+    }
+    let sum_sq: f64 = (start..end)
+        .map(|i| (intensity[i] - gaussian(q[i], mu, sigma, amplitude)).powi(2))
+        .sum();
+    (sum_sq / (end - start) as f64).sqrt() / amplitude.abs()
 }
 
 /// Subtract a Gaussian from intensity data.
@@ -243,7 +385,6 @@ fn subtract_gaussian(intensity: &mut [f64], q: &[f64], mu: f64, sigma: f64, ampl
 }
 
 /// Pure Gaussian function.
-#[allow(dead_code)]
 fn gaussian(x: f64, mu: f64, sigma: f64, amplitude: f64) -> f64 {
     amplitude * (-(x - mu).powi(2) / (sigma.powi(2))).exp()
 }
@@ -300,4 +441,27 @@ mod tests {
         assert!(intensity[25] < 0.01, "Peak value after subtraction: {}", intensity[25]);
         assert!(intensity[25] < original_peak * 0.1);
     }
+
+    #[test]
+    fn test_allocation_budget() {
+        use crate::alloc_count::{assert_max_allocations, assert_no_allocations};
+
+        let mut sample = make_sample_with_peak();
+        let (q, i) = (&sample.q_values, &sample.intensity);
+        let (mu, sigma, amp) = assert_no_allocations("fit_parabola", || fit_parabola(q, i, 50, 5));
+        assert_no_allocations("refine_gaussian", || {
+            refine_gaussian(q, i, 50, (mu, sigma, amp), 3.0, FIT_ITERATIONS, 0.0)
+        });
+        assert_no_allocations("subtract_gaussian", || {
+            subtract_gaussian(&mut sample.intensity, &sample.q_values, mu, sigma, amp)
+        });
+
+        // Request metadata clone (id + maps), sample metadata maps, the
+        // processed-peak insert and the request Vec.
+        let stage = ProcessPeakStage::default();
+        let mut metadata = FlowMetadata::new("test");
+        metadata.current_peak = Some(50);
+        let sample = make_sample_with_peak();
+        assert_max_allocations("ProcessPeak", 8, || stage.process(sample, metadata));
+    }
 }
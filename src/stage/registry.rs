@@ -1,21 +1,25 @@
 //! Stage registry for managing available stages.
 
-use super::traits::{Stage, StageId};
+use super::traits::{Stage, StageId, StageKey};
 use super::{FindPeakStage, ProcessPeakStage};
-use std::collections::HashMap;
+use crate::data::hash::StableHasher;
+use std::hash::Hasher;
 use std::sync::Arc;
 
 /// Registry of available stages.
+///
+/// Stages are keyed by kind and instance and stored in a dense array
+/// indexed by `StageKey::index`, so lookups need no hashing. Lookups for
+/// an instance that has no stage of that kind fall back to instance 0,
+/// so an instance only registers the kinds it configures differently.
 pub struct StageRegistry {
-    stages: HashMap<StageId, Arc<dyn Stage>>,
+    stages: Vec<Option<Arc<dyn Stage>>>,
 }
 
 impl StageRegistry {
     /// Create an empty registry.
     pub fn new() -> Self {
-        Self {
-            stages: HashMap::new(),
-        }
+        Self { stages: Vec::new() }
     }
 
     /// Create a registry with default stages registered.
@@ -26,40 +30,113 @@ impl StageRegistry {
         registry
     }
 
-    /// Register a stage.
+    /// Register a stage as the default instance of its kind.
     pub fn register<S: Stage + 'static>(&mut self, stage: S) {
-        self.stages.insert(stage.id(), Arc::new(stage));
+        self.register_arc(Arc::new(stage));
     }
 
     /// Register a stage from an Arc.
     pub fn register_arc(&mut self, stage: Arc<dyn Stage>) {
-        self.stages.insert(stage.id(), stage);
+        self.register_arc_instance(0, stage);
+    }
+
+    /// Register a stage as `instance` of its kind.
+    pub fn register_instance<S: Stage + 'static>(&mut self, instance: u16, stage: S) {
+        self.register_arc_instance(instance, Arc::new(stage));
     }
 
-    /// Get a stage by ID.
+    /// Register a stage from an Arc as `instance` of its kind.
+    pub fn register_arc_instance(&mut self, instance: u16, stage: Arc<dyn Stage>) {
+        let index = StageKey::new(stage.id(), instance).index();
+        if index >= self.stages.len() {
+            self.stages.resize(index + 1, None);
+        }
+        self.stages[index] = Some(stage);
+    }
+
+    /// Get the default instance of a stage.
     pub fn get(&self, id: StageId) -> Option<Arc<dyn Stage>> {
-        self.stages.get(&id).cloned()
+        self.get_instance(id.into())
+    }
+
+    /// Get exactly the stage registered under `key`.
+    pub fn get_instance(&self, key: StageKey) -> Option<Arc<dyn Stage>> {
+        self.slot(key).cloned()
+    }
+
+    /// Stage that runs items for `key`: its own instance, else the default.
+    #[inline]
+    pub fn resolve(&self, key: StageKey) -> Option<Arc<dyn Stage>> {
+        self.slot(key)
+            .or_else(|| self.slot(key.kind.into()))
+            .cloned()
     }
 
     /// Check if a stage is registered.
     pub fn contains(&self, id: StageId) -> bool {
-        self.stages.contains_key(&id)
+        self.contains_instance(id.into())
     }
 
-    /// Get all registered stage IDs.
+    /// Check if a stage is registered under exactly `key`.
+    pub fn contains_instance(&self, key: StageKey) -> bool {
+        self.slot(key).is_some()
+    }
+
+    /// Get all registered stage IDs (kinds with a default instance).
     pub fn stage_ids(&self) -> Vec<StageId> {
-        self.stages.keys().copied().collect()
+        StageId::ALL
+            .into_iter()
+            .filter(|&id| self.contains(id))
+            .collect()
+    }
+
+    /// Keys of all registered stages, in dense order.
+    pub fn keys(&self) -> Vec<StageKey> {
+        (0..self.stages.len())
+            .filter(|&i| self.stages[i].is_some())
+            .map(|i| {
+                let instance = (i / StageId::COUNT) as u16;
+                StageKey::new(StageId::ALL[i % StageId::COUNT], instance)
+            })
+            .collect()
+    }
+
+    /// Combined configuration hash of all registered stages.
+    pub fn config_hash(&self) -> u64 {
+        let mut h = StableHasher::new();
+        for (index, stage) in self.stages.iter().enumerate() {
+            if let Some(stage) = stage {
+                h.write_usize(index);
+                h.write_u64(stage.config_hash());
+            }
+        }
+        h.finish()
     }
 
-    /// Remove a stage.
+    /// Whether every registered stage is cacheable.
+    pub fn cacheable(&self) -> bool {
+        self.stages.iter().flatten().all(|s| s.cacheable())
+    }
+
+    /// Remove the default instance of a stage.
     pub fn remove(&mut self, id: StageId) -> Option<Arc<dyn Stage>> {
-        self.stages.remove(&id)
+        self.remove_instance(id.into())
+    }
+
+    /// Remove the stage registered under `key`.
+    pub fn remove_instance(&mut self, key: StageKey) -> Option<Arc<dyn Stage>> {
+        self.stages.get_mut(key.index())?.take()
     }
 
     /// Clear all stages.
     pub fn clear(&mut self) {
         self.stages.clear();
     }
+
+    #[inline]
+    fn slot(&self, key: StageKey) -> Option<&Arc<dyn Stage>> {
+        self.stages.get(key.index())?.as_ref()
+    }
 }
 
 impl Default for StageRegistry {
@@ -88,4 +165,32 @@ mod tests {
         let stage = registry.get(StageId::FindPeak).unwrap();
         assert_eq!(stage.id(), StageId::FindPeak);
     }
+
+    #[test]
+    fn test_registry_instances() {
+        use crate::stage::find_peak::FindPeakConfig;
+
+        let mut registry = StageRegistry::new_with_defaults();
+        let fine = FindPeakStage::new(FindPeakConfig {
+            min_prominence: 0.01,
+            ..Default::default()
+        });
+        let fine_hash = fine.config_hash();
+        let hash = registry.config_hash();
+        registry.register_instance(2, fine);
+
+        let key = StageKey::new(StageId::FindPeak, 2);
+        assert!(registry.contains_instance(key));
+        assert_eq!(registry.resolve(key).unwrap().config_hash(), fine_hash);
+        // Kinds the instance does not override come from the default.
+        let process = StageKey::new(StageId::ProcessPeak, 2);
+        assert!(registry.get_instance(process).is_none());
+        assert!(registry.resolve(process).is_some());
+        assert!(registry.resolve(StageKey::new(StageId::Phase, 2)).is_none());
+
+        assert_eq!(registry.keys().len(), 3);
+        assert_ne!(registry.config_hash(), hash);
+        registry.remove_instance(key);
+        assert_eq!(registry.config_hash(), hash);
+    }
 }
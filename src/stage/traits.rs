@@ -21,6 +21,30 @@ pub enum StageId {
 }
 
 impl StageId {
+    /// Number of stage identifiers.
+    pub const COUNT: usize = 6;
+
+    /// All stage identifiers in declaration order.
+    pub const ALL: [StageId; StageId::COUNT] = [
+        StageId::Background,
+        StageId::Cut,
+        StageId::Filter,
+        StageId::FindPeak,
+        StageId::ProcessPeak,
+        StageId::Phase,
+    ];
+
+    /// Dense index of this stage (0..COUNT).
+    #[inline]
+    pub fn index(self) -> usize {
+        self as usize
+    }
+
+    /// Look up a stage by its dense index.
+    pub fn from_index(index: usize) -> Option<StageId> {
+        StageId::ALL.get(index).copied()
+    }
+
     /// Get the string name of this stage.
     pub fn name(&self) -> &'static str {
         match self {
@@ -34,18 +58,59 @@ impl StageId {
     }
 }
 
+/// A stage kind together with one of its registered instances.
+///
+/// Instance 0 is the default; further instances of the same kind carry
+/// their own configuration (e.g. a coarse and a fine peak search).
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct StageKey {
+    pub kind: StageId,
+    pub instance: u16,
+}
+
+impl StageKey {
+    pub const fn new(kind: StageId, instance: u16) -> Self {
+        Self { kind, instance }
+    }
+
+    /// Dense index of this key (`instance * StageId::COUNT + kind`).
+    #[inline]
+    pub fn index(self) -> usize {
+        self.instance as usize * StageId::COUNT + self.kind.index()
+    }
+}
+
+impl From<StageId> for StageKey {
+    fn from(kind: StageId) -> Self {
+        Self::new(kind, 0)
+    }
+}
+
 /// A request to execute a stage.
-#[derive(Clone)]
+#[derive(Clone, Debug)]
 pub struct StageRequest {
     /// The stage to execute.
     pub stage_id: StageId,
     /// Metadata to pass to the stage.
     pub metadata: FlowMetadata,
+    /// Instance of the stage; `None` keeps the instance of the item that
+    /// issued the request.
+    pub instance: Option<u16>,
 }
 
 impl StageRequest {
     pub fn new(stage_id: StageId, metadata: FlowMetadata) -> Self {
-        Self { stage_id, metadata }
+        Self {
+            stage_id,
+            metadata,
+            instance: None,
+        }
+    }
+
+    /// Target a specific instance of the stage.
+    pub fn on_instance(mut self, instance: u16) -> Self {
+        self.instance = Some(instance);
+        self
     }
 }
 
@@ -81,6 +146,14 @@ impl StageResult {
             requests,
         }
     }
+
+    /// Point requests that name no instance at `instance`, the instance
+    /// of the item that produced this result.
+    pub fn inherit_instance(&mut self, instance: u16) {
+        for request in &mut self.requests {
+            request.instance.get_or_insert(instance);
+        }
+    }
 }
 
 /// Trait for processing stages.
@@ -95,4 +168,22 @@ pub trait Stage: Send + Sync {
     fn name(&self) -> &'static str {
         self.id().name()
     }
+
+    /// Stable hash of the stage configuration.
+    ///
+    /// Used to key cached results; stages whose output depends on
+    /// configuration must return a value that changes with it.
+    fn config_hash(&self) -> u64 {
+        0
+    }
+
+    /// Whether results may be served from the result cache.
+    ///
+    /// Off by default: a stage opts in once `config_hash` covers its
+    /// configuration, since cached results (also on disk) are keyed by
+    /// it. Stages that record into shared state (e.g. a `SeriesStore`)
+    /// stay out, since a cache hit would skip the recording.
+    fn cacheable(&self) -> bool {
+        false
+    }
 }